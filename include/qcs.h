@@ -26,9 +26,21 @@
 /* QUANTUM CIRCUIT BUILDER */
 /* ======================================================================== */
 typedef struct t_q_circuit t_q_circuit;
+typedef struct t_q_counts t_q_counts;
+
+/* Basis-state index: 64 bits on the LP64 targets QCS builds for, so states
+ * past 31 qubits are addressable */
+typedef long t_q_index;
 
 /* Circuit Creation */
 t_q_circuit *qc_create(int num_qubits);
+t_q_circuit *qc_create_mps(int num_qubits, int max_bond_dim,
+                           double truncation_threshold);
+t_q_circuit *qc_create_sparse(int num_qubits, double dense_fill_ratio);
+t_q_circuit *qc_create_out_of_core(int num_qubits, const char *scratch_dir,
+                                   int chunk_qubits);
+t_q_circuit *qc_create_compressed(int num_qubits, int block_qubits,
+                                  double error_bound);
 void qc_destroy(t_q_circuit *circuit);
 
 /* Basic Gates */
@@ -43,6 +55,18 @@ void qc_phase(t_q_circuit *circuit, int qubit, double angle);
 void qc_rx(t_q_circuit *circuit, int qubit, double angle);
 void qc_ry(t_q_circuit *circuit, int qubit, double angle);
 void qc_rz(t_q_circuit *circuit, int qubit, double angle);
+void qc_cphase(t_q_circuit *circuit, int control, int target, double angle);
+
+/* Parameterized Gates */
+void qc_rx_param(t_q_circuit *circuit, int qubit, int slot);
+void qc_ry_param(t_q_circuit *circuit, int qubit, int slot);
+void qc_rz_param(t_q_circuit *circuit, int qubit, int slot);
+void qc_phase_param(t_q_circuit *circuit, int qubit, int slot);
+int qc_bind(t_q_circuit *circuit, const double *values);
+int qc_run_parameter_batch(t_q_circuit *circuit, const double *params,
+                           int batch_size, const char **terms,
+                           const double *coeffs, int count,
+                           double *out_expectations);
 
 /* Circuit Operations */
 void qc_barrier(t_q_circuit *circuit);
@@ -55,22 +79,62 @@ void qc_measure_all(t_q_circuit *circuit, int *results);
 /* Circuit Execution */
 void qc_run(t_q_circuit *circuit);
 void qc_run_shots(t_q_circuit *circuit, int shots, int *results);
+void qc_set_seed(t_q_circuit *circuit, unsigned long seed);
+
+/* Shot Counts */
+t_q_counts *qc_run_shots_counts(t_q_circuit *circuit, long shots);
+long qc_counts_num_outcomes(const t_q_counts *counts);
+long qc_counts_total(const t_q_counts *counts);
+long qc_counts_get(const t_q_counts *counts, t_q_index bitstring);
+int qc_counts_next(const t_q_counts *counts, long *cursor,
+                   t_q_index *bitstring, long *count);
+long qc_counts_top_k(const t_q_counts *counts, long k, t_q_index *bitstrings,
+                     long *values);
+t_q_counts *qc_counts_marginal(const t_q_counts *counts, const int *qubits,
+                               int num_qubits);
+int qc_counts_to_dense(const t_q_counts *counts, int *results, long size);
+void qc_counts_free(t_q_counts *counts);
 
 /* State Access */
-int qc_find_most_likely_state(t_q_circuit *circuit);
-double qc_get_probability(t_q_circuit *circuit, int state);
-void qc_print_state(t_q_circuit *circuit, int solution_index);
+t_q_index qc_find_most_likely_state(t_q_circuit *circuit);
+long qc_top_k_states(t_q_circuit *circuit, long k, t_q_index *indices,
+                     double *probs);
+double qc_get_probability(t_q_circuit *circuit, t_q_index state);
+int qc_marginal_probabilities(t_q_circuit *circuit, const int *qubits, int k,
+                              double *out);
+void qc_print_state(t_q_circuit *circuit, t_q_index solution_index);
+double qc_expectation_pauli(t_q_circuit *circuit, const char *pauli);
+double qc_expectation_hamiltonian(t_q_circuit *circuit, const char **terms,
+                                  const double *coeffs, int count);
+int qc_get_num_parameters(t_q_circuit *circuit);
+int qc_gradient_adjoint(t_q_circuit *circuit, const char **terms,
+                        const double *coeffs, int count, double *gradients);
 void qc_print_circuit(t_q_circuit *circuit);
 
 /* Built-in Algorithms */
-void qc_grover_search(t_q_circuit *circuit, int solution_state);
+void qc_grover_search(t_q_circuit *circuit, t_q_index solution_state);
 void qc_quantum_fourier_transform(t_q_circuit *circuit);
-void qc_bernstein_vazirani(t_q_circuit *circuit, int hidden_string);
+void qc_bernstein_vazirani(t_q_circuit *circuit, t_q_index hidden_string);
 void qc_ghz_state(t_q_circuit *circuit);
 
+/* State Allocation (flags for qc_set_alloc_policy) */
+#define QC_ALLOC_HUGE_PAGES 1  /* hugetlb pages, else transparent huge pages */
+#define QC_ALLOC_FIRST_TOUCH 2 /* zero in parallel to place pages by NUMA node */
+#define QC_ALLOC_INTERLEAVE 4  /* interleave pages over the allowed nodes */
+void qc_set_alloc_policy(int policy);
+int qc_get_alloc_policy(t_q_circuit *circuit);
+
+/* State Checkpoints */
+int qc_save_state(t_q_circuit *circuit, const char *path);
+t_q_circuit *qc_load_state(const char *path);
+int qc_set_checkpoint(t_q_circuit *circuit, const char *path, int interval);
+t_q_circuit *qc_clone(t_q_circuit *circuit);
+
 /* Utility Functions */
 int qc_get_num_qubits(t_q_circuit *circuit);
 int qc_get_num_gates(t_q_circuit *circuit);
+double qc_get_truncation_error(t_q_circuit *circuit);
+long qc_get_state_bytes(t_q_circuit *circuit);
 void qc_optimize(t_q_circuit *circuit);
 
 #endif
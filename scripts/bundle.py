@@ -1,5 +1,6 @@
 import os
 import re
+import sys
 
 OUTPUT_FILE = "qcs.h"
 
@@ -29,8 +30,23 @@ LICENSE = """
 SRC_FILES = [
     "src/complex.c",
     "src/q_utils.c",
+    "src/q_alloc.c",
+    "src/q_random.c",
     "src/q_matrix.c",
     "src/q_state.c",
+    "src/q_mps.c",
+    "src/q_sparse.c",
+    "src/q_zip.c",
+    "src/q_disk.c",
+    "src/q_checkpoint.c",
+    "src/q_expectation.c",
+    "src/q_program.c",
+    "src/q_batch.c",
+    "src/q_sampler.c",
+    "src/q_shots.c",
+    "src/q_counts.c",
+    "src/q_marginal.c",
+    "src/q_top_k.c",
     "src/qcs.c",
     "src/thread_pools.c",
     "src/q_gates.c",
@@ -41,8 +57,8 @@ GPU_SRC_FILES = [
 ]
 
 API_HEADERS = [
-    "src/internal.h",
     "include/qcs.h",
+    "src/internal.h",
 ]
 
 EXCLUDE_INCLUDES = [
@@ -245,4 +261,6 @@ static void q_apply_2q_gate_worker(void *arg);
 
 
 if __name__ == "__main__":
+    if len(sys.argv) > 1:
+        OUTPUT_FILE = sys.argv[1]
     bundle_library()
@@ -3,6 +3,9 @@
 
 #include <pthread.h>
 #include <stddef.h>
+
+#include "../include/qcs.h"
+
 struct t_complex {
   double number_real;
   double number_imaginary;
@@ -39,18 +42,58 @@ void c_mul_gpu_real(struct t_complex *result, const struct t_complex *a,
 void c_copy_gpu_real(struct t_complex *dest, const struct t_complex *src, long count);
 double c_norm_sq_sum_gpu_real(const struct t_complex *a, long count);
 
+/* RANDOM NUMBERS */
+struct t_q_rng {
+  unsigned long s[4];
+};
+
+void q_rng_seed(struct t_q_rng *rng, unsigned long seed);
+unsigned long q_rng_next(struct t_q_rng *rng);
+double q_rng_uniform(struct t_q_rng *rng);
+void q_rng_jump(struct t_q_rng *rng);
+void q_rng_split(struct t_q_rng *rng, struct t_q_rng *streams, long count);
+double q_rng_exponential(struct t_q_rng *rng);
+long q_rng_binomial(struct t_q_rng *rng, long n, double p);
+
+/* STATE ALLOCATION */
+
+/* Vectors of at least one huge page are mapped rather than heap allocated */
+#define QCS_HUGE_PAGE_SIZE (1L << 21)
+#define QCS_GIGA_PAGE_SIZE (1L << 30)
+
+void q_alloc_set_policy(int policy);
+int q_alloc_get_policy(void);
+struct t_complex *q_alloc_vector(t_q_index size, int policy, int *used);
+void q_alloc_free(struct t_complex *vector, t_q_index size);
+struct t_complex *q_alloc_map_file(int fd, long offset, t_q_index size);
+void q_alloc_unmap_file(struct t_complex *vector, t_q_index size);
+int q_alloc_share(const struct t_complex *vector, t_q_index size);
 
 struct t_q_state {
   int qubits_num;
-  long size;
+  t_q_index size;
   struct t_complex *vector;
   struct t_complex *scratch_vector;
+  int alloc_policy; /* QC_ALLOC_* flags in effect for both vectors */
+  struct t_complex *file_vector; /* copy-on-write file mapping, or NULL */
 };
 
 struct t_q_state *q_state_init(int qubits_num);
 void q_state_free(struct t_q_state *state);
-void q_state_set_basis(struct t_q_state *state, int index_basis);
-void q_state_print(const struct t_q_state *state, int solution_index);
+int q_state_share(struct t_q_state *state);
+struct t_q_state *q_state_map_shared(int fd, int num_qubits);
+struct t_q_state *q_state_copy(const struct t_q_state *state);
+void q_state_set_basis(struct t_q_state *state, t_q_index index_basis);
+void q_state_print(const struct t_q_state *state, t_q_index solution_index);
+int q_state_measure(struct t_q_state *state, int qubit, double random_val);
+long q_state_measure_all(struct t_q_state *state, double random_val);
+int q_state_marginal(const struct t_q_state *state, const int *qubits, int k,
+                     double *out);
+long q_state_top_k(const struct t_q_state *state, long k, t_q_index *indices,
+                   double *probs);
+void q_top_k_offer(double *probs, t_q_index *indices, long *size, long k,
+                   double prob, t_q_index index);
+void q_top_k_sort(double *probs, t_q_index *indices, long size);
 
 struct __attribute__((aligned(64))) t_q_matrix {
   int rows;
@@ -60,6 +103,7 @@ struct __attribute__((aligned(64))) t_q_matrix {
 
 struct t_q_matrix *q_matrix_init(int rows, int cols);
 void q_matrix_free(struct t_q_matrix *mat);
+struct t_q_matrix *q_matrix_adjoint(const struct t_q_matrix *mat);
 void q_gate_apply(struct t_q_state *state, const struct t_q_matrix *gate);
 void q_matrix_print(const struct t_q_matrix *mat);
 
@@ -75,15 +119,313 @@ struct t_q_matrix *q_gate_RX(double angle);
 struct t_q_matrix *q_gate_RY(double angle);
 struct t_q_matrix *q_gate_RZ(double angle);
 
+/* Gate matrices without heap traffic: constant tables for the fixed gates,
+   and inline 2x2 storage filled on the caller's stack for the rotations */
+extern const struct t_q_matrix q_gate_table_I;
+extern const struct t_q_matrix q_gate_table_X;
+extern const struct t_q_matrix q_gate_table_Y;
+extern const struct t_q_matrix q_gate_table_Z;
+extern const struct t_q_matrix q_gate_table_H;
+
+struct t_q_gate {
+  struct t_q_matrix matrix; /* data points at cells */
+  struct t_complex cells[4];
+};
+
+const struct t_q_matrix *q_gate_set_P(struct t_q_gate *gate, double angle);
+const struct t_q_matrix *q_gate_set_RX(struct t_q_gate *gate, double angle);
+const struct t_q_matrix *q_gate_set_RY(struct t_q_gate *gate, double angle);
+const struct t_q_matrix *q_gate_set_RZ(struct t_q_gate *gate, double angle);
+
 void q_apply_diffusion(struct t_q_state *state);
-void q_apply_phase_flip(struct t_q_state *state, int target_index);
+void q_apply_phase_flip(struct t_q_state *state, t_q_index target_index);
 void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
                      int target_qubit);
 void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
                      int control_qubit, int target_qubit);
+void q_apply_1q_gate_serial(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int target_qubit);
+void q_apply_2q_gate_serial(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit);
+void q_apply_1q_gate_mapped(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int target_qubit);
+void q_apply_2q_gate_mapped(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit);
 
 void q_state_normalize(struct t_q_state *state);
-int q_grover_iterations(int num_qubits);
+long q_grover_iterations(int num_qubits);
+
+/* Fixed reduction block count: results do not depend on the thread count */
+#define QCS_REDUCE_BLOCKS 64
+
+double q_state_expectation_pauli(const struct t_q_state *state, long flip_mask,
+                                 long z_mask, int y_count);
+double q_state_expectation_terms(const struct t_q_state *state,
+                                 const long *flip_masks, const long *z_masks,
+                                 const int *y_counts, const double *coeffs,
+                                 int count);
+struct t_complex q_state_pauli_overlap(const struct t_q_state *bra,
+                                       const struct t_q_state *ket,
+                                       long flip_mask, long z_mask,
+                                       int y_count);
+int q_state_apply_pauli_sum(struct t_q_state *out, const struct t_q_state *in,
+                            const long *flip_masks, const long *z_masks,
+                            const int *y_counts, const double *coeffs,
+                            int count);
+
+/* MATRIX PRODUCT STATE BACKEND */
+struct t_q_mps {
+  int qubits_num;
+  int max_bond_dim;
+  double truncation_threshold;
+  double truncation_error;
+  int center;
+  int *bond_dims;
+  struct t_complex **sites;
+};
+
+struct t_q_mps *q_mps_init(int qubits_num, int max_bond_dim,
+                           double truncation_threshold);
+void q_mps_free(struct t_q_mps *mps);
+struct t_q_mps *q_mps_clone(const struct t_q_mps *mps);
+void q_mps_apply_1q_gate(struct t_q_mps *mps, const struct t_q_matrix *gate,
+                         int target_qubit);
+void q_mps_apply_2q_gate(struct t_q_mps *mps, const struct t_q_matrix *gate,
+                         int control_qubit, int target_qubit);
+int q_mps_measure(struct t_q_mps *mps, int qubit, double random_val);
+struct t_complex q_mps_amplitude(struct t_q_mps *mps, t_q_index index);
+void q_mps_prepare_sampling(struct t_q_mps *mps);
+long q_mps_sample(const struct t_q_mps *mps, struct t_q_rng *rng, int *bits);
+long q_mps_top_k(struct t_q_mps *mps, long k, t_q_index *indices,
+                 double *probs);
+double q_mps_expectation_pauli(struct t_q_mps *mps, const char *pauli);
+void q_mps_print(const struct t_q_mps *mps);
+
+/* SPARSE STATE BACKEND */
+#define SPARSE_EMPTY_KEY (-1L)
+
+struct t_q_sparse {
+  int qubits_num;
+  long count;
+  long capacity;
+  long *keys;
+  struct t_complex *values;
+  long scratch_capacity;
+  long *scratch_keys;
+  struct t_complex *scratch_values;
+};
+
+struct t_q_sparse *q_sparse_init(int qubits_num);
+void q_sparse_free(struct t_q_sparse *sparse);
+struct t_q_sparse *q_sparse_clone(const struct t_q_sparse *sparse);
+struct t_complex q_sparse_get(const struct t_q_sparse *sparse, t_q_index index);
+int q_sparse_set(struct t_q_sparse *sparse, t_q_index index,
+                 struct t_complex value);
+void q_sparse_apply_1q_gate(struct t_q_sparse *sparse,
+                            const struct t_q_matrix *gate, int target_qubit);
+void q_sparse_apply_2q_gate(struct t_q_sparse *sparse,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit);
+int q_sparse_measure(struct t_q_sparse *sparse, int qubit, double random_val);
+double q_sparse_fill_ratio(const struct t_q_sparse *sparse);
+struct t_q_state *q_sparse_to_dense(const struct t_q_sparse *sparse);
+struct t_q_sampler *q_sparse_sampler(const struct t_q_sparse *sparse);
+void q_sparse_marginal(const struct t_q_sparse *sparse, const int *qubits,
+                       int k, double *out);
+long q_sparse_top_k(const struct t_q_sparse *sparse, long k,
+                    t_q_index *indices, double *probs);
+double q_sparse_expectation_pauli(const struct t_q_sparse *sparse,
+                                  long flip_mask, long z_mask, int y_count);
+void q_sparse_print(const struct t_q_sparse *sparse);
+
+/* COMPRESSED STATE BLOCKS */
+#define QCS_ZIP_BLOCK_QUBITS 16 /* default: 1 MiB blocks before encoding */
+
+struct t_q_zip_block {
+  unsigned char *data; /* encoding tag then payload, NULL for all zeros */
+  size_t bytes;
+  double error_sq; /* rounding error stored since the last pass */
+};
+
+struct t_q_zip {
+  long blocks;
+  t_q_index block_size;
+  double error_bound;
+  double error; /* accumulated bound on the 2-norm error */
+  struct t_q_zip_block *table;
+};
+
+struct t_q_zip *q_zip_init(long blocks, t_q_index block_size,
+                           double error_bound);
+void q_zip_free(struct t_q_zip *zip);
+void q_zip_clear(struct t_q_zip *zip);
+size_t q_zip_scratch_size(const struct t_q_zip *zip);
+void q_zip_load(const struct t_q_zip *zip, long block, struct t_complex *out);
+int q_zip_store(struct t_q_zip *zip, long block, const struct t_complex *in,
+                unsigned char *scratch);
+void q_zip_end_pass(struct t_q_zip *zip);
+long q_zip_bytes(const struct t_q_zip *zip);
+
+/* OUT-OF-CORE STATE BACKEND */
+#define QCS_DISK_CHUNK_QUBITS 20 /* default: 16 MiB chunks */
+#define QCS_DISK_PASS_HIGH 2     /* chunk-selecting qubits per gate pass */
+#define QCS_DISK_MAX_QUBITS 58   /* file size must fit in off_t */
+
+struct t_q_disk_gate {
+  struct t_complex data[4];
+  int control; /* -1 for an uncontrolled gate */
+  int target;
+};
+
+struct t_q_disk {
+  int qubits_num;
+  int chunk_qubits;
+  t_q_index size;
+  t_q_index chunk_size;
+  long chunks;
+  int fd;              /* scratch file, or -1 for a compressed state */
+  struct t_q_zip *zip; /* compressed blocks in memory, or NULL */
+  struct t_q_disk_gate *pending;
+  int num_pending;
+  int pending_capacity;
+};
+
+struct t_q_disk *q_disk_init(int qubits_num, const char *dir,
+                             int chunk_qubits);
+struct t_q_disk *q_disk_init_compressed(int qubits_num, int block_qubits,
+                                        double error_bound);
+void q_disk_free(struct t_q_disk *disk);
+int q_disk_reset(struct t_q_disk *disk);
+int q_disk_flush(struct t_q_disk *disk);
+int q_disk_apply_1q_gate(struct t_q_disk *disk, const struct t_q_matrix *gate,
+                         int target_qubit);
+int q_disk_apply_2q_gate(struct t_q_disk *disk, const struct t_q_matrix *gate,
+                         int control_qubit, int target_qubit);
+struct t_complex q_disk_get(struct t_q_disk *disk, t_q_index index);
+int q_disk_marginal(struct t_q_disk *disk, const int *qubits, int k,
+                    double *out);
+long q_disk_top_k(struct t_q_disk *disk, long k, t_q_index *indices,
+                  double *probs);
+int q_disk_measure(struct t_q_disk *disk, int qubit, double random_val);
+int q_disk_read(struct t_q_disk *disk, struct t_complex *buffer,
+                t_q_index count, t_q_index index);
+t_q_index q_disk_measure_all(struct t_q_disk *disk, double random_val);
+void q_disk_print(struct t_q_disk *disk, t_q_index solution_index);
+
+/* STATE CHECKPOINTS */
+int q_state_save(const struct t_q_state *state, const char *path);
+int q_sparse_save(const struct t_q_sparse *sparse, const char *path);
+int q_disk_save(struct t_q_disk *disk, const char *path);
+struct t_q_state *q_state_load(const char *path, int *file);
+int q_state_file_read(int fd, struct t_complex *vector, t_q_index size);
+
+/* COMPILED PARAMETERIZED PROGRAMS */
+struct t_q_program_factor {
+  int gate;
+  int slot;
+  double angle;
+};
+
+struct t_q_program_op {
+  int target;
+  int control;
+  int first_factor;
+  int num_factors;
+};
+
+struct t_q_program {
+  int num_ops;
+  struct t_q_program_op *ops;
+  struct t_q_program_factor *factors;
+  int num_slots;
+  struct t_q_program_binding *binding;
+};
+
+/* Fused matrices for one set of slot values; one per concurrent user */
+struct t_q_program_binding {
+  struct t_complex *cells; /* one row-major 2x2 per op */
+  double *values;
+  int bound;
+};
+
+struct t_q_program *q_program_compile(const char *const *names,
+                                      const int *targets, const int *controls,
+                                      const double *params, const int *slots,
+                                      int count, int num_qubits);
+struct t_q_program_binding *
+q_program_binding_init(const struct t_q_program *program);
+void q_program_binding_free(const struct t_q_program *program,
+                            struct t_q_program_binding *binding);
+int q_program_bind(const struct t_q_program *program,
+                   struct t_q_program_binding *binding, const double *values);
+const struct t_q_matrix *
+q_program_matrix(const struct t_q_program_binding *binding, int op,
+                 struct t_q_matrix *view);
+void q_program_free(struct t_q_program *program);
+int q_program_run_batch(const struct t_q_program *program, int num_qubits,
+                        int initial_fd, const double *params, int batch_size,
+                        const long *flip_masks, const long *z_masks,
+                        const int *y_counts, const double *coeffs, int count,
+                        double *out);
+
+/* MEASUREMENT SAMPLING */
+
+/* Widest state whose basis indices fit in a t_q_index */
+#define QCS_INDEX_MAX_QUBITS 63
+
+/* From 2^26 amplitudes (1 GiB of state) an N-entry cumulative table is
+ * itself a memory problem, so shots are streamed instead */
+#define QCS_STREAM_SAMPLING_QUBITS 26
+
+struct t_q_sampler {
+  long size;
+  long *keys;
+  double *cdf;
+  double total;
+  double *alias_prob;
+  long *alias_index;
+};
+
+struct t_q_sampler *q_sampler_init(const struct t_complex *amplitudes,
+                                   long *keys, long size);
+int q_sampler_build_alias(struct t_q_sampler *sampler);
+long q_sampler_sample(const struct t_q_sampler *sampler, double random_val);
+void q_sampler_free(struct t_q_sampler *sampler);
+
+/* SHOT COUNTS */
+struct t_q_counts {
+  long capacity;
+  int shift;
+  long size;
+  long total;
+  unsigned long *keys;
+  long *values;
+};
+
+struct t_q_counts *q_counts_init(long expected);
+int q_counts_add(struct t_q_counts *counts, unsigned long key, long count);
+int q_counts_merge(struct t_q_counts *dst, const struct t_q_counts *src);
+long q_counts_get(const struct t_q_counts *counts, unsigned long key);
+long q_counts_top_k(const struct t_q_counts *counts, long k,
+                    unsigned long *keys, long *values);
+struct t_q_counts *q_counts_marginal(const struct t_q_counts *counts,
+                                     const int *qubits, int num_qubits);
+void q_counts_free(struct t_q_counts *counts);
+
+/* Shot output: a dense histogram, or a counts table when dense is NULL */
+struct t_q_shot_sink {
+  int *dense;
+  struct t_q_counts *counts;
+};
+
+int q_state_sample_counts(const struct t_q_state *state, long shots,
+                          struct t_q_rng *rng, struct t_q_shot_sink *sink);
+int q_sample_shots(long shots, long size,
+                   long (*draw)(void *context, struct t_q_rng *rng),
+                   void *context, struct t_q_rng *rng,
+                   struct t_q_shot_sink *sink);
 
 #include <pthread.h>
 
@@ -106,22 +448,32 @@ typedef struct {
   pthread_mutex_t lock;
   pthread_cond_t notify;
   pthread_cond_t all_tasks_done;
+  pthread_cond_t queue_not_full;
 } thread_pool_t;
 
+/* Most workers a parallel call splits over, well above the core count the
+   pool is sized from; callers keep one task slot per worker on their stack
+   instead of allocating them */
+#define QCS_POOL_MAX_THREADS 256
+
 thread_pool_t *thread_pool_create(int num_threads, int queue_size);
 int thread_pool_add_task(thread_pool_t *pool, void (*function)(void *),
                          void *arg);
 void thread_pool_wait(thread_pool_t *pool);
 int thread_pool_destroy(thread_pool_t *pool);
+int thread_pool_is_worker(const thread_pool_t *pool);
 void get_thread_work_range(long total_size, int num_threads, int thread_id,
                            long *start, long *end);
+void q_parallel_for(long count, long grain,
+                    void (*body)(void *context, long start, long end),
+                    void *context);
 
 /* PTHREADS THREAD ARGS*/
 #define CACHE_LINE_SIZE 64
 
 struct t_thread_args {
-  long start;
-  long end;
+  t_q_index start;
+  t_q_index end;
 
   int target_qubit;
   int control_qubit;
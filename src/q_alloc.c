@@ -0,0 +1,302 @@
+/* mmap flags, madvise and syscall are outside strict C89 */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * State-vector allocation policy.
+ *
+ * Vectors of at least one huge page are mapped directly. With
+ * QC_ALLOC_HUGE_PAGES an explicit hugetlb mapping is tried first (1 GiB
+ * pages, then the default huge page size) and transparent huge pages are
+ * requested with madvise otherwise. State sizes are powers of two, so such
+ * a vector is always a whole number of pages of every size. With
+ * QC_ALLOC_INTERLEAVE the mapping is interleaved over the allowed NUMA
+ * nodes with mbind before anything touches it.
+ *
+ * A fresh mapping reads as the kernel's zero page, so it is never zeroed
+ * here: with QC_ALLOC_FIRST_TOUCH each page is first written by the gate
+ * worker that owns it, inside the first gate that writes the buffer, and
+ * startup costs no stores at all. Without it the vector is zeroed up front
+ * by the calling thread. Smaller vectors, and platforms without mmap, use
+ * cache-line aligned heap memory zeroed with memset.
+ *
+ * Every allocation reports the policy bits that actually took effect.
+ *
+ * A saved state can instead be mapped privately from its file, which
+ * shares the page cache until the first write to each page; gates on such
+ * a state store only the amplitudes they change. Cloned states work the
+ * same way through an anonymous memory file holding a snapshot.
+ */
+
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+#define ALLOC_HAVE_MMAP 1
+#endif
+
+/* Linux memory policy constants (numaif.h is not assumed to be present) */
+#define ALLOC_MPOL_INTERLEAVE 3
+#define ALLOC_MPOL_F_MEMS_ALLOWED (1 << 2)
+#define ALLOC_MAX_NODES 1024
+#define ALLOC_MFD_CLOEXEC 1U
+
+#define ALLOC_POLICY_MASK                                                      \
+  (QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH | QC_ALLOC_INTERLEAVE)
+
+static int q_alloc_policy = QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH;
+
+/**
+ * Set the policy used for state vectors allocated from now on
+ * @param policy Bitwise OR of QC_ALLOC_* flags
+ */
+void q_alloc_set_policy(int policy) {
+  q_alloc_policy = policy & ALLOC_POLICY_MASK;
+}
+
+/**
+ * Policy used for new state vectors
+ * @return Bitwise OR of QC_ALLOC_* flags
+ */
+int q_alloc_get_policy(void) { return q_alloc_policy; }
+
+#ifdef ALLOC_HAVE_MMAP
+/**
+ * Whether a vector is mapped directly rather than taken from the heap
+ * @param size Number of amplitudes
+ * @return Nonzero for a mapped vector
+ */
+static int q_alloc_is_mapped(t_q_index size) {
+  return (size_t)size * sizeof(struct t_complex) >= QCS_HUGE_PAGE_SIZE;
+}
+
+/**
+ * Interleave a fresh mapping over the NUMA nodes this process may use
+ * @param ptr Mapping
+ * @param bytes Mapping length
+ * @return 0 if interleaving was applied, -1 otherwise (one node, or no
+ *         kernel support)
+ */
+static int q_alloc_interleave(void *ptr, size_t bytes) {
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+  unsigned long mask[ALLOC_MAX_NODES / (8 * sizeof(unsigned long))];
+  int nodes = 0;
+  size_t w;
+  int b;
+
+  memset(mask, 0, sizeof(mask));
+  if (syscall(SYS_get_mempolicy, NULL, mask, (unsigned long)ALLOC_MAX_NODES,
+              NULL, ALLOC_MPOL_F_MEMS_ALLOWED) != 0)
+    return -1;
+  for (w = 0; w < sizeof(mask) / sizeof(mask[0]); w++)
+    for (b = 0; b < (int)(8 * sizeof(unsigned long)); b++)
+      nodes += (int)((mask[w] >> b) & 1UL);
+  if (nodes < 2)
+    return -1;
+  return syscall(SYS_mbind, ptr, bytes, ALLOC_MPOL_INTERLEAVE, mask,
+                 (unsigned long)ALLOC_MAX_NODES, 0) == 0
+             ? 0
+             : -1;
+#else
+  (void)ptr;
+  (void)bytes;
+  return -1;
+#endif
+}
+
+/**
+ * Map an anonymous region, preferring explicit huge pages
+ * @param bytes Length, a multiple of every huge page size it is used with
+ * @param policy Requested QC_ALLOC_* flags
+ * @param used Output flags that took effect
+ * @return Mapping, or NULL on failure
+ */
+static void *q_alloc_map(size_t bytes, int policy, int *used) {
+  void *ptr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  if (policy & QC_ALLOC_HUGE_PAGES) {
+    if (bytes % QCS_GIGA_PAGE_SIZE == 0)
+      ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                     (30 << MAP_HUGE_SHIFT),
+                 -1, 0);
+    if (ptr == MAP_FAILED)
+      ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+      *used |= QC_ALLOC_HUGE_PAGES;
+  }
+#endif
+
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+      return NULL;
+#ifdef MADV_HUGEPAGE
+    if ((policy & QC_ALLOC_HUGE_PAGES) &&
+        madvise(ptr, bytes, MADV_HUGEPAGE) == 0)
+      *used |= QC_ALLOC_HUGE_PAGES;
+#endif
+  }
+
+  if ((policy & QC_ALLOC_INTERLEAVE) && q_alloc_interleave(ptr, bytes) == 0)
+    *used |= QC_ALLOC_INTERLEAVE;
+  return ptr;
+}
+#endif
+
+/**
+ * Allocate a zeroed state vector
+ * @param size Number of amplitudes
+ * @param policy Requested QC_ALLOC_* flags
+ * @param used Output flags that took effect
+ * @return Vector aligned to at least a cache line, or NULL on failure
+ */
+struct t_complex *q_alloc_vector(t_q_index size, int policy, int *used) {
+  size_t bytes = (size_t)size * sizeof(struct t_complex);
+  void *ptr = NULL;
+
+  *used = 0;
+#ifdef ALLOC_HAVE_MMAP
+  if (q_alloc_is_mapped(size)) {
+    ptr = q_alloc_map(bytes, policy, used);
+    if (ptr == NULL)
+      return NULL;
+    if (!(policy & QC_ALLOC_FIRST_TOUCH))
+      memset(ptr, 0, bytes);
+#if defined(QCS_MULTI_THREAD) || defined(QCS_CPU_OPENMP)
+    else
+      *used |= QC_ALLOC_FIRST_TOUCH;
+#endif
+    return (struct t_complex *)ptr;
+  }
+#endif
+  if (posix_memalign(&ptr, CACHE_LINE_SIZE, bytes) != 0)
+    return NULL;
+  memset(ptr, 0, bytes);
+  return (struct t_complex *)ptr;
+}
+
+/**
+ * Free a state vector
+ * @param vector Vector from q_alloc_vector (may be NULL)
+ * @param size Number of amplitudes it was allocated with
+ */
+void q_alloc_free(struct t_complex *vector, t_q_index size) {
+  if (vector == NULL)
+    return;
+#ifdef ALLOC_HAVE_MMAP
+  if (q_alloc_is_mapped(size)) {
+    munmap(vector, (size_t)size * sizeof(struct t_complex));
+    return;
+  }
+#endif
+  free(vector);
+}
+
+/**
+ * Map amplitudes stored in a file copy-on-write: pages are read on first
+ * access and copied privately on first write, so the file is never changed
+ * @param fd Open file descriptor (may be closed once mapped)
+ * @param offset Byte offset of the first amplitude, a multiple of the page
+ *        size
+ * @param size Number of amplitudes
+ * @return Mapped vector, or NULL if the file cannot be mapped
+ */
+struct t_complex *q_alloc_map_file(int fd, long offset, t_q_index size) {
+#ifdef ALLOC_HAVE_MMAP
+  size_t bytes = (size_t)size * sizeof(struct t_complex);
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   (off_t)offset);
+
+  if (ptr == MAP_FAILED)
+    return NULL;
+#ifdef MADV_WILLNEED
+  /* start reading ahead; the call does not wait for the pages */
+  madvise(ptr, bytes, MADV_WILLNEED);
+#endif
+  return (struct t_complex *)ptr;
+#else
+  (void)fd;
+  (void)offset;
+  (void)size;
+  return NULL;
+#endif
+}
+
+/**
+ * Unmap a vector from q_alloc_map_file
+ * @param vector Mapped vector (may be NULL)
+ * @param size Number of amplitudes it was mapped with
+ */
+void q_alloc_unmap_file(struct t_complex *vector, t_q_index size) {
+#ifdef ALLOC_HAVE_MMAP
+  if (vector != NULL)
+    munmap(vector, (size_t)size * sizeof(struct t_complex));
+#else
+  (void)vector;
+  (void)size;
+#endif
+}
+
+/**
+ * Snapshot a vector into an anonymous memory file for copy-on-write
+ * sharing with q_alloc_map_file. Pages that are all zero stay holes, so
+ * they take no memory in the snapshot either.
+ * @param vector Vector to snapshot
+ * @param size Number of amplitudes
+ * @return File descriptor (caller closes), or -1 if vectors smaller than a
+ *         page or the platform cannot share memory this way
+ */
+int q_alloc_share(const struct t_complex *vector, t_q_index size) {
+#if defined(ALLOC_HAVE_MMAP) && defined(SYS_memfd_create)
+  size_t bytes = (size_t)size * sizeof(struct t_complex);
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const char *p = (const char *)vector;
+  size_t offset;
+  int fd;
+
+  if (bytes < page || bytes % page != 0)
+    return -1;
+  fd = (int)syscall(SYS_memfd_create, "qcs-state", ALLOC_MFD_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (ftruncate(fd, (off_t)bytes) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  for (offset = 0; offset < bytes; offset += page) {
+    size_t i, done;
+
+    for (i = 0; i < page && p[offset + i] == 0; i++)
+      ;
+    if (i == page)
+      continue;
+    for (done = 0; done < page;) {
+      ssize_t n = pwrite(fd, p + offset + done, page - done,
+                         (off_t)(offset + done));
+      if (n <= 0) {
+        close(fd);
+        return -1;
+      }
+      done += (size_t)n;
+    }
+  }
+  return fd;
+#else
+  (void)vector;
+  (void)size;
+  return -1;
+#endif
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * Batched parameter sweeps: B independent simulations of one compiled
+ * program. Small states run one simulation per worker, each worker owning
+ * its state buffer and fused matrices while sharing the read-only program;
+ * large states run one simulation at a time with the parallel kernels.
+ */
+
+/* Up to 2^14 amplitudes (256 KiB) a state fits a core's cache, so splitting
+ * the batch across workers beats splitting each gate */
+#define QCS_BATCH_MAX_QUBITS 14
+
+struct t_batch_ctx {
+  const struct t_q_program *program;
+  int num_qubits;
+  int initial_fd;
+  const double *params;
+  const long *flip_masks;
+  const long *z_masks;
+  const int *y_counts;
+  const double *coeffs;
+  int count;
+  double *out;
+  int failed;
+};
+
+/**
+ * Allocate a state without a scratch vector for the in-place serial kernels
+ * @param num_qubits Number of qubits
+ * @return State, or NULL on allocation failure
+ */
+static struct t_q_state *q_batch_state_alloc(int num_qubits) {
+  struct t_q_state *state =
+      (struct t_q_state *)malloc(sizeof(struct t_q_state));
+
+  if (state == NULL)
+    return NULL;
+
+  state->qubits_num = num_qubits;
+  state->size = (t_q_index)1 << num_qubits;
+  state->scratch_vector = NULL;
+  state->file_vector = NULL;
+  state->vector = q_alloc_vector(state->size, 0, &state->alloc_policy);
+  if (state->vector == NULL) {
+    free(state);
+    return NULL;
+  }
+  return state;
+}
+
+/**
+ * Simulate one parameter vector and evaluate the observable
+ * @param ctx Batch context
+ * @param binding Fused matrices owned by the caller
+ * @param state State buffer owned by the caller
+ * @param item Batch index
+ * @param serial Nonzero to use the in-place single-thread kernels
+ */
+static void q_batch_run_item(struct t_batch_ctx *ctx,
+                             struct t_q_program_binding *binding,
+                             struct t_q_state *state, long item, int serial) {
+  const struct t_q_program *program = ctx->program;
+  long i;
+  int k;
+
+  q_program_bind(program, binding,
+                 ctx->params + item * (long)program->num_slots);
+
+  if (ctx->initial_fd >= 0) {
+    if (q_state_file_read(ctx->initial_fd, state->vector, state->size) != 0) {
+      ctx->failed = 1;
+      return;
+    }
+  } else {
+    for (i = 0; i < state->size; i++)
+      state->vector[i] = c_zero();
+    state->vector[0] = c_one();
+  }
+
+  for (k = 0; k < program->num_ops; k++) {
+    const struct t_q_program_op *op = &program->ops[k];
+    struct t_q_matrix view;
+    const struct t_q_matrix *matrix = q_program_matrix(binding, k, &view);
+
+    if (op->control >= 0) {
+      if (serial)
+        q_apply_2q_gate_serial(state, matrix, op->control, op->target);
+      else
+        q_apply_2q_gate(state, matrix, op->control, op->target);
+    } else {
+      if (serial)
+        q_apply_1q_gate_serial(state, matrix, op->target);
+      else
+        q_apply_1q_gate(state, matrix, op->target);
+    }
+  }
+
+  ctx->out[item] =
+      q_state_expectation_terms(state, ctx->flip_masks, ctx->z_masks,
+                                ctx->y_counts, ctx->coeffs, ctx->count);
+}
+
+/**
+ * Parallel body running a contiguous range of batch items on one worker
+ * @param context Batch context
+ * @param start First batch index
+ * @param end One past the last batch index
+ */
+static void q_batch_body(void *context, long start, long end) {
+  struct t_batch_ctx *ctx = (struct t_batch_ctx *)context;
+  struct t_q_program_binding *binding;
+  struct t_q_state *state;
+  long item;
+
+  binding = q_program_binding_init(ctx->program);
+  state = q_batch_state_alloc(ctx->num_qubits);
+  if (binding == NULL || state == NULL) {
+    ctx->failed = 1;
+  } else {
+    for (item = start; item < end; item++)
+      q_batch_run_item(ctx, binding, state, item, 1);
+  }
+
+  q_program_binding_free(ctx->program, binding);
+  q_state_free(state);
+}
+
+/**
+ * Run a compiled program for many parameter vectors and evaluate a Pauli
+ * observable on each final state
+ * @param program Compiled program (shared read-only)
+ * @param num_qubits Number of qubits
+ * @param initial_fd State file every run starts from (see
+ *        q_state_file_read), or -1 to start from |0...0>
+ * @param params batch_size rows of program->num_slots values, row-major
+ * @param batch_size Number of parameter vectors
+ * @param flip_masks Per-term masks of qubits carrying X or Y
+ * @param z_masks Per-term masks of qubits carrying Y or Z
+ * @param y_counts Per-term number of Y factors
+ * @param coeffs Per-term real coefficients
+ * @param count Number of terms
+ * @param out Output expectation value per parameter vector
+ * @return 0 on success, -1 on allocation or read failure
+ */
+int q_program_run_batch(const struct t_q_program *program, int num_qubits,
+                        int initial_fd, const double *params, int batch_size,
+                        const long *flip_masks, const long *z_masks,
+                        const int *y_counts, const double *coeffs, int count,
+                        double *out) {
+  struct t_batch_ctx ctx;
+
+  ctx.program = program;
+  ctx.num_qubits = num_qubits;
+  ctx.initial_fd = initial_fd;
+  ctx.params = params;
+  ctx.flip_masks = flip_masks;
+  ctx.z_masks = z_masks;
+  ctx.y_counts = y_counts;
+  ctx.coeffs = coeffs;
+  ctx.count = count;
+  ctx.out = out;
+  ctx.failed = 0;
+
+  if (num_qubits <= QCS_BATCH_MAX_QUBITS) {
+    q_parallel_for(batch_size, 1, q_batch_body, &ctx);
+  } else {
+    struct t_q_program_binding *binding = q_program_binding_init(program);
+    struct t_q_state *state = q_state_init(num_qubits);
+    long item;
+
+    if (binding == NULL || state == NULL) {
+      ctx.failed = 1;
+    } else {
+      for (item = 0; item < batch_size; item++)
+        q_batch_run_item(&ctx, binding, state, item, 0);
+    }
+    q_program_binding_free(program, binding);
+    q_state_free(state);
+  }
+
+  return ctx.failed ? -1 : 0;
+}
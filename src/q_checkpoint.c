@@ -0,0 +1,335 @@
+/* pread, pwrite, fsync, ftruncate and fstat are outside C89 */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+/*
+ * Saved state files.
+ *
+ * A file is a 4 KiB header followed by the 2^n amplitudes in basis-index
+ * order, each stored as its real then imaginary double in native byte
+ * order. The header records the qubit count, precision and layout, plus a
+ * byte-order mark so a file from a machine of the other endianness is
+ * rejected rather than misread. Because the amplitudes start on a page
+ * boundary, a load maps them copy-on-write straight from the page cache:
+ * no read happens up front, and any number of circuits loaded from one file
+ * share its pages until they write them.
+ *
+ * Saves write to "<path>.tmp", sync it and rename it over the target, so a
+ * checkpoint interrupted part way leaves the previous one intact.
+ */
+
+#define STATE_FILE_MAGIC "QCSSTATE"
+#define STATE_FILE_VERSION 1L
+#define STATE_FILE_HEADER_SIZE 4096L
+#define STATE_FILE_BYTE_ORDER 0x0102030405060708UL
+#define STATE_FILE_LAYOUT_INTERLEAVED 0L
+
+struct t_state_file_header {
+  char magic[8];
+  unsigned long byte_order;
+  long version;
+  long qubits_num;
+  long precision; /* bytes per real component */
+  long layout;    /* STATE_FILE_LAYOUT_* */
+};
+
+/**
+ * Write a byte range, retrying short writes
+ * @param fd File descriptor
+ * @param data Bytes to write
+ * @param bytes Number of bytes
+ * @param offset File offset
+ * @return 0 on success, -1 on an I/O error
+ */
+static int q_checkpoint_write(int fd, const void *data, size_t bytes,
+                              long offset) {
+  const char *p = (const char *)data;
+
+  while (bytes > 0) {
+    ssize_t done = pwrite(fd, p, bytes, (off_t)offset);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0)
+      return -1;
+    p += done;
+    bytes -= (size_t)done;
+    offset += done;
+  }
+  return 0;
+}
+
+/**
+ * Read a byte range, retrying short reads
+ * @param fd File descriptor
+ * @param data Output bytes
+ * @param bytes Number of bytes
+ * @param offset File offset
+ * @return 0 on success, -1 on an I/O error or end of file
+ */
+static int q_checkpoint_read(int fd, void *data, size_t bytes, long offset) {
+  char *p = (char *)data;
+
+  while (bytes > 0) {
+    ssize_t done = pread(fd, p, bytes, (off_t)offset);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0)
+      return -1;
+    p += done;
+    bytes -= (size_t)done;
+    offset += done;
+  }
+  return 0;
+}
+
+/**
+ * Create the temporary file of a save, sized and with its header written;
+ * amplitudes not written afterwards read as zero
+ * @param path Target path
+ * @param qubits_num Number of qubits
+ * @param tmp_path Output temporary path (caller frees)
+ * @return File descriptor, or -1 on failure
+ */
+static int q_checkpoint_begin(const char *path, int qubits_num,
+                              char **tmp_path) {
+  char header[STATE_FILE_HEADER_SIZE];
+  struct t_state_file_header fields;
+  long bytes = ((long)sizeof(struct t_complex) << qubits_num);
+  int fd;
+
+  *tmp_path = (char *)malloc(strlen(path) + sizeof(".tmp"));
+  if (*tmp_path == NULL)
+    return -1;
+  sprintf(*tmp_path, "%s.tmp", path);
+
+  fd = open(*tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not create state file %s\n", *tmp_path);
+    free(*tmp_path);
+    return -1;
+  }
+
+  memset(header, 0, sizeof(header));
+  memcpy(fields.magic, STATE_FILE_MAGIC, sizeof(fields.magic));
+  fields.byte_order = STATE_FILE_BYTE_ORDER;
+  fields.version = STATE_FILE_VERSION;
+  fields.qubits_num = qubits_num;
+  fields.precision = (long)sizeof(double);
+  fields.layout = STATE_FILE_LAYOUT_INTERLEAVED;
+  memcpy(header, &fields, sizeof(fields));
+
+  if (ftruncate(fd, STATE_FILE_HEADER_SIZE + bytes) != 0 ||
+      q_checkpoint_write(fd, header, sizeof(header), 0) != 0) {
+    fprintf(stderr, "Error: Could not write state file %s\n", *tmp_path);
+    close(fd);
+    unlink(*tmp_path);
+    free(*tmp_path);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Finish a save: sync the temporary file and rename it over the target, or
+ * remove it after a failure
+ * @param fd File descriptor from q_checkpoint_begin
+ * @param tmp_path Temporary path (freed)
+ * @param path Target path
+ * @param status 0 if every amplitude was written, -1 otherwise
+ * @return 0 on success, -1 on failure
+ */
+static int q_checkpoint_end(int fd, char *tmp_path, const char *path,
+                            int status) {
+  if (status == 0 && fsync(fd) != 0)
+    status = -1;
+  if (close(fd) != 0)
+    status = -1;
+  if (status == 0 && rename(tmp_path, path) != 0)
+    status = -1;
+  if (status != 0) {
+    fprintf(stderr, "Error: Could not write state file %s\n", path);
+    unlink(tmp_path);
+  }
+  free(tmp_path);
+  return status;
+}
+
+/**
+ * Save a dense state
+ * @param state Quantum state
+ * @param path Output file
+ * @return 0 on success, -1 on failure
+ */
+int q_state_save(const struct t_q_state *state, const char *path) {
+  char *tmp_path;
+  int fd = q_checkpoint_begin(path, state->qubits_num, &tmp_path);
+
+  if (fd < 0)
+    return -1;
+  return q_checkpoint_end(
+      fd, tmp_path, path,
+      q_checkpoint_write(fd, state->vector,
+                         (size_t)state->size * sizeof(struct t_complex),
+                         STATE_FILE_HEADER_SIZE));
+}
+
+/**
+ * Save a sparse state; only the stored amplitudes are written, the rest of
+ * the file stays a hole that reads as zero
+ * @param sparse Sparse state
+ * @param path Output file
+ * @return 0 on success, -1 on failure
+ */
+int q_sparse_save(const struct t_q_sparse *sparse, const char *path) {
+  char *tmp_path;
+  int fd = q_checkpoint_begin(path, sparse->qubits_num, &tmp_path);
+  int status = 0;
+  long i;
+
+  if (fd < 0)
+    return -1;
+  for (i = 0; i < sparse->capacity && status == 0; i++) {
+    if (sparse->keys[i] != SPARSE_EMPTY_KEY)
+      status = q_checkpoint_write(
+          fd, &sparse->values[i], sizeof(struct t_complex),
+          STATE_FILE_HEADER_SIZE +
+              sparse->keys[i] * (long)sizeof(struct t_complex));
+  }
+  return q_checkpoint_end(fd, tmp_path, path, status);
+}
+
+/**
+ * Save an out-of-core state, copying it a chunk at a time
+ * @param disk Out-of-core state
+ * @param path Output file
+ * @return 0 on success, -1 on failure
+ */
+int q_disk_save(struct t_q_disk *disk, const char *path) {
+  struct t_complex *buffer;
+  char *tmp_path;
+  int fd, used, status = 0;
+  long chunk;
+
+  buffer = q_alloc_vector(disk->chunk_size, q_alloc_get_policy(), &used);
+  if (buffer == NULL)
+    return -1;
+  fd = q_checkpoint_begin(path, disk->qubits_num, &tmp_path);
+  if (fd < 0) {
+    q_alloc_free(buffer, disk->chunk_size);
+    return -1;
+  }
+
+  for (chunk = 0; chunk < disk->chunks && status == 0; chunk++) {
+    t_q_index index = chunk * disk->chunk_size;
+
+    if (q_disk_read(disk, buffer, disk->chunk_size, index) != 0 ||
+        q_checkpoint_write(fd, buffer,
+                           (size_t)disk->chunk_size * sizeof(struct t_complex),
+                           STATE_FILE_HEADER_SIZE +
+                               index * (long)sizeof(struct t_complex)) != 0)
+      status = -1;
+  }
+
+  q_alloc_free(buffer, disk->chunk_size);
+  return q_checkpoint_end(fd, tmp_path, path, status);
+}
+
+/**
+ * Load a saved state. The amplitudes are mapped copy-on-write from the file
+ * where the platform allows, and read into memory otherwise.
+ * @param path State file
+ * @param file Output descriptor of the file, kept open so that the state
+ *        can be restored later with q_state_file_read (NULL to close it)
+ * @return Dense state, or NULL on failure
+ */
+struct t_q_state *q_state_load(const char *path, int *file) {
+  struct t_state_file_header fields;
+  struct t_q_state *state;
+  struct stat info;
+  int fd, used;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not open state file %s\n", path);
+    return NULL;
+  }
+  if (q_checkpoint_read(fd, &fields, sizeof(fields), 0) != 0 ||
+      memcmp(fields.magic, STATE_FILE_MAGIC, sizeof(fields.magic)) != 0 ||
+      fields.byte_order != STATE_FILE_BYTE_ORDER ||
+      fields.version != STATE_FILE_VERSION ||
+      fields.precision != (long)sizeof(double) ||
+      fields.layout != STATE_FILE_LAYOUT_INTERLEAVED ||
+      fields.qubits_num < 1 || fields.qubits_num > QCS_DISK_MAX_QUBITS ||
+      fstat(fd, &info) != 0 ||
+      (long)info.st_size < STATE_FILE_HEADER_SIZE +
+                               ((long)sizeof(struct t_complex)
+                                << fields.qubits_num)) {
+    fprintf(stderr, "Error: %s is not a valid state file\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  state = (struct t_q_state *)malloc(sizeof(struct t_q_state));
+  if (state == NULL) {
+    close(fd);
+    return NULL;
+  }
+  state->qubits_num = (int)fields.qubits_num;
+  state->size = (t_q_index)1 << fields.qubits_num;
+  state->vector = NULL;
+  state->scratch_vector = NULL;
+  state->file_vector =
+      q_alloc_map_file(fd, STATE_FILE_HEADER_SIZE, state->size);
+
+  /* the first gate writes the scratch vector whole, as in q_state_init */
+  state->scratch_vector =
+      q_alloc_vector(state->size, q_alloc_get_policy(), &state->alloc_policy);
+  if (state->file_vector != NULL) {
+    state->vector = state->file_vector;
+    /* the mapping's pages are placed by whoever reads them first */
+    state->alloc_policy = 0;
+  } else if (state->scratch_vector != NULL) {
+    state->vector = q_alloc_vector(state->size, q_alloc_get_policy(), &used);
+    if (state->vector != NULL &&
+        q_checkpoint_read(fd, state->vector,
+                          (size_t)state->size * sizeof(struct t_complex),
+                          STATE_FILE_HEADER_SIZE) != 0) {
+      fprintf(stderr, "Error: Could not read state file %s\n", path);
+      q_alloc_free(state->vector, state->size);
+      state->vector = NULL;
+    }
+    state->alloc_policy &= used;
+  }
+
+  if (state->vector == NULL || state->scratch_vector == NULL) {
+    close(fd);
+    q_state_free(state);
+    return NULL;
+  }
+  if (file != NULL)
+    *file = fd;
+  else
+    close(fd);
+  return state;
+}
+
+/**
+ * Read the amplitudes of a state file opened by q_state_load again
+ * @param fd File descriptor
+ * @param vector Output amplitudes
+ * @param size Number of amplitudes, as loaded
+ * @return 0 on success, -1 on an I/O error
+ */
+int q_state_file_read(int fd, struct t_complex *vector, t_q_index size) {
+  return q_checkpoint_read(fd, vector, (size_t)size * sizeof(struct t_complex),
+                           STATE_FILE_HEADER_SIZE);
+}
@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * Shot counts keyed by basis index: an open-addressing table with linear
+ * probing and Fibonacci hashing. A zero count marks an empty slot, so only
+ * the keys and counts arrays are stored. Memory grows with the number of
+ * distinct outcomes, not with 2^n.
+ */
+
+#define COUNTS_MIN_CAPACITY 16
+
+/**
+ * Home slot of a key
+ * @param counts Counts table
+ * @param key Basis index
+ * @return Slot index
+ */
+static long q_counts_slot(const struct t_q_counts *counts, unsigned long key) {
+  return (long)((key * 0x9E3779B97F4A7C15UL) >> counts->shift);
+}
+
+/**
+ * Allocate the slot arrays of a table
+ * @param counts Counts table (capacity and shift are set from log2_capacity)
+ * @param log2_capacity Base-2 logarithm of the slot count
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_counts_alloc_slots(struct t_q_counts *counts, int log2_capacity) {
+  counts->capacity = 1L << log2_capacity;
+  counts->shift = 64 - log2_capacity;
+  counts->keys = (unsigned long *)malloc(counts->capacity *
+                                         sizeof(unsigned long));
+  counts->values = (long *)calloc(counts->capacity, sizeof(long));
+  if (counts->keys == NULL || counts->values == NULL) {
+    free(counts->keys);
+    free(counts->values);
+    counts->keys = NULL;
+    counts->values = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Create an empty counts table
+ * @param expected Expected number of distinct outcomes (may be 0)
+ * @return New table, or NULL on allocation failure
+ */
+struct t_q_counts *q_counts_init(long expected) {
+  struct t_q_counts *counts;
+  int log2_capacity = 4;
+
+  counts = (struct t_q_counts *)calloc(1, sizeof(struct t_q_counts));
+  if (counts == NULL)
+    return NULL;
+
+  /* keep the load factor under 1/2 for the expected size */
+  while ((1L << log2_capacity) < COUNTS_MIN_CAPACITY ||
+         (1L << log2_capacity) < 2 * expected)
+    log2_capacity++;
+
+  if (q_counts_alloc_slots(counts, log2_capacity) != 0) {
+    free(counts);
+    return NULL;
+  }
+  return counts;
+}
+
+/**
+ * Double the slot count and reinsert every entry
+ * @param counts Counts table
+ * @return 0 on success, -1 on allocation failure (table unchanged)
+ */
+static int q_counts_grow(struct t_q_counts *counts) {
+  struct t_q_counts old = *counts;
+  long i;
+
+  if (q_counts_alloc_slots(counts, 64 - old.shift + 1) != 0) {
+    *counts = old;
+    return -1;
+  }
+
+  for (i = 0; i < old.capacity; i++) {
+    long slot;
+
+    if (old.values[i] == 0)
+      continue;
+    slot = q_counts_slot(counts, old.keys[i]);
+    while (counts->values[slot] != 0)
+      slot = (slot + 1) & (counts->capacity - 1);
+    counts->keys[slot] = old.keys[i];
+    counts->values[slot] = old.values[i];
+  }
+
+  free(old.keys);
+  free(old.values);
+  return 0;
+}
+
+/**
+ * Add occurrences of an outcome
+ * @param counts Counts table
+ * @param key Basis index
+ * @param count Number of occurrences (> 0)
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_counts_add(struct t_q_counts *counts, unsigned long key, long count) {
+  long slot;
+
+  if (count <= 0)
+    return 0;
+
+  /* grow at a load factor of 3/4 */
+  if (4 * (counts->size + 1) > 3 * counts->capacity &&
+      q_counts_grow(counts) != 0)
+    return -1;
+
+  slot = q_counts_slot(counts, key);
+  while (counts->values[slot] != 0 && counts->keys[slot] != key)
+    slot = (slot + 1) & (counts->capacity - 1);
+
+  if (counts->values[slot] == 0) {
+    counts->keys[slot] = key;
+    counts->size++;
+  }
+  counts->values[slot] += count;
+  counts->total += count;
+  return 0;
+}
+
+/**
+ * Add every entry of one table to another
+ * @param dst Table to add to
+ * @param src Table to add from
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_counts_merge(struct t_q_counts *dst, const struct t_q_counts *src) {
+  long i;
+
+  for (i = 0; i < src->capacity; i++) {
+    if (src->values[i] != 0 &&
+        q_counts_add(dst, src->keys[i], src->values[i]) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * Number of occurrences of an outcome
+ * @param counts Counts table
+ * @param key Basis index
+ * @return Count, 0 if the outcome never occurred
+ */
+long q_counts_get(const struct t_q_counts *counts, unsigned long key) {
+  long slot = q_counts_slot(counts, key);
+
+  while (counts->values[slot] != 0) {
+    if (counts->keys[slot] == key)
+      return counts->values[slot];
+    slot = (slot + 1) & (counts->capacity - 1);
+  }
+  return 0;
+}
+
+/**
+ * Whether entry a ranks below entry b (fewer counts; ties: larger key)
+ * @param counts Counts table
+ * @param a Slot index
+ * @param b Slot index
+ * @return Nonzero if a ranks below b
+ */
+static int q_counts_below(const struct t_q_counts *counts, long a, long b) {
+  if (counts->values[a] != counts->values[b])
+    return counts->values[a] < counts->values[b];
+  return counts->keys[a] > counts->keys[b];
+}
+
+/**
+ * Restore the min-heap property below a heap position
+ * @param counts Counts table
+ * @param heap Heap of slot indices, lowest-ranked entry at the root
+ * @param size Heap size
+ * @param pos Position to sift down from
+ */
+static void q_counts_sift_down(const struct t_q_counts *counts, long *heap,
+                               long size, long pos) {
+  for (;;) {
+    long child = 2 * pos + 1;
+    long tmp;
+
+    if (child >= size)
+      return;
+    if (child + 1 < size && q_counts_below(counts, heap[child + 1], heap[child]))
+      child++;
+    if (!q_counts_below(counts, heap[child], heap[pos]))
+      return;
+    tmp = heap[pos];
+    heap[pos] = heap[child];
+    heap[child] = tmp;
+    pos = child;
+  }
+}
+
+/**
+ * The k most frequent outcomes, most frequent first (ties: smaller key
+ * first), using a size-k min-heap over the table
+ * @param counts Counts table
+ * @param k Number of outcomes wanted
+ * @param keys Output basis indices (k entries)
+ * @param values Output counts (k entries)
+ * @return Number of outcomes written (min(k, size)), or -1 on allocation
+ *         failure
+ */
+long q_counts_top_k(const struct t_q_counts *counts, long k,
+                    unsigned long *keys, long *values) {
+  long *heap;
+  long size = 0;
+  long i;
+
+  if (k > counts->size)
+    k = counts->size;
+  if (k <= 0)
+    return 0;
+
+  heap = (long *)malloc(k * sizeof(long));
+  if (heap == NULL)
+    return -1;
+
+  for (i = 0; i < counts->capacity; i++) {
+    if (counts->values[i] == 0)
+      continue;
+    if (size < k) {
+      long pos = size++;
+
+      heap[pos] = i;
+      while (pos > 0 && q_counts_below(counts, heap[pos], heap[(pos - 1) / 2])) {
+        long parent = (pos - 1) / 2;
+        long tmp = heap[pos];
+
+        heap[pos] = heap[parent];
+        heap[parent] = tmp;
+        pos = parent;
+      }
+    } else if (q_counts_below(counts, heap[0], i)) {
+      heap[0] = i;
+      q_counts_sift_down(counts, heap, size, 0);
+    }
+  }
+
+  /* popping the root yields the lowest-ranked remaining entry */
+  while (size > 0) {
+    long slot = heap[0];
+
+    keys[size - 1] = counts->keys[slot];
+    values[size - 1] = counts->values[slot];
+    heap[0] = heap[--size];
+    q_counts_sift_down(counts, heap, size, 0);
+  }
+
+  free(heap);
+  return k;
+}
+
+/**
+ * Counts of a subset of qubits. Bit j of each new key is qubit qubits[j]
+ * of the original key.
+ * @param counts Counts table
+ * @param qubits Qubits to keep
+ * @param num_qubits Number of qubits to keep (at most 63)
+ * @return New table, or NULL on allocation failure
+ */
+struct t_q_counts *q_counts_marginal(const struct t_q_counts *counts,
+                                     const int *qubits, int num_qubits) {
+  struct t_q_counts *marginal;
+  long i;
+  int j;
+
+  marginal = q_counts_init(num_qubits < 20 ? 1L << num_qubits : counts->size);
+  if (marginal == NULL)
+    return NULL;
+
+  for (i = 0; i < counts->capacity; i++) {
+    unsigned long key = 0;
+
+    if (counts->values[i] == 0)
+      continue;
+    for (j = 0; j < num_qubits; j++)
+      key |= ((counts->keys[i] >> qubits[j]) & 1UL) << j;
+    if (q_counts_add(marginal, key, counts->values[i]) != 0) {
+      q_counts_free(marginal);
+      return NULL;
+    }
+  }
+  return marginal;
+}
+
+/**
+ * Free a counts table
+ * @param counts Table to free
+ */
+void q_counts_free(struct t_q_counts *counts) {
+  if (counts == NULL)
+    return;
+  free(counts->keys);
+  free(counts->values);
+  free(counts);
+}
@@ -0,0 +1,870 @@
+/* pread, pwrite, mkstemp, ftruncate and posix_fadvise are outside C89 */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+/*
+ * Out-of-core state vector kept in an unlinked scratch file, or compressed
+ * in memory as a table of independently encoded blocks (q_zip.c).
+ *
+ * The file holds the 2^n amplitudes in index order and is split into chunks
+ * of 2^chunk_qubits amplitudes; only chunk-sized buffers are ever resident.
+ * A compressed state keeps one block per chunk, decoded into the same
+ * buffers and re-encoded after the gates, each worker with its own encoding
+ * scratch.
+ * A qubit below chunk_qubits is "low": its gate pairs sit inside every
+ * chunk. Higher qubits select the chunk and are "high".
+ *
+ * Gates are queued and applied in passes over the file. A pass takes the
+ * longest run of queued gates touching at most QCS_DISK_PASS_HIGH distinct
+ * high qubits; the chunks that differ only in those qubits form a group,
+ * which is read into one buffer where the high qubits become local qubits
+ * above the chunk, so every gate of the pass runs in memory with the
+ * in-place serial kernels. Groups are disjoint and spread over the workers,
+ * and each worker asks the kernel to read its next group ahead while it
+ * computes on the current one. A run of low-qubit gates thus costs a single
+ * read and write of the file.
+ *
+ * Reads of the state (probabilities, marginals, top-k, measurement) flush
+ * the queue first, then stream the file chunk by chunk, reducing each chunk
+ * with the dense routines in a fixed order so results do not depend on the
+ * thread count. A single-qubit measurement is queued as a scaled projector
+ * and applied with the next pass.
+ */
+
+/* Queued gates after which a pass is forced, bounding the queue */
+#define DISK_MAX_PENDING 1024
+
+struct t_disk_pass_ctx {
+  struct t_q_disk *disk;
+  struct t_q_disk_gate *gates;
+  int num_gates;
+  int high[QCS_DISK_PASS_HIGH];
+  int num_high;
+  int failed;
+};
+
+/**
+ * Read or write a run of amplitudes of a compressed state; partial blocks
+ * are decoded, patched and re-encoded
+ * @param disk Compressed state
+ * @param buffer Amplitude buffer
+ * @param count Number of amplitudes
+ * @param index Basis index of the first amplitude
+ * @param write Nonzero to write the buffer, zero to read into it
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_disk_zip_transfer(const struct t_q_disk *disk,
+                               struct t_complex *buffer, t_q_index count,
+                               t_q_index index, int write) {
+  struct t_complex *block = NULL;
+  unsigned char *scratch = NULL;
+  int status = 0;
+
+  if (write)
+    scratch = (unsigned char *)malloc(q_zip_scratch_size(disk->zip));
+  if (write && scratch == NULL)
+    return -1;
+
+  while (count > 0 && status == 0) {
+    long b = index >> disk->chunk_qubits;
+    t_q_index offset = index - b * disk->chunk_size;
+    t_q_index n = disk->chunk_size - offset < count ? disk->chunk_size - offset
+                                                    : count;
+
+    if (n == disk->chunk_size) {
+      if (write)
+        status = q_zip_store(disk->zip, b, buffer, scratch);
+      else
+        q_zip_load(disk->zip, b, buffer);
+    } else {
+      if (block == NULL) {
+        block = (struct t_complex *)malloc(disk->chunk_size *
+                                           sizeof(struct t_complex));
+        if (block == NULL) {
+          status = -1;
+          break;
+        }
+      }
+      q_zip_load(disk->zip, b, block);
+      if (write) {
+        memcpy(block + offset, buffer, n * sizeof(struct t_complex));
+        status = q_zip_store(disk->zip, b, block, scratch);
+      } else {
+        memcpy(buffer, block + offset, n * sizeof(struct t_complex));
+      }
+    }
+    buffer += n;
+    index += n;
+    count -= n;
+  }
+  if (write)
+    q_zip_end_pass(disk->zip);
+
+  free(block);
+  free(scratch);
+  return status;
+}
+
+/**
+ * Read or write a run of amplitudes, retrying short transfers
+ * @param disk Out-of-core state
+ * @param buffer Amplitude buffer
+ * @param count Number of amplitudes
+ * @param index Basis index of the first amplitude
+ * @param write Nonzero to write the buffer, zero to read into it
+ * @return 0 on success, -1 on an I/O error
+ */
+static int q_disk_transfer(const struct t_q_disk *disk,
+                           struct t_complex *buffer, t_q_index count,
+                           t_q_index index, int write) {
+  char *data = (char *)buffer;
+  size_t left = (size_t)count * sizeof(struct t_complex);
+  off_t offset = (off_t)index * (off_t)sizeof(struct t_complex);
+
+  if (disk->zip != NULL)
+    return q_disk_zip_transfer(disk, buffer, count, index, write);
+  while (left > 0) {
+    ssize_t done = write ? pwrite(disk->fd, data, left, offset)
+                         : pread(disk->fd, data, left, offset);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0)
+      return -1;
+    data += done;
+    left -= (size_t)done;
+    offset += done;
+  }
+  return 0;
+}
+
+/**
+ * Ask the kernel to start reading a chunk ahead of its use
+ * @param disk Out-of-core state
+ * @param chunk Chunk index
+ */
+static void q_disk_read_ahead(const struct t_q_disk *disk, long chunk) {
+#ifdef POSIX_FADV_WILLNEED
+  off_t bytes = (off_t)disk->chunk_size * (off_t)sizeof(struct t_complex);
+
+  if (disk->zip == NULL)
+    posix_fadvise(disk->fd, chunk * bytes, bytes, POSIX_FADV_WILLNEED);
+#else
+  (void)disk;
+  (void)chunk;
+#endif
+}
+
+/**
+ * Clear the file to the all-zero vector, then store |0...0>
+ * @param disk Out-of-core state
+ * @return 0 on success, -1 on an I/O error
+ */
+int q_disk_reset(struct t_q_disk *disk) {
+  struct t_complex one = {1.0, 0.0};
+  off_t bytes = (off_t)disk->size * (off_t)sizeof(struct t_complex);
+
+  disk->num_pending = 0;
+  if (disk->zip != NULL)
+    q_zip_clear(disk->zip);
+  /* truncating drops every block, and the regrown file reads as zeros */
+  if ((disk->zip == NULL &&
+       (ftruncate(disk->fd, 0) != 0 || ftruncate(disk->fd, bytes) != 0)) ||
+      q_disk_transfer(disk, &one, 1, 0, 1) != 0) {
+    fprintf(stderr, "Error: Could not reset the out-of-core state file\n");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Allocate an out-of-core state with no storage attached
+ * @param qubits_num Number of qubits
+ * @param chunk_qubits log2 of the amplitudes per chunk (<= 0 for the
+ *        default), capped at qubits_num
+ * @param default_qubits Chunk qubits used when chunk_qubits <= 0
+ * @return Out-of-core state, or NULL on failure
+ */
+static struct t_q_disk *q_disk_alloc(int qubits_num, int chunk_qubits,
+                                     int default_qubits) {
+  struct t_q_disk *disk;
+
+  if (qubits_num < 1 || qubits_num > QCS_DISK_MAX_QUBITS) {
+    fprintf(stderr, "Error: Out-of-core states support 1 to %d qubits\n",
+            QCS_DISK_MAX_QUBITS);
+    return NULL;
+  }
+  if (chunk_qubits <= 0)
+    chunk_qubits = default_qubits;
+  if (chunk_qubits > qubits_num)
+    chunk_qubits = qubits_num;
+
+  disk = (struct t_q_disk *)malloc(sizeof(struct t_q_disk));
+  if (disk == NULL) {
+    fprintf(stderr, "Error: Could not allocate out-of-core state\n");
+    return NULL;
+  }
+  disk->qubits_num = qubits_num;
+  disk->chunk_qubits = chunk_qubits;
+  disk->size = 1L << qubits_num;
+  disk->chunk_size = 1L << chunk_qubits;
+  disk->chunks = 1L << (qubits_num - chunk_qubits);
+  disk->fd = -1;
+  disk->zip = NULL;
+  disk->pending = NULL;
+  disk->num_pending = 0;
+  disk->pending_capacity = 0;
+  return disk;
+}
+
+/**
+ * Create an out-of-core state in |0...0>
+ * @param qubits_num Number of qubits
+ * @param dir Directory for the scratch file (NULL for /tmp)
+ * @param chunk_qubits log2 of the amplitudes per chunk (<= 0 for
+ *        QCS_DISK_CHUNK_QUBITS), capped at qubits_num
+ * @return Out-of-core state, or NULL on failure
+ */
+struct t_q_disk *q_disk_init(int qubits_num, const char *dir,
+                             int chunk_qubits) {
+  struct t_q_disk *disk;
+  char *path;
+
+  disk = q_disk_alloc(qubits_num, chunk_qubits, QCS_DISK_CHUNK_QUBITS);
+  if (disk == NULL)
+    return NULL;
+  if (dir == NULL)
+    dir = "/tmp";
+
+  path = (char *)malloc(strlen(dir) + sizeof("/qcs-state-XXXXXX"));
+  if (path == NULL) {
+    q_disk_free(disk);
+    return NULL;
+  }
+  sprintf(path, "%s/qcs-state-XXXXXX", dir);
+  disk->fd = mkstemp(path);
+  if (disk->fd < 0) {
+    fprintf(stderr, "Error: Could not create a scratch file in %s\n", dir);
+    q_disk_free(disk);
+    free(path);
+    return NULL;
+  }
+  /* the file lives only as long as the descriptor */
+  unlink(path);
+  free(path);
+
+  if (q_disk_reset(disk) != 0) {
+    q_disk_free(disk);
+    return NULL;
+  }
+  return disk;
+}
+
+/**
+ * Create a compressed in-memory state in |0...0>
+ * @param qubits_num Number of qubits
+ * @param block_qubits log2 of the amplitudes per block (<= 0 for
+ *        QCS_ZIP_BLOCK_QUBITS), capped at qubits_num
+ * @param error_bound Largest change allowed per real or imaginary part at
+ *        each store (0 for lossless blocks)
+ * @return Compressed state, or NULL on failure
+ */
+struct t_q_disk *q_disk_init_compressed(int qubits_num, int block_qubits,
+                                        double error_bound) {
+  struct t_q_disk *disk;
+
+  disk = q_disk_alloc(qubits_num, block_qubits, QCS_ZIP_BLOCK_QUBITS);
+  if (disk == NULL)
+    return NULL;
+  disk->zip = q_zip_init(disk->chunks, disk->chunk_size, error_bound);
+  if (disk->zip == NULL || q_disk_reset(disk) != 0) {
+    fprintf(stderr, "Error: Could not allocate compressed state\n");
+    q_disk_free(disk);
+    return NULL;
+  }
+  return disk;
+}
+
+/**
+ * Free an out-of-core state and its scratch file
+ * @param disk Out-of-core state (may be NULL)
+ */
+void q_disk_free(struct t_q_disk *disk) {
+  if (disk == NULL)
+    return;
+  if (disk->fd >= 0)
+    close(disk->fd);
+  q_zip_free(disk->zip);
+  free(disk->pending);
+  free(disk);
+}
+
+/**
+ * Allocate a buffer view of one group of chunks
+ * @param disk Out-of-core state
+ * @param num_high Number of high qubits merged into the view
+ * @param view Output state view over the buffer
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_disk_view_alloc(const struct t_q_disk *disk, int num_high,
+                             struct t_q_state *view) {
+  view->qubits_num = disk->chunk_qubits + num_high;
+  view->size = disk->chunk_size << num_high;
+  view->scratch_vector = NULL;
+  view->file_vector = NULL;
+  view->vector =
+      q_alloc_vector(view->size, q_alloc_get_policy(), &view->alloc_policy);
+  return view->vector == NULL ? -1 : 0;
+}
+
+/**
+ * Chunk holding one member of a group
+ * @param ctx Pass context
+ * @param group Group index (the chunk bits outside the pass's high qubits)
+ * @param member Member index (bit k is high qubit ctx->high[k])
+ * @return Chunk index
+ */
+static long q_disk_group_chunk(const struct t_disk_pass_ctx *ctx, long group,
+                               long member) {
+  long chunk = group;
+  int k;
+
+  /* high qubits ascend, so each insertion leaves the lower ones in place */
+  for (k = 0; k < ctx->num_high; k++) {
+    int bit = ctx->high[k] - ctx->disk->chunk_qubits;
+    chunk = ((chunk >> bit) << (bit + 1)) | (chunk & ((1L << bit) - 1));
+  }
+  for (k = 0; k < ctx->num_high; k++) {
+    if ((member >> k) & 1)
+      chunk |= 1L << (ctx->high[k] - ctx->disk->chunk_qubits);
+  }
+  return chunk;
+}
+
+/**
+ * Qubit of a group buffer standing for a qubit of the full state
+ * @param ctx Pass context
+ * @param qubit Qubit of the full state (low, or one of the pass's high)
+ * @return Qubit of the group buffer
+ */
+static int q_disk_local_qubit(const struct t_disk_pass_ctx *ctx, int qubit) {
+  int k;
+
+  if (qubit < ctx->disk->chunk_qubits)
+    return qubit;
+  for (k = 0; ctx->high[k] != qubit; k++)
+    ;
+  return ctx->disk->chunk_qubits + k;
+}
+
+/**
+ * Parallel body running a pass over a range of groups
+ * @param context Pass context
+ * @param start First group
+ * @param end One past the last group
+ */
+static void q_disk_pass_body(void *context, long start, long end) {
+  struct t_disk_pass_ctx *ctx = (struct t_disk_pass_ctx *)context;
+  struct t_q_disk *disk = ctx->disk;
+  long members = 1L << ctx->num_high;
+  struct t_q_state view;
+  struct t_q_matrix matrix;
+  unsigned char *scratch = NULL;
+  long g, m;
+  int i;
+
+  if (disk->zip != NULL) {
+    scratch = (unsigned char *)malloc(q_zip_scratch_size(disk->zip));
+    if (scratch == NULL) {
+      ctx->failed = 1;
+      return;
+    }
+  }
+  if (q_disk_view_alloc(disk, ctx->num_high, &view) != 0) {
+    free(scratch);
+    ctx->failed = 1;
+    return;
+  }
+  matrix.rows = 2;
+  matrix.cols = 2;
+
+  for (m = 0; m < members; m++)
+    q_disk_read_ahead(disk, q_disk_group_chunk(ctx, start, m));
+
+  for (g = start; g < end && !ctx->failed; g++) {
+    for (m = 0; m < members; m++) {
+      if (g + 1 < end)
+        q_disk_read_ahead(disk, q_disk_group_chunk(ctx, g + 1, m));
+      if (q_disk_transfer(disk, view.vector + m * disk->chunk_size,
+                          disk->chunk_size,
+                          q_disk_group_chunk(ctx, g, m) * disk->chunk_size,
+                          0) != 0)
+        ctx->failed = 1;
+    }
+    if (ctx->failed)
+      break;
+
+    for (i = 0; i < ctx->num_gates; i++) {
+      const struct t_q_disk_gate *gate = &ctx->gates[i];
+
+      matrix.data = ctx->gates[i].data;
+      if (gate->control >= 0)
+        q_apply_2q_gate_serial(&view, &matrix,
+                               q_disk_local_qubit(ctx, gate->control),
+                               q_disk_local_qubit(ctx, gate->target));
+      else
+        q_apply_1q_gate_serial(&view, &matrix,
+                               q_disk_local_qubit(ctx, gate->target));
+    }
+
+    for (m = 0; m < members; m++) {
+      struct t_complex *amps = view.vector + m * disk->chunk_size;
+      long chunk = q_disk_group_chunk(ctx, g, m);
+
+      if ((disk->zip != NULL
+               ? q_zip_store(disk->zip, chunk, amps, scratch)
+               : q_disk_transfer(disk, amps, disk->chunk_size,
+                                 chunk * disk->chunk_size, 1)) != 0)
+        ctx->failed = 1;
+    }
+  }
+
+  q_alloc_free(view.vector, view.size);
+  free(scratch);
+}
+
+/**
+ * Add a gate's high qubits to the high qubits of a pass
+ * @param disk Out-of-core state
+ * @param gate Queued gate
+ * @param high High qubits of the pass, kept ascending, updated
+ * @param num_high Number of high qubits, updated
+ * @return 0 if the gate fits in the pass, -1 if it would need too many
+ */
+static int q_disk_pass_add(const struct t_q_disk *disk,
+                           const struct t_q_disk_gate *gate, int *high,
+                           int *num_high) {
+  int qubits[2];
+  int merged[QCS_DISK_PASS_HIGH + 2];
+  int count = *num_high;
+  int i, j, k;
+
+  qubits[0] = gate->target;
+  qubits[1] = gate->control;
+  memcpy(merged, high, *num_high * sizeof(int));
+  for (i = 0; i < 2; i++) {
+    if (qubits[i] < disk->chunk_qubits)
+      continue;
+    for (j = 0; j < count && merged[j] < qubits[i]; j++)
+      ;
+    if (j < count && merged[j] == qubits[i])
+      continue;
+    for (k = count; k > j; k--)
+      merged[k] = merged[k - 1];
+    merged[j] = qubits[i];
+    count++;
+  }
+  if (count > QCS_DISK_PASS_HIGH)
+    return -1;
+  memcpy(high, merged, count * sizeof(int));
+  *num_high = count;
+  return 0;
+}
+
+/**
+ * Apply every queued gate to the file, a pass per run of gates
+ * @param disk Out-of-core state
+ * @return 0 on success, -1 on an I/O or allocation error (the queue is
+ *         dropped either way)
+ */
+int q_disk_flush(struct t_q_disk *disk) {
+  struct t_disk_pass_ctx ctx;
+  int first = 0;
+
+  ctx.disk = disk;
+  while (first < disk->num_pending) {
+    int last = first;
+
+    ctx.num_high = 0;
+    while (last < disk->num_pending &&
+           q_disk_pass_add(disk, &disk->pending[last], ctx.high,
+                           &ctx.num_high) == 0)
+      last++;
+
+    ctx.gates = disk->pending + first;
+    ctx.num_gates = last - first;
+    ctx.failed = 0;
+    q_parallel_for(disk->chunks >> ctx.num_high, 1, q_disk_pass_body, &ctx);
+    if (disk->zip != NULL)
+      q_zip_end_pass(disk->zip);
+    if (ctx.failed) {
+      fprintf(stderr, "Error: Out-of-core gate pass failed\n");
+      disk->num_pending = 0;
+      return -1;
+    }
+    first = last;
+  }
+  disk->num_pending = 0;
+  return 0;
+}
+
+/**
+ * Queue a gate for the next pass
+ * @param disk Out-of-core state
+ * @param data 2x2 matrix entries
+ * @param control Control qubit, or -1 for an uncontrolled gate
+ * @param target Target qubit
+ * @return 0 on success, -1 on failure
+ */
+static int q_disk_queue(struct t_q_disk *disk, const struct t_complex *data,
+                        int control, int target) {
+  struct t_q_disk_gate *gate;
+
+  if (disk->num_pending == DISK_MAX_PENDING && q_disk_flush(disk) != 0)
+    return -1;
+  if (disk->num_pending == disk->pending_capacity) {
+    int capacity = disk->pending_capacity ? 2 * disk->pending_capacity : 64;
+    struct t_q_disk_gate *pending = (struct t_q_disk_gate *)realloc(
+        disk->pending, capacity * sizeof(struct t_q_disk_gate));
+    if (pending == NULL) {
+      fprintf(stderr, "Error: Could not grow the out-of-core gate queue\n");
+      return -1;
+    }
+    disk->pending = pending;
+    disk->pending_capacity = capacity;
+  }
+
+  gate = &disk->pending[disk->num_pending++];
+  memcpy(gate->data, data, 4 * sizeof(struct t_complex));
+  gate->control = control;
+  gate->target = target;
+  return 0;
+}
+
+/**
+ * Queue a 1-qubit gate
+ * @param disk Out-of-core state
+ * @param gate 2x2 gate matrix
+ * @param target_qubit Target qubit index
+ * @return 0 on success, -1 on failure
+ */
+int q_disk_apply_1q_gate(struct t_q_disk *disk, const struct t_q_matrix *gate,
+                         int target_qubit) {
+  return q_disk_queue(disk, gate->data, -1, target_qubit);
+}
+
+/**
+ * Queue a controlled 1-qubit gate
+ * @param disk Out-of-core state
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control_qubit Control qubit index
+ * @param target_qubit Target qubit index
+ * @return 0 on success, -1 on failure
+ */
+int q_disk_apply_2q_gate(struct t_q_disk *disk, const struct t_q_matrix *gate,
+                         int control_qubit, int target_qubit) {
+  return q_disk_queue(disk, gate->data, control_qubit, target_qubit);
+}
+
+/**
+ * Read one chunk into a view, asking for the next one ahead
+ * @param disk Out-of-core state
+ * @param chunk Chunk index
+ * @param view Chunk-sized view
+ * @return 0 on success, -1 on an I/O error
+ */
+static int q_disk_read_chunk(const struct t_q_disk *disk, long chunk,
+                             struct t_q_state *view) {
+  if (chunk + 1 < disk->chunks)
+    q_disk_read_ahead(disk, chunk + 1);
+  return q_disk_transfer(disk, view->vector, disk->chunk_size,
+                         chunk * disk->chunk_size, 0);
+}
+
+/**
+ * Read a run of amplitudes after applying the queued gates
+ * @param disk Out-of-core state
+ * @param buffer Output amplitudes
+ * @param count Number of amplitudes
+ * @param index Basis index of the first amplitude
+ * @return 0 on success, -1 on failure
+ */
+int q_disk_read(struct t_q_disk *disk, struct t_complex *buffer,
+                t_q_index count, t_q_index index) {
+  if (q_disk_flush(disk) != 0)
+    return -1;
+  return q_disk_transfer(disk, buffer, count, index, 0);
+}
+
+/**
+ * Amplitude of one basis state
+ * @param disk Out-of-core state
+ * @param index Basis state index
+ * @return Amplitude (zero on an I/O error)
+ */
+struct t_complex q_disk_get(struct t_q_disk *disk, t_q_index index) {
+  struct t_complex amp;
+
+  if (q_disk_read(disk, &amp, 1, index) != 0)
+    amp.number_real = amp.number_imaginary = 0.0;
+  return amp;
+}
+
+/**
+ * Probability distribution over a subset of qubits, streamed chunk by chunk
+ * @param disk Out-of-core state
+ * @param qubits Distinct qubits; bit j of an outcome is qubit qubits[j]
+ * @param k Number of qubits (at most 30)
+ * @param out Output array of 2^k probabilities
+ * @return 0 on success, -1 on failure
+ */
+int q_disk_marginal(struct t_q_disk *disk, const int *qubits, int k,
+                    double *out) {
+  int low[30], slots[30];
+  int num_low = 0;
+  struct t_q_state view;
+  double *local;
+  long chunk, l;
+  int j, status = 0;
+
+  if (q_disk_flush(disk) != 0)
+    return -1;
+  for (j = 0; j < k; j++) {
+    if (qubits[j] < disk->chunk_qubits) {
+      low[num_low] = qubits[j];
+      slots[num_low++] = j;
+    }
+  }
+
+  local = (double *)malloc((1L << num_low) * sizeof(double));
+  if (local == NULL || q_disk_view_alloc(disk, 0, &view) != 0) {
+    free(local);
+    return -1;
+  }
+  memset(out, 0, (1L << k) * sizeof(double));
+
+  for (chunk = 0; chunk < disk->chunks && status == 0; chunk++) {
+    long base = 0;
+
+    if (q_disk_read_chunk(disk, chunk, &view) != 0 ||
+        q_state_marginal(&view, low, num_low, local) != 0) {
+      status = -1;
+      break;
+    }
+    /* high qubits are fixed across a chunk */
+    for (j = 0; j < k; j++) {
+      if (qubits[j] >= disk->chunk_qubits &&
+          ((chunk >> (qubits[j] - disk->chunk_qubits)) & 1))
+        base |= 1L << j;
+    }
+    for (l = 0; l < (1L << num_low); l++) {
+      long outcome = base;
+      int i;
+
+      for (i = 0; i < num_low; i++) {
+        if ((l >> i) & 1)
+          outcome |= 1L << slots[i];
+      }
+      out[outcome] += local[l];
+    }
+  }
+
+  q_alloc_free(view.vector, view.size);
+  free(local);
+  return status;
+}
+
+/**
+ * The k most likely basis states, streamed chunk by chunk
+ * @param disk Out-of-core state
+ * @param k Number of states wanted
+ * @param indices Output basis indices, most likely first (k entries)
+ * @param probs Output probabilities (k entries)
+ * @return Number of states written (zero-probability states are skipped),
+ *         or -1 on failure
+ */
+long q_disk_top_k(struct t_q_disk *disk, long k, t_q_index *indices,
+                  double *probs) {
+  struct t_q_state view;
+  t_q_index *chunk_indices;
+  double *chunk_probs;
+  long size = 0, found, chunk, i;
+
+  if (k > disk->size)
+    k = disk->size;
+  if (k <= 0)
+    return 0;
+  if (q_disk_flush(disk) != 0)
+    return -1;
+
+  found = k < disk->chunk_size ? k : disk->chunk_size;
+  chunk_indices = (t_q_index *)malloc(found * sizeof(t_q_index));
+  chunk_probs = (double *)malloc(found * sizeof(double));
+  if (chunk_indices == NULL || chunk_probs == NULL ||
+      q_disk_view_alloc(disk, 0, &view) != 0) {
+    free(chunk_indices);
+    free(chunk_probs);
+    return -1;
+  }
+
+  for (chunk = 0; chunk < disk->chunks; chunk++) {
+    if (q_disk_read_chunk(disk, chunk, &view) != 0) {
+      size = -1;
+      break;
+    }
+    found = q_state_top_k(&view, k, chunk_indices, chunk_probs);
+    if (found < 0) {
+      size = -1;
+      break;
+    }
+    for (i = 0; i < found; i++)
+      q_top_k_offer(probs, indices, &size, k, chunk_probs[i],
+                    chunk * disk->chunk_size + chunk_indices[i]);
+  }
+  if (size > 0)
+    q_top_k_sort(probs, indices, size);
+
+  q_alloc_free(view.vector, view.size);
+  free(chunk_indices);
+  free(chunk_probs);
+  return size;
+}
+
+/**
+ * Measure one qubit; the collapse is queued as a scaled projector
+ * @param disk Out-of-core state
+ * @param qubit Qubit to measure
+ * @param random_val Uniform random value in [0, 1)
+ * @return Measured value (0 or 1), or -1 on failure
+ */
+int q_disk_measure(struct t_q_disk *disk, int qubit, double random_val) {
+  struct t_complex projector[4];
+  double p[2], kept;
+  int outcome;
+
+  if (q_disk_marginal(disk, &qubit, 1, p) != 0)
+    return -1;
+
+  /* relative to the actual norm, so a drifted state still renormalizes */
+  outcome = random_val * (p[0] + p[1]) < p[0] ? 0 : 1;
+  if (p[outcome] <= 0.0)
+    outcome = 1 - outcome;
+  kept = p[outcome];
+
+  memset(projector, 0, sizeof(projector));
+  projector[outcome ? 3 : 0].number_real = kept > 0.0 ? 1.0 / sqrt(kept) : 0.0;
+  if (q_disk_queue(disk, projector, -1, qubit) != 0)
+    return -1;
+  return outcome;
+}
+
+/**
+ * Measure every qubit and collapse the state to the outcome
+ * @param disk Out-of-core state
+ * @param random_val Uniform random value in [0, 1)
+ * @return Measured basis index, or -1 on failure
+ */
+t_q_index q_disk_measure_all(struct t_q_disk *disk, double random_val) {
+  struct t_q_state view;
+  struct t_complex kept;
+  double *masses;
+  double total = 0.0, target, half[2];
+  int qubit = 0;
+  long chunk, last = -1;
+  t_q_index index;
+
+  if (q_disk_flush(disk) != 0)
+    return -1;
+  masses = (double *)malloc(disk->chunks * sizeof(double));
+  if (masses == NULL || q_disk_view_alloc(disk, 0, &view) != 0) {
+    free(masses);
+    return -1;
+  }
+
+  for (chunk = 0; chunk < disk->chunks; chunk++) {
+    if (q_disk_read_chunk(disk, chunk, &view) != 0 ||
+        q_state_marginal(&view, &qubit, 1, half) != 0) {
+      q_alloc_free(view.vector, view.size);
+      free(masses);
+      return -1;
+    }
+    masses[chunk] = half[0] + half[1];
+    total += masses[chunk];
+  }
+
+  /* chunk holding the target; rounding past the end falls back to the last
+     chunk with nonzero probability */
+  target = random_val * total;
+  for (chunk = 0; chunk < disk->chunks; chunk++) {
+    if (masses[chunk] <= 0.0)
+      continue;
+    last = chunk;
+    if (target < masses[chunk])
+      break;
+    target -= masses[chunk];
+  }
+  if (chunk == disk->chunks)
+    chunk = last >= 0 ? last : 0;
+
+  index = -1;
+  if (q_disk_read_chunk(disk, chunk, &view) == 0) {
+    double local = masses[chunk] > 0.0 ? target / masses[chunk] : 0.0;
+
+    index = q_state_measure_all(&view, local < 1.0 ? local : 0.0);
+    kept = view.vector[index];
+    index += chunk * disk->chunk_size;
+    if (q_disk_reset(disk) != 0 ||
+        q_disk_transfer(disk, &kept, 1, index, 1) != 0)
+      index = -1;
+  }
+
+  q_alloc_free(view.vector, view.size);
+  free(masses);
+  return index;
+}
+
+/**
+ * Print the first and last amplitudes of an out-of-core state
+ * @param disk Out-of-core state
+ * @param solution_index Index to highlight (or -1 for none)
+ */
+void q_disk_print(struct t_q_disk *disk, t_q_index solution_index) {
+  t_q_index max_print = disk->size > 8 ? 4 : disk->size;
+  t_q_index i;
+  struct t_complex amp;
+
+  printf("--- %s Quantum State (%d Qubits, %ld chunks) ---\n",
+         disk->zip != NULL ? "Compressed" : "Out-of-core", disk->qubits_num,
+         disk->chunks);
+
+  for (i = 0; i < max_print; i++) {
+    amp = q_disk_get(disk, i);
+    printf("|%ld>: %f + i%f%s\n", i, amp.number_real, amp.number_imaginary,
+           i == solution_index ? " <-- SOLUTION" : "");
+  }
+
+  if (solution_index >= max_print && solution_index < disk->size - 1) {
+    amp = q_disk_get(disk, solution_index);
+    printf("...\n");
+    printf("|%ld>: %f + i%f <-- SOLUTION\n", solution_index, amp.number_real,
+           amp.number_imaginary);
+  }
+
+  if (disk->size > max_print) {
+    amp = q_disk_get(disk, disk->size - 1);
+    printf("...\n");
+    printf("|%ld>: %f + i%f%s\n", disk->size - 1, amp.number_real,
+           amp.number_imaginary,
+           disk->size - 1 == solution_index ? " <-- SOLUTION" : "");
+  }
+
+  printf("----------------------------------\n");
+}
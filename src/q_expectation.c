@@ -0,0 +1,499 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#define SIMD_AVAILABLE 1
+#else
+#define SIMD_AVAILABLE 0
+#endif
+
+#define EXPECTATION_GRAIN 1
+
+/*
+ * For a Pauli string P with X/Y positions in flip_mask and Y/Z positions in
+ * z_mask, P|i> = i^y_count (-1)^popcount(i & z_mask) |i ^ flip_mask>, so
+ *
+ *   <psi|P|psi> = i^y_count * sum_i conj(psi[i ^ flip]) psi[i] (-1)^parity(i & z)
+ *
+ * The sum is real once multiplied by i^y_count, so only its real part (even
+ * y_count) or imaginary part (odd y_count) has to be accumulated.
+ */
+
+struct t_pauli_ctx {
+  const struct t_complex *vector;
+  long size;
+  long flip_mask;
+  long z_mask;
+  int imaginary;
+  long blocks;
+  double *partials;
+};
+
+/**
+ * Parity of the set bits of a mask
+ * @param x Bit mask
+ * @return 1 if an odd number of bits are set, 0 otherwise
+ */
+static int q_parity(long x) { return __builtin_parityl((unsigned long)x); }
+
+/**
+ * Signed overlap sum conj(psi[i ^ flip]) psi[i] over one index range
+ * @param ctx Pauli context
+ * @param start First index (even)
+ * @param end One past the last index
+ * @return Real or imaginary part of the range sum, per ctx->imaginary
+ */
+static double q_pauli_range_sum(const struct t_pauli_ctx *ctx, long start,
+                                long end) {
+  const struct t_complex *v = ctx->vector;
+  long flip = ctx->flip_mask;
+  long z = ctx->z_mask;
+  double sum = 0.0;
+  long i = start;
+
+#if SIMD_AVAILABLE
+  {
+    __m256d acc = _mm256_setzero_pd();
+    __m256d lane_sign = ctx->imaginary ? _mm256_setr_pd(1.0, -1.0, 1.0, -1.0)
+                                       : _mm256_set1_pd(1.0);
+    double pair_sign = (z & 1L) ? -1.0 : 1.0;
+    double buf[4];
+
+    for (; i + 1 < end; i += 2) {
+      __m256d a = _mm256_loadu_pd((const double *)&v[i]);
+      __m256d b = _mm256_loadu_pd((const double *)&v[(i ^ flip) & ~1L]);
+      __m256d prod;
+      double s0 = q_parity(i & z) ? -1.0 : 1.0;
+
+      if (flip & 1L)
+        b = _mm256_permute2f128_pd(b, b, 1);
+      if (ctx->imaginary)
+        a = _mm256_permute_pd(a, 0x5);
+
+      prod = _mm256_mul_pd(_mm256_mul_pd(a, b), lane_sign);
+      acc = _mm256_add_pd(
+          acc, _mm256_mul_pd(prod, _mm256_setr_pd(s0, s0, s0 * pair_sign,
+                                                  s0 * pair_sign)));
+    }
+
+    _mm256_storeu_pd(buf, acc);
+    sum = (buf[0] + buf[1]) + (buf[2] + buf[3]);
+  }
+#endif
+
+  for (; i < end; i++) {
+    struct t_complex a = v[i];
+    struct t_complex b = v[i ^ flip];
+    double term = ctx->imaginary
+                      ? (b.number_real * a.number_imaginary -
+                         b.number_imaginary * a.number_real)
+                      : (b.number_real * a.number_real +
+                         b.number_imaginary * a.number_imaginary);
+    sum += q_parity(i & z) ? -term : term;
+  }
+
+  return sum;
+}
+
+/**
+ * Parallel body reducing a contiguous run of fixed blocks
+ * @param context Pauli context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_pauli_block_body(void *context, long start, long end) {
+  struct t_pauli_ctx *ctx = (struct t_pauli_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    long lo, hi;
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    ctx->partials[b] = q_pauli_range_sum(ctx, lo, hi);
+  }
+}
+
+/**
+ * Expectation value of a Pauli string on a dense state, read-only.
+ * Partial sums are kept per fixed block and added in block order, so the
+ * result does not depend on the number of threads.
+ * @param state Quantum state
+ * @param flip_mask Qubits carrying X or Y
+ * @param z_mask Qubits carrying Y or Z
+ * @param y_count Number of Y factors
+ * @return <psi|P|psi>
+ */
+double q_state_expectation_pauli(const struct t_q_state *state, long flip_mask,
+                                 long z_mask, int y_count) {
+  struct t_pauli_ctx ctx;
+  double partials[QCS_REDUCE_BLOCKS];
+  double sum = 0.0;
+  long b;
+
+  ctx.vector = state->vector;
+  ctx.size = state->size;
+  ctx.flip_mask = flip_mask;
+  ctx.z_mask = z_mask;
+  ctx.imaginary = y_count & 1;
+  ctx.blocks = state->size / 2 < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+  ctx.partials = partials;
+
+  q_parallel_for(ctx.blocks, EXPECTATION_GRAIN, q_pauli_block_body, &ctx);
+
+  for (b = 0; b < ctx.blocks; b++)
+    sum += partials[b];
+
+  /* Re(i^k * S): S.re, -S.im, -S.re, S.im for k = 0..3 */
+  switch (y_count & 3) {
+  case 0:
+    return sum;
+  case 1:
+    return -sum;
+  case 2:
+    return -sum;
+  default:
+    return sum;
+  }
+}
+
+struct t_pauli_term {
+  long flip_mask;
+  long z_mask;
+  int y_count;
+  double coeff;
+};
+
+struct t_group_ctx {
+  const struct t_complex *vector;
+  long size;
+  long flip_mask;
+  const struct t_pauli_term *terms;
+  int count;
+  long blocks;
+  double *partials;
+};
+
+/**
+ * qsort comparator ordering terms by flip mask
+ * @param a First term
+ * @param b Second term
+ * @return Negative, zero or positive as for qsort
+ */
+static int q_compare_terms(const void *a, const void *b) {
+  long fa = ((const struct t_pauli_term *)a)->flip_mask;
+  long fb = ((const struct t_pauli_term *)b)->flip_mask;
+  return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Parallel body sweeping a run of blocks once for a whole group of terms.
+ * Every term of the group reads the same product conj(psi[i ^ flip]) psi[i];
+ * only the Z parity sign and the real/imaginary choice differ per term.
+ * @param context Group context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_group_block_body(void *context, long start, long end) {
+  struct t_group_ctx *ctx = (struct t_group_ctx *)context;
+  const struct t_complex *v = ctx->vector;
+  const struct t_pauli_term *terms = ctx->terms;
+  long flip = ctx->flip_mask;
+  int count = ctx->count;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double *acc = ctx->partials + b * count;
+    long lo, hi, i;
+    int t;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+
+    for (t = 0; t < count; t++)
+      acc[t] = 0.0;
+
+    for (i = lo; i < hi; i++) {
+      struct t_complex a = v[i];
+      struct t_complex c = v[i ^ flip];
+      double re = c.number_real * a.number_real +
+                  c.number_imaginary * a.number_imaginary;
+      double im = c.number_real * a.number_imaginary -
+                  c.number_imaginary * a.number_real;
+
+      for (t = 0; t < count; t++) {
+        double term = (terms[t].y_count & 1) ? im : re;
+        acc[t] += q_parity(i & terms[t].z_mask) ? -term : term;
+      }
+    }
+  }
+}
+
+/**
+ * Weighted sum of Pauli-string expectation values on a dense state.
+ * Terms are grouped by flip mask and each group is evaluated in a single
+ * read-only sweep; per-block partials are reduced in block order.
+ * @param state Quantum state
+ * @param flip_masks Per-term masks of qubits carrying X or Y
+ * @param z_masks Per-term masks of qubits carrying Y or Z
+ * @param y_counts Per-term number of Y factors
+ * @param coeffs Per-term real coefficients
+ * @param count Number of terms
+ * @return sum_k coeffs[k] <psi|P_k|psi>, or 0.0 on allocation failure
+ */
+double q_state_expectation_terms(const struct t_q_state *state,
+                                 const long *flip_masks, const long *z_masks,
+                                 const int *y_counts, const double *coeffs,
+                                 int count) {
+  struct t_pauli_term *terms;
+  struct t_group_ctx ctx;
+  double *partials;
+  double total = 0.0;
+  int first, last, t;
+  long b;
+
+  if (count <= 0)
+    return 0.0;
+
+  terms = (struct t_pauli_term *)malloc(count * sizeof(struct t_pauli_term));
+  if (terms == NULL)
+    return 0.0;
+
+  for (t = 0; t < count; t++) {
+    terms[t].flip_mask = flip_masks[t];
+    terms[t].z_mask = z_masks[t];
+    terms[t].y_count = y_counts[t];
+    terms[t].coeff = coeffs[t];
+  }
+  qsort(terms, count, sizeof(struct t_pauli_term), q_compare_terms);
+
+  ctx.vector = state->vector;
+  ctx.size = state->size;
+  ctx.blocks = state->size / 2 < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+
+  partials = (double *)malloc(ctx.blocks * count * sizeof(double));
+  if (partials == NULL) {
+    free(terms);
+    return 0.0;
+  }
+  ctx.partials = partials;
+
+  for (first = 0; first < count; first = last) {
+    for (last = first + 1;
+         last < count && terms[last].flip_mask == terms[first].flip_mask;
+         last++)
+      ;
+
+    ctx.flip_mask = terms[first].flip_mask;
+    ctx.terms = terms + first;
+    ctx.count = last - first;
+    q_parallel_for(ctx.blocks, EXPECTATION_GRAIN, q_group_block_body, &ctx);
+
+    for (t = 0; t < ctx.count; t++) {
+      double sum = 0.0;
+      for (b = 0; b < ctx.blocks; b++)
+        sum += partials[b * ctx.count + t];
+      /* Re(i^k * S), as in q_state_expectation_pauli */
+      if ((ctx.terms[t].y_count & 3) == 1 || (ctx.terms[t].y_count & 3) == 2)
+        sum = -sum;
+      total += ctx.terms[t].coeff * sum;
+    }
+  }
+
+  free(partials);
+  free(terms);
+  return total;
+}
+
+struct t_overlap_ctx {
+  const struct t_complex *bra;
+  const struct t_complex *ket;
+  long size;
+  long flip_mask;
+  long z_mask;
+  long blocks;
+  double *partials_real;
+  double *partials_imag;
+};
+
+/**
+ * Parallel body for q_state_pauli_overlap
+ * @param context Overlap context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_overlap_block_body(void *context, long start, long end) {
+  struct t_overlap_ctx *ctx = (struct t_overlap_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double re = 0.0, im = 0.0;
+    long lo, hi, i;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++) {
+      struct t_complex a = ctx->ket[i];
+      struct t_complex c = ctx->bra[i ^ ctx->flip_mask];
+      double sign = q_parity(i & ctx->z_mask) ? -1.0 : 1.0;
+
+      re += sign * (c.number_real * a.number_real +
+                    c.number_imaginary * a.number_imaginary);
+      im += sign * (c.number_real * a.number_imaginary -
+                    c.number_imaginary * a.number_real);
+    }
+    ctx->partials_real[b] = re;
+    ctx->partials_imag[b] = im;
+  }
+}
+
+/**
+ * Matrix element <bra|P|ket> of a Pauli string between two dense states
+ * @param bra Left state
+ * @param ket Right state
+ * @param flip_mask Qubits carrying X or Y
+ * @param z_mask Qubits carrying Y or Z
+ * @param y_count Number of Y factors
+ * @return Complex overlap
+ */
+struct t_complex q_state_pauli_overlap(const struct t_q_state *bra,
+                                       const struct t_q_state *ket,
+                                       long flip_mask, long z_mask,
+                                       int y_count) {
+  struct t_overlap_ctx ctx;
+  double partials_real[QCS_REDUCE_BLOCKS];
+  double partials_imag[QCS_REDUCE_BLOCKS];
+  struct t_complex sum = c_zero();
+  struct t_complex result;
+  long b;
+
+  ctx.bra = bra->vector;
+  ctx.ket = ket->vector;
+  ctx.size = ket->size;
+  ctx.flip_mask = flip_mask;
+  ctx.z_mask = z_mask;
+  ctx.blocks = ket->size < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+  ctx.partials_real = partials_real;
+  ctx.partials_imag = partials_imag;
+
+  q_parallel_for(ctx.blocks, EXPECTATION_GRAIN, q_overlap_block_body, &ctx);
+
+  for (b = 0; b < ctx.blocks; b++) {
+    sum.number_real += partials_real[b];
+    sum.number_imaginary += partials_imag[b];
+  }
+
+  /* multiply by i^y_count */
+  switch (y_count & 3) {
+  case 0:
+    result = sum;
+    break;
+  case 1:
+    result.number_real = -sum.number_imaginary;
+    result.number_imaginary = sum.number_real;
+    break;
+  case 2:
+    result.number_real = -sum.number_real;
+    result.number_imaginary = -sum.number_imaginary;
+    break;
+  default:
+    result.number_real = sum.number_imaginary;
+    result.number_imaginary = -sum.number_real;
+    break;
+  }
+  return result;
+}
+
+struct t_pauli_sum_ctx {
+  const struct t_complex *in;
+  struct t_complex *out;
+  const long *flip_masks;
+  const long *z_masks;
+  const struct t_complex *factors;
+  int count;
+};
+
+/**
+ * Parallel body for q_state_apply_pauli_sum, gathering every term into each
+ * output amplitude so that workers never write the same index
+ * @param context Pauli sum context
+ * @param start First output index
+ * @param end One past the last output index
+ */
+static void q_pauli_sum_body(void *context, long start, long end) {
+  struct t_pauli_sum_ctx *ctx = (struct t_pauli_sum_ctx *)context;
+  long j;
+  int t;
+
+  for (j = start; j < end; j++) {
+    struct t_complex acc = c_zero();
+
+    for (t = 0; t < ctx->count; t++) {
+      long i = j ^ ctx->flip_masks[t];
+      struct t_complex term = c_mul(ctx->factors[t], ctx->in[i]);
+
+      if (q_parity(i & ctx->z_masks[t])) {
+        acc.number_real -= term.number_real;
+        acc.number_imaginary -= term.number_imaginary;
+      } else {
+        acc.number_real += term.number_real;
+        acc.number_imaginary += term.number_imaginary;
+      }
+    }
+    ctx->out[j] = acc;
+  }
+}
+
+/**
+ * Write out = sum_k coeffs[k] P_k in for a list of Pauli strings
+ * @param out Destination state (same size as in, not aliased)
+ * @param in Source state
+ * @param flip_masks Per-term masks of qubits carrying X or Y
+ * @param z_masks Per-term masks of qubits carrying Y or Z
+ * @param y_counts Per-term number of Y factors
+ * @param coeffs Per-term real coefficients
+ * @param count Number of terms
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_state_apply_pauli_sum(struct t_q_state *out, const struct t_q_state *in,
+                            const long *flip_masks, const long *z_masks,
+                            const int *y_counts, const double *coeffs,
+                            int count) {
+  struct t_pauli_sum_ctx ctx;
+  struct t_complex *factors;
+  int t;
+
+  factors = (struct t_complex *)malloc(count * sizeof(struct t_complex));
+  if (factors == NULL)
+    return -1;
+
+  /* coeff * i^y_count */
+  for (t = 0; t < count; t++) {
+    factors[t] = c_zero();
+    switch (y_counts[t] & 3) {
+    case 0:
+      factors[t].number_real = coeffs[t];
+      break;
+    case 1:
+      factors[t].number_imaginary = coeffs[t];
+      break;
+    case 2:
+      factors[t].number_real = -coeffs[t];
+      break;
+    default:
+      factors[t].number_imaginary = -coeffs[t];
+      break;
+    }
+  }
+
+  ctx.in = in->vector;
+  ctx.out = out->vector;
+  ctx.flip_masks = flip_masks;
+  ctx.z_masks = z_masks;
+  ctx.factors = factors;
+  ctx.count = count;
+  q_parallel_for(in->size, QCS_REDUCE_BLOCKS, q_pauli_sum_body, &ctx);
+
+  free(factors);
+  return 0;
+}
@@ -5,6 +5,8 @@
 
 #include "internal.h"
 
+#define Q_GATE_MAPPED_GRAIN 4096 /* amplitude pairs per mapped-gate task */
+
 #ifdef QCS_MULTI_THREAD
 static void q_apply_1q_gate_worker(void *arg);
 static void q_apply_2q_gate_worker(void *arg);
@@ -35,11 +37,12 @@ void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
     return;
   }
 
+  /* the pair loops write every scratch amplitude, so scratch is not copied
+     first; on a fresh state the workers are also the first to touch it */
+
   #ifdef QCS_GPU_OPENCL
     q_apply_1q_gate_gpu(state, gate, target_qubit);
   #elif defined(QCS_CPU_OPENMP)
-    c_copy_simd(state->scratch_vector, state->vector, size);
-    
     #ifdef _OPENMP
     #pragma omp parallel for
     for (i = 0; i < size; i += block_size) {
@@ -83,8 +86,6 @@ void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
     }
     
   #elif defined(QCS_SIMD_ONLY)
-    c_copy_simd(state->scratch_vector, state->vector, size);
-    
     for (i = 0; i < size; i += block_size) {
         for (j = i; j < i + step; j++) {
             long index0 = j;
@@ -100,11 +101,13 @@ void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
   #elif defined(QCS_MULTI_THREAD)
     extern thread_pool_t *pool;
     
-    memcpy(state->scratch_vector, state->vector, size * sizeof(struct t_complex));
-
-    int effective_threads = (pool->num_threads > 4) ? 4 : pool->num_threads;
+    int effective_threads = (pool->num_threads > QCS_POOL_MAX_THREADS)
+                                ? QCS_POOL_MAX_THREADS
+                                : pool->num_threads;
     long num_blocks = size / block_size;
     long blocks_per_thread = (num_blocks + effective_threads - 1) / effective_threads;
+    /* one cache-aligned slot per task, alive until thread_pool_wait returns */
+    struct t_thread_args slots[QCS_POOL_MAX_THREADS];
     int k;
 
     for (k = 0; k < effective_threads; k++) {
@@ -114,8 +117,7 @@ void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
         
         if (start_block >= end_block) break;
 
-        struct t_thread_args *args = malloc(sizeof(struct t_thread_args));
-        if (!args) exit(EXIT_FAILURE);
+        struct t_thread_args *args = &slots[k];
 
         args->start = start_block * block_size;
         args->end = end_block * block_size;
@@ -128,8 +130,6 @@ void q_apply_1q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
     thread_pool_wait(pool);
     
   #else
-    memcpy(state->scratch_vector, state->vector, size * sizeof(struct t_complex));
-
     for (i = 0; i < size; i += block_size) {
         for (j = i; j < i + step; j++) {
             long index0 = j;
@@ -169,11 +169,12 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
     return;
   }
 
+  /* amplitudes with the control clear are copied inside the loops, so
+     scratch is not copied first */
+
   #ifdef QCS_GPU_OPENCL
     q_apply_2q_gate_gpu(state, gate, control_qubit, target_qubit);
   #elif defined(QCS_CPU_OPENMP)
-    c_copy_simd(state->scratch_vector, state->vector, size);
-    
     #ifdef _OPENMP
     #pragma omp parallel for
     for (i = 0; i < size; i++) {
@@ -186,7 +187,7 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
 
             state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
             state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-        } else {
+        } else if ((i & c_bit) == 0) {
             state->scratch_vector[i] = state->vector[i];
         }
     }
@@ -201,7 +202,7 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
 
             state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
             state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-        } else {
+        } else if ((i & c_bit) == 0) {
             state->scratch_vector[i] = state->vector[i];
         }
     }
@@ -220,14 +221,12 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
 
             state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
             state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-        } else {
+        } else if ((i & c_bit) == 0) {
             state->scratch_vector[i] = state->vector[i];
         }
     }
     
   #elif defined(QCS_SIMD_ONLY)
-    c_copy_simd(state->scratch_vector, state->vector, size);
-    
     for (i = 0; i < size; i++) {
         if ((i & c_bit) != 0 && (i & t_bit) == 0) {
             long index0 = i;
@@ -238,7 +237,7 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
 
             state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
             state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-        } else {
+        } else if ((i & c_bit) == 0) {
             state->scratch_vector[i] = state->vector[i];
         }
     }
@@ -246,10 +245,11 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
   #elif defined(QCS_MULTI_THREAD)
     extern thread_pool_t *pool;
     
-    memcpy(state->scratch_vector, state->vector, size * sizeof(struct t_complex));
-
-    int effective_threads = (pool->num_threads > 4) ? 4 : pool->num_threads;
+    int effective_threads = (pool->num_threads > QCS_POOL_MAX_THREADS)
+                                ? QCS_POOL_MAX_THREADS
+                                : pool->num_threads;
     long work_per_thread = (size + effective_threads - 1) / effective_threads;
+    struct t_thread_args slots[QCS_POOL_MAX_THREADS];
     int k;
 
     for (k = 0; k < effective_threads; k++) {
@@ -259,8 +259,7 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
         
         if (start >= end) break;
 
-        struct t_thread_args *args = malloc(sizeof(struct t_thread_args));
-        if (!args) exit(EXIT_FAILURE);
+        struct t_thread_args *args = &slots[k];
 
         args->start = start;
         args->end = end;
@@ -274,8 +273,6 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
     thread_pool_wait(pool);
     
   #else
-    memcpy(state->scratch_vector, state->vector, size * sizeof(struct t_complex));
-
     for (i = 0; i < size; i++) {
         if ((i & c_bit) != 0 && (i & t_bit) == 0) {
             long index0 = i;
@@ -286,7 +283,7 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
 
             state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
             state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-        } else {
+        } else if ((i & c_bit) == 0) {
             state->scratch_vector[i] = state->vector[i];
         }
     }
@@ -297,12 +294,170 @@ void q_apply_2q_gate(struct t_q_state *state, const struct t_q_matrix *gate,
   state->scratch_vector = temp;
 }
 
+/**
+ * Apply a 1-qubit gate in place on the calling thread, without the scratch
+ * vector or the thread pool. Meant for callers that already run on a worker,
+ * such as batched parameter sweeps with one state per worker.
+ * @param state Quantum state vector
+ * @param gate 2x2 gate matrix
+ * @param target_qubit Target qubit index
+ */
+void q_apply_1q_gate_serial(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int target_qubit) {
+  long size = state->size;
+  long step = 1L << target_qubit;
+  long block_size = step << 1;
+  struct t_complex g0 = gate->data[0], g1 = gate->data[1];
+  struct t_complex g2 = gate->data[2], g3 = gate->data[3];
+  long i, j;
+
+  for (i = 0; i < size; i += block_size) {
+    for (j = i; j < i + step; j++) {
+      struct t_complex v0 = state->vector[j];
+      struct t_complex v1 = state->vector[j + step];
+
+      state->vector[j] = c_add(c_mul(g0, v0), c_mul(g1, v1));
+      state->vector[j + step] = c_add(c_mul(g2, v0), c_mul(g3, v1));
+    }
+  }
+}
+
+/**
+ * Apply a controlled 1-qubit gate in place on the calling thread
+ * @param state Quantum state vector
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control_qubit Control qubit index
+ * @param target_qubit Target qubit index
+ */
+void q_apply_2q_gate_serial(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit) {
+  long size = state->size;
+  long c_bit = 1L << control_qubit;
+  long t_bit = 1L << target_qubit;
+  struct t_complex g0 = gate->data[0], g1 = gate->data[1];
+  struct t_complex g2 = gate->data[2], g3 = gate->data[3];
+  long i;
+
+  for (i = c_bit; i < size; i = (i + 1) | c_bit) {
+    if ((i & t_bit) == 0) {
+      struct t_complex v0 = state->vector[i];
+      struct t_complex v1 = state->vector[i | t_bit];
+
+      state->vector[i] = c_add(c_mul(g0, v0), c_mul(g1, v1));
+      state->vector[i | t_bit] = c_add(c_mul(g2, v0), c_mul(g3, v1));
+    }
+  }
+}
+
+struct t_q_mapped_gate_ctx {
+  struct t_complex *vector;
+  const struct t_q_matrix *gate;
+  long c_bit; /* 0 for an uncontrolled gate */
+  long t_bit;
+};
+
+/**
+ * Spread a pair counter over basis indices by inserting a 0 bit
+ * @param p Counter
+ * @param bit Single-bit mask where the 0 goes
+ * @return p with a 0 inserted at bit
+ */
+static long q_mapped_insert_zero(long p, long bit) {
+  return ((p & ~(bit - 1)) << 1) | (p & (bit - 1));
+}
+
+/**
+ * Store an amplitude only if it changes, so an unchanged page is never
+ * written and stays shared
+ * @param slot Amplitude in the mapped vector
+ * @param value New value
+ */
+static void q_mapped_store(struct t_complex *slot, struct t_complex value) {
+  if (slot->number_real != value.number_real ||
+      slot->number_imaginary != value.number_imaginary)
+    *slot = value;
+}
+
+/**
+ * Parallel body applying a gate in place to a range of amplitude pairs
+ * @param context Mapped gate context
+ * @param start First pair
+ * @param end One past the last pair
+ */
+static void q_apply_mapped_body(void *context, long start, long end) {
+  const struct t_q_mapped_gate_ctx *ctx =
+      (const struct t_q_mapped_gate_ctx *)context;
+  const struct t_complex *g = ctx->gate->data;
+  long low = ctx->c_bit != 0 && ctx->c_bit < ctx->t_bit ? ctx->c_bit
+                                                        : ctx->t_bit;
+  long high = ctx->c_bit > ctx->t_bit ? ctx->c_bit : ctx->t_bit;
+  long p;
+
+  for (p = start; p < end; p++) {
+    long i0 = q_mapped_insert_zero(p, low);
+    long i1;
+    struct t_complex v0, v1;
+
+    if (ctx->c_bit != 0)
+      i0 = q_mapped_insert_zero(i0, high) | ctx->c_bit;
+    i1 = i0 | ctx->t_bit;
+    v0 = ctx->vector[i0];
+    v1 = ctx->vector[i1];
+    q_mapped_store(&ctx->vector[i0], c_add(c_mul(g[0], v0), c_mul(g[1], v1)));
+    q_mapped_store(&ctx->vector[i1], c_add(c_mul(g[2], v0), c_mul(g[3], v1)));
+  }
+}
+
+/**
+ * Apply a 1-qubit gate in place to a state that still reads its amplitudes
+ * through a copy-on-write mapping (a clone or a loaded state). Only
+ * amplitudes that change are stored, so the state copies just the pages the
+ * gate actually alters and the rest stay shared.
+ * @param state Quantum state with vector == file_vector
+ * @param gate 2x2 gate matrix
+ * @param target_qubit Target qubit index
+ */
+void q_apply_1q_gate_mapped(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int target_qubit) {
+  struct t_q_mapped_gate_ctx ctx;
+
+  ctx.vector = state->vector;
+  ctx.gate = gate;
+  ctx.c_bit = 0;
+  ctx.t_bit = 1L << target_qubit;
+  q_parallel_for(state->size >> 1, Q_GATE_MAPPED_GRAIN, q_apply_mapped_body,
+                 &ctx);
+}
+
+/**
+ * Apply a controlled 1-qubit gate in place to a state that still reads its
+ * amplitudes through a copy-on-write mapping; amplitudes with the control
+ * clear, and any the gate leaves unchanged, are never written
+ * @param state Quantum state with vector == file_vector
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control_qubit Control qubit index
+ * @param target_qubit Target qubit index
+ */
+void q_apply_2q_gate_mapped(struct t_q_state *state,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit) {
+  struct t_q_mapped_gate_ctx ctx;
+
+  ctx.vector = state->vector;
+  ctx.gate = gate;
+  ctx.c_bit = 1L << control_qubit;
+  ctx.t_bit = 1L << target_qubit;
+  q_parallel_for(state->size >> 2, Q_GATE_MAPPED_GRAIN, q_apply_mapped_body,
+                 &ctx);
+}
+
 /**
  * Apply phase flip to a specific quantum state
  * @param state Quantum state vector
  * @param index Index of state to flip
  */
-void q_apply_phase_flip(struct t_q_state *state, int index) {
+void q_apply_phase_flip(struct t_q_state *state, t_q_index index) {
   if (state == NULL || index < 0 || index >= state->size) {
     fprintf(stderr, "Error: Invalid state or index for phase flip.\n");
     return;
@@ -355,139 +510,181 @@ void q_apply_diffusion(struct t_q_state *state) {
   }
 }
 
+/* Constant gate tables, shared by every caller and never written */
+#define Q_GATE_ROOT2_INV 0.70710678118654752440
+
+static const struct t_complex q_gate_I_cells[4] = {
+    {1.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}, {1.0, 0.0}};
+static const struct t_complex q_gate_X_cells[4] = {
+    {0.0, 0.0}, {1.0, 0.0}, {1.0, 0.0}, {0.0, 0.0}};
+static const struct t_complex q_gate_Y_cells[4] = {
+    {0.0, 0.0}, {0.0, -1.0}, {0.0, 1.0}, {0.0, 0.0}};
+static const struct t_complex q_gate_Z_cells[4] = {
+    {1.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}, {-1.0, 0.0}};
+static const struct t_complex q_gate_H_cells[4] = {
+    {Q_GATE_ROOT2_INV, 0.0}, {Q_GATE_ROOT2_INV, 0.0},
+    {Q_GATE_ROOT2_INV, 0.0}, {-Q_GATE_ROOT2_INV, 0.0}};
+
+const struct t_q_matrix q_gate_table_I = {2, 2,
+                                          (struct t_complex *)q_gate_I_cells};
+const struct t_q_matrix q_gate_table_X = {2, 2,
+                                          (struct t_complex *)q_gate_X_cells};
+const struct t_q_matrix q_gate_table_Y = {2, 2,
+                                          (struct t_complex *)q_gate_Y_cells};
+const struct t_q_matrix q_gate_table_Z = {2, 2,
+                                          (struct t_complex *)q_gate_Z_cells};
+const struct t_q_matrix q_gate_table_H = {2, 2,
+                                          (struct t_complex *)q_gate_H_cells};
+
 /**
- * Create identity gate matrix
- * @return Identity gate matrix
+ * Point an inline gate's matrix at its own cells
+ * @param gate Inline gate
+ * @param a Top-left entry
+ * @param b Top-right entry
+ * @param c Bottom-left entry
+ * @param d Bottom-right entry
+ * @return The gate's matrix
+ */
+static const struct t_q_matrix *q_gate_set(struct t_q_gate *gate,
+                                           struct t_complex a,
+                                           struct t_complex b,
+                                           struct t_complex c,
+                                           struct t_complex d) {
+  gate->cells[0] = a;
+  gate->cells[1] = b;
+  gate->cells[2] = c;
+  gate->cells[3] = d;
+  gate->matrix.rows = 2;
+  gate->matrix.cols = 2;
+  gate->matrix.data = gate->cells;
+  return &gate->matrix;
+}
+
+/**
+ * Fill an inline phase gate diag(1, e^{i angle}); controlled, it is CPHASE
+ * @param gate Inline gate, typically on the caller's stack
+ * @param angle Phase angle in radians
+ * @return The gate's matrix, valid as long as the gate
+ */
+const struct t_q_matrix *q_gate_set_P(struct t_q_gate *gate, double angle) {
+  struct t_complex phase;
+
+  phase.number_real = cos(angle);
+  phase.number_imaginary = sin(angle);
+  return q_gate_set(gate, c_one(), c_zero(), c_zero(), phase);
+}
+
+/**
+ * Fill an inline RX gate
+ * @param gate Inline gate, typically on the caller's stack
+ * @param angle Rotation angle in radians
+ * @return The gate's matrix, valid as long as the gate
+ */
+const struct t_q_matrix *q_gate_set_RX(struct t_q_gate *gate, double angle) {
+  struct t_complex c = c_from_real(cos(angle / 2.0));
+  struct t_complex s = c_zero();
+
+  s.number_imaginary = -sin(angle / 2.0);
+  return q_gate_set(gate, c, s, s, c);
+}
+
+/**
+ * Fill an inline RY gate
+ * @param gate Inline gate, typically on the caller's stack
+ * @param angle Rotation angle in radians
+ * @return The gate's matrix, valid as long as the gate
+ */
+const struct t_q_matrix *q_gate_set_RY(struct t_q_gate *gate, double angle) {
+  double sin_half = sin(angle / 2.0);
+  struct t_complex c = c_from_real(cos(angle / 2.0));
+
+  return q_gate_set(gate, c, c_from_real(-sin_half), c_from_real(sin_half), c);
+}
+
+/**
+ * Fill an inline RZ gate
+ * @param gate Inline gate, typically on the caller's stack
+ * @param angle Rotation angle in radians
+ * @return The gate's matrix, valid as long as the gate
+ */
+const struct t_q_matrix *q_gate_set_RZ(struct t_q_gate *gate, double angle) {
+  double cos_half = cos(angle / 2.0);
+  double sin_half = sin(angle / 2.0);
+  struct t_complex a, d;
+
+  a.number_real = cos_half;
+  a.number_imaginary = -sin_half;
+  d.number_real = cos_half;
+  d.number_imaginary = sin_half;
+  return q_gate_set(gate, a, c_zero(), c_zero(), d);
+}
+
+/**
+ * Heap copy of a 2x2 gate, for callers that own and free their matrices
+ * @param gate Gate matrix
+ * @return Newly allocated copy, or NULL on failure
  */
-struct t_q_matrix *q_gate_I(void) {
-  struct t_q_matrix *i = q_matrix_init(2, 2);
-  if (!i)
+static struct t_q_matrix *q_gate_alloc(const struct t_q_matrix *gate) {
+  struct t_q_matrix *copy = q_matrix_init(2, 2);
+  if (!copy)
     return NULL;
-  i->data[0] = c_one();
-  i->data[3] = c_one();
-  return i;
+  memcpy(copy->data, gate->data, 4 * sizeof(struct t_complex));
+  return copy;
 }
 
+/**
+ * Create identity gate matrix
+ * @return Identity gate matrix
+ */
+struct t_q_matrix *q_gate_I(void) { return q_gate_alloc(&q_gate_table_I); }
+
 /**
  * Create X (Pauli-X) gate matrix
  * @return X gate matrix
  */
-struct t_q_matrix *q_gate_X(void) {
-  struct t_q_matrix *X = q_matrix_init(2, 2);
-  if (!X)
-    return NULL;
-  X->data[1] = c_one();
-  X->data[2] = c_one();
-  return X;
-}
+struct t_q_matrix *q_gate_X(void) { return q_gate_alloc(&q_gate_table_X); }
 
 /**
  * Create Hadamard gate matrix
  * @return Hadamard gate matrix
  */
-struct t_q_matrix *q_gate_H(void) {
-  double root2_inv = 1.0 / sqrt(2.0);
-  struct t_complex factor = c_from_real(root2_inv);
-  struct t_q_matrix *H = q_matrix_init(2, 2);
-  if (!H)
-    return NULL;
-  H->data[0] = factor;
-  H->data[1] = factor;
-  H->data[2] = factor;
-  H->data[3] = c_from_real(-root2_inv);
-  return H;
-}
+struct t_q_matrix *q_gate_H(void) { return q_gate_alloc(&q_gate_table_H); }
 
 struct t_q_matrix *q_gate_CP(double angle) {
-  struct t_q_matrix *CP = q_matrix_init(2, 2);
-  if (!CP)
-    return NULL;
-
-  CP->data[0] = c_one();
-  CP->data[3].number_real = cos(angle);
-  CP->data[3].number_imaginary = sin(angle);
-  return CP;
+  struct t_q_gate CP;
+  return q_gate_alloc(q_gate_set_P(&CP, angle));
 }
 
 /**
  * Create Y (Pauli-Y) gate matrix
  * @return Y gate matrix
  */
-struct t_q_matrix *q_gate_Y(void) {
-  struct t_q_matrix *Y = q_matrix_init(2, 2);
-  if (!Y)
-    return NULL;
-  Y->data[1].number_imaginary = -1.0;
-  Y->data[2].number_imaginary = 1.0;
-  return Y;
-}
+struct t_q_matrix *q_gate_Y(void) { return q_gate_alloc(&q_gate_table_Y); }
 
 /**
  * Create Z (Pauli-Z) gate matrix
  * @return Z gate matrix
  */
-struct t_q_matrix *q_gate_Z(void) {
-  struct t_q_matrix *Z = q_matrix_init(2, 2);
-  if (!Z)
-    return NULL;
-  Z->data[0] = c_one();
-  Z->data[3] = c_from_real(-1.0);
-  return Z;
-}
+struct t_q_matrix *q_gate_Z(void) { return q_gate_alloc(&q_gate_table_Z); }
 
 struct t_q_matrix *q_gate_P(double angle) {
-  struct t_q_matrix *P = q_matrix_init(2, 2);
-  if (!P)
-    return NULL;
-  P->data[0] = c_one();
-  P->data[3].number_real = cos(angle);
-  P->data[3].number_imaginary = sin(angle);
-  return P;
+  struct t_q_gate P;
+  return q_gate_alloc(q_gate_set_P(&P, angle));
 }
 
 struct t_q_matrix *q_gate_RX(double angle) {
-  struct t_q_matrix *RX = q_matrix_init(2, 2);
-  double cos_half = cos(angle / 2.0);
-  double sin_half = sin(angle / 2.0);
-  if (!RX)
-    return NULL;
-
-  RX->data[0].number_real = cos_half;
-  RX->data[1].number_imaginary = -sin_half;
-  RX->data[2].number_imaginary = -sin_half;
-  RX->data[3].number_real = cos_half;
-
-  return RX;
+  struct t_q_gate RX;
+  return q_gate_alloc(q_gate_set_RX(&RX, angle));
 }
 
 struct t_q_matrix *q_gate_RY(double angle) {
-  struct t_q_matrix *RY = q_matrix_init(2, 2);
-  double cos_half = cos(angle / 2.0);
-  double sin_half = sin(angle / 2.0);
-  if (!RY)
-    return NULL;
-
-  RY->data[0].number_real = cos_half;
-  RY->data[1].number_real = -sin_half;
-  RY->data[2].number_real = sin_half;
-  RY->data[3].number_real = cos_half;
-
-  return RY;
+  struct t_q_gate RY;
+  return q_gate_alloc(q_gate_set_RY(&RY, angle));
 }
 
 struct t_q_matrix *q_gate_RZ(double angle) {
-  struct t_q_matrix *RZ = q_matrix_init(2, 2);
-  double cos_half = cos(angle / 2.0);
-  double sin_half = sin(angle / 2.0);
-  if (!RZ)
-    return NULL;
-
-  RZ->data[0].number_real = cos_half;
-  RZ->data[0].number_imaginary = -sin_half;
-  RZ->data[3].number_real = cos_half;
-  RZ->data[3].number_imaginary = sin_half;
-
-  return RZ;
+  struct t_q_gate RZ;
+  return q_gate_alloc(q_gate_set_RZ(&RZ, angle));
 }
 
 #ifdef QCS_MULTI_THREAD
@@ -513,7 +710,6 @@ static void q_apply_1q_gate_worker(void *arg) {
       state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
     }
   }
-  free(args);
 }
 
 static void q_apply_2q_gate_worker(void *arg) {
@@ -538,10 +734,9 @@ static void q_apply_2q_gate_worker(void *arg) {
 
       state->scratch_vector[index0] = c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
       state->scratch_vector[index1] = c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
-    } else {
+    } else if ((i & c_bit) == 0) {
       state->scratch_vector[i] = state->vector[i];
     }
   }
-  free(args);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+/*
+ * Marginal distribution over k chosen qubits of a dense state, in one pass
+ * that reads the state only.
+ *
+ * Index bits below the lowest chosen qubit never change the outcome, so the
+ * state is walked in runs of 2^lowest amplitudes that share one outcome;
+ * each run is one contiguous norm sum and one accumulator update. The runs
+ * are split into fixed blocks with a private 2^k accumulator each, summed
+ * in block order at the end, so the result does not depend on the thread
+ * count. The outcome of a run is extracted with pext when BMI2 is
+ * available, otherwise with one lookup per index byte.
+ */
+
+#define MARGINAL_INDEX_BYTES 8
+
+/* Upper bound on the total size of the private accumulators, in doubles */
+#define MARGINAL_ACC_BUDGET (1L << 22)
+
+#define MARGINAL_MERGE_GRAIN 4096
+
+struct t_marginal_ctx {
+  const struct t_complex *vector;
+  int k;
+  long run;
+  long runs;
+  long blocks;
+  double *acc;
+  double *out;
+  unsigned long table[MARGINAL_INDEX_BYTES][256];
+#ifdef __BMI2__
+  unsigned long mask;
+#endif
+};
+
+/**
+ * Outcome of the chosen qubits for a basis index
+ * @param ctx Marginal context
+ * @param index Basis index
+ * @return Outcome; bit j is qubit qubits[j] (sorted order under BMI2)
+ */
+static unsigned long q_marginal_key(const struct t_marginal_ctx *ctx,
+                                    unsigned long index) {
+#ifdef __BMI2__
+  return (unsigned long)_pext_u64(index, ctx->mask);
+#else
+  unsigned long key = 0;
+  int b;
+
+  for (b = 0; index != 0; b++, index >>= 8)
+    key |= ctx->table[b][index & 0xFF];
+  return key;
+#endif
+}
+
+/**
+ * Parallel body accumulating a range of blocks into their accumulators
+ * @param context Marginal context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_marginal_body(void *context, long start, long end) {
+  struct t_marginal_ctx *ctx = (struct t_marginal_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double *acc = ctx->acc + (b << ctx->k);
+    long lo, hi, r;
+
+    get_thread_work_range(ctx->runs, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (r = lo; r < hi; r++) {
+      const struct t_complex *amp = ctx->vector + r * ctx->run;
+      double sum = 0.0;
+      long i;
+
+      for (i = 0; i < ctx->run; i++)
+        sum += amp[i].number_real * amp[i].number_real +
+               amp[i].number_imaginary * amp[i].number_imaginary;
+      acc[q_marginal_key(ctx, (unsigned long)r * ctx->run)] += sum;
+    }
+  }
+}
+
+/**
+ * Parallel body summing the block accumulators in block order
+ * @param context Marginal context
+ * @param start First outcome
+ * @param end One past the last outcome
+ */
+static void q_marginal_merge_body(void *context, long start, long end) {
+  struct t_marginal_ctx *ctx = (struct t_marginal_ctx *)context;
+  long j, b;
+
+  for (j = start; j < end; j++) {
+    double sum = 0.0;
+
+    for (b = 0; b < ctx->blocks; b++)
+      sum += ctx->acc[(b << ctx->k) + j];
+    ctx->out[j] = sum;
+  }
+}
+
+/**
+ * Marginal probabilities of a subset of qubits
+ * @param state Quantum state (read only)
+ * @param qubits Distinct qubits; bit j of an outcome is qubit qubits[j]
+ * @param k Number of qubits
+ * @param out Output array of 2^k probabilities
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_state_marginal(const struct t_q_state *state, const int *qubits, int k,
+                     double *out) {
+  struct t_marginal_ctx *ctx;
+  long outcomes = 1L << k;
+  int lowest = state->qubits_num;
+  int j, b, v;
+
+  ctx = (struct t_marginal_ctx *)calloc(1, sizeof(struct t_marginal_ctx));
+  if (ctx == NULL)
+    return -1;
+
+  for (j = 0; j < k; j++) {
+    if (qubits[j] < lowest)
+      lowest = qubits[j];
+    for (v = 0; v < 256; v++) {
+      b = qubits[j] / 8;
+      if ((v >> (qubits[j] % 8)) & 1)
+        ctx->table[b][v] |= 1UL << j;
+    }
+#ifdef __BMI2__
+    ctx->mask |= 1UL << qubits[j];
+#endif
+  }
+
+  ctx->vector = state->vector;
+  ctx->k = k;
+  ctx->run = 1L << lowest;
+  ctx->runs = state->size / ctx->run;
+  ctx->blocks = QCS_REDUCE_BLOCKS;
+  while (ctx->blocks > 1 && (ctx->blocks > ctx->runs ||
+                             ctx->blocks * outcomes > MARGINAL_ACC_BUDGET))
+    ctx->blocks /= 2;
+  ctx->out = out;
+  ctx->acc = (double *)calloc(ctx->blocks * outcomes, sizeof(double));
+  if (ctx->acc == NULL) {
+    free(ctx);
+    return -1;
+  }
+
+  q_parallel_for(ctx->blocks, 1, q_marginal_body, ctx);
+
+#ifdef __BMI2__
+  /* pext packs the qubits in ascending order; the lookup tables map a
+     sorted-order outcome back to the requested order */
+  {
+    int sorted = 1;
+
+    for (j = 1; j < k; j++)
+      if (qubits[j] < qubits[j - 1])
+        sorted = 0;
+    if (!sorted) {
+      double *packed = (double *)malloc(outcomes * sizeof(double));
+      long key;
+
+      if (packed == NULL) {
+        free(ctx->acc);
+        free(ctx);
+        return -1;
+      }
+      ctx->out = packed;
+      q_parallel_for(outcomes, MARGINAL_MERGE_GRAIN, q_marginal_merge_body,
+                     ctx);
+      for (key = 0; key < outcomes; key++) {
+        unsigned long index = (unsigned long)_pdep_u64(key, ctx->mask);
+        unsigned long requested = 0;
+
+        for (b = 0; index != 0; b++, index >>= 8)
+          requested |= ctx->table[b][index & 0xFF];
+        out[requested] = packed[key];
+      }
+      free(packed);
+      free(ctx->acc);
+      free(ctx);
+      return 0;
+    }
+  }
+#endif
+
+  q_parallel_for(outcomes, MARGINAL_MERGE_GRAIN, q_marginal_merge_body, ctx);
+  free(ctx->acc);
+  free(ctx);
+  return 0;
+}
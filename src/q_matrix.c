@@ -1,3 +1,6 @@
+/* posix_memalign is outside strict C89 */
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -11,6 +14,7 @@
  */
 struct t_q_matrix *q_matrix_init(int rows, int cols) {
   struct t_q_matrix *mat;
+  void *block;
   int size = rows * cols;
 
   if (rows <= 0 || cols <= 0) {
@@ -18,7 +22,11 @@ struct t_q_matrix *q_matrix_init(int rows, int cols) {
     return NULL;
   }
 
-  mat = (struct t_q_matrix *)malloc(sizeof(struct t_q_matrix));
+  /* The struct is declared cache-line aligned; plain malloc would not honour
+   * that, and the gate kernels load it with aligned accesses */
+  if (posix_memalign(&block, CACHE_LINE_SIZE, sizeof(struct t_q_matrix)) != 0)
+    block = NULL;
+  mat = (struct t_q_matrix *)block;
   if (mat == NULL) {
     fprintf(stderr, "Error: Could not allocate t_q_matrix structure\n");
     return NULL;
@@ -27,6 +35,7 @@ struct t_q_matrix *q_matrix_init(int rows, int cols) {
   mat->data = (struct t_complex *)calloc(size, sizeof(struct t_complex));
   if (mat->data == NULL) {
     fprintf(stderr, "Error: Could not allocate matrix data\n");
+    free(mat);
     return NULL;
   }
 
@@ -49,6 +58,30 @@ void q_matrix_free(struct t_q_matrix *mat) {
   }
 }
 
+/**
+ * Create the conjugate transpose of a matrix
+ * @param mat Source matrix
+ * @return Newly allocated adjoint matrix or NULL on failure
+ */
+struct t_q_matrix *q_matrix_adjoint(const struct t_q_matrix *mat) {
+  struct t_q_matrix *adj;
+  int i, j;
+
+  if (mat == NULL)
+    return NULL;
+
+  adj = q_matrix_init(mat->cols, mat->rows);
+  if (adj == NULL)
+    return NULL;
+
+  for (i = 0; i < mat->rows; i++) {
+    for (j = 0; j < mat->cols; j++) {
+      adj->data[j * mat->rows + i] = c_conj(mat->data[i * mat->cols + j]);
+    }
+  }
+  return adj;
+}
+
 #define BLOCK_SIZE 64
 
 /**
@@ -0,0 +1,1332 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define MPS_SVD_MAX_SWEEPS 64
+#define MPS_SVD_TOLERANCE 1e-14
+#define MPS_SVD_CUTOFF 1e-14     /* singular values below this times s[0] */
+#define MPS_SVD_MIN_NORM_SQ 1e-200 /* columns below this are numerically 0 */
+#define MPS_PARALLEL_GRAIN 4096
+#define MPS_TOP_K_EPSILON 1e-24           /* prefixes below are empty */
+#define MPS_TOP_K_MAX_EXPANSIONS (1L << 16) /* plus k per qubit */
+
+/*
+ * Site k of the MPS is a rank-3 tensor A[a][s][b] of shape
+ * bond_dims[k] x 2 x bond_dims[k + 1], stored row-major so that
+ * A[a][s][b] lives at sites[k][(a * 2 + s) * bond_dims[k + 1] + b].
+ * Qubit k maps to site k, matching the bit order of the dense backend.
+ */
+
+struct t_mps_jacobi_ctx {
+  struct t_complex *work;
+  struct t_complex *v;
+  int rows;
+  int cols;
+  const int *pair_p;
+  const int *pair_q;
+  int *rotated;
+};
+
+struct t_mps_theta_ctx {
+  const struct t_complex *left;
+  const struct t_complex *right;
+  const struct t_complex *gate;
+  struct t_complex *theta;
+  int dim_mid;
+  int dim_right;
+};
+
+/**
+ * Rotate one pair of columns so that they become mutually orthogonal
+ * @param ctx Jacobi context holding the column-major work matrices
+ * @param p First column index
+ * @param q Second column index
+ * @return 1 if a rotation was applied, 0 if the pair was already orthogonal
+ */
+static int q_mps_jacobi_rotate(struct t_mps_jacobi_ctx *ctx, int p, int q) {
+  struct t_complex *wp = ctx->work + (long)p * ctx->rows;
+  struct t_complex *wq = ctx->work + (long)q * ctx->rows;
+  struct t_complex *vp = ctx->v + (long)p * ctx->cols;
+  struct t_complex *vq = ctx->v + (long)q * ctx->cols;
+  struct t_complex gamma = c_zero();
+  struct t_complex phase;
+  double alpha = 0.0;
+  double beta = 0.0;
+  double g, zeta, t, c, s;
+  int i;
+
+  for (i = 0; i < ctx->rows; i++) {
+    alpha += c_norm_sq(wp[i]);
+    beta += c_norm_sq(wq[i]);
+    gamma = c_add(gamma, c_mul(c_conj(wp[i]), wq[i]));
+  }
+
+  /* a column that has underflowed has no direction left to rotate, and
+     the phase taken from its overlap would no longer have unit modulus */
+  if (alpha < MPS_SVD_MIN_NORM_SQ || beta < MPS_SVD_MIN_NORM_SQ)
+    return 0;
+
+  g = c_magnitude(gamma);
+  if (g <= MPS_SVD_TOLERANCE * sqrt(alpha) * sqrt(beta))
+    return 0;
+
+  phase.number_real = gamma.number_real / g;
+  phase.number_imaginary = -gamma.number_imaginary / g;
+
+  zeta = (beta - alpha) / (2.0 * g);
+  t = (zeta >= 0.0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+  c = 1.0 / sqrt(1.0 + t * t);
+  s = c * t;
+
+  for (i = 0; i < ctx->rows; i++) {
+    struct t_complex a = wp[i];
+    struct t_complex b = c_mul(wq[i], phase);
+    wp[i].number_real = c * a.number_real - s * b.number_real;
+    wp[i].number_imaginary = c * a.number_imaginary - s * b.number_imaginary;
+    wq[i].number_real = s * a.number_real + c * b.number_real;
+    wq[i].number_imaginary = s * a.number_imaginary + c * b.number_imaginary;
+  }
+
+  for (i = 0; i < ctx->cols; i++) {
+    struct t_complex a = vp[i];
+    struct t_complex b = c_mul(vq[i], phase);
+    vp[i].number_real = c * a.number_real - s * b.number_real;
+    vp[i].number_imaginary = c * a.number_imaginary - s * b.number_imaginary;
+    vq[i].number_real = s * a.number_real + c * b.number_real;
+    vq[i].number_imaginary = s * a.number_imaginary + c * b.number_imaginary;
+  }
+
+  return 1;
+}
+
+/**
+ * Parallel body for one round of disjoint Jacobi column pairs
+ * @param context Jacobi context
+ * @param start First pair index
+ * @param end One past the last pair index
+ */
+static void q_mps_jacobi_round_body(void *context, long start, long end) {
+  struct t_mps_jacobi_ctx *ctx = (struct t_mps_jacobi_ctx *)context;
+  long k;
+
+  for (k = start; k < end; k++) {
+    if (ctx->pair_p[k] < ctx->cols && ctx->pair_q[k] < ctx->cols)
+      ctx->rotated[k] = q_mps_jacobi_rotate(ctx, ctx->pair_p[k], ctx->pair_q[k]);
+    else
+      ctx->rotated[k] = 0;
+  }
+}
+
+/**
+ * One-sided Jacobi SVD of a tall matrix (rows >= cols)
+ * @param matrix Row-major rows x cols input
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param u Output rows x cols left singular vectors (row-major)
+ * @param s Output cols singular values, sorted descending
+ * @param vh Output cols x cols conjugate-transposed right vectors (row-major)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_mps_svd_tall(const struct t_complex *matrix, int rows, int cols,
+                          struct t_complex *u, double *s,
+                          struct t_complex *vh) {
+  struct t_mps_jacobi_ctx ctx;
+  struct t_complex *work;
+  struct t_complex *v;
+  double *norms;
+  int *order;
+  int *players;
+  int *pair_p;
+  int *pair_q;
+  int *rotated;
+  int players_num = cols + (cols & 1);
+  int pairs_num = players_num / 2;
+  int sweep, round, i, j, k;
+  long grain;
+
+  work = (struct t_complex *)malloc((long)rows * cols * sizeof(struct t_complex));
+  v = (struct t_complex *)calloc((long)cols * cols, sizeof(struct t_complex));
+  norms = (double *)malloc(cols * sizeof(double));
+  order = (int *)malloc(cols * sizeof(int));
+  players = (int *)malloc(players_num * sizeof(int));
+  pair_p = (int *)malloc(pairs_num * sizeof(int));
+  pair_q = (int *)malloc(pairs_num * sizeof(int));
+  rotated = (int *)malloc(pairs_num * sizeof(int));
+
+  if (!work || !v || !norms || !order || !players || !pair_p || !pair_q ||
+      !rotated) {
+    free(work);
+    free(v);
+    free(norms);
+    free(order);
+    free(players);
+    free(pair_p);
+    free(pair_q);
+    free(rotated);
+    return -1;
+  }
+
+  for (i = 0; i < rows; i++)
+    for (j = 0; j < cols; j++)
+      work[(long)j * rows + i] = matrix[(long)i * cols + j];
+  for (j = 0; j < cols; j++)
+    v[(long)j * cols + j] = c_one();
+
+  ctx.work = work;
+  ctx.v = v;
+  ctx.rows = rows;
+  ctx.cols = cols;
+  ctx.pair_p = pair_p;
+  ctx.pair_q = pair_q;
+  ctx.rotated = rotated;
+
+  grain = MPS_PARALLEL_GRAIN / (rows + cols) + 1;
+
+  for (sweep = 0; sweep < MPS_SVD_MAX_SWEEPS && cols > 1; sweep++) {
+    int any_rotated = 0;
+
+    for (i = 0; i < players_num; i++)
+      players[i] = i;
+
+    /* Round-robin tournament: every round pairs each column exactly once */
+    for (round = 0; round < players_num - 1; round++) {
+      int last;
+
+      for (k = 0; k < pairs_num; k++) {
+        pair_p[k] = players[k];
+        pair_q[k] = players[players_num - 1 - k];
+      }
+
+      q_parallel_for(pairs_num, grain, q_mps_jacobi_round_body, &ctx);
+
+      for (k = 0; k < pairs_num; k++)
+        any_rotated |= rotated[k];
+
+      last = players[players_num - 1];
+      for (i = players_num - 1; i > 1; i--)
+        players[i] = players[i - 1];
+      players[1] = last;
+    }
+
+    if (!any_rotated)
+      break;
+  }
+
+  for (j = 0; j < cols; j++) {
+    double sum = 0.0;
+    for (i = 0; i < rows; i++)
+      sum += c_norm_sq(work[(long)j * rows + i]);
+    norms[j] = sqrt(sum);
+    order[j] = j;
+  }
+
+  for (i = 1; i < cols; i++) {
+    int key = order[i];
+    for (j = i - 1; j >= 0 && norms[order[j]] < norms[key]; j--)
+      order[j + 1] = order[j];
+    order[j + 1] = key;
+  }
+
+  for (k = 0; k < cols; k++) {
+    int src = order[k];
+    double inv = norms[src] > 0.0 ? 1.0 / norms[src] : 0.0;
+
+    s[k] = norms[src];
+    for (i = 0; i < rows; i++) {
+      struct t_complex w = work[(long)src * rows + i];
+      u[(long)i * cols + k].number_real = w.number_real * inv;
+      u[(long)i * cols + k].number_imaginary = w.number_imaginary * inv;
+    }
+    for (i = 0; i < cols; i++)
+      vh[(long)k * cols + i] = c_conj(v[(long)src * cols + i]);
+  }
+
+  free(work);
+  free(v);
+  free(norms);
+  free(order);
+  free(players);
+  free(pair_p);
+  free(pair_q);
+  free(rotated);
+  return 0;
+}
+
+/**
+ * Thin SVD of an arbitrary complex matrix: matrix = u * diag(s) * vh
+ * @param matrix Row-major rows x cols input
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param u Output rows x min(rows, cols) matrix (row-major)
+ * @param s Output min(rows, cols) singular values, sorted descending
+ * @param vh Output min(rows, cols) x cols matrix (row-major)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_mps_svd(const struct t_complex *matrix, int rows, int cols,
+                     struct t_complex *u, double *s, struct t_complex *vh) {
+  struct t_complex *adjoint;
+  struct t_complex *u_adj;
+  struct t_complex *vh_adj;
+  int i, j;
+  int ret;
+
+  if (rows >= cols)
+    return q_mps_svd_tall(matrix, rows, cols, u, s, vh);
+
+  /* Wide matrix: decompose the adjoint and swap the factors back */
+  adjoint = (struct t_complex *)calloc((long)rows * cols, sizeof(struct t_complex));
+  u_adj = (struct t_complex *)malloc((long)cols * rows * sizeof(struct t_complex));
+  vh_adj = (struct t_complex *)malloc((long)rows * rows * sizeof(struct t_complex));
+  if (!adjoint || !u_adj || !vh_adj) {
+    free(adjoint);
+    free(u_adj);
+    free(vh_adj);
+    return -1;
+  }
+
+  for (i = 0; i < rows; i++)
+    for (j = 0; j < cols; j++)
+      adjoint[(long)j * rows + i] = c_conj(matrix[(long)i * cols + j]);
+
+  ret = q_mps_svd_tall(adjoint, cols, rows, u_adj, s, vh_adj);
+  if (ret == 0) {
+    for (i = 0; i < rows; i++)
+      for (j = 0; j < rows; j++)
+        u[(long)i * rows + j] = c_conj(vh_adj[(long)j * rows + i]);
+    for (i = 0; i < rows; i++)
+      for (j = 0; j < cols; j++)
+        vh[(long)i * cols + j] = c_conj(u_adj[(long)j * rows + i]);
+  }
+
+  free(adjoint);
+  free(u_adj);
+  free(vh_adj);
+  return ret;
+}
+
+/**
+ * Choose how many singular values to keep under the bond cap and threshold.
+ * Values below MPS_SVD_CUTOFF relative to the largest are rounding noise and
+ * always dropped, so exact states keep their true rank.
+ * @param s Singular values, sorted descending
+ * @param count Number of singular values
+ * @param max_bond Maximum bond dimension
+ * @param threshold Maximum discarded weight relative to the total
+ * @param discarded Output discarded weight relative to the total
+ * @return Number of singular values to keep (at least 1)
+ */
+static int q_mps_truncate_rank(const double *s, int count, int max_bond,
+                               double threshold, double *discarded) {
+  double total = 0.0;
+  double dropped = 0.0;
+  int keep = count;
+  int i;
+
+  for (i = 0; i < count; i++)
+    total += s[i] * s[i];
+
+  while (keep > 1 && s[keep - 1] <= MPS_SVD_CUTOFF * s[0]) {
+    dropped += s[keep - 1] * s[keep - 1];
+    keep--;
+  }
+
+  while (keep > 1 && (keep > max_bond ||
+                      (dropped + s[keep - 1] * s[keep - 1]) <=
+                          threshold * total)) {
+    dropped += s[keep - 1] * s[keep - 1];
+    keep--;
+  }
+
+  *discarded = total > 0.0 ? dropped / total : 0.0;
+  return keep;
+}
+
+/**
+ * Move the orthogonality centre one site to the right
+ * @param mps Matrix product state
+ * @return 0 on success, -1 on failure
+ */
+static int q_mps_shift_center_right(struct t_q_mps *mps) {
+  int c = mps->center;
+  int dl = mps->bond_dims[c];
+  int dm = mps->bond_dims[c + 1];
+  int dr = mps->bond_dims[c + 2];
+  int rows = dl * 2;
+  int k = rows < dm ? rows : dm;
+  struct t_complex *u, *vh, *next;
+  double *s;
+  double discarded;
+  int keep, a, b, m, j;
+
+  u = (struct t_complex *)malloc((long)rows * k * sizeof(struct t_complex));
+  vh = (struct t_complex *)malloc((long)k * dm * sizeof(struct t_complex));
+  s = (double *)malloc(k * sizeof(double));
+  if (!u || !vh || !s || q_mps_svd(mps->sites[c], rows, dm, u, s, vh) != 0) {
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  keep = q_mps_truncate_rank(s, k, k, 0.0, &discarded);
+
+  next = (struct t_complex *)calloc((long)keep * 2 * dr, sizeof(struct t_complex));
+  if (!next) {
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  /* next[m][t][b] = sum_j s[m] vh[m][j] A_{c+1}[j][t][b] */
+  for (m = 0; m < keep; m++) {
+    for (j = 0; j < dm; j++) {
+      struct t_complex coeff = vh[(long)m * dm + j];
+      coeff.number_real *= s[m];
+      coeff.number_imaginary *= s[m];
+      for (b = 0; b < 2 * dr; b++) {
+        next[(long)m * 2 * dr + b] =
+            c_add(next[(long)m * 2 * dr + b],
+                  c_mul(coeff, mps->sites[c + 1][(long)j * 2 * dr + b]));
+      }
+    }
+  }
+
+  for (a = 0; a < rows; a++)
+    for (m = 0; m < keep; m++)
+      u[(long)a * keep + m] = u[(long)a * k + m];
+
+  free(mps->sites[c]);
+  free(mps->sites[c + 1]);
+  mps->sites[c] = u;
+  mps->sites[c + 1] = next;
+  mps->bond_dims[c + 1] = keep;
+  mps->center = c + 1;
+
+  free(vh);
+  free(s);
+  return 0;
+}
+
+/**
+ * Move the orthogonality centre one site to the left
+ * @param mps Matrix product state
+ * @return 0 on success, -1 on failure
+ */
+static int q_mps_shift_center_left(struct t_q_mps *mps) {
+  int c = mps->center;
+  int dp = mps->bond_dims[c - 1];
+  int dl = mps->bond_dims[c];
+  int dr = mps->bond_dims[c + 1];
+  int cols = 2 * dr;
+  int k = dl < cols ? dl : cols;
+  struct t_complex *u, *vh, *prev;
+  double *s;
+  double discarded;
+  int keep, a, m, j;
+
+  u = (struct t_complex *)malloc((long)dl * k * sizeof(struct t_complex));
+  vh = (struct t_complex *)malloc((long)k * cols * sizeof(struct t_complex));
+  s = (double *)malloc(k * sizeof(double));
+  if (!u || !vh || !s || q_mps_svd(mps->sites[c], dl, cols, u, s, vh) != 0) {
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  keep = q_mps_truncate_rank(s, k, k, 0.0, &discarded);
+
+  prev = (struct t_complex *)calloc((long)dp * 2 * keep, sizeof(struct t_complex));
+  if (!prev) {
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  /* prev[a][t][m] = sum_j A_{c-1}[a][t][j] u[j][m] s[m] */
+  for (a = 0; a < dp * 2; a++) {
+    for (j = 0; j < dl; j++) {
+      struct t_complex left = mps->sites[c - 1][(long)a * dl + j];
+      for (m = 0; m < keep; m++) {
+        struct t_complex coeff = u[(long)j * k + m];
+        coeff.number_real *= s[m];
+        coeff.number_imaginary *= s[m];
+        prev[(long)a * keep + m] =
+            c_add(prev[(long)a * keep + m], c_mul(left, coeff));
+      }
+    }
+  }
+
+  free(mps->sites[c - 1]);
+  free(mps->sites[c]);
+  mps->sites[c - 1] = prev;
+  mps->sites[c] = vh;
+  mps->bond_dims[c] = keep;
+  mps->center = c - 1;
+
+  free(u);
+  free(s);
+  return 0;
+}
+
+/**
+ * Move the orthogonality centre to the given site
+ * @param mps Matrix product state
+ * @param site Destination site
+ * @return 0 on success, -1 on failure
+ */
+static int q_mps_move_center(struct t_q_mps *mps, int site) {
+  while (mps->center < site) {
+    if (q_mps_shift_center_right(mps) != 0)
+      return -1;
+  }
+  while (mps->center > site) {
+    if (q_mps_shift_center_left(mps) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * Parallel body contracting two sites and applying a 4x4 gate
+ * @param context Theta context
+ * @param start First left bond index
+ * @param end One past the last left bond index
+ */
+static void q_mps_theta_body(void *context, long start, long end) {
+  struct t_mps_theta_ctx *ctx = (struct t_mps_theta_ctx *)context;
+  int dm = ctx->dim_mid;
+  int dr = ctx->dim_right;
+  long cols = 2L * dr;
+  long a;
+  int s1, s2, b, m, r;
+
+  for (a = start; a < end; a++) {
+    struct t_complex *rows0 = ctx->theta + (a * 2) * cols;
+
+    for (s1 = 0; s1 < 2; s1++) {
+      struct t_complex *row = rows0 + s1 * cols;
+      for (m = 0; m < dm; m++) {
+        struct t_complex left = ctx->left[(a * 2 + s1) * dm + m];
+        const struct t_complex *right = ctx->right + (long)m * cols;
+        for (b = 0; b < cols; b++)
+          row[b] = c_add(row[b], c_mul(left, right[b]));
+      }
+    }
+
+    for (b = 0; b < dr; b++) {
+      struct t_complex in[4];
+      struct t_complex out;
+
+      for (s1 = 0; s1 < 2; s1++)
+        for (s2 = 0; s2 < 2; s2++)
+          in[s1 * 2 + s2] = rows0[s1 * cols + s2 * dr + b];
+
+      for (r = 0; r < 4; r++) {
+        out = c_zero();
+        for (m = 0; m < 4; m++)
+          out = c_add(out, c_mul(ctx->gate[r * 4 + m], in[m]));
+        rows0[(r >> 1) * cols + (r & 1) * dr + b] = out;
+      }
+    }
+  }
+}
+
+/**
+ * Apply a 4x4 gate to the adjacent sites (site, site + 1) and re-split them
+ * @param mps Matrix product state
+ * @param site Left site of the pair
+ * @param gate Row-major 4x4 matrix in the basis |s_site s_site+1>
+ * @return 0 on success, -1 on failure
+ */
+static int q_mps_apply_two_site(struct t_q_mps *mps, int site,
+                                const struct t_complex *gate) {
+  struct t_mps_theta_ctx ctx;
+  struct t_complex *theta, *u, *vh, *left, *right;
+  double *s;
+  double discarded, kept_weight, total_weight, scale;
+  int dl, dm, dr, rows, cols, k, keep, i, m;
+
+  if (q_mps_move_center(mps, site) != 0)
+    return -1;
+
+  dl = mps->bond_dims[site];
+  dm = mps->bond_dims[site + 1];
+  dr = mps->bond_dims[site + 2];
+  rows = dl * 2;
+  cols = 2 * dr;
+  k = rows < cols ? rows : cols;
+
+  theta = (struct t_complex *)calloc((long)rows * cols, sizeof(struct t_complex));
+  u = (struct t_complex *)malloc((long)rows * k * sizeof(struct t_complex));
+  vh = (struct t_complex *)malloc((long)k * cols * sizeof(struct t_complex));
+  s = (double *)malloc(k * sizeof(double));
+  if (!theta || !u || !vh || !s) {
+    free(theta);
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  ctx.left = mps->sites[site];
+  ctx.right = mps->sites[site + 1];
+  ctx.gate = gate;
+  ctx.theta = theta;
+  ctx.dim_mid = dm;
+  ctx.dim_right = dr;
+  q_parallel_for(dl, MPS_PARALLEL_GRAIN / (4L * dm * dr) + 1,
+                 q_mps_theta_body, &ctx);
+
+  if (q_mps_svd(theta, rows, cols, u, s, vh) != 0) {
+    free(theta);
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+  free(theta);
+
+  keep = q_mps_truncate_rank(s, k, mps->max_bond_dim,
+                             mps->truncation_threshold, &discarded);
+  mps->truncation_error += discarded;
+
+  total_weight = 0.0;
+  kept_weight = 0.0;
+  for (m = 0; m < k; m++) {
+    total_weight += s[m] * s[m];
+    if (m < keep)
+      kept_weight += s[m] * s[m];
+  }
+  scale = kept_weight > 0.0 ? sqrt(total_weight / kept_weight) : 1.0;
+
+  left = (struct t_complex *)malloc((long)rows * keep * sizeof(struct t_complex));
+  right = (struct t_complex *)malloc((long)keep * cols * sizeof(struct t_complex));
+  if (!left || !right) {
+    free(left);
+    free(right);
+    free(u);
+    free(vh);
+    free(s);
+    return -1;
+  }
+
+  for (i = 0; i < rows; i++)
+    for (m = 0; m < keep; m++)
+      left[(long)i * keep + m] = u[(long)i * k + m];
+
+  for (m = 0; m < keep; m++) {
+    double weight = s[m] * scale;
+    for (i = 0; i < cols; i++) {
+      right[(long)m * cols + i].number_real =
+          vh[(long)m * cols + i].number_real * weight;
+      right[(long)m * cols + i].number_imaginary =
+          vh[(long)m * cols + i].number_imaginary * weight;
+    }
+  }
+
+  free(mps->sites[site]);
+  free(mps->sites[site + 1]);
+  mps->sites[site] = left;
+  mps->sites[site + 1] = right;
+  mps->bond_dims[site + 1] = keep;
+  mps->center = site + 1;
+
+  free(u);
+  free(vh);
+  free(s);
+  return 0;
+}
+
+/**
+ * Initialize a matrix product state in |0...0>
+ * @param qubits_num Number of qubits (sites)
+ * @param max_bond_dim Maximum bond dimension kept after each gate
+ * @param truncation_threshold Maximum discarded weight per truncation
+ * @return Pointer to allocated MPS or NULL on failure
+ */
+struct t_q_mps *q_mps_init(int qubits_num, int max_bond_dim,
+                           double truncation_threshold) {
+  struct t_q_mps *mps;
+  int k;
+
+  if (qubits_num <= 0 || max_bond_dim <= 0) {
+    fprintf(stderr, "Error: MPS needs positive qubit count and bond dimension.\n");
+    return NULL;
+  }
+
+  mps = (struct t_q_mps *)malloc(sizeof(struct t_q_mps));
+  if (mps == NULL)
+    return NULL;
+
+  mps->qubits_num = qubits_num;
+  mps->max_bond_dim = max_bond_dim;
+  mps->truncation_threshold =
+      truncation_threshold > 0.0 ? truncation_threshold : 0.0;
+  mps->truncation_error = 0.0;
+  mps->center = 0;
+  mps->bond_dims = (int *)malloc((qubits_num + 1) * sizeof(int));
+  mps->sites = (struct t_complex **)calloc(qubits_num, sizeof(struct t_complex *));
+
+  if (!mps->bond_dims || !mps->sites) {
+    q_mps_free(mps);
+    return NULL;
+  }
+
+  for (k = 0; k <= qubits_num; k++)
+    mps->bond_dims[k] = 1;
+
+  for (k = 0; k < qubits_num; k++) {
+    mps->sites[k] = (struct t_complex *)calloc(2, sizeof(struct t_complex));
+    if (mps->sites[k] == NULL) {
+      q_mps_free(mps);
+      return NULL;
+    }
+    mps->sites[k][0] = c_one();
+  }
+
+  return mps;
+}
+
+/**
+ * Deep copy of a matrix product state
+ * @param mps MPS to copy
+ * @return Independent copy, or NULL on allocation failure
+ */
+struct t_q_mps *q_mps_clone(const struct t_q_mps *mps) {
+  struct t_q_mps *copy;
+  int k;
+
+  copy = (struct t_q_mps *)malloc(sizeof(struct t_q_mps));
+  if (copy == NULL)
+    return NULL;
+
+  *copy = *mps;
+  copy->bond_dims = (int *)malloc((mps->qubits_num + 1) * sizeof(int));
+  copy->sites = (struct t_complex **)calloc(mps->qubits_num,
+                                            sizeof(struct t_complex *));
+  if (!copy->bond_dims || !copy->sites) {
+    q_mps_free(copy);
+    return NULL;
+  }
+  memcpy(copy->bond_dims, mps->bond_dims, (mps->qubits_num + 1) * sizeof(int));
+
+  for (k = 0; k < mps->qubits_num; k++) {
+    size_t bytes = (size_t)mps->bond_dims[k] * 2 * mps->bond_dims[k + 1] *
+                   sizeof(struct t_complex);
+
+    copy->sites[k] = (struct t_complex *)malloc(bytes);
+    if (copy->sites[k] == NULL) {
+      q_mps_free(copy);
+      return NULL;
+    }
+    memcpy(copy->sites[k], mps->sites[k], bytes);
+  }
+  return copy;
+}
+
+/**
+ * Free memory allocated for a matrix product state
+ * @param mps MPS to free
+ */
+void q_mps_free(struct t_q_mps *mps) {
+  int k;
+
+  if (mps) {
+    if (mps->sites) {
+      for (k = 0; k < mps->qubits_num; k++)
+        free(mps->sites[k]);
+      free(mps->sites);
+    }
+    free(mps->bond_dims);
+    free(mps);
+  }
+}
+
+/**
+ * Apply a 1-qubit gate to a single MPS site
+ * @param mps Matrix product state
+ * @param gate 2x2 gate matrix
+ * @param target_qubit Target qubit index
+ */
+void q_mps_apply_1q_gate(struct t_q_mps *mps, const struct t_q_matrix *gate,
+                         int target_qubit) {
+  struct t_complex *site;
+  long dl, dr, a, b;
+
+  if (mps == NULL || gate == NULL || target_qubit < 0 ||
+      target_qubit >= mps->qubits_num) {
+    fprintf(stderr, "Error: Invalid arguments for MPS 1-qubit gate.\n");
+    return;
+  }
+
+  site = mps->sites[target_qubit];
+  dl = mps->bond_dims[target_qubit];
+  dr = mps->bond_dims[target_qubit + 1];
+
+  for (a = 0; a < dl; a++) {
+    for (b = 0; b < dr; b++) {
+      struct t_complex v0 = site[(a * 2) * dr + b];
+      struct t_complex v1 = site[(a * 2 + 1) * dr + b];
+      site[(a * 2) * dr + b] =
+          c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1));
+      site[(a * 2 + 1) * dr + b] =
+          c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1));
+    }
+  }
+}
+
+/**
+ * Apply a controlled 1-qubit gate, routing distant qubits with SWAPs
+ * @param mps Matrix product state
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control_qubit Control qubit index
+ * @param target_qubit Target qubit index
+ */
+void q_mps_apply_2q_gate(struct t_q_mps *mps, const struct t_q_matrix *gate,
+                         int control_qubit, int target_qubit) {
+  struct t_complex swap[16];
+  struct t_complex controlled[16];
+  int low, high, site, t0, t1;
+  int control_first;
+
+  if (mps == NULL || gate == NULL || control_qubit < 0 || target_qubit < 0 ||
+      control_qubit >= mps->qubits_num || target_qubit >= mps->qubits_num ||
+      control_qubit == target_qubit) {
+    fprintf(stderr, "Error: Invalid arguments for MPS 2-qubit gate.\n");
+    return;
+  }
+
+  for (t0 = 0; t0 < 16; t0++) {
+    swap[t0] = c_zero();
+    controlled[t0] = c_zero();
+  }
+  swap[0] = swap[6] = swap[9] = swap[15] = c_one();
+
+  control_first = control_qubit < target_qubit;
+  low = control_first ? control_qubit : target_qubit;
+  high = control_first ? target_qubit : control_qubit;
+
+  /* Controlled-U on the pair (low, low + 1); index = s_low * 2 + s_low+1 */
+  for (t0 = 0; t0 < 2; t0++) {
+    for (t1 = 0; t1 < 2; t1++) {
+      if (control_first) {
+        controlled[(0 * 2 + t0) * 4 + (0 * 2 + t0)] = c_one();
+        controlled[(2 + t0) * 4 + (2 + t1)] = gate->data[t0 * 2 + t1];
+      } else {
+        controlled[(t0 * 2) * 4 + (t0 * 2)] = c_one();
+        controlled[(t0 * 2 + 1) * 4 + (t1 * 2 + 1)] = gate->data[t0 * 2 + t1];
+      }
+    }
+  }
+
+  for (site = high - 1; site > low; site--) {
+    if (q_mps_apply_two_site(mps, site, swap) != 0)
+      goto fail;
+  }
+
+  if (q_mps_apply_two_site(mps, low, controlled) != 0)
+    goto fail;
+
+  for (site = low + 1; site < high; site++) {
+    if (q_mps_apply_two_site(mps, site, swap) != 0)
+      goto fail;
+  }
+  return;
+
+fail:
+  fprintf(stderr, "Error: MPS 2-qubit gate failed to allocate memory.\n");
+}
+
+/**
+ * Measure one qubit of the MPS and collapse it
+ * @param mps Matrix product state
+ * @param qubit Qubit to measure
+ * @param random_val Uniform random number in [0, 1]
+ * @return Measured value (0 or 1)
+ */
+int q_mps_measure(struct t_q_mps *mps, int qubit, double random_val) {
+  struct t_complex *site;
+  double prob[2];
+  double scale;
+  long dl, dr, a, b;
+  int s, outcome;
+
+  if (mps == NULL || qubit < 0 || qubit >= mps->qubits_num)
+    return 0;
+
+  if (q_mps_move_center(mps, qubit) != 0) {
+    fprintf(stderr, "Error: MPS measurement failed to allocate memory.\n");
+    return 0;
+  }
+
+  site = mps->sites[qubit];
+  dl = mps->bond_dims[qubit];
+  dr = mps->bond_dims[qubit + 1];
+
+  prob[0] = prob[1] = 0.0;
+  for (a = 0; a < dl; a++)
+    for (s = 0; s < 2; s++)
+      for (b = 0; b < dr; b++)
+        prob[s] += c_norm_sq(site[(a * 2 + s) * dr + b]);
+
+  outcome = (random_val * (prob[0] + prob[1]) <= prob[0]) ? 0 : 1;
+  scale = prob[outcome] > 1e-300 ? 1.0 / sqrt(prob[outcome]) : 0.0;
+
+  for (a = 0; a < dl; a++) {
+    for (b = 0; b < dr; b++) {
+      struct t_complex *keep = &site[(a * 2 + outcome) * dr + b];
+      site[(a * 2 + (1 - outcome)) * dr + b] = c_zero();
+      keep->number_real *= scale;
+      keep->number_imaginary *= scale;
+    }
+  }
+
+  return outcome;
+}
+
+/**
+ * Contract the MPS for a single basis state amplitude
+ * @param mps Matrix product state
+ * @param index Basis state index (bit k is qubit k; qubits from
+ *        QCS_INDEX_MAX_QUBITS on are 0)
+ * @return Complex amplitude
+ */
+struct t_complex q_mps_amplitude(struct t_q_mps *mps, t_q_index index) {
+  struct t_complex *env;
+  struct t_complex *next;
+  struct t_complex result = c_zero();
+  int max_dim = 1;
+  int k, a, b;
+
+  for (k = 0; k <= mps->qubits_num; k++)
+    if (mps->bond_dims[k] > max_dim)
+      max_dim = mps->bond_dims[k];
+
+  env = (struct t_complex *)malloc(max_dim * sizeof(struct t_complex));
+  next = (struct t_complex *)malloc(max_dim * sizeof(struct t_complex));
+  if (!env || !next) {
+    free(env);
+    free(next);
+    return result;
+  }
+
+  env[0] = c_one();
+  for (k = 0; k < mps->qubits_num; k++) {
+    int dl = mps->bond_dims[k];
+    int dr = mps->bond_dims[k + 1];
+    int s = (k < QCS_INDEX_MAX_QUBITS) ? (int)((index >> k) & 1L) : 0;
+    struct t_complex *tmp;
+
+    for (b = 0; b < dr; b++) {
+      next[b] = c_zero();
+      for (a = 0; a < dl; a++)
+        next[b] = c_add(next[b],
+                        c_mul(env[a], mps->sites[k][((long)a * 2 + s) * dr + b]));
+    }
+    tmp = env;
+    env = next;
+    next = tmp;
+  }
+
+  result = env[0];
+  free(env);
+  free(next);
+  return result;
+}
+
+/**
+ * Bring the MPS into right-canonical form for repeated sampling
+ * @param mps Matrix product state
+ */
+void q_mps_prepare_sampling(struct t_q_mps *mps) {
+  if (mps != NULL && q_mps_move_center(mps, 0) != 0)
+    fprintf(stderr, "Error: MPS sampling failed to allocate memory.\n");
+}
+
+/**
+ * Draw one bitstring from the MPS without collapsing it.
+ * q_mps_prepare_sampling must have been called since the last gate.
+ * @param mps Matrix product state with its centre on site 0
+ * @param rng Generator
+ * @param bits Optional output array of qubits_num measured bits
+ * @return Basis index of the sample; only meaningful when qubits_num is at
+ *         most QCS_INDEX_MAX_QUBITS, wider callers read bits instead
+ */
+long q_mps_sample(const struct t_q_mps *mps, struct t_q_rng *rng, int *bits) {
+  struct t_complex *env;
+  struct t_complex *branch[2];
+  long index = 0;
+  int max_dim = 1;
+  int k, a, b, s;
+
+  for (k = 0; k <= mps->qubits_num; k++)
+    if (mps->bond_dims[k] > max_dim)
+      max_dim = mps->bond_dims[k];
+
+  env = (struct t_complex *)malloc(max_dim * sizeof(struct t_complex));
+  branch[0] = (struct t_complex *)malloc(max_dim * sizeof(struct t_complex));
+  branch[1] = (struct t_complex *)malloc(max_dim * sizeof(struct t_complex));
+  if (!env || !branch[0] || !branch[1]) {
+    free(env);
+    free(branch[0]);
+    free(branch[1]);
+    return 0;
+  }
+
+  env[0] = c_one();
+  for (k = 0; k < mps->qubits_num; k++) {
+    int dl = mps->bond_dims[k];
+    int dr = mps->bond_dims[k + 1];
+    double prob[2];
+    double random_val, scale;
+    int outcome;
+
+    for (s = 0; s < 2; s++) {
+      prob[s] = 0.0;
+      for (b = 0; b < dr; b++) {
+        struct t_complex sum = c_zero();
+        for (a = 0; a < dl; a++)
+          sum = c_add(sum, c_mul(env[a],
+                                 mps->sites[k][((long)a * 2 + s) * dr + b]));
+        branch[s][b] = sum;
+        prob[s] += c_norm_sq(sum);
+      }
+    }
+
+    random_val = q_rng_uniform(rng);
+    outcome = (random_val * (prob[0] + prob[1]) < prob[0]) ? 0 : 1;
+    if (prob[outcome] <= 0.0)
+      outcome = 1 - outcome;
+
+    scale = prob[outcome] > 0.0 ? 1.0 / sqrt(prob[outcome]) : 0.0;
+    for (b = 0; b < dr; b++) {
+      env[b].number_real = branch[outcome][b].number_real * scale;
+      env[b].number_imaginary = branch[outcome][b].number_imaginary * scale;
+    }
+
+    if (bits)
+      bits[k] = outcome;
+    if (outcome && k < QCS_INDEX_MAX_QUBITS)
+      index |= 1L << k;
+  }
+
+  free(env);
+  free(branch[0]);
+  free(branch[1]);
+  return index;
+}
+
+/* A bitstring prefix in the top-k search: its vector on the open bond and
+ * the probability of every bitstring that starts with it */
+struct t_mps_top_k_node {
+  double prob;
+  t_q_index prefix;
+  int depth;
+  struct t_complex *env;
+};
+
+/**
+ * Search order: more likely first, then deeper, then smaller prefix
+ * @param a First node
+ * @param b Second node
+ * @return Nonzero when a is expanded before b
+ */
+static int q_mps_top_k_before(const struct t_mps_top_k_node *a,
+                              const struct t_mps_top_k_node *b) {
+  if (a->prob != b->prob)
+    return a->prob > b->prob;
+  if (a->depth != b->depth)
+    return a->depth > b->depth;
+  return a->prefix < b->prefix;
+}
+
+/**
+ * Push a node onto the search heap
+ * @param heap Heap array, grown as needed
+ * @param size Heap size, updated
+ * @param capacity Heap capacity, updated
+ * @param node Node to push
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_mps_top_k_push(struct t_mps_top_k_node **heap, long *size,
+                            long *capacity, struct t_mps_top_k_node node) {
+  long pos;
+
+  if (*size == *capacity) {
+    long grown_capacity = *capacity > 0 ? *capacity * 2 : 64;
+    struct t_mps_top_k_node *grown = (struct t_mps_top_k_node *)realloc(
+        *heap, grown_capacity * sizeof(struct t_mps_top_k_node));
+    if (grown == NULL)
+      return -1;
+    *heap = grown;
+    *capacity = grown_capacity;
+  }
+
+  pos = (*size)++;
+  while (pos > 0 && q_mps_top_k_before(&node, &(*heap)[(pos - 1) / 2])) {
+    (*heap)[pos] = (*heap)[(pos - 1) / 2];
+    pos = (pos - 1) / 2;
+  }
+  (*heap)[pos] = node;
+  return 0;
+}
+
+/**
+ * Pop the first node in search order
+ * @param heap Nonempty heap array
+ * @param size Heap size, updated
+ * @return Popped node
+ */
+static struct t_mps_top_k_node q_mps_top_k_pop(struct t_mps_top_k_node *heap,
+                                               long *size) {
+  struct t_mps_top_k_node top = heap[0];
+  struct t_mps_top_k_node last = heap[--(*size)];
+  long pos = 0;
+
+  for (;;) {
+    long child = 2 * pos + 1;
+
+    if (child >= *size)
+      break;
+    if (child + 1 < *size && q_mps_top_k_before(&heap[child + 1], &heap[child]))
+      child++;
+    if (!q_mps_top_k_before(&heap[child], &last))
+      break;
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  heap[pos] = last;
+  return top;
+}
+
+/**
+ * The k most likely basis states, by best-first search over bitstring
+ * prefixes. With the centre on site 0 a prefix's probability is the norm of
+ * its open-bond vector and bounds every completion, so complete bitstrings
+ * leave the search most likely first and the rest of the tree is pruned.
+ * @param mps Matrix product state (its centre is moved to site 0)
+ * @param k Number of states wanted
+ * @param indices Output basis indices, most likely first (k entries)
+ * @param probs Output probabilities (k entries)
+ * @return Number of states written, or -1 when the state is wider than a
+ *         basis index, too spread out to search, or memory runs out
+ */
+long q_mps_top_k(struct t_q_mps *mps, long k, t_q_index *indices,
+                 double *probs) {
+  struct t_mps_top_k_node *heap = NULL;
+  struct t_mps_top_k_node node, child;
+  long heap_size = 0, heap_capacity = 0, size = 0, budget;
+  int status = 0;
+  int s, a, b;
+
+  if (mps->qubits_num > QCS_INDEX_MAX_QUBITS || q_mps_move_center(mps, 0) != 0)
+    return -1;
+  if (k == 0)
+    return 0;
+
+  budget = MPS_TOP_K_MAX_EXPANSIONS + k * mps->qubits_num;
+  node.prob = 1.0;
+  node.prefix = 0;
+  node.depth = 0;
+  node.env = (struct t_complex *)malloc(sizeof(struct t_complex));
+  if (node.env == NULL)
+    return -1;
+  node.env[0] = c_one();
+  if (q_mps_top_k_push(&heap, &heap_size, &heap_capacity, node) != 0) {
+    free(node.env);
+    return -1;
+  }
+
+  while (heap_size > 0 && status == 0) {
+    int dl, dr;
+
+    node = q_mps_top_k_pop(heap, &heap_size);
+    /* every prefix left is less likely than the k-th state found */
+    if (size == k && node.prob < probs[0]) {
+      free(node.env);
+      break;
+    }
+    if (node.depth == mps->qubits_num) {
+      q_top_k_offer(probs, indices, &size, k, node.prob, node.prefix);
+      free(node.env);
+      continue;
+    }
+    if (budget-- == 0) {
+      free(node.env);
+      status = -1;
+      break;
+    }
+
+    dl = mps->bond_dims[node.depth];
+    dr = mps->bond_dims[node.depth + 1];
+    for (s = 0; s < 2; s++) {
+      child.env = (struct t_complex *)malloc(dr * sizeof(struct t_complex));
+      if (child.env == NULL) {
+        status = -1;
+        break;
+      }
+      child.prob = 0.0;
+      for (b = 0; b < dr; b++) {
+        struct t_complex sum = c_zero();
+        for (a = 0; a < dl; a++)
+          sum = c_add(sum,
+                      c_mul(node.env[a],
+                            mps->sites[node.depth][((long)a * 2 + s) * dr + b]));
+        child.env[b] = sum;
+        child.prob += c_norm_sq(sum);
+      }
+      child.prefix = node.prefix | ((t_q_index)s << node.depth);
+      child.depth = node.depth + 1;
+
+      if (child.prob <= MPS_TOP_K_EPSILON ||
+          (size == k && child.prob < probs[0])) {
+        free(child.env);
+        continue;
+      }
+      if (q_mps_top_k_push(&heap, &heap_size, &heap_capacity, child) != 0) {
+        free(child.env);
+        status = -1;
+        break;
+      }
+    }
+    free(node.env);
+  }
+
+  while (heap_size > 0)
+    free(heap[--heap_size].env);
+  free(heap);
+  if (status != 0)
+    return -1;
+  q_top_k_sort(probs, indices, size);
+  return size;
+}
+
+/**
+ * Expectation value of a Pauli string by left-to-right transfer matrices
+ * @param mps Matrix product state
+ * @param pauli One of 'I', 'X', 'Y', 'Z' per qubit (qubits_num characters)
+ * @return <psi|P|psi>
+ */
+double q_mps_expectation_pauli(struct t_q_mps *mps, const char *pauli) {
+  struct t_complex *env, *next, *op_site, *partial;
+  struct t_complex result = c_zero();
+  long max_dim = 1;
+  int k;
+
+  for (k = 0; k <= mps->qubits_num; k++)
+    if (mps->bond_dims[k] > max_dim)
+      max_dim = mps->bond_dims[k];
+
+  env = (struct t_complex *)malloc(max_dim * max_dim * sizeof(struct t_complex));
+  next = (struct t_complex *)malloc(max_dim * max_dim * sizeof(struct t_complex));
+  op_site = (struct t_complex *)malloc(max_dim * 2 * max_dim * sizeof(struct t_complex));
+  partial = (struct t_complex *)malloc(max_dim * 2 * max_dim * sizeof(struct t_complex));
+  if (!env || !next || !op_site || !partial) {
+    free(env);
+    free(next);
+    free(op_site);
+    free(partial);
+    return 0.0;
+  }
+
+  env[0] = c_one();
+  for (k = 0; k < mps->qubits_num; k++) {
+    const struct t_complex *site = mps->sites[k];
+    long dl = mps->bond_dims[k];
+    long dr = mps->bond_dims[k + 1];
+    long a, a2, b, b2;
+    struct t_complex *tmp;
+    int s;
+
+    /* op_site[a'][s][b'] = sum_s' O[s][s'] A[a'][s'][b'] */
+    for (a = 0; a < dl; a++) {
+      for (b = 0; b < dr; b++) {
+        struct t_complex v0 = site[(a * 2) * dr + b];
+        struct t_complex v1 = site[(a * 2 + 1) * dr + b];
+        struct t_complex o0 = v0, o1 = v1;
+
+        switch (pauli[k]) {
+        case 'X':
+          o0 = v1;
+          o1 = v0;
+          break;
+        case 'Y':
+          o0.number_real = v1.number_imaginary;
+          o0.number_imaginary = -v1.number_real;
+          o1.number_real = -v0.number_imaginary;
+          o1.number_imaginary = v0.number_real;
+          break;
+        case 'Z':
+          o1.number_real = -v1.number_real;
+          o1.number_imaginary = -v1.number_imaginary;
+          break;
+        default:
+          break;
+        }
+        op_site[(a * 2) * dr + b] = o0;
+        op_site[(a * 2 + 1) * dr + b] = o1;
+      }
+    }
+
+    /* partial[a][s][b'] = sum_a' env[a][a'] op_site[a'][s][b'] */
+    for (a = 0; a < dl; a++) {
+      for (s = 0; s < 2; s++) {
+        for (b2 = 0; b2 < dr; b2++) {
+          struct t_complex sum = c_zero();
+          for (a2 = 0; a2 < dl; a2++)
+            sum = c_add(sum, c_mul(env[a * dl + a2],
+                                   op_site[(a2 * 2 + s) * dr + b2]));
+          partial[(a * 2 + s) * dr + b2] = sum;
+        }
+      }
+    }
+
+    /* next[b][b'] = sum_{a,s} conj(A[a][s][b]) partial[a][s][b'] */
+    for (b = 0; b < dr; b++) {
+      for (b2 = 0; b2 < dr; b2++) {
+        struct t_complex sum = c_zero();
+        for (a = 0; a < dl * 2; a++)
+          sum = c_add(sum, c_mul(c_conj(site[a * dr + b]),
+                                 partial[a * dr + b2]));
+        next[b * dr + b2] = sum;
+      }
+    }
+
+    tmp = env;
+    env = next;
+    next = tmp;
+  }
+
+  result = env[0];
+  free(env);
+  free(next);
+  free(op_site);
+  free(partial);
+  return result.number_real;
+}
+
+/**
+ * Print a summary of the MPS bond structure
+ * @param mps Matrix product state
+ */
+void q_mps_print(const struct t_q_mps *mps) {
+  int k;
+  int largest = 1;
+
+  printf("--- MPS State (%d Qubits) ---\n", mps->qubits_num);
+  printf("Bond dims:");
+  for (k = 1; k < mps->qubits_num; k++) {
+    printf(" %d", mps->bond_dims[k]);
+    if (mps->bond_dims[k] > largest)
+      largest = mps->bond_dims[k];
+  }
+  printf("\nLargest bond: %d / %d | Truncation error: %e\n", largest,
+         mps->max_bond_dim, mps->truncation_error);
+  printf("----------------------------------\n");
+}
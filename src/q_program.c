@@ -0,0 +1,357 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*
+ * A compiled program is the unitary part of a gate history rewritten as a
+ * list of kernel calls. Runs of 1-qubit gates on the same qubit, with no
+ * 2-qubit gate touching that qubit in between, are fused into one 2x2
+ * matrix. Each op keeps the list of gates (factors) it was fused from, so a
+ * bind only rebuilds the matrices whose factors reference a parameter slot
+ * whose value changed; all other matrices stay cached. The matrices live in
+ * a separate binding so that concurrent runs can share one program.
+ */
+
+static const char *const q_program_gate_names[] = {
+    "H", "X", "Y", "Z", "RX", "RY", "RZ", "P", "CNOT", "CPHASE"};
+
+#define Q_PROGRAM_NUM_GATES 10
+#define Q_PROGRAM_CNOT 8
+#define Q_PROGRAM_CPHASE 9
+
+/**
+ * Look up the program gate code of a history entry
+ * @param name Gate name from the history
+ * @return Gate code, or -1 if the gate cannot be compiled
+ */
+static int q_program_gate_code(const char *name) {
+  int code;
+
+  for (code = 0; code < Q_PROGRAM_NUM_GATES; code++) {
+    if (strcmp(name, q_program_gate_names[code]) == 0)
+      return code;
+  }
+  return -1;
+}
+
+/**
+ * Write the 2x2 matrix of a gate in place, without allocating
+ * @param code Gate code
+ * @param angle Gate angle (ignored by fixed gates)
+ * @param m Output matrix entries, row-major
+ */
+static void q_program_gate_fill(int code, double angle, struct t_complex *m) {
+  double root2_inv = 1.0 / sqrt(2.0);
+  double c = cos(angle / 2.0);
+  double s = sin(angle / 2.0);
+  int k;
+
+  for (k = 0; k < 4; k++)
+    m[k] = c_zero();
+
+  switch (code) {
+  case 0: /* H */
+    m[0] = c_from_real(root2_inv);
+    m[1] = c_from_real(root2_inv);
+    m[2] = c_from_real(root2_inv);
+    m[3] = c_from_real(-root2_inv);
+    break;
+  case 1: /* X */
+  case Q_PROGRAM_CNOT:
+    m[1] = c_one();
+    m[2] = c_one();
+    break;
+  case 2: /* Y */
+    m[1].number_imaginary = -1.0;
+    m[2].number_imaginary = 1.0;
+    break;
+  case 3: /* Z */
+    m[0] = c_one();
+    m[3] = c_from_real(-1.0);
+    break;
+  case 4: /* RX */
+    m[0].number_real = c;
+    m[1].number_imaginary = -s;
+    m[2].number_imaginary = -s;
+    m[3].number_real = c;
+    break;
+  case 5: /* RY */
+    m[0].number_real = c;
+    m[1].number_real = -s;
+    m[2].number_real = s;
+    m[3].number_real = c;
+    break;
+  case 6: /* RZ */
+    m[0].number_real = c;
+    m[0].number_imaginary = -s;
+    m[3].number_real = c;
+    m[3].number_imaginary = s;
+    break;
+  default: /* P, CPHASE */
+    m[0] = c_one();
+    m[3].number_real = cos(angle);
+    m[3].number_imaginary = sin(angle);
+    break;
+  }
+}
+
+/**
+ * Compile the unitary part of a gate history into fused kernel calls
+ * @param names Gate names
+ * @param targets Target qubits
+ * @param controls Control qubits (-1 for 1-qubit gates)
+ * @param params Literal angles
+ * @param slots Parameter slot of each gate (-1 for a literal angle)
+ * @param count Number of history entries
+ * @param num_qubits Number of qubits
+ * @return Compiled program, or NULL if the history holds a non-unitary
+ *         entry other than a terminal measurement (the caller checks that
+ *         measurements are terminal) or allocation fails
+ */
+struct t_q_program *q_program_compile(const char *const *names,
+                                      const int *targets, const int *controls,
+                                      const double *params, const int *slots,
+                                      int count, int num_qubits) {
+  struct t_q_program *program;
+  int *op_of = NULL;
+  int *pending = NULL;
+  int *fill = NULL;
+  int g, q, k;
+
+  program = (struct t_q_program *)calloc(1, sizeof(struct t_q_program));
+  if (program == NULL)
+    return NULL;
+
+  program->factors = (struct t_q_program_factor *)malloc(
+      (count > 0 ? count : 1) * sizeof(struct t_q_program_factor));
+  program->ops = (struct t_q_program_op *)calloc(
+      count > 0 ? count : 1, sizeof(struct t_q_program_op));
+  op_of = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+  pending = (int *)malloc(num_qubits * sizeof(int));
+  if (program->factors == NULL || program->ops == NULL || op_of == NULL ||
+      pending == NULL)
+    goto fail;
+
+  for (q = 0; q < num_qubits; q++)
+    pending[q] = -1;
+
+  /* assign each gate to an op; 2-qubit gates close the runs they touch */
+  for (g = 0; g < count; g++) {
+    int code;
+
+    op_of[g] = -1;
+    /* measurements are terminal here, so they commute past every gate */
+    if (strcmp(names[g], "BARRIER") == 0 || strcmp(names[g], "MEASURE") == 0)
+      continue;
+
+    code = q_program_gate_code(names[g]);
+    if (code < 0) {
+      fprintf(stderr, "Error: Gate %s cannot be compiled for binding.\n",
+              names[g]);
+      goto fail;
+    }
+
+    if (controls[g] >= 0) {
+      pending[controls[g]] = -1;
+      pending[targets[g]] = -1;
+      op_of[g] = program->num_ops;
+      program->ops[program->num_ops].target = targets[g];
+      program->ops[program->num_ops].control = controls[g];
+      program->num_ops++;
+    } else {
+      if (pending[targets[g]] < 0) {
+        pending[targets[g]] = program->num_ops;
+        program->ops[program->num_ops].target = targets[g];
+        program->ops[program->num_ops].control = -1;
+        program->num_ops++;
+      }
+      op_of[g] = pending[targets[g]];
+    }
+    program->ops[op_of[g]].num_factors++;
+    if (slots[g] >= program->num_slots)
+      program->num_slots = slots[g] + 1;
+  }
+
+  /* lay the factors of each op out contiguously, in history order */
+  fill = (int *)calloc(program->num_ops > 0 ? program->num_ops : 1,
+                       sizeof(int));
+  if (fill == NULL)
+    goto fail;
+  for (k = 0; k < program->num_ops; k++) {
+    program->ops[k].first_factor =
+        k == 0 ? 0
+               : program->ops[k - 1].first_factor +
+                     program->ops[k - 1].num_factors;
+  }
+  for (g = 0; g < count; g++) {
+    struct t_q_program_factor *f;
+    int op = op_of[g];
+
+    if (op < 0)
+      continue;
+    f = &program->factors[program->ops[op].first_factor + fill[op]++];
+    f->gate = q_program_gate_code(names[g]);
+    f->slot = slots[g];
+    f->angle = params[g];
+  }
+
+  program->binding = q_program_binding_init(program);
+  if (program->binding == NULL)
+    goto fail;
+
+  free(op_of);
+  free(pending);
+  free(fill);
+  return program;
+
+fail:
+  free(op_of);
+  free(pending);
+  free(fill);
+  q_program_free(program);
+  return NULL;
+}
+
+/**
+ * Rebuild the fused matrix of one op from its factors
+ * @param program Compiled program
+ * @param op Op to rebuild
+ * @param values Parameter slot values
+ * @param m Output matrix entries, row-major
+ */
+static void q_program_build_op(const struct t_q_program *program,
+                               const struct t_q_program_op *op,
+                               const double *values, struct t_complex *m) {
+  struct t_complex g[4], r[4];
+  int k;
+
+  m[0] = c_one();
+  m[1] = c_zero();
+  m[2] = c_zero();
+  m[3] = c_one();
+
+  /* later gates multiply from the left */
+  for (k = 0; k < op->num_factors; k++) {
+    const struct t_q_program_factor *f =
+        &program->factors[op->first_factor + k];
+
+    q_program_gate_fill(f->gate, f->slot >= 0 ? values[f->slot] : f->angle,
+                        g);
+    r[0] = c_add(c_mul(g[0], m[0]), c_mul(g[1], m[2]));
+    r[1] = c_add(c_mul(g[0], m[1]), c_mul(g[1], m[3]));
+    r[2] = c_add(c_mul(g[2], m[0]), c_mul(g[3], m[2]));
+    r[3] = c_add(c_mul(g[2], m[1]), c_mul(g[3], m[3]));
+    m[0] = r[0];
+    m[1] = r[1];
+    m[2] = r[2];
+    m[3] = r[3];
+  }
+}
+
+/**
+ * Allocate an unbound set of fused matrices for a program
+ * @param program Compiled program
+ * @return New binding, or NULL on allocation failure
+ */
+struct t_q_program_binding *
+q_program_binding_init(const struct t_q_program *program) {
+  struct t_q_program_binding *binding;
+
+  binding = (struct t_q_program_binding *)calloc(
+      1, sizeof(struct t_q_program_binding));
+  if (binding == NULL)
+    return NULL;
+
+  binding->cells = (struct t_complex *)calloc(
+      4 * (program->num_ops > 0 ? program->num_ops : 1),
+      sizeof(struct t_complex));
+  binding->values = (double *)calloc(
+      program->num_slots > 0 ? program->num_slots : 1, sizeof(double));
+  if (binding->cells == NULL || binding->values == NULL) {
+    q_program_binding_free(program, binding);
+    return NULL;
+  }
+  return binding;
+}
+
+/**
+ * Free a set of fused matrices
+ * @param program Program the binding belongs to
+ * @param binding Binding to free
+ */
+void q_program_binding_free(const struct t_q_program *program,
+                            struct t_q_program_binding *binding) {
+  (void)program;
+  if (binding == NULL)
+    return;
+  free(binding->cells);
+  free(binding->values);
+  free(binding);
+}
+
+/**
+ * Bind parameter values, rebuilding only the ops that depend on a slot
+ * whose value changed since the previous bind of the same binding
+ * @param program Compiled program (read-only, may be shared)
+ * @param binding Fused matrices to update
+ * @param values One value per parameter slot (program->num_slots entries)
+ * @return Number of op matrices rebuilt
+ */
+int q_program_bind(const struct t_q_program *program,
+                   struct t_q_program_binding *binding, const double *values) {
+  int rebuilt = 0;
+  int k, f;
+
+  for (k = 0; k < program->num_ops; k++) {
+    const struct t_q_program_op *op = &program->ops[k];
+    int dirty = !binding->bound;
+
+    for (f = 0; f < op->num_factors && !dirty; f++) {
+      int slot = program->factors[op->first_factor + f].slot;
+      if (slot >= 0 && values[slot] != binding->values[slot])
+        dirty = 1;
+    }
+
+    if (dirty) {
+      q_program_build_op(program, op, values, binding->cells + 4L * k);
+      rebuilt++;
+    }
+  }
+
+  if (program->num_slots > 0)
+    memcpy(binding->values, values, program->num_slots * sizeof(double));
+  binding->bound = 1;
+  return rebuilt;
+}
+
+/**
+ * View the fused matrix of one op as a gate, without allocating or copying
+ * @param binding Bound matrices
+ * @param op Op index
+ * @param view Caller-owned matrix header, pointed at the op's cells
+ * @return view
+ */
+const struct t_q_matrix *
+q_program_matrix(const struct t_q_program_binding *binding, int op,
+                 struct t_q_matrix *view) {
+  view->rows = 2;
+  view->cols = 2;
+  view->data = binding->cells + 4L * op;
+  return view;
+}
+
+/**
+ * Free a compiled program
+ * @param program Program to free
+ */
+void q_program_free(struct t_q_program *program) {
+  if (program == NULL)
+    return;
+  q_program_binding_free(program, program->binding);
+  free(program->ops);
+  free(program->factors);
+  free(program);
+}
@@ -0,0 +1,208 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * xoshiro256** generator, seeded through splitmix64. Each circuit owns one
+ * generator. Parallel work splits it into streams with the 2^128 jump: a
+ * stream is tied to a fixed work block, never to a thread, so results do
+ * not depend on how many threads run the blocks.
+ */
+
+#define RNG_BINOMIAL_DIRECT 16
+
+/**
+ * Rotate a 64-bit word left
+ * @param x Word
+ * @param k Bit count (1..63)
+ * @return Rotated word
+ */
+static unsigned long q_rng_rotl(unsigned long x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * splitmix64 step, used to expand a seed into generator state
+ * @param state Seed state
+ * @return Next 64-bit output
+ */
+static unsigned long q_rng_splitmix(unsigned long *state) {
+  unsigned long z = (*state += 0x9E3779B97F4A7C15UL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Seed a generator
+ * @param rng Generator
+ * @param seed Seed value
+ */
+void q_rng_seed(struct t_q_rng *rng, unsigned long seed) {
+  int k;
+
+  for (k = 0; k < 4; k++)
+    rng->s[k] = q_rng_splitmix(&seed);
+}
+
+/**
+ * Next 64-bit output
+ * @param rng Generator
+ * @return Random word
+ */
+unsigned long q_rng_next(struct t_q_rng *rng) {
+  unsigned long *s = rng->s;
+  unsigned long result = q_rng_rotl(s[1] * 5, 7) * 9;
+  unsigned long t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = q_rng_rotl(s[3], 45);
+  return result;
+}
+
+/**
+ * Uniform double in [0, 1) with 53-bit resolution
+ * @param rng Generator
+ * @return Random value
+ */
+double q_rng_uniform(struct t_q_rng *rng) {
+  return (double)(q_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Advance a generator by 2^128 steps
+ * @param rng Generator
+ */
+void q_rng_jump(struct t_q_rng *rng) {
+  static const unsigned long jump[4] = {
+      0x180EC6D33CFD0ABAUL, 0xD5A61266F0C9392CUL, 0xA9582618E03FC9AAUL,
+      0x39ABDC4529B1661CUL};
+  unsigned long s[4] = {0, 0, 0, 0};
+  int k, b;
+
+  for (k = 0; k < 4; k++) {
+    for (b = 0; b < 64; b++) {
+      if (jump[k] & (1UL << b)) {
+        s[0] ^= rng->s[0];
+        s[1] ^= rng->s[1];
+        s[2] ^= rng->s[2];
+        s[3] ^= rng->s[3];
+      }
+      q_rng_next(rng);
+    }
+  }
+  for (k = 0; k < 4; k++)
+    rng->s[k] = s[k];
+}
+
+/**
+ * Split non-overlapping streams off a generator. Stream k starts k + 1
+ * jumps ahead; the generator itself ends up past the last stream.
+ * @param rng Generator to split
+ * @param streams Output generators
+ * @param count Number of streams
+ */
+void q_rng_split(struct t_q_rng *rng, struct t_q_rng *streams, long count) {
+  long k;
+
+  for (k = 0; k < count; k++) {
+    q_rng_jump(rng);
+    streams[k] = *rng;
+  }
+  q_rng_jump(rng);
+}
+
+/**
+ * Standard exponential variate
+ * @param rng Generator
+ * @return Random value
+ */
+double q_rng_exponential(struct t_q_rng *rng) {
+  return -log(1.0 - q_rng_uniform(rng));
+}
+
+/**
+ * Standard normal variate (Marsaglia polar method)
+ * @param rng Generator
+ * @return Random value
+ */
+static double q_rng_normal(struct t_q_rng *rng) {
+  double u, v, s;
+
+  do {
+    u = 2.0 * q_rng_uniform(rng) - 1.0;
+    v = 2.0 * q_rng_uniform(rng) - 1.0;
+    s = u * u + v * v;
+  } while (s >= 1.0 || s == 0.0);
+  return u * sqrt(-2.0 * log(s) / s);
+}
+
+/**
+ * Gamma(shape, 1) variate for shape >= 1 (Marsaglia-Tsang)
+ * @param rng Generator
+ * @param shape Shape parameter
+ * @return Random value
+ */
+static double q_rng_gamma(struct t_q_rng *rng, double shape) {
+  double d = shape - 1.0 / 3.0;
+  double c = 1.0 / sqrt(9.0 * d);
+
+  for (;;) {
+    double x, v, u;
+
+    do {
+      x = q_rng_normal(rng);
+      v = 1.0 + c * x;
+    } while (v <= 0.0);
+    v = v * v * v;
+    u = q_rng_uniform(rng);
+    if (u < 1.0 - 0.0331 * x * x * x * x)
+      return d * v;
+    if (log(u) < 0.5 * x * x + d * (1.0 - v + log(v)))
+      return d * v;
+  }
+}
+
+/**
+ * Binomial(n, p) variate. Large n is halved repeatedly using the Beta
+ * distribution of the middle order statistic of n uniforms, so the cost is
+ * O(log n) gamma draws plus at most RNG_BINOMIAL_DIRECT Bernoulli trials.
+ * @param rng Generator
+ * @param n Number of trials
+ * @param p Success probability
+ * @return Number of successes
+ */
+long q_rng_binomial(struct t_q_rng *rng, long n, double p) {
+  long k = 0;
+
+  while (n > RNG_BINOMIAL_DIRECT && p > 0.0 && p < 1.0) {
+    long i = (n + 1) / 2;
+    double a = q_rng_gamma(rng, (double)i);
+    double x = a / (a + q_rng_gamma(rng, (double)(n + 1 - i)));
+
+    if (p < x) {
+      n = i - 1;
+      p = p / x;
+    } else {
+      k += i;
+      n -= i;
+      p = (p - x) / (1.0 - x);
+    }
+  }
+
+  if (p <= 0.0)
+    return k;
+  if (p >= 1.0)
+    return k + n;
+  for (; n > 0; n--) {
+    if (q_rng_uniform(rng) < p)
+      k++;
+  }
+  return k;
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * Reusable measurement sampler. The inclusive prefix sum of the outcome
+ * probabilities is built once (in parallel, over fixed blocks) and each
+ * shot is a binary search, O(log N) instead of a linear scan. For shot
+ * counts at or above the number of outcomes a Walker alias table is added
+ * on demand, making each shot O(1). The owner keeps the sampler until the
+ * state it was built from changes.
+ */
+
+#define SAMPLER_GRAIN 1
+
+struct t_cdf_ctx {
+  const struct t_complex *amplitudes;
+  double *cdf;
+  long size;
+  long blocks;
+  double *block_sums;
+};
+
+/**
+ * Parallel body writing block-local inclusive prefix sums
+ * @param context Prefix-sum context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_cdf_scan_body(void *context, long start, long end) {
+  struct t_cdf_ctx *ctx = (struct t_cdf_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double running = 0.0;
+    long lo, hi, i;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++) {
+      running += c_norm_sq(ctx->amplitudes[i]);
+      ctx->cdf[i] = running;
+    }
+    ctx->block_sums[b] = running;
+  }
+}
+
+/**
+ * Parallel body adding each block's offset to its prefix sums
+ * @param context Prefix-sum context (block_sums hold exclusive offsets)
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_cdf_offset_body(void *context, long start, long end) {
+  struct t_cdf_ctx *ctx = (struct t_cdf_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double offset = ctx->block_sums[b];
+    long lo, hi, i;
+
+    if (offset == 0.0)
+      continue;
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++)
+      ctx->cdf[i] += offset;
+  }
+}
+
+/**
+ * Build a sampler over a list of amplitudes
+ * @param amplitudes Amplitude of each outcome
+ * @param keys Basis-state label of each outcome, or NULL when outcome i is
+ *        basis state i; ownership passes to the sampler
+ * @param size Number of outcomes
+ * @return Sampler, or NULL on allocation failure (keys is freed)
+ */
+struct t_q_sampler *q_sampler_init(const struct t_complex *amplitudes,
+                                   long *keys, long size) {
+  struct t_q_sampler *sampler;
+  struct t_cdf_ctx ctx;
+  double block_sums[QCS_REDUCE_BLOCKS];
+  double offset = 0.0;
+  long b;
+
+  sampler = (struct t_q_sampler *)calloc(1, sizeof(struct t_q_sampler));
+  if (sampler == NULL) {
+    free(keys);
+    return NULL;
+  }
+  sampler->size = size;
+  sampler->keys = keys;
+  sampler->cdf = (double *)malloc((size > 0 ? size : 1) * sizeof(double));
+  if (sampler->cdf == NULL) {
+    q_sampler_free(sampler);
+    return NULL;
+  }
+
+  ctx.amplitudes = amplitudes;
+  ctx.cdf = sampler->cdf;
+  ctx.size = size;
+  ctx.blocks = size < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+  ctx.block_sums = block_sums;
+
+  if (size > 0) {
+    q_parallel_for(ctx.blocks, SAMPLER_GRAIN, q_cdf_scan_body, &ctx);
+    for (b = 0; b < ctx.blocks; b++) {
+      double sum = block_sums[b];
+      block_sums[b] = offset;
+      offset += sum;
+    }
+    q_parallel_for(ctx.blocks, SAMPLER_GRAIN, q_cdf_offset_body, &ctx);
+  }
+  sampler->total = offset;
+  return sampler;
+}
+
+/**
+ * Add a Walker alias table to a sampler (Vose's construction)
+ * @param sampler Sampler
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_sampler_build_alias(struct t_q_sampler *sampler) {
+  long n = sampler->size;
+  long *small, *large;
+  long num_small = 0, num_large = 0;
+  long i;
+
+  if (sampler->alias_prob != NULL)
+    return 0;
+  if (n <= 0 || sampler->total <= 0.0)
+    return -1;
+
+  sampler->alias_prob = (double *)malloc(n * sizeof(double));
+  sampler->alias_index = (long *)malloc(n * sizeof(long));
+  small = (long *)malloc(n * sizeof(long));
+  large = (long *)malloc(n * sizeof(long));
+  if (sampler->alias_prob == NULL || sampler->alias_index == NULL ||
+      small == NULL || large == NULL) {
+    free(sampler->alias_prob);
+    free(sampler->alias_index);
+    sampler->alias_prob = NULL;
+    sampler->alias_index = NULL;
+    free(small);
+    free(large);
+    return -1;
+  }
+
+  /* scaled probabilities: mean 1 */
+  for (i = 0; i < n; i++) {
+    double p = sampler->cdf[i] - (i > 0 ? sampler->cdf[i - 1] : 0.0);
+    sampler->alias_prob[i] = p * (double)n / sampler->total;
+    sampler->alias_index[i] = i;
+    if (sampler->alias_prob[i] < 1.0)
+      small[num_small++] = i;
+    else
+      large[num_large++] = i;
+  }
+
+  while (num_small > 0 && num_large > 0) {
+    long s = small[--num_small];
+    long l = large[num_large - 1];
+
+    sampler->alias_index[s] = l;
+    sampler->alias_prob[l] -= 1.0 - sampler->alias_prob[s];
+    if (sampler->alias_prob[l] < 1.0) {
+      num_large--;
+      small[num_small++] = l;
+    }
+  }
+
+  /* leftovers are 1 up to rounding */
+  while (num_large > 0)
+    sampler->alias_prob[large[--num_large]] = 1.0;
+  while (num_small > 0)
+    sampler->alias_prob[small[--num_small]] = 1.0;
+
+  free(small);
+  free(large);
+  return 0;
+}
+
+/**
+ * Draw one outcome
+ * @param sampler Sampler
+ * @param random_val Uniform random number in [0, 1)
+ * @return Sampled basis state
+ */
+long q_sampler_sample(const struct t_q_sampler *sampler, double random_val) {
+  long lo, hi, index;
+
+  if (sampler->size <= 0)
+    return 0;
+
+  if (sampler->alias_prob != NULL) {
+    double scaled = random_val * (double)sampler->size;
+    long column = (long)scaled;
+
+    if (column >= sampler->size)
+      column = sampler->size - 1;
+    index = (scaled - (double)column < sampler->alias_prob[column])
+                ? column
+                : sampler->alias_index[column];
+  } else {
+    double target = random_val * sampler->total;
+    int inclusive = 0;
+
+    lo = 0;
+    hi = sampler->size - 1;
+
+    /* past the end (rounding, or random_val == 1): last nonzero outcome */
+    if (target >= sampler->cdf[hi]) {
+      target = sampler->cdf[hi];
+      inclusive = 1;
+    }
+
+    /* first outcome whose cumulative probability exceeds target */
+    while (lo < hi) {
+      long mid = lo + (hi - lo) / 2;
+      if (sampler->cdf[mid] > target ||
+          (inclusive && sampler->cdf[mid] >= target))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    index = lo;
+  }
+
+  return sampler->keys != NULL ? sampler->keys[index] : index;
+}
+
+/**
+ * Free a sampler
+ * @param sampler Sampler to free
+ */
+void q_sampler_free(struct t_q_sampler *sampler) {
+  if (sampler == NULL)
+    return;
+  free(sampler->keys);
+  free(sampler->cdf);
+  free(sampler->alias_prob);
+  free(sampler->alias_index);
+  free(sampler);
+}
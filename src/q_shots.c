@@ -0,0 +1,364 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * Streaming shot sampler, O(2^n + shots) with no per-amplitude buffer.
+ *
+ * 1. One parallel pass sums the probability mass of fixed index blocks.
+ * 2. The shots are split across blocks with an exact multinomial draw
+ *    (conditional binomials).
+ * 3. Each block draws its shots' uniforms already sorted, largest first,
+ *    from exponential spacings (Renyi: log U(k) = log U(k+1) - E_k / k),
+ *    and merges them against its running cumulative probability while
+ *    walking its amplitudes from the top index down.
+ *
+ * Blocks own disjoint index ranges of the result array, so the merge runs
+ * in parallel without atomics, and each block draws from its own generator
+ * stream, so the histogram does not depend on the thread count. For a
+ * counts table each block fills its own table, merged once at the end.
+ */
+
+#define SHOT_BLOCKS QCS_REDUCE_BLOCKS
+
+struct t_shot_ctx {
+  const struct t_complex *vector;
+  long size;
+  long blocks;
+  double *masses;
+  long *counts;
+  struct t_q_rng *streams;
+  int *results;
+  struct t_q_counts **tables;
+  int failed;
+};
+
+/**
+ * Record the shots that landed on one outcome of a block
+ * @param ctx Shot context
+ * @param block Block index
+ * @param index Basis index
+ * @param hits Number of shots
+ */
+static void q_shot_emit(struct t_shot_ctx *ctx, long block, long index,
+                        long hits) {
+  if (ctx->results != NULL)
+    ctx->results[index] += (int)hits;
+  else if (q_counts_add(ctx->tables[block], (unsigned long)index, hits) != 0)
+    ctx->failed = 1;
+}
+
+/**
+ * Parallel body summing the probability mass of each block
+ * @param context Shot context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_shot_mass_body(void *context, long start, long end) {
+  struct t_shot_ctx *ctx = (struct t_shot_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double mass = 0.0;
+    long lo, hi, i;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++)
+      mass += c_norm_sq(ctx->vector[i]);
+    ctx->masses[b] = mass;
+  }
+}
+
+/**
+ * Parallel body merging each block's sorted uniforms with its amplitudes
+ * @param context Shot context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_shot_merge_body(void *context, long start, long end) {
+  struct t_shot_ctx *ctx = (struct t_shot_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    struct t_q_rng *rng = &ctx->streams[b];
+    long remaining = ctx->counts[b];
+    long lo, hi, i;
+    long last_nonzero = -1;
+    double top = ctx->masses[b];
+    double log_u = 0.0;
+    double target = 0.0;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    if (ctx->results != NULL) {
+      for (i = lo; i < hi; i++)
+        ctx->results[i] = 0;
+    } else {
+      ctx->tables[b] = q_counts_init(remaining < hi - lo ? remaining : hi - lo);
+      if (ctx->tables[b] == NULL) {
+        ctx->failed = 1;
+        continue;
+      }
+    }
+
+    if (remaining > 0) {
+      log_u = -q_rng_exponential(rng) / (double)remaining;
+      target = exp(log_u) * top;
+    }
+
+    for (i = hi - 1; i >= lo && remaining > 0; i--) {
+      double p = c_norm_sq(ctx->vector[i]);
+      double lower = top - p;
+      long hits = 0;
+
+      if (p <= 0.0)
+        continue;
+      last_nonzero = i;
+      while (remaining > 0 && target >= lower) {
+        hits++;
+        remaining--;
+        if (remaining > 0) {
+          log_u -= q_rng_exponential(rng) / (double)remaining;
+          target = exp(log_u) * ctx->masses[b];
+        }
+      }
+      if (hits > 0)
+        q_shot_emit(ctx, b, i, hits);
+      top = lower;
+    }
+
+    /* rounding left the lowest targets below the last boundary */
+    if (remaining > 0 && last_nonzero >= 0)
+      q_shot_emit(ctx, b, last_nonzero, remaining);
+  }
+}
+
+/**
+ * Sample measurement outcomes of a dense state without building a
+ * cumulative-probability array
+ * @param state Quantum state (not modified)
+ * @param shots Number of shots
+ * @param rng Generator; block streams are split off it
+ * @param sink Output: dense histogram of state->size entries, or a counts
+ *        table the outcomes are added to
+ * @return 0 on success, -1 if the state has no probability mass or a
+ *         counts table could not grow
+ */
+int q_state_sample_counts(const struct t_q_state *state, long shots,
+                          struct t_q_rng *rng, struct t_q_shot_sink *sink) {
+  struct t_shot_ctx ctx;
+  double masses[SHOT_BLOCKS];
+  long counts[SHOT_BLOCKS];
+  struct t_q_rng streams[SHOT_BLOCKS];
+  struct t_q_counts *tables[SHOT_BLOCKS];
+  double remaining_mass = 0.0;
+  long remaining = shots;
+  long b;
+
+  ctx.vector = state->vector;
+  ctx.size = state->size;
+  ctx.blocks = state->size < SHOT_BLOCKS ? 1 : SHOT_BLOCKS;
+  ctx.masses = masses;
+  ctx.counts = counts;
+  ctx.streams = streams;
+  ctx.results = sink->dense;
+  ctx.tables = tables;
+  ctx.failed = 0;
+
+  q_parallel_for(ctx.blocks, 1, q_shot_mass_body, &ctx);
+  for (b = 0; b < ctx.blocks; b++)
+    remaining_mass += masses[b];
+  if (remaining_mass <= 0.0)
+    return -1;
+
+  /* multinomial split: conditional binomials over the remaining mass */
+  for (b = 0; b < ctx.blocks; b++) {
+    if (b == ctx.blocks - 1 || remaining == 0) {
+      counts[b] = remaining;
+    } else {
+      counts[b] = q_rng_binomial(rng, remaining, masses[b] / remaining_mass);
+    }
+    remaining -= counts[b];
+    remaining_mass -= masses[b];
+  }
+
+  for (b = 0; b < ctx.blocks; b++)
+    tables[b] = NULL;
+  q_rng_split(rng, streams, ctx.blocks);
+  q_parallel_for(ctx.blocks, 1, q_shot_merge_body, &ctx);
+
+  if (sink->dense == NULL) {
+    for (b = 0; b < ctx.blocks; b++) {
+      if (tables[b] != NULL && q_counts_merge(sink->counts, tables[b]) != 0)
+        ctx.failed = 1;
+      q_counts_free(tables[b]);
+    }
+  }
+  return ctx.failed ? -1 : 0;
+}
+
+/*
+ * Independent draws (cached sampler, MPS) are spread over a fixed number of
+ * shot chunks, each with its own generator stream. Every worker tallies its
+ * chunks privately and adds the tally to the shared histogram under a lock;
+ * integer counts sum the same in any order, so the result depends only on
+ * the seed. For a dense histogram a worker keeps a full histogram when it
+ * draws at least half as many shots as there are outcomes, and a list of
+ * outcomes otherwise; for a counts table it keeps a counts table.
+ */
+
+#define SHOT_CHUNKS QCS_REDUCE_BLOCKS
+
+struct t_draw_ctx {
+  long shots;
+  long size;
+  long (*draw)(void *context, struct t_q_rng *rng);
+  void *context;
+  struct t_q_rng *streams;
+  int *results;
+  struct t_q_counts *counts;
+  int failed;
+  pthread_mutex_t lock;
+};
+
+/**
+ * Number of shots assigned to a chunk
+ * @param shots Total shots
+ * @param chunk Chunk index
+ * @return Shots in the chunk
+ */
+static long q_draw_chunk_shots(long shots, long chunk) {
+  return shots / SHOT_CHUNKS + (chunk < shots % SHOT_CHUNKS ? 1 : 0);
+}
+
+/**
+ * Parallel body drawing a range of chunks into a private tally
+ * @param context Draw context
+ * @param start First chunk
+ * @param end One past the last chunk
+ */
+static void q_draw_body(void *context, long start, long end) {
+  struct t_draw_ctx *ctx = (struct t_draw_ctx *)context;
+  long shots = 0;
+  long c, s, n = 0;
+  int *histogram = NULL;
+  long *outcomes = NULL;
+  struct t_q_counts *table;
+
+  if (ctx->results == NULL) {
+    /* a single worker owns the whole table */
+    table = (start == 0 && end == SHOT_CHUNKS) ? ctx->counts
+                                                : q_counts_init(0);
+    if (table == NULL) {
+      ctx->failed = 1;
+      return;
+    }
+    for (c = start; c < end; c++) {
+      for (s = q_draw_chunk_shots(ctx->shots, c); s > 0; s--) {
+        long index = ctx->draw(ctx->context, &ctx->streams[c]);
+        if (q_counts_add(table, (unsigned long)index, 1) != 0)
+          ctx->failed = 1;
+      }
+    }
+    if (table != ctx->counts) {
+      pthread_mutex_lock(&ctx->lock);
+      if (q_counts_merge(ctx->counts, table) != 0)
+        ctx->failed = 1;
+      pthread_mutex_unlock(&ctx->lock);
+      q_counts_free(table);
+    }
+    return;
+  }
+
+  /* a single worker owns the whole histogram */
+  if (start == 0 && end == SHOT_CHUNKS) {
+    for (c = start; c < end; c++)
+      for (s = q_draw_chunk_shots(ctx->shots, c); s > 0; s--)
+        ctx->results[ctx->draw(ctx->context, &ctx->streams[c])]++;
+    return;
+  }
+
+  for (c = start; c < end; c++)
+    shots += q_draw_chunk_shots(ctx->shots, c);
+  if (2 * shots >= ctx->size)
+    histogram = (int *)calloc(ctx->size, sizeof(int));
+  else
+    outcomes = (long *)malloc((shots > 0 ? shots : 1) * sizeof(long));
+
+  if (histogram == NULL && outcomes == NULL) {
+    /* no private tally: draw straight into the shared histogram */
+    pthread_mutex_lock(&ctx->lock);
+    for (c = start; c < end; c++)
+      for (s = q_draw_chunk_shots(ctx->shots, c); s > 0; s--)
+        ctx->results[ctx->draw(ctx->context, &ctx->streams[c])]++;
+    pthread_mutex_unlock(&ctx->lock);
+    return;
+  }
+
+  for (c = start; c < end; c++) {
+    for (s = q_draw_chunk_shots(ctx->shots, c); s > 0; s--) {
+      long index = ctx->draw(ctx->context, &ctx->streams[c]);
+      if (histogram)
+        histogram[index]++;
+      else
+        outcomes[n++] = index;
+    }
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  if (histogram) {
+    for (s = 0; s < ctx->size; s++)
+      ctx->results[s] += histogram[s];
+  } else {
+    for (s = 0; s < n; s++)
+      ctx->results[outcomes[s]]++;
+  }
+  pthread_mutex_unlock(&ctx->lock);
+
+  free(histogram);
+  free(outcomes);
+}
+
+/**
+ * Draw independent shots in parallel
+ * @param shots Number of shots
+ * @param size Number of outcomes (dense histogram entries; unused for a
+ *        counts table)
+ * @param draw Returns one outcome using the given generator; must be safe
+ *        to call concurrently with distinct generators
+ * @param context Context passed to draw
+ * @param rng Generator; chunk streams are split off it
+ * @param sink Output: dense histogram of size entries, or a counts table
+ *        the outcomes are added to
+ * @return 0 on success, -1 if a counts table could not grow
+ */
+int q_sample_shots(long shots, long size,
+                   long (*draw)(void *context, struct t_q_rng *rng),
+                   void *context, struct t_q_rng *rng,
+                   struct t_q_shot_sink *sink) {
+  struct t_draw_ctx ctx;
+  struct t_q_rng streams[SHOT_CHUNKS];
+  long i;
+
+  if (sink->dense != NULL) {
+    for (i = 0; i < size; i++)
+      sink->dense[i] = 0;
+  }
+
+  ctx.shots = shots;
+  ctx.size = size;
+  ctx.draw = draw;
+  ctx.context = context;
+  ctx.streams = streams;
+  ctx.results = sink->dense;
+  ctx.counts = sink->counts;
+  ctx.failed = 0;
+  pthread_mutex_init(&ctx.lock, NULL);
+
+  q_rng_split(rng, streams, SHOT_CHUNKS);
+  q_parallel_for(SHOT_CHUNKS, 1, q_draw_body, &ctx);
+
+  pthread_mutex_destroy(&ctx.lock);
+  return ctx.failed ? -1 : 0;
+}
@@ -0,0 +1,586 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define SPARSE_MIN_CAPACITY 16L
+#define SPARSE_EPSILON_SQ 1e-24
+
+/*
+ * The sparse backend keeps only the nonzero amplitudes in an open-addressing
+ * hash (linear probing, load factor <= 1/2). Gates read the live entries of
+ * "keys/values" and write a fresh table into "scratch_keys/scratch_values",
+ * then the two tables are swapped, mirroring vector/scratch_vector in the
+ * dense backend.
+ */
+
+/**
+ * Hash a basis index into a table slot (Fibonacci hashing)
+ * @param key Basis state index
+ * @param capacity Table capacity (power of two)
+ * @return Slot index
+ */
+static long q_sparse_slot(long key, long capacity) {
+  unsigned long h = (unsigned long)key * 0x9E3779B97F4A7C15UL;
+  return (long)((h ^ (h >> 29)) & (unsigned long)(capacity - 1));
+}
+
+/**
+ * Find the slot holding key, or the empty slot where it would go
+ * @param keys Table keys
+ * @param capacity Table capacity
+ * @param key Basis state index
+ * @return Slot index
+ */
+static long q_sparse_find(const long *keys, long capacity, long key) {
+  long slot = q_sparse_slot(key, capacity);
+
+  while (keys[slot] != SPARSE_EMPTY_KEY && keys[slot] != key)
+    slot = (slot + 1) & (capacity - 1);
+  return slot;
+}
+
+/**
+ * Allocate an empty key/value table
+ * @param capacity Table capacity (power of two)
+ * @param keys Output key array
+ * @param values Output value array
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_sparse_alloc_table(long capacity, long **keys,
+                                struct t_complex **values) {
+  long i;
+
+  *keys = (long *)malloc(capacity * sizeof(long));
+  *values = (struct t_complex *)malloc(capacity * sizeof(struct t_complex));
+  if (*keys == NULL || *values == NULL) {
+    free(*keys);
+    free(*values);
+    *keys = NULL;
+    *values = NULL;
+    return -1;
+  }
+
+  for (i = 0; i < capacity; i++)
+    (*keys)[i] = SPARSE_EMPTY_KEY;
+  return 0;
+}
+
+/**
+ * Make sure the scratch table can hold at least entries at load <= 1/2
+ * @param sparse Sparse state
+ * @param entries Number of entries the next table may need
+ * @return 0 on success, -1 on allocation failure
+ */
+static int q_sparse_prepare_scratch(struct t_q_sparse *sparse, long entries) {
+  long capacity = SPARSE_MIN_CAPACITY;
+  long i;
+
+  while (capacity < 2 * entries)
+    capacity <<= 1;
+
+  if (capacity != sparse->scratch_capacity) {
+    free(sparse->scratch_keys);
+    free(sparse->scratch_values);
+    sparse->scratch_capacity = 0;
+    if (q_sparse_alloc_table(capacity, &sparse->scratch_keys,
+                             &sparse->scratch_values) != 0)
+      return -1;
+    sparse->scratch_capacity = capacity;
+  } else {
+    for (i = 0; i < capacity; i++)
+      sparse->scratch_keys[i] = SPARSE_EMPTY_KEY;
+  }
+  return 0;
+}
+
+/**
+ * Store an amplitude in the scratch table unless it is below epsilon
+ * @param sparse Sparse state
+ * @param key Basis state index
+ * @param value Amplitude
+ * @param count Running entry count of the scratch table
+ */
+static void q_sparse_emit(struct t_q_sparse *sparse, long key,
+                          struct t_complex value, long *count) {
+  long slot;
+
+  if (c_norm_sq(value) < SPARSE_EPSILON_SQ)
+    return;
+
+  slot = q_sparse_find(sparse->scratch_keys, sparse->scratch_capacity, key);
+  sparse->scratch_keys[slot] = key;
+  sparse->scratch_values[slot] = value;
+  (*count)++;
+}
+
+/**
+ * Swap the scratch table in as the live table
+ * @param sparse Sparse state
+ * @param count Number of entries written to the scratch table
+ */
+static void q_sparse_swap(struct t_q_sparse *sparse, long count) {
+  long *keys = sparse->keys;
+  struct t_complex *values = sparse->values;
+  long capacity = sparse->capacity;
+
+  sparse->keys = sparse->scratch_keys;
+  sparse->values = sparse->scratch_values;
+  sparse->capacity = sparse->scratch_capacity;
+  sparse->count = count;
+
+  sparse->scratch_keys = keys;
+  sparse->scratch_values = values;
+  sparse->scratch_capacity = capacity;
+}
+
+/**
+ * Initialize a sparse quantum state in |0...0>
+ * @param qubits_num Number of qubits (at most 62)
+ * @return Pointer to allocated sparse state or NULL on failure
+ */
+struct t_q_sparse *q_sparse_init(int qubits_num) {
+  struct t_q_sparse *sparse;
+
+  if (qubits_num <= 0 || qubits_num > 62) {
+    fprintf(stderr, "Error: Sparse backend supports 1 to 62 qubits.\n");
+    return NULL;
+  }
+
+  sparse = (struct t_q_sparse *)malloc(sizeof(struct t_q_sparse));
+  if (sparse == NULL)
+    return NULL;
+
+  sparse->qubits_num = qubits_num;
+  sparse->count = 0;
+  sparse->capacity = SPARSE_MIN_CAPACITY;
+  sparse->scratch_capacity = 0;
+  sparse->scratch_keys = NULL;
+  sparse->scratch_values = NULL;
+
+  if (q_sparse_alloc_table(sparse->capacity, &sparse->keys,
+                           &sparse->values) != 0) {
+    free(sparse);
+    return NULL;
+  }
+
+  q_sparse_set(sparse, 0, c_one());
+  return sparse;
+}
+
+/**
+ * Free memory allocated for a sparse state
+ * @param sparse Sparse state to free
+ */
+void q_sparse_free(struct t_q_sparse *sparse) {
+  if (sparse) {
+    free(sparse->keys);
+    free(sparse->values);
+    free(sparse->scratch_keys);
+    free(sparse->scratch_values);
+    free(sparse);
+  }
+}
+
+/**
+ * Deep copy of a sparse state (the scratch tables are not copied)
+ * @param sparse Sparse state
+ * @return Independent copy, or NULL on allocation failure
+ */
+struct t_q_sparse *q_sparse_clone(const struct t_q_sparse *sparse) {
+  struct t_q_sparse *copy;
+
+  copy = (struct t_q_sparse *)malloc(sizeof(struct t_q_sparse));
+  if (copy == NULL)
+    return NULL;
+
+  copy->qubits_num = sparse->qubits_num;
+  copy->count = sparse->count;
+  copy->capacity = sparse->capacity;
+  copy->scratch_capacity = 0;
+  copy->scratch_keys = NULL;
+  copy->scratch_values = NULL;
+  copy->keys = (long *)malloc(sparse->capacity * sizeof(long));
+  copy->values = (struct t_complex *)malloc(sparse->capacity *
+                                            sizeof(struct t_complex));
+  if (copy->keys == NULL || copy->values == NULL) {
+    q_sparse_free(copy);
+    return NULL;
+  }
+  memcpy(copy->keys, sparse->keys, sparse->capacity * sizeof(long));
+  memcpy(copy->values, sparse->values,
+         sparse->capacity * sizeof(struct t_complex));
+  return copy;
+}
+
+/**
+ * Look up the amplitude of a basis state
+ * @param sparse Sparse state
+ * @param index Basis state index
+ * @return Amplitude, or zero if the entry is not stored
+ */
+struct t_complex q_sparse_get(const struct t_q_sparse *sparse,
+                              t_q_index index) {
+  long slot = q_sparse_find(sparse->keys, sparse->capacity, index);
+
+  if (sparse->keys[slot] == SPARSE_EMPTY_KEY)
+    return c_zero();
+  return sparse->values[slot];
+}
+
+/**
+ * Insert or overwrite the amplitude of a basis state
+ * @param sparse Sparse state
+ * @param index Basis state index
+ * @param value Amplitude to store
+ * @return 0 on success, -1 on allocation failure
+ */
+int q_sparse_set(struct t_q_sparse *sparse, t_q_index index,
+                 struct t_complex value) {
+  long slot;
+  long i;
+
+  if (2 * (sparse->count + 1) > sparse->capacity) {
+    long count = 0;
+
+    if (q_sparse_prepare_scratch(sparse, sparse->count + 1) != 0)
+      return -1;
+    for (i = 0; i < sparse->capacity; i++) {
+      if (sparse->keys[i] != SPARSE_EMPTY_KEY)
+        q_sparse_emit(sparse, sparse->keys[i], sparse->values[i], &count);
+    }
+    q_sparse_swap(sparse, count);
+  }
+
+  slot = q_sparse_find(sparse->keys, sparse->capacity, index);
+  if (sparse->keys[slot] == SPARSE_EMPTY_KEY) {
+    sparse->keys[slot] = index;
+    sparse->count++;
+  }
+  sparse->values[slot] = value;
+  return 0;
+}
+
+/**
+ * Apply a (optionally controlled) 2x2 gate touching only live entries
+ * @param sparse Sparse state
+ * @param gate 2x2 gate matrix
+ * @param control_qubit Control qubit index, or -1 for an uncontrolled gate
+ * @param target_qubit Target qubit index
+ */
+static void q_sparse_apply(struct t_q_sparse *sparse,
+                           const struct t_q_matrix *gate, int control_qubit,
+                           int target_qubit) {
+  long t_bit = 1L << target_qubit;
+  long c_bit = control_qubit >= 0 ? (1L << control_qubit) : 0;
+  long count = 0;
+  long i;
+
+  if (q_sparse_prepare_scratch(sparse, 2 * sparse->count) != 0) {
+    fprintf(stderr, "Error: Sparse gate failed to allocate memory.\n");
+    return;
+  }
+
+  for (i = 0; i < sparse->capacity; i++) {
+    long key = sparse->keys[i];
+    long index0, index1;
+    struct t_complex v0, v1;
+
+    if (key == SPARSE_EMPTY_KEY)
+      continue;
+
+    if ((key & c_bit) != c_bit) {
+      q_sparse_emit(sparse, key, sparse->values[i], &count);
+      continue;
+    }
+
+    index0 = key & ~t_bit;
+    index1 = key | t_bit;
+
+    if (key == index0) {
+      v0 = sparse->values[i];
+      v1 = q_sparse_get(sparse, index1);
+    } else {
+      /* The |0> partner, when stored, already produced both outputs */
+      long slot = q_sparse_find(sparse->keys, sparse->capacity, index0);
+      if (sparse->keys[slot] != SPARSE_EMPTY_KEY)
+        continue;
+      v0 = c_zero();
+      v1 = sparse->values[i];
+    }
+
+    q_sparse_emit(sparse, index0,
+                  c_add(c_mul(gate->data[0], v0), c_mul(gate->data[1], v1)),
+                  &count);
+    q_sparse_emit(sparse, index1,
+                  c_add(c_mul(gate->data[2], v0), c_mul(gate->data[3], v1)),
+                  &count);
+  }
+
+  q_sparse_swap(sparse, count);
+}
+
+/**
+ * Apply a 1-qubit gate to the sparse state
+ * @param sparse Sparse state
+ * @param gate 2x2 gate matrix
+ * @param target_qubit Target qubit index
+ */
+void q_sparse_apply_1q_gate(struct t_q_sparse *sparse,
+                            const struct t_q_matrix *gate, int target_qubit) {
+  if (sparse == NULL || gate == NULL || target_qubit < 0 ||
+      target_qubit >= sparse->qubits_num) {
+    fprintf(stderr, "Error: Invalid arguments for sparse 1-qubit gate.\n");
+    return;
+  }
+  q_sparse_apply(sparse, gate, -1, target_qubit);
+}
+
+/**
+ * Apply a controlled 1-qubit gate to the sparse state
+ * @param sparse Sparse state
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control_qubit Control qubit index
+ * @param target_qubit Target qubit index
+ */
+void q_sparse_apply_2q_gate(struct t_q_sparse *sparse,
+                            const struct t_q_matrix *gate, int control_qubit,
+                            int target_qubit) {
+  if (sparse == NULL || gate == NULL || control_qubit < 0 || target_qubit < 0 ||
+      control_qubit >= sparse->qubits_num ||
+      target_qubit >= sparse->qubits_num || control_qubit == target_qubit) {
+    fprintf(stderr, "Error: Invalid arguments for sparse 2-qubit gate.\n");
+    return;
+  }
+  q_sparse_apply(sparse, gate, control_qubit, target_qubit);
+}
+
+/**
+ * Measure one qubit of the sparse state and collapse it
+ * @param sparse Sparse state
+ * @param qubit Qubit to measure
+ * @param random_val Uniform random number in [0, 1]
+ * @return Measured value (0 or 1)
+ */
+int q_sparse_measure(struct t_q_sparse *sparse, int qubit, double random_val) {
+  long bit = 1L << qubit;
+  double prob[2];
+  double scale;
+  long count = 0;
+  long i;
+  int outcome;
+
+  prob[0] = prob[1] = 0.0;
+  for (i = 0; i < sparse->capacity; i++) {
+    if (sparse->keys[i] != SPARSE_EMPTY_KEY)
+      prob[(sparse->keys[i] & bit) ? 1 : 0] += c_norm_sq(sparse->values[i]);
+  }
+
+  outcome = (random_val * (prob[0] + prob[1]) <= prob[0]) ? 0 : 1;
+  scale = prob[outcome] > 1e-300 ? 1.0 / sqrt(prob[outcome]) : 0.0;
+
+  if (q_sparse_prepare_scratch(sparse, sparse->count) != 0) {
+    fprintf(stderr, "Error: Sparse measurement failed to allocate memory.\n");
+    return outcome;
+  }
+
+  for (i = 0; i < sparse->capacity; i++) {
+    long key = sparse->keys[i];
+    struct t_complex amp;
+
+    if (key == SPARSE_EMPTY_KEY || ((key & bit) ? 1 : 0) != outcome)
+      continue;
+    amp = sparse->values[i];
+    amp.number_real *= scale;
+    amp.number_imaginary *= scale;
+    q_sparse_emit(sparse, key, amp, &count);
+  }
+
+  q_sparse_swap(sparse, count);
+  return outcome;
+}
+
+/**
+ * Fraction of the 2^n basis states currently stored
+ * @param sparse Sparse state
+ * @return Fill ratio in [0, 1]
+ */
+double q_sparse_fill_ratio(const struct t_q_sparse *sparse) {
+  return (double)sparse->count / ldexp(1.0, sparse->qubits_num);
+}
+
+/**
+ * Build a dense state vector holding the same amplitudes
+ * @param sparse Sparse state
+ * @return Newly allocated dense state or NULL on failure
+ */
+struct t_q_state *q_sparse_to_dense(const struct t_q_sparse *sparse) {
+  struct t_q_state *state = q_state_init(sparse->qubits_num);
+  long i;
+
+  if (state == NULL)
+    return NULL;
+
+  state->vector[0] = c_zero();
+  for (i = 0; i < sparse->capacity; i++) {
+    if (sparse->keys[i] != SPARSE_EMPTY_KEY)
+      state->vector[sparse->keys[i]] = sparse->values[i];
+  }
+  return state;
+}
+
+/**
+ * Print the stored amplitudes of a sparse state
+ * @param sparse Sparse state
+ */
+void q_sparse_print(const struct t_q_sparse *sparse) {
+  long i;
+  long printed = 0;
+
+  printf("--- Sparse Quantum State (%d Qubits, %ld nonzero) ---\n",
+         sparse->qubits_num, sparse->count);
+
+  for (i = 0; i < sparse->capacity && printed < 8; i++) {
+    if (sparse->keys[i] != SPARSE_EMPTY_KEY) {
+      printf("|%ld>: %f + i%f\n", sparse->keys[i],
+             sparse->values[i].number_real,
+             sparse->values[i].number_imaginary);
+      printed++;
+    }
+  }
+  if (sparse->count > printed)
+    printf("...\n");
+
+  printf("----------------------------------\n");
+}
+
+/**
+ * Build a measurement sampler over the stored amplitudes
+ * @param sparse Sparse state
+ * @return Sampler whose outcomes are the stored basis states, or NULL on
+ *         allocation failure
+ */
+struct t_q_sampler *q_sparse_sampler(const struct t_q_sparse *sparse) {
+  struct t_q_sampler *sampler;
+  struct t_complex *amplitudes;
+  long *keys;
+  long count = 0;
+  long i;
+
+  keys = (long *)malloc((sparse->count > 0 ? sparse->count : 1) * sizeof(long));
+  amplitudes = (struct t_complex *)malloc(
+      (sparse->count > 0 ? sparse->count : 1) * sizeof(struct t_complex));
+  if (keys == NULL || amplitudes == NULL) {
+    free(keys);
+    free(amplitudes);
+    return NULL;
+  }
+
+  for (i = 0; i < sparse->capacity; i++) {
+    if (sparse->keys[i] != SPARSE_EMPTY_KEY) {
+      keys[count] = sparse->keys[i];
+      amplitudes[count] = sparse->values[i];
+      count++;
+    }
+  }
+
+  sampler = q_sampler_init(amplitudes, keys, count);
+  free(amplitudes);
+  return sampler;
+}
+
+/**
+ * The k most likely stored basis states
+ * @param sparse Sparse state
+ * @param k Number of states wanted
+ * @param indices Output basis indices, most likely first (k entries)
+ * @param probs Output probabilities (k entries)
+ * @return Number of states written
+ */
+long q_sparse_top_k(const struct t_q_sparse *sparse, long k,
+                    t_q_index *indices, double *probs) {
+  long size = 0;
+  long i;
+
+  if (k <= 0)
+    return 0;
+  for (i = 0; i < sparse->capacity; i++) {
+    double prob;
+
+    if (sparse->keys[i] == SPARSE_EMPTY_KEY)
+      continue;
+    prob = c_norm_sq(sparse->values[i]);
+    if (prob > 0.0)
+      q_top_k_offer(probs, indices, &size, k, prob, sparse->keys[i]);
+  }
+  q_top_k_sort(probs, indices, size);
+  return size;
+}
+
+/**
+ * Expectation value of a Pauli string over the stored amplitudes
+ * @param sparse Sparse state
+ * @param flip_mask Qubits carrying X or Y
+ * @param z_mask Qubits carrying Y or Z
+ * @param y_count Number of Y factors
+ * @return <psi|P|psi>
+ */
+double q_sparse_expectation_pauli(const struct t_q_sparse *sparse,
+                                  long flip_mask, long z_mask, int y_count) {
+  struct t_complex sum = c_zero();
+  long i;
+
+  for (i = 0; i < sparse->capacity; i++) {
+    long key = sparse->keys[i];
+    struct t_complex term;
+
+    if (key == SPARSE_EMPTY_KEY)
+      continue;
+
+    term = c_mul(c_conj(q_sparse_get(sparse, key ^ flip_mask)),
+                 sparse->values[i]);
+    if (__builtin_parityl((unsigned long)(key & z_mask)))
+      sum = c_sub(sum, term);
+    else
+      sum = c_add(sum, term);
+  }
+
+  switch (y_count & 3) {
+  case 0:
+    return sum.number_real;
+  case 1:
+    return -sum.number_imaginary;
+  case 2:
+    return -sum.number_real;
+  default:
+    return sum.number_imaginary;
+  }
+}
+
+/**
+ * Marginal probabilities of a subset of qubits over the stored amplitudes
+ * @param sparse Sparse state
+ * @param qubits Distinct qubits; bit j of an outcome is qubit qubits[j]
+ * @param k Number of qubits
+ * @param out Output array of 2^k probabilities
+ */
+void q_sparse_marginal(const struct t_q_sparse *sparse, const int *qubits,
+                       int k, double *out) {
+  long i, outcomes = 1L << k;
+  int j;
+
+  for (i = 0; i < outcomes; i++)
+    out[i] = 0.0;
+
+  for (i = 0; i < sparse->capacity; i++) {
+    long key = 0;
+
+    if (sparse->keys[i] == SPARSE_EMPTY_KEY)
+      continue;
+    for (j = 0; j < k; j++)
+      key |= ((sparse->keys[i] >> qubits[j]) & 1L) << j;
+    out[key] += c_norm_sq(sparse->values[i]);
+  }
+}
@@ -1,29 +1,11 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "internal.h"
 
-#define CACHE_LINE_SIZE 64
-
-#ifdef QCS_MULTI_THREAD
-extern thread_pool_t *pool;
-#endif
-
-/**
- * Worker function for parallel state initialization
- * @param arg Thread arguments containing state and range
- */
-static void q_state_init_worker(void *arg) {
-  struct t_thread_args *args = (struct t_thread_args *)arg;
-  long i;
-
-  for (i = args->start; i < args->end; i++) {
-    args->state->vector[i] = c_zero();
-    args->state->scratch_vector[i] = c_zero();
-  }
-  free(args);
-}
-
 /**
  * Initialize a quantum state vector with specified number of qubits
  * @param num_qubits Number of qubits in the system
@@ -31,71 +13,44 @@ static void q_state_init_worker(void *arg) {
  */
 struct t_q_state *q_state_init(int num_qubits) {
   struct t_q_state *state;
-  long size;
-  int i;
-  int ret;
+  int policy = q_alloc_get_policy();
+  int vector_used, scratch_used;
 
   if (num_qubits <= 0) {
     fprintf(stderr, "Error: Number of qubits must be positive.\n");
     return NULL;
   }
 
-  size = 1L << num_qubits;
   state = (struct t_q_state *)malloc(sizeof(struct t_q_state));
   if (state == NULL) {
     return NULL;
   }
 
-  ret = posix_memalign((void **)&state->vector, CACHE_LINE_SIZE,
-                       size * sizeof(struct t_complex));
-  if (ret != 0) {
+  state->qubits_num = num_qubits;
+  state->size = (t_q_index)1 << num_qubits;
+  state->file_vector = NULL;
+
+  state->vector = q_alloc_vector(state->size, policy, &vector_used);
+  if (state->vector == NULL) {
     fprintf(stderr,
             "Error: Aligned memory allocation failed for state vector.\n");
     free(state);
     return NULL;
   }
 
-  ret = posix_memalign((void **)&state->scratch_vector, CACHE_LINE_SIZE,
-                       size * sizeof(struct t_complex));
-  if (ret != 0) {
+  state->scratch_vector = q_alloc_vector(state->size, policy, &scratch_used);
+  if (state->scratch_vector == NULL) {
     fprintf(stderr,
             "Error: Aligned memory allocation failed for scratch vector.\n");
-    free(state->vector);
+    q_alloc_free(state->vector, state->size);
     free(state);
     return NULL;
   }
 
-  state->qubits_num = num_qubits;
-  state->size = size;
-
-#ifdef QCS_MULTI_THREAD
-  for (i = 0; i < pool->num_threads; i++) {
-    long start, end;
-
-    get_thread_work_range(size, pool->num_threads, i, &start, &end);
-
-    struct t_thread_args *args = malloc(sizeof(struct t_thread_args));
-    if (args == NULL) {
-      fprintf(stderr,
-              "Error: Failed to allocate memory for thread arguments.\n");
-      exit(EXIT_FAILURE);
-    }
-
-    args->start = start;
-    args->end = end;
-    args->state = state;
-
-    thread_pool_add_task(pool, q_state_init_worker, args);
-  }
-
-  thread_pool_wait(pool);
-#else
-  for (i = 0; i < size; i++) {
-    state->vector[i] = c_zero();
-    state->scratch_vector[i] = c_zero();
-  }
-#endif
+  /* the gate kernels write both buffers, so both are placed the same way */
+  state->alloc_policy = vector_used & scratch_used;
 
+  /* everything else still reads as zero pages until the first gates */
   state->vector[0] = c_one();
   return state;
 }
@@ -106,21 +61,106 @@ struct t_q_state *q_state_init(int num_qubits) {
  */
 void q_state_free(struct t_q_state *state) {
   if (state) {
-    if (state->vector)
-      free(state->vector);
-    if (state->scratch_vector)
-      free(state->scratch_vector);
+    /* gates swap the buffers, so the mapping may be either of them */
+    q_alloc_unmap_file(state->file_vector, state->size);
+    if (state->vector != state->file_vector)
+      q_alloc_free(state->vector, state->size);
+    if (state->scratch_vector != state->file_vector)
+      q_alloc_free(state->scratch_vector, state->size);
     free(state);
   }
 }
 
+/**
+ * Move a state's amplitudes into a shareable snapshot. Afterwards the
+ * state reads them through a private mapping of the snapshot, so it and
+ * every state mapped from the same descriptor share its pages. Gates on a
+ * mapped state run in place and store only the amplitudes they change, so
+ * each state copies just the pages it alters.
+ * @param state Quantum state
+ * @return Snapshot descriptor for q_state_map_shared (caller closes), or
+ *         -1 if the state cannot be shared (it is left unchanged)
+ */
+int q_state_share(struct t_q_state *state) {
+  struct t_complex *mapped, *scratch = state->scratch_vector;
+  int fd, used;
+
+  fd = q_alloc_share(state->vector, state->size);
+  if (fd < 0)
+    return -1;
+  mapped = q_alloc_map_file(fd, 0, state->size);
+  if (scratch == state->file_vector)
+    scratch = q_alloc_vector(state->size, q_alloc_get_policy(), &used);
+  if (mapped == NULL || scratch == NULL) {
+    q_alloc_unmap_file(mapped, state->size);
+    if (scratch != state->scratch_vector)
+      q_alloc_free(scratch, state->size);
+    close(fd);
+    return -1;
+  }
+
+  q_alloc_unmap_file(state->file_vector, state->size);
+  if (state->vector != state->file_vector)
+    q_alloc_free(state->vector, state->size);
+  state->vector = mapped;
+  state->scratch_vector = scratch;
+  state->file_vector = mapped;
+  state->alloc_policy = 0;
+  return fd;
+}
+
+/**
+ * Create a state that reads its amplitudes copy-on-write from a snapshot
+ * @param fd Descriptor from q_state_share (stays owned by the caller)
+ * @param num_qubits Number of qubits of the snapshot
+ * @return Quantum state, or NULL on failure
+ */
+struct t_q_state *q_state_map_shared(int fd, int num_qubits) {
+  struct t_q_state *state;
+  int used;
+
+  state = (struct t_q_state *)malloc(sizeof(struct t_q_state));
+  if (state == NULL)
+    return NULL;
+  state->qubits_num = num_qubits;
+  state->size = (t_q_index)1 << num_qubits;
+  state->file_vector = q_alloc_map_file(fd, 0, state->size);
+  state->vector = state->file_vector;
+  /* gates run in place on the mapping, so the scratch vector is only
+     touched by operations that swap vectors */
+  state->scratch_vector =
+      q_alloc_vector(state->size, q_alloc_get_policy(), &used);
+  /* copy-on-write works per base page, so the mapping has no policy bits */
+  state->alloc_policy = 0;
+  if (state->vector == NULL || state->scratch_vector == NULL) {
+    q_state_free(state);
+    return NULL;
+  }
+  return state;
+}
+
+/**
+ * Deep copy of a quantum state
+ * @param state Quantum state
+ * @return Independent copy, or NULL on failure
+ */
+struct t_q_state *q_state_copy(const struct t_q_state *state) {
+  struct t_q_state *copy = q_state_init(state->qubits_num);
+
+  if (copy == NULL)
+    return NULL;
+  memcpy(copy->vector, state->vector,
+         (size_t)state->size * sizeof(struct t_complex));
+  return copy;
+}
+
 /**
  * Set quantum state to a specific basis state
  * @param state Quantum state to modify
  * @param index_basis Basis state index
  */
-void q_state_set_basis(struct t_q_state *state, int index_basis) {
-  long i;
+void q_state_set_basis(struct t_q_state *state, t_q_index index_basis) {
+  t_q_index i;
   if (state == NULL || index_basis < 0 || index_basis >= state->size) {
     fprintf(stderr, "Error: Invalid state or basis index\n");
     return;
@@ -136,9 +176,9 @@ void q_state_set_basis(struct t_q_state *state, int index_basis) {
  * @param state Quantum state to print
  * @param solution_index Index to highlight (or -1 for none)
  */
-void q_state_print(const struct t_q_state *state, int solution_index) {
-  long i;
-  int max_print = state->size > 8 ? 4 : state->size;
+void q_state_print(const struct t_q_state *state, t_q_index solution_index) {
+  t_q_index i;
+  t_q_index max_print = state->size > 8 ? 4 : state->size;
 
   printf("--- Quantum State (%d Qubits) ---\n", state->qubits_num);
 
@@ -150,14 +190,14 @@ void q_state_print(const struct t_q_state *state, int solution_index) {
 
   if (solution_index >= max_print && solution_index < state->size - 1) {
     printf("...\n");
-    printf("|%d>: %f + i%f <-- SOLUTION\n", solution_index,
+    printf("|%ld>: %f + i%f <-- SOLUTION\n", solution_index,
            state->vector[solution_index].number_real,
            state->vector[solution_index].number_imaginary);
   }
 
   if (state->size > max_print) {
     printf("...\n");
-    long last_index = state->size - 1;
+    t_q_index last_index = state->size - 1;
     printf("|%ld>: %f + i%f%s\n", last_index,
            state->vector[last_index].number_real,
            state->vector[last_index].number_imaginary,
@@ -166,3 +206,227 @@ void q_state_print(const struct t_q_state *state, int solution_index) {
 
   printf("----------------------------------\n");
 }
+
+/* Pairs (i0, i1) differing in the measured bit per collapse range */
+#define MEASURE_GRAIN 4096
+
+struct t_measure_ctx {
+  struct t_complex *vector;
+  long half;
+  long bit;
+  long blocks;
+  double *partials;
+  int outcome;
+  double scale;
+};
+
+/**
+ * Index of the k-th pair's member whose measured bit is 0
+ * @param k Pair index in [0, size / 2)
+ * @param bit Measured bit mask
+ * @return Basis index with the measured bit clear
+ */
+static long q_measure_pair(long k, long bit) {
+  return ((k & ~(bit - 1)) << 1) | (k & (bit - 1));
+}
+
+/**
+ * Parallel body summing both outcome probabilities per block
+ * @param context Measurement context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_measure_sum_body(void *context, long start, long end) {
+  struct t_measure_ctx *ctx = (struct t_measure_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double p0 = 0.0, p1 = 0.0;
+    long lo, hi, k;
+
+    get_thread_work_range(ctx->half, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (k = lo; k < hi; k++) {
+      const struct t_complex *a0 = &ctx->vector[q_measure_pair(k, ctx->bit)];
+      const struct t_complex *a1 = a0 + ctx->bit;
+
+      p0 += a0->number_real * a0->number_real +
+            a0->number_imaginary * a0->number_imaginary;
+      p1 += a1->number_real * a1->number_real +
+            a1->number_imaginary * a1->number_imaginary;
+    }
+    ctx->partials[2 * b] = p0;
+    ctx->partials[2 * b + 1] = p1;
+  }
+}
+
+/**
+ * Parallel body zeroing the rejected half and rescaling the kept half
+ * @param context Measurement context
+ * @param start First pair
+ * @param end One past the last pair
+ */
+static void q_measure_collapse_body(void *context, long start, long end) {
+  struct t_measure_ctx *ctx = (struct t_measure_ctx *)context;
+  long k;
+
+  for (k = start; k < end; k++) {
+    long i0 = q_measure_pair(k, ctx->bit);
+    struct t_complex *keep = &ctx->vector[ctx->outcome ? i0 | ctx->bit : i0];
+    struct t_complex *drop = &ctx->vector[ctx->outcome ? i0 : i0 | ctx->bit];
+
+    keep->number_real *= ctx->scale;
+    keep->number_imaginary *= ctx->scale;
+    drop->number_real = 0.0;
+    drop->number_imaginary = 0.0;
+  }
+}
+
+/**
+ * Measure one qubit: one reduction for the outcome probabilities, then one
+ * sweep that collapses and renormalizes with the known probability
+ * @param state Quantum state
+ * @param qubit Qubit to measure
+ * @param random_val Uniform random number in [0, 1)
+ * @return Measurement outcome (0 or 1)
+ */
+int q_state_measure(struct t_q_state *state, int qubit, double random_val) {
+  struct t_measure_ctx ctx;
+  double partials[2 * QCS_REDUCE_BLOCKS];
+  double p0 = 0.0, p1 = 0.0, kept;
+  long b;
+
+  ctx.vector = state->vector;
+  ctx.half = state->size / 2;
+  ctx.bit = 1L << qubit;
+  ctx.blocks = ctx.half < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+  ctx.partials = partials;
+
+  q_parallel_for(ctx.blocks, 1, q_measure_sum_body, &ctx);
+  for (b = 0; b < ctx.blocks; b++) {
+    p0 += partials[2 * b];
+    p1 += partials[2 * b + 1];
+  }
+
+  /* relative to the actual norm, so a drifted state still renormalizes */
+  ctx.outcome = random_val * (p0 + p1) < p0 ? 0 : 1;
+  if ((ctx.outcome ? p1 : p0) <= 0.0)
+    ctx.outcome = 1 - ctx.outcome;
+  kept = ctx.outcome ? p1 : p0;
+  ctx.scale = kept > 0.0 ? 1.0 / sqrt(kept) : 0.0;
+
+  q_parallel_for(ctx.half, MEASURE_GRAIN, q_measure_collapse_body, &ctx);
+  return ctx.outcome;
+}
+
+struct t_collapse_ctx {
+  struct t_complex *vector;
+  long size;
+  long blocks;
+  double *masses;
+};
+
+/**
+ * Parallel body summing the probability mass of each block
+ * @param context Collapse context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_collapse_mass_body(void *context, long start, long end) {
+  struct t_collapse_ctx *ctx = (struct t_collapse_ctx *)context;
+  long b;
+
+  for (b = start; b < end; b++) {
+    double mass = 0.0;
+    long lo, hi, i;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++)
+      mass += ctx->vector[i].number_real * ctx->vector[i].number_real +
+              ctx->vector[i].number_imaginary * ctx->vector[i].number_imaginary;
+    ctx->masses[b] = mass;
+  }
+}
+
+/**
+ * Parallel body clearing a range of amplitudes
+ * @param context Collapse context
+ * @param start First index
+ * @param end One past the last index
+ */
+static void q_collapse_zero_body(void *context, long start, long end) {
+  struct t_collapse_ctx *ctx = (struct t_collapse_ctx *)context;
+  long i;
+
+  for (i = start; i < end; i++) {
+    ctx->vector[i].number_real = 0.0;
+    ctx->vector[i].number_imaginary = 0.0;
+  }
+}
+
+/**
+ * Measure every qubit at once: sample one basis index and collapse onto it.
+ * The sample costs one block reduction plus a scan of the chosen block; the
+ * collapse is one write sweep.
+ * @param state Quantum state
+ * @param random_val Uniform random number in [0, 1)
+ * @return Measured basis index
+ */
+long q_state_measure_all(struct t_q_state *state, double random_val) {
+  struct t_collapse_ctx ctx;
+  double masses[QCS_REDUCE_BLOCKS];
+  double total = 0.0, target;
+  struct t_complex kept;
+  long b, lo, hi, i, index = 0, last = -1;
+  double norm;
+
+  ctx.vector = state->vector;
+  ctx.size = state->size;
+  ctx.blocks = state->size < QCS_REDUCE_BLOCKS ? 1 : QCS_REDUCE_BLOCKS;
+  ctx.masses = masses;
+
+  q_parallel_for(ctx.blocks, 1, q_collapse_mass_body, &ctx);
+  for (b = 0; b < ctx.blocks; b++)
+    total += masses[b];
+
+  /* block holding the target, then the outcome inside it; rounding past
+     the end falls back to the last outcome with nonzero probability */
+  target = random_val * total;
+  for (b = 0; b < ctx.blocks; b++) {
+    if (masses[b] <= 0.0)
+      continue;
+    last = b;
+    if (target < masses[b])
+      break;
+    target -= masses[b];
+  }
+  if (b == ctx.blocks && last >= 0) {
+    b = last;
+    target = masses[b];
+  }
+
+  if (last >= 0) {
+    get_thread_work_range(ctx.size, (int)ctx.blocks, (int)b, &lo, &hi);
+    for (i = lo; i < hi; i++) {
+      double p = c_norm_sq(ctx.vector[i]);
+      if (p > 0.0) {
+        index = i;
+        if (target < p)
+          break;
+        target -= p;
+      }
+    }
+  }
+
+  /* keep the outcome's phase, as successive single-qubit collapses do */
+  kept = ctx.vector[index];
+  norm = sqrt(c_norm_sq(kept));
+
+  q_parallel_for(ctx.size, MEASURE_GRAIN, q_collapse_zero_body, &ctx);
+  if (norm > 0.0) {
+    ctx.vector[index].number_real = kept.number_real / norm;
+    ctx.vector[index].number_imaginary = kept.number_imaginary / norm;
+  } else {
+    ctx.vector[index] = c_one();
+  }
+  return index;
+}
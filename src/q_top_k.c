@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+
+/*
+ * The k most likely basis states of a dense state in one read-only pass.
+ *
+ * Fixed index blocks each keep a bounded min-heap of their k best outcomes,
+ * lowest-ranked at the root. Norms are computed a tile at a time into a
+ * small buffer (a straight loop the compiler vectorises) and compared
+ * against the root, so almost every amplitude costs one compare. The block
+ * heaps are then merged into one. Outcomes rank by probability, ties by the
+ * smaller index, a total order, so the result does not depend on the block
+ * split or the thread count.
+ */
+
+#define TOP_K_TILE 256
+
+/* Upper bound on the total size of the block heaps, in entries */
+#define TOP_K_HEAP_BUDGET (1L << 22)
+
+struct t_top_k_ctx {
+  const struct t_complex *vector;
+  long size;
+  long blocks;
+  long k;
+  double *probs;
+  t_q_index *indices;
+  long *sizes;
+};
+
+/**
+ * Whether entry a ranks below entry b (less likely; ties: larger index)
+ * @param probs Heap probabilities
+ * @param indices Heap basis indices
+ * @param a Heap position
+ * @param b Heap position
+ * @return Nonzero if a ranks below b
+ */
+static int q_top_k_below(const double *probs, const t_q_index *indices,
+                         long a, long b) {
+  if (probs[a] != probs[b])
+    return probs[a] < probs[b];
+  return indices[a] > indices[b];
+}
+
+/**
+ * Swap two heap entries
+ * @param probs Heap probabilities
+ * @param indices Heap basis indices
+ * @param a Heap position
+ * @param b Heap position
+ */
+static void q_top_k_swap(double *probs, t_q_index *indices, long a, long b) {
+  double p = probs[a];
+  t_q_index i = indices[a];
+
+  probs[a] = probs[b];
+  indices[a] = indices[b];
+  probs[b] = p;
+  indices[b] = i;
+}
+
+/**
+ * Restore the min-heap property below a heap position
+ * @param probs Heap probabilities
+ * @param indices Heap basis indices
+ * @param size Heap size
+ * @param pos Position to sift down from
+ */
+static void q_top_k_sift_down(double *probs, t_q_index *indices, long size,
+                              long pos) {
+  for (;;) {
+    long child = 2 * pos + 1;
+
+    if (child >= size)
+      return;
+    if (child + 1 < size && q_top_k_below(probs, indices, child + 1, child))
+      child++;
+    if (!q_top_k_below(probs, indices, child, pos))
+      return;
+    q_top_k_swap(probs, indices, pos, child);
+    pos = child;
+  }
+}
+
+/**
+ * Offer an outcome to a bounded min-heap of the k best outcomes
+ * @param probs Heap probabilities (k entries)
+ * @param indices Heap basis indices (k entries)
+ * @param size Current heap size, updated
+ * @param k Heap bound (> 0)
+ * @param prob Probability of the outcome
+ * @param index Basis index of the outcome
+ */
+void q_top_k_offer(double *probs, t_q_index *indices, long *size, long k,
+                   double prob, t_q_index index) {
+  long pos;
+
+  if (*size < k) {
+    pos = (*size)++;
+    probs[pos] = prob;
+    indices[pos] = index;
+    while (pos > 0 && q_top_k_below(probs, indices, pos, (pos - 1) / 2)) {
+      q_top_k_swap(probs, indices, pos, (pos - 1) / 2);
+      pos = (pos - 1) / 2;
+    }
+    return;
+  }
+  if (prob < probs[0] || (prob == probs[0] && index > indices[0]))
+    return;
+  probs[0] = prob;
+  indices[0] = index;
+  q_top_k_sift_down(probs, indices, *size, 0);
+}
+
+/**
+ * Sort a heap in place, most likely outcome first
+ * @param probs Heap probabilities
+ * @param indices Heap basis indices
+ * @param size Heap size
+ */
+void q_top_k_sort(double *probs, t_q_index *indices, long size) {
+  /* popping the root moves the lowest-ranked entry to the back */
+  while (size > 1) {
+    q_top_k_swap(probs, indices, 0, --size);
+    q_top_k_sift_down(probs, indices, size, 0);
+  }
+}
+
+/**
+ * Parallel body filling the heap of each block in a range
+ * @param context Top-k context
+ * @param start First block
+ * @param end One past the last block
+ */
+static void q_top_k_body(void *context, long start, long end) {
+  struct t_top_k_ctx *ctx = (struct t_top_k_ctx *)context;
+  double norms[TOP_K_TILE];
+  long b;
+
+  for (b = start; b < end; b++) {
+    double *probs = ctx->probs + b * ctx->k;
+    t_q_index *indices = ctx->indices + b * ctx->k;
+    long size = 0;
+    long lo, hi, tile;
+
+    get_thread_work_range(ctx->size, (int)ctx->blocks, (int)b, &lo, &hi);
+    for (tile = lo; tile < hi; tile += TOP_K_TILE) {
+      const struct t_complex *amp = ctx->vector + tile;
+      long count = hi - tile < TOP_K_TILE ? hi - tile : TOP_K_TILE;
+      double floor = size < ctx->k ? 0.0 : probs[0];
+      long i;
+
+      for (i = 0; i < count; i++)
+        norms[i] = amp[i].number_real * amp[i].number_real +
+                   amp[i].number_imaginary * amp[i].number_imaginary;
+      for (i = 0; i < count; i++) {
+        /* indices only grow, so an outcome tied with the root loses */
+        if (norms[i] > floor) {
+          q_top_k_offer(probs, indices, &size, ctx->k, norms[i], tile + i);
+          if (size == ctx->k)
+            floor = probs[0];
+        }
+      }
+    }
+    ctx->sizes[b] = size;
+  }
+}
+
+/**
+ * The k most likely basis states of a dense state
+ * @param state Quantum state (read only)
+ * @param k Number of states wanted
+ * @param indices Output basis indices, most likely first (k entries)
+ * @param probs Output probabilities (k entries)
+ * @return Number of states written (states with zero probability are
+ *         skipped), or -1 on allocation failure
+ */
+long q_state_top_k(const struct t_q_state *state, long k, t_q_index *indices,
+                   double *probs) {
+  struct t_top_k_ctx ctx;
+  long sizes[QCS_REDUCE_BLOCKS];
+  long size = 0;
+  long b, i;
+
+  if (k > state->size)
+    k = state->size;
+  if (k <= 0)
+    return 0;
+
+  ctx.vector = state->vector;
+  ctx.size = state->size;
+  ctx.k = k;
+  ctx.sizes = sizes;
+  ctx.blocks = QCS_REDUCE_BLOCKS;
+  while (ctx.blocks > 1 && (ctx.blocks * TOP_K_TILE > state->size ||
+                            ctx.blocks * k > TOP_K_HEAP_BUDGET))
+    ctx.blocks /= 2;
+
+  ctx.probs = (double *)malloc(ctx.blocks * k * sizeof(double));
+  ctx.indices = (t_q_index *)malloc(ctx.blocks * k * sizeof(t_q_index));
+  if (ctx.probs == NULL || ctx.indices == NULL) {
+    free(ctx.probs);
+    free(ctx.indices);
+    return -1;
+  }
+
+  q_parallel_for(ctx.blocks, 1, q_top_k_body, &ctx);
+
+  for (b = 0; b < ctx.blocks; b++)
+    for (i = 0; i < sizes[b]; i++)
+      q_top_k_offer(probs, indices, &size, k, ctx.probs[b * k + i],
+                    ctx.indices[b * k + i]);
+  q_top_k_sort(probs, indices, size);
+
+  free(ctx.probs);
+  free(ctx.indices);
+  return size;
+}
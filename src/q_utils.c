@@ -34,7 +34,6 @@ static void normalize_divide_worker(void *arg) {
     args->state->vector[i].number_real *= inv_norm;
     args->state->vector[i].number_imaginary *= inv_norm;
   }
-  free(args);
 }
 
 /**
@@ -46,56 +45,37 @@ void q_state_normalize(struct t_q_state *state) {
     return;
 
 #ifdef QCS_MULTI_THREAD
-  int i;
+  int i, tasks;
   long size;
-  struct t_thread_args **reduction_args_list;
+  /* one cache-aligned slot per task, reused by both passes */
+  struct t_thread_args slots[QCS_POOL_MAX_THREADS];
   double total_norm_sq = 0.0;
 
   size = state->size;
-  reduction_args_list =
-      malloc(pool->num_threads * sizeof(struct t_thread_args *));
-  if (!reduction_args_list)
-    exit(EXIT_FAILURE);
+  tasks = (pool->num_threads > QCS_POOL_MAX_THREADS) ? QCS_POOL_MAX_THREADS
+                                                     : pool->num_threads;
 
-  for (i = 0; i < pool->num_threads; i++) {
+  for (i = 0; i < tasks; i++) {
     long start, end;
-    get_thread_work_range(size, pool->num_threads, i, &start, &end);
+    get_thread_work_range(size, tasks, i, &start, &end);
 
-    reduction_args_list[i] = malloc(sizeof(struct t_thread_args));
-    if (!reduction_args_list[i])
-      exit(EXIT_FAILURE);
+    slots[i].start = start;
+    slots[i].end = end;
+    slots[i].state = state;
 
-    reduction_args_list[i]->start = start;
-    reduction_args_list[i]->end = end;
-    reduction_args_list[i]->state = state;
-
-    thread_pool_add_task(pool, normalize_sum_worker, reduction_args_list[i]);
+    thread_pool_add_task(pool, normalize_sum_worker, &slots[i]);
   }
   thread_pool_wait(pool);
 
-  for (i = 0; i < pool->num_threads; i++) {
-    total_norm_sq +=
-        reduction_args_list[i]->reduction_result.sums.partial_real_sum;
-    free(reduction_args_list[i]);
+  for (i = 0; i < tasks; i++) {
+    total_norm_sq += slots[i].reduction_result.sums.partial_real_sum;
   }
-  free(reduction_args_list);
 
   if (total_norm_sq > 1e-12 && total_norm_sq != 1.0) {
     double inv_norm = 1.0 / sqrt(total_norm_sq);
-    for (i = 0; i < pool->num_threads; i++) {
-      long start, end;
-      get_thread_work_range(size, pool->num_threads, i, &start, &end);
-
-      struct t_thread_args *div_args = malloc(sizeof(struct t_thread_args));
-      if (div_args == NULL) {
-        exit(EXIT_FAILURE);
-      }
-      div_args->start = start;
-      div_args->end = end;
-      div_args->state = state;
-      div_args->mean.number_real = inv_norm;
-
-      thread_pool_add_task(pool, normalize_divide_worker, div_args);
+    for (i = 0; i < tasks; i++) {
+      slots[i].mean.number_real = inv_norm;
+      thread_pool_add_task(pool, normalize_divide_worker, &slots[i]);
     }
     thread_pool_wait(pool);
   }
@@ -123,12 +103,12 @@ void q_state_normalize(struct t_q_state *state) {
  * @param num_qubits Number of qubits in the system
  * @return Number of iterations needed
  */
-int q_grover_iterations(int num_qubits) {
+long q_grover_iterations(int num_qubits) {
   double const m_pi = (3.14159265358979323846);
-  double N = (double)(1 << num_qubits);
+  double N = (double)(1L << num_qubits);
   double R;
 
   R = (m_pi / 4.0) * sqrt(N);
 
-  return (int)floor(R);
+  return (long)floor(R);
 }
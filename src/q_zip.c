@@ -0,0 +1,372 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*
+ * Table of independently compressed state blocks.
+ *
+ * Each block of 2^block_qubits amplitudes is encoded on its own, so any
+ * block can be decoded, updated and re-encoded without touching the rest.
+ * An all-zero block stores nothing. Otherwise the encoding is one of:
+ *
+ *   ZIP_XOR    lossless: each real and imaginary part is XORed with the
+ *              previous one of the same kind, and only the low bytes up to
+ *              the last nonzero one are kept. A control byte per amplitude
+ *              holds the two byte counts. Runs of equal or nearby values,
+ *              common in structured states, shrink to a byte or two.
+ *   ZIP_QUANT  bounded error: each part is rounded to a multiple of twice
+ *              the error bound, so no part moves by more than the bound,
+ *              and the difference from the previous multiple is stored as a
+ *              zigzag varint. Amplitudes of an n-qubit state are near
+ *              2^(-n/2), so the multiples are small and take a few bytes.
+ *   ZIP_RAW    the amplitudes as they are, when neither encoding is smaller.
+ *
+ * Each store records the squared 2-norm error it introduced. A pass over
+ * the state writes disjoint blocks, so their errors are orthogonal and the
+ * pass adds the square root of their sum to the running error bound.
+ */
+
+#define ZIP_RAW 0
+#define ZIP_XOR 1
+#define ZIP_QUANT 2
+
+/* Smallest error bound used for quantization; below it blocks are lossless */
+#define ZIP_MIN_ERROR_BOUND 1e-15
+
+/**
+ * Create an all-zero block table
+ * @param blocks Number of blocks
+ * @param block_size Amplitudes per block
+ * @param error_bound Largest change allowed per real or imaginary part
+ *        (0 for lossless blocks)
+ * @return Block table, or NULL on allocation failure
+ */
+struct t_q_zip *q_zip_init(long blocks, t_q_index block_size,
+                           double error_bound) {
+  struct t_q_zip *zip = (struct t_q_zip *)malloc(sizeof(struct t_q_zip));
+
+  if (zip == NULL)
+    return NULL;
+  zip->table = (struct t_q_zip_block *)calloc(blocks,
+                                              sizeof(struct t_q_zip_block));
+  if (zip->table == NULL) {
+    free(zip);
+    return NULL;
+  }
+  zip->blocks = blocks;
+  zip->block_size = block_size;
+  zip->error_bound = error_bound >= ZIP_MIN_ERROR_BOUND ? error_bound : 0.0;
+  zip->error = 0.0;
+  return zip;
+}
+
+/**
+ * Free a block table
+ * @param zip Block table (may be NULL)
+ */
+void q_zip_free(struct t_q_zip *zip) {
+  if (zip == NULL)
+    return;
+  q_zip_clear(zip);
+  free(zip->table);
+  free(zip);
+}
+
+/**
+ * Set every block to zero and forget the accumulated error
+ * @param zip Block table
+ */
+void q_zip_clear(struct t_q_zip *zip) {
+  long b;
+
+  for (b = 0; b < zip->blocks; b++) {
+    free(zip->table[b].data);
+    zip->table[b].data = NULL;
+    zip->table[b].bytes = 0;
+    zip->table[b].error_sq = 0.0;
+  }
+  zip->error = 0.0;
+}
+
+/**
+ * Size of the scratch buffer q_zip_store needs
+ * @param zip Block table
+ * @return Bytes
+ */
+size_t q_zip_scratch_size(const struct t_q_zip *zip) {
+  /* worst case: a control byte and 2 x 8 bytes, or 2 x 10-byte varints */
+  return 1 + (size_t)zip->block_size * 20;
+}
+
+/**
+ * Bit pattern of a double
+ * @param value Value
+ * @return Its 64 bits
+ */
+static unsigned long q_zip_bits(double value) {
+  unsigned long bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/**
+ * Double with a bit pattern
+ * @param bits 64 bits
+ * @return Value
+ */
+static double q_zip_value(unsigned long bits) {
+  double value;
+
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * Encode a block losslessly
+ * @param in Amplitudes
+ * @param count Number of amplitudes
+ * @param out Output bytes (q_zip_scratch_size)
+ * @return Bytes written
+ */
+static size_t q_zip_encode_xor(const struct t_complex *in, t_q_index count,
+                               unsigned char *out) {
+  unsigned long prev_re = 0, prev_im = 0;
+  size_t pos = 0;
+  t_q_index i;
+
+  for (i = 0; i < count; i++) {
+    unsigned long x[2];
+    int len[2], k;
+
+    x[0] = q_zip_bits(in[i].number_real) ^ prev_re;
+    x[1] = q_zip_bits(in[i].number_imaginary) ^ prev_im;
+    prev_re ^= x[0];
+    prev_im ^= x[1];
+    for (k = 0; k < 2; k++) {
+      len[k] = 8;
+      while (len[k] > 0 && (x[k] >> (8 * (len[k] - 1))) == 0)
+        len[k]--;
+    }
+    out[pos++] = (unsigned char)(len[0] | (len[1] << 4));
+    for (k = 0; k < 2; k++) {
+      int j;
+
+      for (j = 0; j < len[k]; j++)
+        out[pos++] = (unsigned char)(x[k] >> (8 * j));
+    }
+  }
+  return pos;
+}
+
+/**
+ * Decode a lossless block
+ * @param in Encoded bytes
+ * @param count Number of amplitudes
+ * @param out Output amplitudes
+ */
+static void q_zip_decode_xor(const unsigned char *in, t_q_index count,
+                             struct t_complex *out) {
+  unsigned long prev[2] = {0, 0};
+  t_q_index i;
+
+  for (i = 0; i < count; i++) {
+    int len[2], k;
+
+    len[0] = *in & 0x0f;
+    len[1] = *in++ >> 4;
+    for (k = 0; k < 2; k++) {
+      unsigned long x = 0;
+      int j;
+
+      for (j = 0; j < len[k]; j++)
+        x |= (unsigned long)*in++ << (8 * j);
+      prev[k] ^= x;
+    }
+    out[i].number_real = q_zip_value(prev[0]);
+    out[i].number_imaginary = q_zip_value(prev[1]);
+  }
+}
+
+/**
+ * Encode a block to multiples of twice the error bound
+ * @param in Amplitudes
+ * @param count Number of amplitudes
+ * @param step Quantization step (twice the error bound)
+ * @param out Output bytes (q_zip_scratch_size)
+ * @param error_sq Output squared 2-norm of the rounding error
+ * @return Bytes written
+ */
+static size_t q_zip_encode_quant(const struct t_complex *in, t_q_index count,
+                                 double step, unsigned char *out,
+                                 double *error_sq) {
+  const double *parts = (const double *)in;
+  double err = 0.0;
+  long prev[2] = {0, 0};
+  size_t pos = 0;
+  t_q_index i;
+
+  for (i = 0; i < 2 * count; i++) {
+    long q = (long)floor(parts[i] / step + 0.5);
+    double diff = parts[i] - (double)q * step;
+    unsigned long u;
+
+    err += diff * diff;
+    /* zigzag: small magnitudes of either sign become small codes */
+    u = ((unsigned long)(q - prev[i & 1]) << 1) ^
+        (unsigned long)((q - prev[i & 1]) >> 63);
+    prev[i & 1] = q;
+    while (u >= 0x80) {
+      out[pos++] = (unsigned char)(u | 0x80);
+      u >>= 7;
+    }
+    out[pos++] = (unsigned char)u;
+  }
+  *error_sq = err;
+  return pos;
+}
+
+/**
+ * Decode a quantized block
+ * @param in Encoded bytes
+ * @param count Number of amplitudes
+ * @param step Quantization step
+ * @param out Output amplitudes
+ */
+static void q_zip_decode_quant(const unsigned char *in, t_q_index count,
+                               double step, struct t_complex *out) {
+  double *parts = (double *)out;
+  long prev[2] = {0, 0};
+  t_q_index i;
+
+  for (i = 0; i < 2 * count; i++) {
+    unsigned long u = 0;
+    int shift = 0;
+
+    while (*in & 0x80) {
+      u |= (unsigned long)(*in++ & 0x7f) << shift;
+      shift += 7;
+    }
+    u |= (unsigned long)*in++ << shift;
+    prev[i & 1] += (long)(u >> 1) ^ -(long)(u & 1);
+    parts[i] = (double)prev[i & 1] * step;
+  }
+}
+
+/**
+ * Decode one block
+ * @param zip Block table
+ * @param block Block index
+ * @param out Output amplitudes (block_size entries)
+ */
+void q_zip_load(const struct t_q_zip *zip, long block, struct t_complex *out) {
+  const struct t_q_zip_block *entry = &zip->table[block];
+
+  if (entry->data == NULL) {
+    memset(out, 0, (size_t)zip->block_size * sizeof(struct t_complex));
+    return;
+  }
+  switch (entry->data[0]) {
+  case ZIP_XOR:
+    q_zip_decode_xor(entry->data + 1, zip->block_size, out);
+    break;
+  case ZIP_QUANT:
+    q_zip_decode_quant(entry->data + 1, zip->block_size,
+                       2.0 * zip->error_bound, out);
+    break;
+  default:
+    memcpy(out, entry->data + 1,
+           (size_t)zip->block_size * sizeof(struct t_complex));
+    break;
+  }
+}
+
+/**
+ * Encode one block, replacing its previous contents. Blocks written by
+ * different threads must differ.
+ * @param zip Block table
+ * @param block Block index
+ * @param in Amplitudes (block_size entries)
+ * @param scratch Work buffer of q_zip_scratch_size bytes
+ * @return 0 on success, -1 on allocation failure (the block is unchanged)
+ */
+int q_zip_store(struct t_q_zip *zip, long block, const struct t_complex *in,
+                unsigned char *scratch) {
+  struct t_q_zip_block *entry = &zip->table[block];
+  size_t raw = (size_t)zip->block_size * sizeof(struct t_complex);
+  size_t bytes;
+  double error_sq = 0.0;
+  unsigned char *data;
+  t_q_index i;
+
+  for (i = 0; i < zip->block_size; i++) {
+    if (in[i].number_real != 0.0 || in[i].number_imaginary != 0.0)
+      break;
+  }
+  if (i == zip->block_size) {
+    free(entry->data);
+    entry->data = NULL;
+    entry->bytes = 0;
+    return 0;
+  }
+
+  if (zip->error_bound > 0.0) {
+    scratch[0] = ZIP_QUANT;
+    bytes = 1 + q_zip_encode_quant(in, zip->block_size,
+                                   2.0 * zip->error_bound, scratch + 1,
+                                   &error_sq);
+  } else {
+    scratch[0] = ZIP_XOR;
+    bytes = 1 + q_zip_encode_xor(in, zip->block_size, scratch + 1);
+  }
+  if (bytes > 1 + raw) {
+    scratch[0] = ZIP_RAW;
+    memcpy(scratch + 1, in, raw);
+    bytes = 1 + raw;
+    error_sq = 0.0;
+  }
+
+  data = (unsigned char *)malloc(bytes);
+  if (data == NULL)
+    return -1;
+  memcpy(data, scratch, bytes);
+  free(entry->data);
+  entry->data = data;
+  entry->bytes = bytes;
+  entry->error_sq += error_sq;
+  return 0;
+}
+
+/**
+ * Close a pass over the blocks: fold the errors stored since the last pass
+ * into the accumulated error bound
+ * @param zip Block table
+ */
+void q_zip_end_pass(struct t_q_zip *zip) {
+  double error_sq = 0.0;
+  long b;
+
+  for (b = 0; b < zip->blocks; b++) {
+    error_sq += zip->table[b].error_sq;
+    zip->table[b].error_sq = 0.0;
+  }
+  zip->error += sqrt(error_sq);
+}
+
+/**
+ * Memory held by the table and its blocks
+ * @param zip Block table
+ * @return Bytes
+ */
+long q_zip_bytes(const struct t_q_zip *zip) {
+  long bytes = (long)(sizeof(struct t_q_zip) +
+                      zip->blocks * sizeof(struct t_q_zip_block));
+  long b;
+
+  for (b = 0; b < zip->blocks; b++)
+    bytes += (long)zip->table[b].bytes;
+  return bytes;
+}
@@ -8,95 +8,452 @@
 
 #ifdef QCS_MULTI_THREAD
 thread_pool_t *pool = NULL;
+/* live circuits sharing the pool; the last qc_destroy() tears it down */
+static int pool_users = 0;
+static pthread_mutex_t pool_users_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+#define QC_BACKEND_DENSE 0
+#define QC_BACKEND_MPS 1
+#define QC_BACKEND_SPARSE 2
+#define QC_BACKEND_DISK 3
+
 struct t_q_circuit {
   int num_qubits;
   int num_gates;
+  int backend;
   struct t_q_state *state;
-  char **gate_history;
+  struct t_q_mps *mps;
+  struct t_q_sparse *sparse;
+  struct t_q_disk *disk;
+  double dense_fill_ratio;
+  const char **gate_history; /* string literals, not owned */
   int *target_qubits;
   int *control_qubits;
   double *parameters;
+  int *param_slots;
   int history_size;
   int history_capacity;
+  double *slot_values;
+  int num_slots;
+  struct t_q_program *program;
+  unsigned long state_version;
+  struct t_q_sampler *sampler;
+  unsigned long sampler_version;
+  struct t_q_rng rng;
+  char *checkpoint_path;
+  int checkpoint_interval;
+  int share_fd;                /* snapshot shared with clones, or -1 */
+  unsigned long share_version; /* state_version the snapshot holds */
+  int initial_fd; /* state file the circuit started from, or -1 for |0...0> */
 };
 
+#ifdef QCS_MULTI_THREAD
 /**
- * Create a new quantum circuit with specified number of qubits
- * @param num_qubits Number of qubits in the circuit
- * @return Pointer to created circuit or NULL on failure
+ * Take a reference on the shared thread pool, creating it on first use
+ * @return 0 on success, -1 if the pool could not be created
  */
-t_q_circuit *qc_create(int num_qubits) {
-  #ifdef QCS_MULTI_THREAD
+static int qc_pool_acquire(void) {
+  pthread_mutex_lock(&pool_users_lock);
   if (pool == NULL) {
     long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int effective_threads;
 
     if (num_cores < 1)
       num_cores = 2;
 
-    int effective_threads = (num_cores > 4) ? 4 : num_cores;
-    pool = thread_pool_create(effective_threads, 16);
+    /* one worker per online core, with room to queue a task for each */
+    effective_threads = (num_cores > QCS_POOL_MAX_THREADS)
+                            ? QCS_POOL_MAX_THREADS
+                            : (int)num_cores;
+    pool = thread_pool_create(effective_threads,
+                              effective_threads > 16 ? effective_threads : 16);
 
     if (pool == NULL) {
+      pthread_mutex_unlock(&pool_users_lock);
       fprintf(stderr, "Error: Could not create thread pool.\n");
-      return NULL;
+      return -1;
     }
   }
+  pool_users++;
+  pthread_mutex_unlock(&pool_users_lock);
+  return 0;
+}
+
+/**
+ * Drop a reference on the shared thread pool, destroying it with the last
+ */
+static void qc_pool_release(void) {
+  pthread_mutex_lock(&pool_users_lock);
+  if (--pool_users == 0 && pool != NULL) {
+    thread_pool_destroy(pool);
+    pool = NULL;
+  }
+  pthread_mutex_unlock(&pool_users_lock);
+}
+#endif
+
+/**
+ * Allocate an empty circuit shell with its gate history buffers
+ * @param num_qubits Number of qubits in the circuit
+ * @return Pointer to circuit with no backend attached, or NULL on failure
+ */
+static t_q_circuit *qc_alloc(int num_qubits) {
+  #ifdef QCS_MULTI_THREAD
+  if (qc_pool_acquire() != 0)
+    return NULL;
   #endif
 
   t_q_circuit *circuit = (t_q_circuit *)malloc(sizeof(t_q_circuit));
-  if (!circuit)
+  if (!circuit) {
+    #ifdef QCS_MULTI_THREAD
+    qc_pool_release();
+    #endif
     return NULL;
+  }
 
   circuit->num_qubits = num_qubits;
   circuit->num_gates = 0;
-  circuit->state = q_state_init(num_qubits);
+  circuit->backend = QC_BACKEND_DENSE;
+  circuit->state = NULL;
+  circuit->mps = NULL;
+  circuit->sparse = NULL;
+  circuit->disk = NULL;
+  circuit->dense_fill_ratio = 0.0;
   circuit->history_size = 0;
   circuit->history_capacity = 100;
 
   circuit->gate_history =
-      (char **)malloc(circuit->history_capacity * sizeof(char *));
+      (const char **)malloc(circuit->history_capacity * sizeof(char *));
   circuit->target_qubits =
       (int *)malloc(circuit->history_capacity * sizeof(int));
   circuit->control_qubits =
       (int *)malloc(circuit->history_capacity * sizeof(int));
   circuit->parameters =
       (double *)malloc(circuit->history_capacity * sizeof(double));
+  circuit->param_slots =
+      (int *)malloc(circuit->history_capacity * sizeof(int));
+  circuit->slot_values = NULL;
+  circuit->num_slots = 0;
+  circuit->program = NULL;
+  circuit->state_version = 0;
+  circuit->sampler = NULL;
+  circuit->sampler_version = 0;
+  circuit->checkpoint_path = NULL;
+  circuit->checkpoint_interval = 0;
+  circuit->share_fd = -1;
+  circuit->share_version = 0;
+  circuit->initial_fd = -1;
+
+  /* seeded from rand() so that srand() keeps runs reproducible until the
+     caller picks a seed with qc_set_seed */
+  q_rng_seed(&circuit->rng, (unsigned long)rand());
 
   return circuit;
 }
 
 /**
- * Destroy a quantum circuit and free all associated memory
- * @param circuit Circuit to destroy
+ * Create a new quantum circuit with specified number of qubits
+ * @param num_qubits Number of qubits in the circuit
+ * @return Pointer to created circuit or NULL on failure
  */
-void qc_destroy(t_q_circuit *circuit) {
-  #ifdef QCS_MULTI_THREAD
-  if (pool != NULL) {
-    thread_pool_destroy(pool);
-    pool = NULL;
+t_q_circuit *qc_create(int num_qubits) {
+  t_q_circuit *circuit = qc_alloc(num_qubits);
+  if (!circuit)
+    return NULL;
+
+  circuit->state = q_state_init(num_qubits);
+  return circuit;
+}
+
+/**
+ * Create a circuit simulated as a matrix product state (MPS).
+ * Memory grows with entanglement rather than 2^n, so wide but
+ * low-entanglement circuits (50-100 qubits) stay tractable. Basis indices
+ * hold 63 qubits, so shots on wider circuits fail; measure them with
+ * qc_measure_all instead.
+ * @param num_qubits Number of qubits in the circuit
+ * @param max_bond_dim Maximum bond dimension kept after each 2-qubit gate
+ * @param truncation_threshold Discarded weight allowed per truncation (0 = exact up to max_bond_dim)
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_create_mps(int num_qubits, int max_bond_dim,
+                           double truncation_threshold) {
+  t_q_circuit *circuit = qc_alloc(num_qubits);
+  if (!circuit)
+    return NULL;
+
+  circuit->backend = QC_BACKEND_MPS;
+  circuit->mps = q_mps_init(num_qubits, max_bond_dim, truncation_threshold);
+  if (circuit->mps == NULL) {
+    qc_destroy(circuit);
+    return NULL;
   }
-  #endif
+  return circuit;
+}
 
-  int i;
+/**
+ * Create a circuit backed by a sparse state vector that stores only the
+ * nonzero amplitudes. Suited to oracle, basis-preparation and arithmetic
+ * circuits with few live amplitudes; supports up to 62 qubits.
+ * @param num_qubits Number of qubits in the circuit
+ * @param dense_fill_ratio Fraction of nonzero amplitudes above which the
+ *        circuit converts itself to the dense backend (<= 0 to never convert)
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_create_sparse(int num_qubits, double dense_fill_ratio) {
+  t_q_circuit *circuit = qc_alloc(num_qubits);
+  if (!circuit)
+    return NULL;
+
+  circuit->backend = QC_BACKEND_SPARSE;
+  circuit->dense_fill_ratio = dense_fill_ratio;
+  circuit->sparse = q_sparse_init(num_qubits);
+  if (circuit->sparse == NULL) {
+    qc_destroy(circuit);
+    return NULL;
+  }
+  return circuit;
+}
+
+/**
+ * Create a circuit whose state vector lives in a scratch file rather than in
+ * memory, for states larger than RAM. Gates are queued and streamed over the
+ * file a chunk at a time; runs of gates are applied in one pass, and gates on
+ * the high (chunk-selecting) qubits read paired chunks together.
+ * @param num_qubits Number of qubits in the circuit (at most 58)
+ * @param scratch_dir Directory for the scratch file, ideally on a fast local
+ *        disk (NULL for /tmp); the file is unlinked as soon as it is created
+ * @param chunk_qubits log2 of the amplitudes read per chunk (<= 0 for the
+ *        default of 2^20 amplitudes, 16 MiB)
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_create_out_of_core(int num_qubits, const char *scratch_dir,
+                                   int chunk_qubits) {
+  t_q_circuit *circuit = qc_alloc(num_qubits);
+  if (!circuit)
+    return NULL;
+
+  circuit->backend = QC_BACKEND_DISK;
+  circuit->disk = q_disk_init(num_qubits, scratch_dir, chunk_qubits);
+  if (circuit->disk == NULL) {
+    qc_destroy(circuit);
+    return NULL;
+  }
+  return circuit;
+}
+
+/**
+ * Create a circuit whose state vector is held in memory as independently
+ * compressed blocks, for states too large to store uncompressed. Gates
+ * decode, update and re-encode the blocks they touch; gates on the high
+ * qubits pair blocks as on the out-of-core backend.
+ * qc_get_state_bytes() reports the compressed size and
+ * qc_get_truncation_error() the accumulated error bound.
+ * @param num_qubits Number of qubits in the circuit (at most 58)
+ * @param block_qubits log2 of the amplitudes per block (<= 0 for the
+ *        default of 2^16 amplitudes, 1 MiB before compression)
+ * @param error_bound Largest rounding allowed per real or imaginary part at
+ *        each re-encoding (0 for lossless compression)
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_create_compressed(int num_qubits, int block_qubits,
+                                  double error_bound) {
+  t_q_circuit *circuit = qc_alloc(num_qubits);
+  if (!circuit)
+    return NULL;
+
+  circuit->backend = QC_BACKEND_DISK;
+  circuit->disk =
+      q_disk_init_compressed(num_qubits, block_qubits, error_bound);
+  if (circuit->disk == NULL) {
+    qc_destroy(circuit);
+    return NULL;
+  }
+  return circuit;
+}
+
+/**
+ * Switch a sparse circuit to the dense backend
+ * @param circuit Quantum circuit
+ * @return 0 on success, -1 if the dense state could not be allocated
+ */
+static int qc_sparse_to_dense(t_q_circuit *circuit) {
+  struct t_q_state *state = q_sparse_to_dense(circuit->sparse);
+  if (state == NULL)
+    return -1;
+
+  q_sparse_free(circuit->sparse);
+  circuit->sparse = NULL;
+  circuit->state = state;
+  circuit->backend = QC_BACKEND_DENSE;
+  circuit->state_version++;
+  return 0;
+}
+
+/**
+ * Convert a sparse circuit to dense once it has filled past its threshold
+ * @param circuit Quantum circuit
+ */
+static void qc_sparse_check_fill(t_q_circuit *circuit) {
+  if (circuit->dense_fill_ratio > 0.0 &&
+      q_sparse_fill_ratio(circuit->sparse) > circuit->dense_fill_ratio) {
+    if (qc_sparse_to_dense(circuit) != 0)
+      circuit->dense_fill_ratio = 0.0;
+  }
+}
+
+/**
+ * Get the accumulated truncation error of an MPS or compressed circuit
+ * @param circuit Quantum circuit
+ * @return Sum of discarded weights for MPS, bound on the 2-norm distance
+ *         from the exact state for a compressed circuit (always 0.0 for the
+ *         other backends)
+ */
+double qc_get_truncation_error(t_q_circuit *circuit) {
+  if (circuit == NULL)
+    return 0.0;
+  if (circuit->backend == QC_BACKEND_MPS)
+    return circuit->mps->truncation_error;
+  if (circuit->backend == QC_BACKEND_DISK && circuit->disk->zip != NULL) {
+    /* queued gates count once they are applied */
+    q_disk_flush(circuit->disk);
+    return circuit->disk->zip->error;
+  }
+  return 0.0;
+}
+
+/**
+ * Memory held by a circuit's quantum state
+ * @param circuit Quantum circuit
+ * @return Bytes of amplitude storage (for an out-of-core circuit, the size
+ *         of its scratch file), or -1 for a NULL circuit
+ */
+long qc_get_state_bytes(t_q_circuit *circuit) {
+  long bytes = 0;
+  int k;
+
+  if (circuit == NULL)
+    return -1;
+  switch (circuit->backend) {
+  case QC_BACKEND_MPS:
+    for (k = 0; k < circuit->num_qubits; k++)
+      bytes += 2L * circuit->mps->bond_dims[k] *
+               circuit->mps->bond_dims[k + 1] * (long)sizeof(struct t_complex);
+    return bytes;
+  case QC_BACKEND_SPARSE:
+    return (circuit->sparse->capacity + circuit->sparse->scratch_capacity) *
+           (long)(sizeof(long) + sizeof(struct t_complex));
+  case QC_BACKEND_DISK:
+    if (circuit->disk->zip != NULL) {
+      q_disk_flush(circuit->disk);
+      return q_zip_bytes(circuit->disk->zip);
+    }
+    return circuit->disk->size * (long)sizeof(struct t_complex);
+  default:
+    return 2 * circuit->state->size * (long)sizeof(struct t_complex);
+  }
+}
+
+/**
+ * Apply a 1-qubit gate matrix on whichever backend the circuit uses
+ * @param circuit Quantum circuit
+ * @param gate 2x2 gate matrix
+ * @param qubit Target qubit index
+ */
+static void qc_apply_1q(t_q_circuit *circuit, const struct t_q_matrix *gate,
+                        int qubit) {
+  circuit->state_version++;
+  if (circuit->backend == QC_BACKEND_MPS) {
+    q_mps_apply_1q_gate(circuit->mps, gate, qubit);
+  } else if (circuit->backend == QC_BACKEND_SPARSE) {
+    q_sparse_apply_1q_gate(circuit->sparse, gate, qubit);
+    qc_sparse_check_fill(circuit);
+  } else if (circuit->backend == QC_BACKEND_DISK) {
+    q_disk_apply_1q_gate(circuit->disk, gate, qubit);
+  } else if (circuit->state->vector == circuit->state->file_vector) {
+    q_apply_1q_gate_mapped(circuit->state, gate, qubit);
+  } else {
+    q_apply_1q_gate(circuit->state, gate, qubit);
+  }
+}
+
+/**
+ * Apply a controlled 1-qubit gate on whichever backend the circuit uses
+ * @param circuit Quantum circuit
+ * @param gate 2x2 matrix applied to the target when the control is |1>
+ * @param control Control qubit index
+ * @param target Target qubit index
+ */
+static void qc_apply_2q(t_q_circuit *circuit, const struct t_q_matrix *gate,
+                        int control, int target) {
+  circuit->state_version++;
+  if (circuit->backend == QC_BACKEND_MPS) {
+    q_mps_apply_2q_gate(circuit->mps, gate, control, target);
+  } else if (circuit->backend == QC_BACKEND_SPARSE) {
+    q_sparse_apply_2q_gate(circuit->sparse, gate, control, target);
+    qc_sparse_check_fill(circuit);
+  } else if (circuit->backend == QC_BACKEND_DISK) {
+    q_disk_apply_2q_gate(circuit->disk, gate, control, target);
+  } else if (circuit->state->vector == circuit->state->file_vector) {
+    q_apply_2q_gate_mapped(circuit->state, gate, control, target);
+  } else {
+    q_apply_2q_gate(circuit->state, gate, control, target);
+  }
+}
+
+/**
+ * Number of basis states, for bounds checks and 2^n-entry histograms
+ * @param circuit Quantum circuit
+ * @return 2^num_qubits, or -1 when that does not fit in a t_q_index
+ *         (MPS and sparse circuits of QCS_INDEX_MAX_QUBITS qubits or more)
+ */
+static t_q_index qc_num_states(t_q_circuit *circuit) {
+  if (circuit->backend == QC_BACKEND_DENSE)
+    return circuit->state->size;
+  if (circuit->num_qubits >= QCS_INDEX_MAX_QUBITS)
+    return -1;
+  return (t_q_index)1 << circuit->num_qubits;
+}
 
+/**
+ * Destroy a quantum circuit and free all associated memory
+ * @param circuit Circuit to destroy
+ */
+void qc_destroy(t_q_circuit *circuit) {
   if (circuit) {
     if (circuit->state)
       q_state_free(circuit->state);
-    if (circuit->gate_history) {
-      for (i = 0; i < circuit->history_size; i++) {
-        free(circuit->gate_history[i]);
-      }
+    if (circuit->mps)
+      q_mps_free(circuit->mps);
+    if (circuit->sparse)
+      q_sparse_free(circuit->sparse);
+    if (circuit->disk)
+      q_disk_free(circuit->disk);
+    if (circuit->gate_history)
       free(circuit->gate_history);
-    }
     if (circuit->target_qubits)
       free(circuit->target_qubits);
     if (circuit->control_qubits)
       free(circuit->control_qubits);
     if (circuit->parameters)
       free(circuit->parameters);
+    if (circuit->param_slots)
+      free(circuit->param_slots);
+    if (circuit->slot_values)
+      free(circuit->slot_values);
+    q_program_free(circuit->program);
+    q_sampler_free(circuit->sampler);
+    free(circuit->checkpoint_path);
+    if (circuit->share_fd >= 0)
+      close(circuit->share_fd);
+    if (circuit->initial_fd >= 0)
+      close(circuit->initial_fd);
     free(circuit);
+
+    #ifdef QCS_MULTI_THREAD
+    qc_pool_release();
+    #endif
   }
 }
 
@@ -122,18 +479,20 @@ static char *qc_strdup(const char *str) {
 }
 
 /**
- * Add a gate to the circuit history
+ * Add a gate to the circuit history, with the parameter slot it reads from
  * @param circuit Quantum circuit
- * @param gate_name Name of the gate
+ * @param gate_name Name of the gate, a string literal (it is recorded by
+ *        pointer, not copied)
  * @param target Target qubit index
  * @param control Control qubit index (or -1 if none)
  * @param param Gate parameter value
+ * @param slot Parameter slot index, or -1 for a literal angle
  */
-void qc_add_gate(t_q_circuit *circuit, const char *gate_name, int target,
-                 int control, double param) {
+static void qc_record_gate(t_q_circuit *circuit, const char *gate_name,
+                           int target, int control, double param, int slot) {
   if (circuit->history_size >= circuit->history_capacity) {
     circuit->history_capacity *= 2;
-    circuit->gate_history = (char **)realloc(
+    circuit->gate_history = (const char **)realloc(
         circuit->gate_history, circuit->history_capacity * sizeof(char *));
     circuit->target_qubits = (int *)realloc(
         circuit->target_qubits, circuit->history_capacity * sizeof(int));
@@ -141,14 +500,40 @@ void qc_add_gate(t_q_circuit *circuit, const char *gate_name, int target,
         circuit->control_qubits, circuit->history_capacity * sizeof(int));
     circuit->parameters = (double *)realloc(
         circuit->parameters, circuit->history_capacity * sizeof(double));
+    circuit->param_slots = (int *)realloc(
+        circuit->param_slots, circuit->history_capacity * sizeof(int));
+  }
+
+  if (circuit->program != NULL) {
+    q_program_free(circuit->program);
+    circuit->program = NULL;
   }
 
-  circuit->gate_history[circuit->history_size] = qc_strdup(gate_name);
+  circuit->gate_history[circuit->history_size] = gate_name;
   circuit->target_qubits[circuit->history_size] = target;
   circuit->control_qubits[circuit->history_size] = control;
   circuit->parameters[circuit->history_size] = param;
+  circuit->param_slots[circuit->history_size] = slot;
   circuit->history_size++;
   circuit->num_gates++;
+
+  if (circuit->checkpoint_interval > 0 &&
+      circuit->num_gates % circuit->checkpoint_interval == 0)
+    qc_save_state(circuit, circuit->checkpoint_path);
+}
+
+/**
+ * Add a gate to the circuit history
+ * @param circuit Quantum circuit
+ * @param gate_name Name of the gate, a string literal (it is recorded by
+ *        pointer, not copied)
+ * @param target Target qubit index
+ * @param control Control qubit index (or -1 if none)
+ * @param param Gate parameter value
+ */
+void qc_add_gate(t_q_circuit *circuit, const char *gate_name, int target,
+                 int control, double param) {
+  qc_record_gate(circuit, gate_name, target, control, param, -1);
 }
 
 /**
@@ -157,9 +542,7 @@ void qc_add_gate(t_q_circuit *circuit, const char *gate_name, int target,
  * @param qubit Target qubit index
  */
 void qc_h(t_q_circuit *circuit, int qubit) {
-  struct t_q_matrix *H = q_gate_H();
-  q_apply_1q_gate(circuit->state, H, qubit);
-  q_matrix_free(H);
+  qc_apply_1q(circuit, &q_gate_table_H, qubit);
   qc_add_gate(circuit, "H", qubit, -1, 0.0);
 }
 
@@ -169,9 +552,7 @@ void qc_h(t_q_circuit *circuit, int qubit) {
  * @param qubit Target qubit index
  */
 void qc_x(t_q_circuit *circuit, int qubit) {
-  struct t_q_matrix *X = q_gate_X();
-  q_apply_1q_gate(circuit->state, X, qubit);
-  q_matrix_free(X);
+  qc_apply_1q(circuit, &q_gate_table_X, qubit);
   qc_add_gate(circuit, "X", qubit, -1, 0.0);
 }
 
@@ -182,10 +563,7 @@ void qc_x(t_q_circuit *circuit, int qubit) {
  * @param target Target qubit index
  */
 void qc_cnot(t_q_circuit *circuit, int control, int target) {
-  struct t_q_matrix *X = q_gate_X();
-
-  q_apply_2q_gate(circuit->state, X, control, target);
-  q_matrix_free(X);
+  qc_apply_2q(circuit, &q_gate_table_X, control, target);
   qc_add_gate(circuit, "CNOT", target, control, 0.0);
 }
 
@@ -196,9 +574,9 @@ void qc_cnot(t_q_circuit *circuit, int control, int target) {
  * @param angle Rotation angle in radians
  */
 void qc_rx(t_q_circuit *circuit, int qubit, double angle) {
-  struct t_q_matrix *RX = q_gate_RX(angle);
-  q_apply_1q_gate(circuit->state, RX, qubit);
-  q_matrix_free(RX);
+  struct t_q_gate RX;
+
+  qc_apply_1q(circuit, q_gate_set_RX(&RX, angle), qubit);
   qc_add_gate(circuit, "RX", qubit, -1, angle);
 }
 
@@ -209,9 +587,9 @@ void qc_rx(t_q_circuit *circuit, int qubit, double angle) {
  * @param angle Rotation angle in radians
  */
 void qc_ry(t_q_circuit *circuit, int qubit, double angle) {
-  struct t_q_matrix *RY = q_gate_RY(angle);
-  q_apply_1q_gate(circuit->state, RY, qubit);
-  q_matrix_free(RY);
+  struct t_q_gate RY;
+
+  qc_apply_1q(circuit, q_gate_set_RY(&RY, angle), qubit);
   qc_add_gate(circuit, "RY", qubit, -1, angle);
 }
 
@@ -222,112 +600,377 @@ void qc_ry(t_q_circuit *circuit, int qubit, double angle) {
  * @param angle Rotation angle in radians
  */
 void qc_rz(t_q_circuit *circuit, int qubit, double angle) {
-  struct t_q_matrix *RZ = q_gate_RZ(angle);
-  q_apply_1q_gate(circuit->state, RZ, qubit);
-  q_matrix_free(RZ);
+  struct t_q_gate RZ;
+
+  qc_apply_1q(circuit, q_gate_set_RZ(&RZ, angle), qubit);
   qc_add_gate(circuit, "RZ", qubit, -1, angle);
 }
 
 /**
- * Measure a single qubit and collapse the quantum state
+ * Current value of a parameter slot, growing the slot table on first use
  * @param circuit Quantum circuit
- * @param qubit Qubit to measure
- * @return Measured value (0 or 1)
+ * @param slot Parameter slot index
+ * @return Last bound value of the slot (0.0 before the first bind)
  */
-int qc_measure(t_q_circuit *circuit, int qubit) {
-  long state_size;
-  double prob_0;
-  long i;
-  double amp_real;
-  double amp_imag;
-  double random_val;
+static double qc_slot_value(t_q_circuit *circuit, int slot) {
+  if (slot >= circuit->num_slots) {
+    double *values =
+        (double *)realloc(circuit->slot_values, (slot + 1) * sizeof(double));
+    int k;
+
+    if (values == NULL) {
+      fprintf(stderr, "Error: Memory allocation failed for parameter slots.\n");
+      return 0.0;
+    }
+    for (k = circuit->num_slots; k <= slot; k++)
+      values[k] = 0.0;
+    circuit->slot_values = values;
+    circuit->num_slots = slot + 1;
+  }
+  return circuit->slot_values[slot];
+}
 
-  if (circuit == NULL || circuit->state == NULL || qubit < 0 ||
-      qubit >= circuit->num_qubits) {
-    return 0;
+/**
+ * Apply a rotation whose angle is read from a parameter slot and record the
+ * slot in the history so that qc_bind() can rebind it later
+ * @param circuit Quantum circuit
+ * @param name Gate name ("RX", "RY", "RZ" or "P")
+ * @param qubit Target qubit index
+ * @param slot Parameter slot index
+ */
+static void qc_param_gate(t_q_circuit *circuit, const char *name, int qubit,
+                          int slot) {
+  struct t_q_gate gate;
+  const struct t_q_matrix *matrix;
+  double angle;
+
+  if (slot < 0) {
+    fprintf(stderr, "Error: Parameter slot must be non-negative.\n");
+    return;
   }
+  angle = qc_slot_value(circuit, slot);
+
+  if (strcmp(name, "RX") == 0)
+    matrix = q_gate_set_RX(&gate, angle);
+  else if (strcmp(name, "RY") == 0)
+    matrix = q_gate_set_RY(&gate, angle);
+  else if (strcmp(name, "RZ") == 0)
+    matrix = q_gate_set_RZ(&gate, angle);
+  else
+    matrix = q_gate_set_P(&gate, angle);
+  qc_apply_1q(circuit, matrix, qubit);
+  /* The slot is recorded with the gate, so an interval checkpoint taken
+   * on this gate already sees it as parameterized */
+  qc_record_gate(circuit, name, qubit, -1, angle, slot);
+}
 
-  state_size = circuit->state->size;
-  prob_0 = 0.0;
+/**
+ * Apply RX with its angle taken from a parameter slot
+ * @param circuit Quantum circuit
+ * @param qubit Target qubit index
+ * @param slot Parameter slot index
+ */
+void qc_rx_param(t_q_circuit *circuit, int qubit, int slot) {
+  qc_param_gate(circuit, "RX", qubit, slot);
+}
 
-  for (i = 0; i < state_size; i++) {
-    if ((i & (1L << qubit)) == 0) {
-      amp_real = circuit->state->vector[i].number_real;
-      amp_imag = circuit->state->vector[i].number_imaginary;
-      prob_0 += (amp_real * amp_real) + (amp_imag * amp_imag);
-    }
-  }
+/**
+ * Apply RY with its angle taken from a parameter slot
+ * @param circuit Quantum circuit
+ * @param qubit Target qubit index
+ * @param slot Parameter slot index
+ */
+void qc_ry_param(t_q_circuit *circuit, int qubit, int slot) {
+  qc_param_gate(circuit, "RY", qubit, slot);
+}
 
-  random_val = rand() / (double)RAND_MAX;
+/**
+ * Apply RZ with its angle taken from a parameter slot
+ * @param circuit Quantum circuit
+ * @param qubit Target qubit index
+ * @param slot Parameter slot index
+ */
+void qc_rz_param(t_q_circuit *circuit, int qubit, int slot) {
+  qc_param_gate(circuit, "RZ", qubit, slot);
+}
 
-  if (random_val <= prob_0) {
-    for (i = 0; i < state_size; i++) {
-      if ((i & (1L << qubit)) != 0) {
-        circuit->state->vector[i].number_real = 0.0;
-        circuit->state->vector[i].number_imaginary = 0.0;
-      }
-    }
-    q_state_normalize(circuit->state);
-    return 0;
+/**
+ * Apply a phase gate with its angle taken from a parameter slot
+ * @param circuit Quantum circuit
+ * @param qubit Target qubit index
+ * @param slot Parameter slot index
+ */
+void qc_phase_param(t_q_circuit *circuit, int qubit, int slot) {
+  qc_param_gate(circuit, "P", qubit, slot);
+}
 
+/**
+ * Reset the backend state of a circuit to its starting state: |0...0>, or
+ * the state it was loaded with
+ * @param circuit Quantum circuit
+ * @return 0 on success, -1 on allocation or read failure
+ */
+static int qc_reset_state(t_q_circuit *circuit) {
+  circuit->state_version++;
+  if (circuit->backend == QC_BACKEND_MPS) {
+    struct t_q_mps *mps =
+        q_mps_init(circuit->num_qubits, circuit->mps->max_bond_dim,
+                   circuit->mps->truncation_threshold);
+    if (mps == NULL)
+      return -1;
+    q_mps_free(circuit->mps);
+    circuit->mps = mps;
+  } else if (circuit->backend == QC_BACKEND_SPARSE) {
+    struct t_q_sparse *sparse = q_sparse_init(circuit->num_qubits);
+    if (sparse == NULL)
+      return -1;
+    q_sparse_free(circuit->sparse);
+    circuit->sparse = sparse;
+  } else if (circuit->backend == QC_BACKEND_DISK) {
+    return q_disk_reset(circuit->disk);
+  } else if (circuit->initial_fd >= 0) {
+    return q_state_file_read(circuit->initial_fd, circuit->state->vector,
+                             circuit->state->size);
   } else {
-    for (i = 0; i < state_size; i++) {
-      if ((i & (1L << qubit)) == 0) {
-        circuit->state->vector[i].number_real = 0.0;
-        circuit->state->vector[i].number_imaginary = 0.0;
-      }
-    }
-
-    q_state_normalize(circuit->state);
-    return 1;
+    q_state_set_basis(circuit->state, 0);
   }
+  return 0;
 }
 
+/* How qc_run_shots has to treat the recorded history */
+#define QC_SHOTS_UNITARY 0    /* no measurement or reset */
+#define QC_SHOTS_TERMINAL 1   /* measurements only after the last gate */
+#define QC_SHOTS_TRAJECTORY 2 /* mid-circuit measurement or reset */
+
 /**
- * Measure all qubits in the circuit
+ * Classify the gate history. A measurement is terminal when no later gate
+ * touches the measured qubit, so it commutes to the end of the circuit.
  * @param circuit Quantum circuit
- * @param results Array to store measurement results
+ * @return QC_SHOTS_UNITARY, QC_SHOTS_TERMINAL or QC_SHOTS_TRAJECTORY
  */
-void qc_measure_all(t_q_circuit *circuit, int *results) {
-  if (circuit == NULL || results == NULL)
-    return;
+static int qc_history_shape(const t_q_circuit *circuit) {
+  int *measured;
+  int all_measured = 0;
+  int any_measured = 0;
+  int g;
 
-  int i;
+  measured = (int *)calloc(circuit->num_qubits, sizeof(int));
+  if (measured == NULL)
+    return QC_SHOTS_TRAJECTORY;
+
+  for (g = 0; g < circuit->history_size; g++) {
+    const char *name = circuit->gate_history[g];
+    int target = circuit->target_qubits[g];
+    int control = circuit->control_qubits[g];
+
+    if (strcmp(name, "BARRIER") == 0)
+      continue;
+    if (strcmp(name, "RESET") == 0)
+      break;
+
+    if (strcmp(name, "MEASURE") == 0) {
+      if (target < 0)
+        all_measured = 1;
+      else
+        measured[target] = 1;
+      any_measured = 1;
+      continue;
+    }
 
-  for (i = 0; i < circuit->num_qubits; i++) {
-    results[i] = qc_measure(circuit, i);
+    /* ORACLE and DIFFUSION act on every qubit */
+    if (all_measured || (any_measured && target < 0) ||
+        (strcmp(name, "ORACLE") == 0 && any_measured) ||
+        (target >= 0 && measured[target]) ||
+        (control >= 0 && measured[control]))
+      break;
   }
 
-  qc_add_gate(circuit, "MEASURE", -1, -1, 0.0);
+  free(measured);
+  if (g < circuit->history_size)
+    return QC_SHOTS_TRAJECTORY;
+  return any_measured ? QC_SHOTS_TERMINAL : QC_SHOTS_UNITARY;
 }
 
 /**
- * Print the quantum circuit gate history
- * @param circuit Quantum circuit to print
+ * Compile the gate history into a cached program if it is not compiled yet.
+ * Measurements are skipped; the history may only hold terminal ones.
+ * @param circuit Quantum circuit
+ * @return Compiled program, or NULL if the history cannot be compiled
  */
-void qc_print_circuit(t_q_circuit *circuit) {
-  int q;
-  int g;
-  int has_measurement;
+static struct t_q_program *qc_compile(t_q_circuit *circuit) {
+  if (circuit->program == NULL) {
+    /* terminal measurements commute to the end and are left out */
+    if (qc_history_shape(circuit) == QC_SHOTS_TRAJECTORY) {
+      fprintf(stderr, "Error: Binding needs every measurement to follow the "
+                      "last gate on its qubit, and no resets.\n");
+      return NULL;
+    }
+    circuit->program = q_program_compile(
+        circuit->gate_history, circuit->target_qubits, circuit->control_qubits,
+        circuit->parameters, circuit->param_slots, circuit->history_size,
+        circuit->num_qubits);
+  }
+  return circuit->program;
+}
 
-  printf("\n╔══════════════════════════════════════════╗\n");
-  printf("║              QUANTUM CIRCUIT             ║\n");
-  printf("╚══════════════════════════════════════════╝\n");
-  printf("Qubits: %d | Gates: %d\n\n", circuit->num_qubits, circuit->num_gates);
+/**
+ * Bind new values to the parameter slots and re-simulate the circuit from
+ * its starting state (|0...0>, or the state loaded by qc_load_state). The
+ * gate history is compiled once into fused kernel calls; later
+ * binds only rebuild the fused matrices that depend on a changed slot.
+ * @param circuit Quantum circuit built from unitary gates, optionally
+ *        followed by measurements
+ * @param values One value per parameter slot used by the circuit
+ * @return 0 on success, -1 on error
+ */
+int qc_bind(t_q_circuit *circuit, const double *values) {
+  struct t_q_program *program;
+  int g, k;
 
-  has_measurement = 0;
+  if (circuit == NULL || (values == NULL && circuit->num_slots > 0))
+    return -1;
+
+  program = qc_compile(circuit);
+  if (program == NULL)
+    return -1;
 
+  if (circuit->num_slots > 0)
+    memcpy(circuit->slot_values, values, circuit->num_slots * sizeof(double));
   for (g = 0; g < circuit->history_size; g++) {
-    if (strcmp(circuit->gate_history[g], "MEASURE") == 0) {
-      has_measurement = 1;
-      break;
-    }
+    if (circuit->param_slots[g] >= 0)
+      circuit->parameters[g] = values[circuit->param_slots[g]];
   }
 
-  for (q = 0; q < circuit->num_qubits; q++) {
-    printf("q%-2d ", q);
+  q_program_bind(program, program->binding, circuit->slot_values);
+  if (qc_reset_state(circuit) != 0) {
+    fprintf(stderr, "Error: Could not reset the state for binding.\n");
+    return -1;
+  }
 
-    for (g = 0; g < circuit->history_size; g++) {
+  for (k = 0; k < program->num_ops; k++) {
+    const struct t_q_program_op *op = &program->ops[k];
+    struct t_q_matrix view;
+    const struct t_q_matrix *matrix =
+        q_program_matrix(program->binding, k, &view);
+
+    if (op->control >= 0)
+      qc_apply_2q(circuit, matrix, op->control, op->target);
+    else
+      qc_apply_1q(circuit, matrix, op->target);
+  }
+  return 0;
+}
+
+
+/**
+ * Measure a single qubit and collapse the state, without recording it
+ * @param circuit Quantum circuit
+ * @param qubit Qubit to measure (validated by the caller)
+ * @return Measured value (0 or 1)
+ */
+static int qc_measure_qubit(t_q_circuit *circuit, int qubit) {
+  circuit->state_version++;
+
+  if (circuit->backend == QC_BACKEND_MPS)
+    return q_mps_measure(circuit->mps, qubit, q_rng_uniform(&circuit->rng));
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return q_sparse_measure(circuit->sparse, qubit,
+                             q_rng_uniform(&circuit->rng));
+  if (circuit->backend == QC_BACKEND_DISK)
+    return q_disk_measure(circuit->disk, qubit, q_rng_uniform(&circuit->rng));
+
+  return q_state_measure(circuit->state, qubit, q_rng_uniform(&circuit->rng));
+}
+
+/**
+ * Measure a single qubit and collapse the quantum state
+ * @param circuit Quantum circuit
+ * @param qubit Qubit to measure
+ * @return Measured value (0 or 1)
+ */
+int qc_measure(t_q_circuit *circuit, int qubit) {
+  int result;
+
+  if (circuit == NULL || qubit < 0 || qubit >= circuit->num_qubits) {
+    return 0;
+  }
+
+  result = qc_measure_qubit(circuit, qubit);
+  qc_add_gate(circuit, "MEASURE", qubit, -1, 0.0);
+  return result;
+}
+
+/**
+ * Measure and collapse every qubit, optionally keeping the outcomes
+ * @param circuit Quantum circuit
+ * @param results Array for the outcomes, or NULL to discard them
+ */
+static void qc_collapse_all(t_q_circuit *circuit, int *results) {
+  int i;
+
+  if (circuit->backend == QC_BACKEND_DENSE) {
+    long index;
+
+    circuit->state_version++;
+    index = q_state_measure_all(circuit->state, q_rng_uniform(&circuit->rng));
+    for (i = 0; results && i < circuit->num_qubits; i++)
+      results[i] = (int)((index >> i) & 1);
+  } else if (circuit->backend == QC_BACKEND_DISK) {
+    t_q_index index;
+
+    circuit->state_version++;
+    index = q_disk_measure_all(circuit->disk, q_rng_uniform(&circuit->rng));
+    for (i = 0; results && i < circuit->num_qubits; i++)
+      results[i] = index < 0 ? 0 : (int)((index >> i) & 1);
+  } else {
+    for (i = 0; i < circuit->num_qubits; i++) {
+      int bit = qc_measure_qubit(circuit, i);
+      if (results)
+        results[i] = bit;
+    }
+  }
+
+  qc_add_gate(circuit, "MEASURE", -1, -1, 0.0);
+}
+
+/**
+ * Measure all qubits in the circuit
+ * @param circuit Quantum circuit
+ * @param results Array to store measurement results
+ */
+void qc_measure_all(t_q_circuit *circuit, int *results) {
+  if (circuit == NULL || results == NULL)
+    return;
+  qc_collapse_all(circuit, results);
+}
+
+/**
+ * Print the quantum circuit gate history
+ * @param circuit Quantum circuit to print
+ */
+void qc_print_circuit(t_q_circuit *circuit) {
+  int q;
+  int g;
+  int has_measurement;
+
+  printf("\n╔══════════════════════════════════════════╗\n");
+  printf("║              QUANTUM CIRCUIT             ║\n");
+  printf("╚══════════════════════════════════════════╝\n");
+  printf("Qubits: %d | Gates: %d\n\n", circuit->num_qubits, circuit->num_gates);
+
+  has_measurement = 0;
+
+  for (g = 0; g < circuit->history_size; g++) {
+    if (strcmp(circuit->gate_history[g], "MEASURE") == 0) {
+      has_measurement = 1;
+      break;
+    }
+  }
+
+  for (q = 0; q < circuit->num_qubits; q++) {
+    printf("q%-2d ", q);
+
+    for (g = 0; g < circuit->history_size; g++) {
       const char *gate = circuit->gate_history[g];
       int target = circuit->target_qubits[g];
       int control = circuit->control_qubits[g];
@@ -364,8 +1007,10 @@ void qc_print_circuit(t_q_circuit *circuit) {
 
     if (strcmp(gate, "CNOT") == 0) {
       printf("CNOT(%d,%d) ", control, target);
-    } else if (strcmp(gate, "MEASURE") == 0) {
+    } else if (strcmp(gate, "MEASURE") == 0 && target < 0) {
       printf("MEASURE ");
+    } else if (strcmp(gate, "ORACLE") == 0) {
+      printf("ORACLE(%ld) ", (t_q_index)circuit->parameters[g]);
     } else {
       printf("%s(%d) ", gate, target);
     }
@@ -378,8 +1023,15 @@ void qc_print_circuit(t_q_circuit *circuit) {
  * @param circuit Quantum circuit
  * @param solution_index Index to highlight (or -1 for none)
  */
-void qc_print_state(t_q_circuit *circuit, int solution_index) {
-  q_state_print(circuit->state, solution_index);
+void qc_print_state(t_q_circuit *circuit, t_q_index solution_index) {
+  if (circuit->backend == QC_BACKEND_MPS)
+    q_mps_print(circuit->mps);
+  else if (circuit->backend == QC_BACKEND_SPARSE)
+    q_sparse_print(circuit->sparse);
+  else if (circuit->backend == QC_BACKEND_DISK)
+    q_disk_print(circuit->disk, solution_index);
+  else
+    q_state_print(circuit->state, solution_index);
 }
 
 /**
@@ -388,30 +1040,526 @@ void qc_print_state(t_q_circuit *circuit, int solution_index) {
  * @param state State index
  * @return Probability amplitude (0.0 to 1.0)
  */
-double qc_get_probability(t_q_circuit *circuit, int state) {
-  if (state < 0 || state >= circuit->state->size)
+double qc_get_probability(t_q_circuit *circuit, t_q_index state) {
+  t_q_index num_states = qc_num_states(circuit);
+
+  /* on wider circuits an index names a state whose remaining qubits are 0 */
+  if (state < 0 || (num_states >= 0 && state >= num_states))
     return 0.0;
+  if (circuit->backend == QC_BACKEND_MPS)
+    return c_norm_sq(q_mps_amplitude(circuit->mps, state));
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return c_norm_sq(q_sparse_get(circuit->sparse, state));
+  if (circuit->backend == QC_BACKEND_DISK)
+    return c_norm_sq(q_disk_get(circuit->disk, state));
   return c_norm_sq(circuit->state->vector[state]);
 }
 
+/**
+ * Probability distribution over a subset of qubits, without modifying or
+ * copying the state
+ * @param circuit Quantum circuit (any backend but MPS)
+ * @param qubits Distinct qubits; bit j of an outcome is qubit qubits[j]
+ * @param k Number of qubits (at most 30)
+ * @param out Output array of 2^k probabilities
+ * @return 0 on success, -1 on invalid arguments or failure
+ */
+int qc_marginal_probabilities(t_q_circuit *circuit, const int *qubits, int k,
+                              double *out) {
+  int i, j;
+
+  if (circuit == NULL || qubits == NULL || out == NULL || k < 0 || k > 30)
+    return -1;
+  for (i = 0; i < k; i++) {
+    if (qubits[i] < 0 || qubits[i] >= circuit->num_qubits)
+      return -1;
+    for (j = 0; j < i; j++) {
+      if (qubits[j] == qubits[i])
+        return -1;
+    }
+  }
+
+  if (circuit->backend == QC_BACKEND_MPS) {
+    fprintf(stderr, "Error: Marginal probabilities require the state-vector "
+                    "or sparse backend.\n");
+    return -1;
+  }
+  if (circuit->backend == QC_BACKEND_SPARSE) {
+    q_sparse_marginal(circuit->sparse, qubits, k, out);
+    return 0;
+  }
+  if (circuit->backend == QC_BACKEND_DISK)
+    return q_disk_marginal(circuit->disk, qubits, k, out);
+  return q_state_marginal(circuit->state, qubits, k, out);
+}
+
+/**
+ * Parse a Pauli string into its flip mask, Z-parity mask and Y count
+ * @param circuit Quantum circuit
+ * @param pauli String of 'I', 'X', 'Y', 'Z'; character k acts on qubit k
+ * @param flip_mask Output mask of qubits carrying X or Y
+ * @param z_mask Output mask of qubits carrying Y or Z
+ * @param y_count Output number of Y factors
+ * @return 0 on success, -1 on an invalid string or, outside MPS, a non-I
+ *         factor on a qubit the masks cannot hold (QCS_INDEX_MAX_QUBITS on)
+ */
+static int qc_parse_pauli(t_q_circuit *circuit, const char *pauli,
+                          long *flip_mask, long *z_mask, int *y_count) {
+  int k;
+
+  *flip_mask = 0;
+  *z_mask = 0;
+  *y_count = 0;
+
+  if (pauli == NULL)
+    return -1;
+
+  for (k = 0; pauli[k] != '\0'; k++) {
+    long bit = (k < QCS_INDEX_MAX_QUBITS) ? (1L << k) : 0;
+
+    if (k >= circuit->num_qubits)
+      return -1;
+    /* the masks cannot hold the factor; MPS reads the string instead */
+    if (bit == 0 && pauli[k] != 'I' && pauli[k] != 'i' &&
+        circuit->backend != QC_BACKEND_MPS) {
+      fprintf(stderr,
+              "Error: Pauli factors on qubit %d or above need the MPS "
+              "backend.\n",
+              QCS_INDEX_MAX_QUBITS);
+      return -1;
+    }
+
+    switch (pauli[k]) {
+    case 'I':
+    case 'i':
+      break;
+    case 'X':
+    case 'x':
+      *flip_mask |= bit;
+      break;
+    case 'Y':
+    case 'y':
+      *flip_mask |= bit;
+      *z_mask |= bit;
+      (*y_count)++;
+      break;
+    case 'Z':
+    case 'z':
+      *z_mask |= bit;
+      break;
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Expectation value <psi|P|psi> of a Pauli string, computed in one
+ * read-only pass; the state is neither copied nor modified.
+ * @param circuit Quantum circuit
+ * @param pauli String of 'I', 'X', 'Y', 'Z'; character k acts on qubit k,
+ *        missing trailing characters are treated as 'I'
+ * @return Expectation value (0.0 on invalid input)
+ */
+double qc_expectation_pauli(t_q_circuit *circuit, const char *pauli) {
+  long flip_mask, z_mask;
+  int y_count;
+
+  if (circuit == NULL ||
+      qc_parse_pauli(circuit, pauli, &flip_mask, &z_mask, &y_count) != 0) {
+    fprintf(stderr, "Error: Invalid Pauli string for expectation value.\n");
+    return 0.0;
+  }
+
+  if (circuit->backend == QC_BACKEND_DISK) {
+    fprintf(stderr, "Error: Expectation values are not supported on the "
+                    "out-of-core or compressed backend.\n");
+    return 0.0;
+  }
+
+  if (circuit->backend == QC_BACKEND_MPS) {
+    char *ops = (char *)malloc(circuit->num_qubits);
+    double value;
+    int k;
+
+    if (ops == NULL)
+      return 0.0;
+    for (k = 0; k < circuit->num_qubits; k++) {
+      ops[k] = 'I';
+    }
+    for (k = 0; pauli[k] != '\0'; k++) {
+      ops[k] = (pauli[k] >= 'a') ? (char)(pauli[k] - 'a' + 'A') : pauli[k];
+    }
+    value = q_mps_expectation_pauli(circuit->mps, ops);
+    free(ops);
+    return value;
+  }
+
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return q_sparse_expectation_pauli(circuit->sparse, flip_mask, z_mask,
+                                      y_count);
+
+  return q_state_expectation_pauli(circuit->state, flip_mask, z_mask, y_count);
+}
+
+/**
+ * Parse a list of Pauli strings into per-term masks
+ * @param circuit Quantum circuit the strings refer to
+ * @param terms Array of Pauli strings
+ * @param count Number of terms
+ * @param flip_masks Output array of X/Y masks (allocated, caller frees)
+ * @param z_masks Output array of Y/Z masks (allocated, caller frees)
+ * @param y_counts Output array of Y counts (allocated, caller frees)
+ * @return 0 on success, -1 on invalid input or allocation failure
+ */
+static int qc_parse_terms(t_q_circuit *circuit, const char **terms, int count,
+                          long **flip_masks, long **z_masks, int **y_counts) {
+  int k;
+
+  *flip_masks = (long *)malloc(count * sizeof(long));
+  *z_masks = (long *)malloc(count * sizeof(long));
+  *y_counts = (int *)malloc(count * sizeof(int));
+  if (*flip_masks == NULL || *z_masks == NULL || *y_counts == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed for Hamiltonian terms.\n");
+    free(*flip_masks);
+    free(*z_masks);
+    free(*y_counts);
+    return -1;
+  }
+
+  for (k = 0; k < count; k++) {
+    if (qc_parse_pauli(circuit, terms[k], &(*flip_masks)[k], &(*z_masks)[k],
+                       &(*y_counts)[k]) != 0) {
+      fprintf(stderr, "Error: Invalid Pauli string '%s' in Hamiltonian.\n",
+              terms[k] != NULL ? terms[k] : "(null)");
+      free(*flip_masks);
+      free(*z_masks);
+      free(*y_counts);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Expectation value of a Hamiltonian given as a weighted sum of Pauli strings.
+ * Terms sharing the same X/Y positions are evaluated together in one pass
+ * over the state; the state is not modified.
+ * @param circuit Quantum circuit
+ * @param terms Array of Pauli strings (see qc_expectation_pauli)
+ * @param coeffs Real coefficient of each term
+ * @param count Number of terms
+ * @return sum_k coeffs[k] <psi|P_k|psi>, or 0.0 on error
+ */
+double qc_expectation_hamiltonian(t_q_circuit *circuit, const char **terms,
+                                  const double *coeffs, int count) {
+  long *flip_masks, *z_masks;
+  int *y_counts;
+  double value = 0.0;
+  int k;
+
+  if (circuit == NULL || terms == NULL || coeffs == NULL || count <= 0)
+    return 0.0;
+
+  if (circuit->backend != QC_BACKEND_DENSE) {
+    for (k = 0; k < count; k++) {
+      value += coeffs[k] * qc_expectation_pauli(circuit, terms[k]);
+    }
+    return value;
+  }
+
+  if (qc_parse_terms(circuit, terms, count, &flip_masks, &z_masks,
+                     &y_counts) != 0)
+    return 0.0;
+
+  value = q_state_expectation_terms(circuit->state, flip_masks, z_masks,
+                                    y_counts, coeffs, count);
+
+  free(flip_masks);
+  free(z_masks);
+  free(y_counts);
+  return value;
+}
+
+/**
+ * Whether a recorded gate carries a differentiable angle
+ * @param name Gate name from the history
+ * @return 1 for RX, RY, RZ and P, 0 otherwise
+ */
+static int qc_is_parameterized(const char *name) {
+  return strcmp(name, "RX") == 0 || strcmp(name, "RY") == 0 ||
+         strcmp(name, "RZ") == 0 || strcmp(name, "P") == 0;
+}
+
+/**
+ * Rebuild the 2x2 matrix of a recorded unitary gate. Every such gate is
+ * either self-adjoint or a rotation, so its adjoint is the matrix for the
+ * negated angle.
+ * @param name Gate name from the history
+ * @param param Recorded angle
+ * @param gate Inline storage for the rotations
+ * @return Constant table or the filled inline gate, or NULL if the gate is
+ *         not a unitary 1-qubit or controlled 1-qubit gate
+ */
+static const struct t_q_matrix *qc_history_matrix(const char *name,
+                                                  double param,
+                                                  struct t_q_gate *gate) {
+  if (strcmp(name, "H") == 0)
+    return &q_gate_table_H;
+  if (strcmp(name, "X") == 0 || strcmp(name, "CNOT") == 0)
+    return &q_gate_table_X;
+  if (strcmp(name, "Y") == 0)
+    return &q_gate_table_Y;
+  if (strcmp(name, "Z") == 0)
+    return &q_gate_table_Z;
+  if (strcmp(name, "RX") == 0)
+    return q_gate_set_RX(gate, param);
+  if (strcmp(name, "RY") == 0)
+    return q_gate_set_RY(gate, param);
+  if (strcmp(name, "RZ") == 0)
+    return q_gate_set_RZ(gate, param);
+  if (strcmp(name, "P") == 0 || strcmp(name, "CPHASE") == 0)
+    return q_gate_set_P(gate, param);
+  return NULL;
+}
+
+/**
+ * Number of differentiable angles (RX, RY, RZ, P) in the gate history
+ * @param circuit Quantum circuit
+ * @return Parameter count
+ */
+int qc_get_num_parameters(t_q_circuit *circuit) {
+  int count = 0;
+  int g;
+
+  if (circuit == NULL)
+    return 0;
+  for (g = 0; g < circuit->history_size; g++) {
+    if (qc_is_parameterized(circuit->gate_history[g]))
+      count++;
+  }
+  return count;
+}
+
+/**
+ * Gradient of <psi|H|psi> with respect to every RX, RY, RZ and P angle in the
+ * gate history, by adjoint differentiation. Two state vectors are walked
+ * backwards through the history with adjoint gate matrices: psi (the state
+ * after each gate) and lambda = U_{N..g+1}^dagger H psi. For U = exp(-i t G)
+ * the derivative is 2 Re <lambda| -iG |psi>.
+ * @param circuit Quantum circuit (dense or sparse, unitary history only)
+ * @param terms Array of Pauli strings defining H
+ * @param coeffs Real coefficient of each term
+ * @param count Number of terms
+ * @param gradients Output array of qc_get_num_parameters() entries, in
+ *                  history order
+ * @return Number of gradients written, or -1 on error
+ */
+int qc_gradient_adjoint(t_q_circuit *circuit, const char **terms,
+                        const double *coeffs, int count, double *gradients) {
+  struct t_q_state *psi;
+  struct t_q_state *lambda;
+  long *flip_masks, *z_masks;
+  int *y_counts;
+  int num_params;
+  int p, g;
+
+  if (circuit == NULL || terms == NULL || coeffs == NULL || count <= 0 ||
+      gradients == NULL)
+    return -1;
+
+  if (circuit->backend == QC_BACKEND_MPS ||
+      circuit->backend == QC_BACKEND_DISK) {
+    fprintf(stderr, "Error: Adjoint gradients require a state-vector circuit.\n");
+    return -1;
+  }
+
+  for (g = 0; g < circuit->history_size; g++) {
+    const char *name = circuit->gate_history[g];
+    struct t_q_gate m;
+
+    if (strcmp(name, "BARRIER") == 0)
+      continue;
+    if (qc_history_matrix(name, 0.0, &m) == NULL) {
+      fprintf(stderr, "Error: Gate %s is not reversible for adjoint gradients.\n",
+              name);
+      return -1;
+    }
+  }
+
+  if (qc_parse_terms(circuit, terms, count, &flip_masks, &z_masks,
+                     &y_counts) != 0)
+    return -1;
+
+  if (circuit->backend == QC_BACKEND_SPARSE) {
+    psi = q_sparse_to_dense(circuit->sparse);
+  } else {
+    psi = q_state_init(circuit->num_qubits);
+    if (psi != NULL)
+      memcpy(psi->vector, circuit->state->vector,
+             psi->size * sizeof(struct t_complex));
+  }
+  lambda = q_state_init(circuit->num_qubits);
+
+  if (psi == NULL || lambda == NULL ||
+      q_state_apply_pauli_sum(lambda, psi, flip_masks, z_masks, y_counts,
+                              coeffs, count) != 0) {
+    fprintf(stderr, "Error: Memory allocation failed for adjoint gradients.\n");
+    q_state_free(psi);
+    q_state_free(lambda);
+    free(flip_masks);
+    free(z_masks);
+    free(y_counts);
+    return -1;
+  }
+
+  num_params = qc_get_num_parameters(circuit);
+  p = num_params;
+
+  for (g = circuit->history_size - 1; g >= 0; g--) {
+    const char *name = circuit->gate_history[g];
+    int target = circuit->target_qubits[g];
+    int control = circuit->control_qubits[g];
+    struct t_q_gate inverse;
+    const struct t_q_matrix *adjoint;
+
+    if (strcmp(name, "BARRIER") == 0)
+      continue;
+
+    if (qc_is_parameterized(name)) {
+      long bit = 1L << target;
+      struct t_complex s;
+
+      p--;
+      if (strcmp(name, "RX") == 0) {
+        s = q_state_pauli_overlap(lambda, psi, bit, 0, 0);
+        gradients[p] = s.number_imaginary;
+      } else if (strcmp(name, "RY") == 0) {
+        s = q_state_pauli_overlap(lambda, psi, bit, bit, 1);
+        gradients[p] = s.number_imaginary;
+      } else if (strcmp(name, "RZ") == 0) {
+        s = q_state_pauli_overlap(lambda, psi, 0, bit, 0);
+        gradients[p] = s.number_imaginary;
+      } else {
+        /* P: generator |1><1| = (I - Z) / 2 */
+        s = q_state_pauli_overlap(lambda, psi, 0, bit, 0);
+        gradients[p] = s.number_imaginary;
+        s = q_state_pauli_overlap(lambda, psi, 0, 0, 0);
+        gradients[p] -= s.number_imaginary;
+      }
+    }
+
+    /* nothing left to differentiate further back */
+    if (p == 0)
+      break;
+
+    adjoint = qc_history_matrix(name, -circuit->parameters[g], &inverse);
+    if (control >= 0) {
+      q_apply_2q_gate(psi, adjoint, control, target);
+      q_apply_2q_gate(lambda, adjoint, control, target);
+    } else {
+      q_apply_1q_gate(psi, adjoint, target);
+      q_apply_1q_gate(lambda, adjoint, target);
+    }
+  }
+
+  q_state_free(psi);
+  q_state_free(lambda);
+  free(flip_masks);
+  free(z_masks);
+  free(y_counts);
+  return num_params;
+}
+
+/**
+ * Evaluate a Hamiltonian for many parameter vectors of the same circuit.
+ * State-vector circuits share one compiled gate list across the batch and
+ * leave the circuit state untouched; small states run one simulation per
+ * worker, larger ones parallelize inside each gate. Other backends bind
+ * and evaluate each row in turn, leaving the last row bound.
+ * @param circuit Quantum circuit built with parameter slots
+ * @param params batch_size rows of one value per parameter slot, row-major
+ * @param batch_size Number of parameter vectors
+ * @param terms Array of Pauli strings defining H
+ * @param coeffs Real coefficient of each term
+ * @param count Number of terms
+ * @param out_expectations Output <H> for each parameter vector
+ * @return 0 on success, -1 on error
+ */
+int qc_run_parameter_batch(t_q_circuit *circuit, const double *params,
+                           int batch_size, const char **terms,
+                           const double *coeffs, int count,
+                           double *out_expectations) {
+  struct t_q_program *program;
+  long *flip_masks, *z_masks;
+  int *y_counts;
+  int result;
+  int b;
+
+  if (circuit == NULL || params == NULL || batch_size <= 0 || terms == NULL ||
+      coeffs == NULL || count <= 0 || out_expectations == NULL)
+    return -1;
+
+  if (circuit->backend != QC_BACKEND_DENSE) {
+    for (b = 0; b < batch_size; b++) {
+      if (qc_bind(circuit, params + (long)b * circuit->num_slots) != 0)
+        return -1;
+      out_expectations[b] =
+          qc_expectation_hamiltonian(circuit, terms, coeffs, count);
+    }
+    return 0;
+  }
+
+  program = qc_compile(circuit);
+  if (program == NULL)
+    return -1;
+
+  if (qc_parse_terms(circuit, terms, count, &flip_masks, &z_masks,
+                     &y_counts) != 0)
+    return -1;
+
+  result = q_program_run_batch(program, circuit->num_qubits,
+                               circuit->initial_fd, params, batch_size, flip_masks, z_masks, y_counts,
+                               coeffs, count, out_expectations);
+  if (result != 0)
+    fprintf(stderr, "Error: Could not run the parameter batch.\n");
+
+  free(flip_masks);
+  free(z_masks);
+  free(y_counts);
+  return result;
+}
+
 /**
  * Apply Grover's search algorithm to find a specific quantum state
  * @param circuit Quantum circuit
  * @param solution_state Target state to search for
  */
-void qc_grover_search(t_q_circuit *circuit, int solution_state) {
+void qc_grover_search(t_q_circuit *circuit, t_q_index solution_state) {
   int q;
-  int i;
+  long i;
   int num_qubits = circuit->num_qubits;
-  int iterations = q_grover_iterations(num_qubits);
+  long iterations = q_grover_iterations(num_qubits);
+
+  if (circuit->backend == QC_BACKEND_SPARSE && qc_sparse_to_dense(circuit) != 0) {
+    fprintf(stderr, "Error: Could not allocate a dense state for Grover search.\n");
+    return;
+  }
+  if (circuit->backend != QC_BACKEND_DENSE) {
+    fprintf(stderr, "Error: Grover search requires the state-vector backend.\n");
+    return;
+  }
 
   for (q = 0; q < circuit->num_qubits; q++) {
     qc_h(circuit, q);
   }
 
   for (i = 0; i < iterations; i++) {
+    circuit->state_version++;
     q_apply_phase_flip(circuit->state, solution_state);
-    qc_add_gate(circuit, "ORACLE", solution_state, -1, 0.0);
+    /* the marked index can exceed an int; a double holds it exactly */
+    qc_add_gate(circuit, "ORACLE", -1, -1, (double)solution_state);
 
     q_apply_diffusion(circuit->state);
     qc_add_gate(circuit, "DIFFUSION", -1, -1, 0.0);
@@ -421,6 +1569,258 @@ void qc_grover_search(t_q_circuit *circuit, int solution_state) {
 int qc_get_num_qubits(t_q_circuit *circuit) { return circuit->num_qubits; }
 int qc_get_num_gates(t_q_circuit *circuit) { return circuit->num_gates; }
 
+/**
+ * Set the allocation policy for state vectors created from now on. Flags a
+ * platform cannot honour are dropped silently; qc_get_alloc_policy reports
+ * what each state actually got.
+ * @param policy Bitwise OR of QC_ALLOC_* flags (0 = plain aligned heap or
+ *        anonymous memory, zeroed by the calling thread)
+ */
+void qc_set_alloc_policy(int policy) { q_alloc_set_policy(policy); }
+
+/**
+ * Allocation policy in effect for a circuit's state vector
+ * @param circuit Quantum circuit
+ * @return Bitwise OR of the QC_ALLOC_* flags that took effect, or -1 if the
+ *         circuit has no dense state vector
+ */
+int qc_get_alloc_policy(t_q_circuit *circuit) {
+  if (circuit == NULL || circuit->backend != QC_BACKEND_DENSE ||
+      circuit->state == NULL)
+    return -1;
+  return circuit->state->alloc_policy;
+}
+
+/**
+ * Save the circuit's current state to a file. The file is written beside
+ * the target and renamed over it, so an existing file is replaced only by
+ * a complete one.
+ * @param circuit Quantum circuit (any backend but MPS, at most 58 qubits)
+ * @param path Output file
+ * @return 0 on success, -1 on failure
+ */
+int qc_save_state(t_q_circuit *circuit, const char *path) {
+  if (circuit == NULL || path == NULL)
+    return -1;
+  if (circuit->backend == QC_BACKEND_MPS) {
+    fprintf(stderr, "Error: Saving a state requires the state-vector, "
+                    "sparse, out-of-core or compressed backend.\n");
+    return -1;
+  }
+  /* a file holds every amplitude, so it is limited like a loadable state */
+  if (circuit->num_qubits > QCS_DISK_MAX_QUBITS) {
+    fprintf(stderr, "Error: Saving a state is limited to %d qubits.\n",
+            QCS_DISK_MAX_QUBITS);
+    return -1;
+  }
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return q_sparse_save(circuit->sparse, path);
+  if (circuit->backend == QC_BACKEND_DISK)
+    return q_disk_save(circuit->disk, path);
+  return q_state_save(circuit->state, path);
+}
+
+/**
+ * Create a dense circuit holding a state saved with qc_save_state. The
+ * amplitudes are mapped copy-on-write from the file, so loading costs no
+ * reads up front and circuits loaded from one file share its pages; gates
+ * copy only the pages whose amplitudes they change. The new circuit has an
+ * empty gate history, and the loaded state is its starting state: qc_bind,
+ * qc_run_parameter_batch and shot replays start from it rather than from
+ * |0...0>.
+ * @param path State file
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_load_state(const char *path) {
+  struct t_q_state *state;
+  t_q_circuit *circuit;
+  int fd;
+
+  if (path == NULL)
+    return NULL;
+  state = q_state_load(path, &fd);
+  if (state == NULL)
+    return NULL;
+
+  circuit = qc_alloc(state->qubits_num);
+  if (!circuit) {
+    q_state_free(state);
+    close(fd);
+    return NULL;
+  }
+  circuit->state = state;
+  circuit->initial_fd = fd;
+  return circuit;
+}
+
+/**
+ * Save the state automatically every interval gates, for resuming long runs
+ * with qc_load_state
+ * @param circuit Quantum circuit
+ * @param path Checkpoint file, rewritten at each checkpoint
+ * @param interval Gates between checkpoints (<= 0 to stop checkpointing)
+ * @return 0 on success, -1 on failure
+ */
+int qc_set_checkpoint(t_q_circuit *circuit, const char *path, int interval) {
+  char *copy = NULL;
+
+  if (circuit == NULL || (interval > 0 && path == NULL))
+    return -1;
+  if (interval > 0) {
+    copy = qc_strdup(path);
+    if (copy == NULL)
+      return -1;
+  }
+  free(circuit->checkpoint_path);
+  circuit->checkpoint_path = copy;
+  circuit->checkpoint_interval = interval > 0 ? interval : 0;
+  return 0;
+}
+
+/**
+ * Copy the gate history and parameter slots of one circuit into another
+ * with an empty history
+ * @param dst Destination circuit
+ * @param src Source circuit
+ * @return 0 on success, -1 on allocation failure
+ */
+static int qc_copy_history(t_q_circuit *dst, const t_q_circuit *src) {
+  if (src->history_capacity > dst->history_capacity) {
+    const char **names = (const char **)realloc(
+        dst->gate_history, src->history_capacity * sizeof(char *));
+    int *targets, *controls, *slots;
+    double *params;
+
+    if (names != NULL)
+      dst->gate_history = names;
+    targets = (int *)realloc(dst->target_qubits,
+                             src->history_capacity * sizeof(int));
+    if (targets != NULL)
+      dst->target_qubits = targets;
+    controls = (int *)realloc(dst->control_qubits,
+                              src->history_capacity * sizeof(int));
+    if (controls != NULL)
+      dst->control_qubits = controls;
+    params = (double *)realloc(dst->parameters,
+                               src->history_capacity * sizeof(double));
+    if (params != NULL)
+      dst->parameters = params;
+    slots = (int *)realloc(dst->param_slots,
+                           src->history_capacity * sizeof(int));
+    if (slots != NULL)
+      dst->param_slots = slots;
+    if (!names || !targets || !controls || !params || !slots)
+      return -1;
+    dst->history_capacity = src->history_capacity;
+  }
+
+  memcpy(dst->gate_history, src->gate_history,
+         src->history_size * sizeof(char *));
+  memcpy(dst->target_qubits, src->target_qubits,
+         src->history_size * sizeof(int));
+  memcpy(dst->control_qubits, src->control_qubits,
+         src->history_size * sizeof(int));
+  memcpy(dst->parameters, src->parameters,
+         src->history_size * sizeof(double));
+  memcpy(dst->param_slots, src->param_slots, src->history_size * sizeof(int));
+  dst->history_size = src->history_size;
+  dst->num_gates = src->num_gates;
+
+  if (src->num_slots > 0) {
+    dst->slot_values = (double *)malloc(src->num_slots * sizeof(double));
+    if (dst->slot_values == NULL)
+      return -1;
+    memcpy(dst->slot_values, src->slot_values,
+           src->num_slots * sizeof(double));
+    dst->num_slots = src->num_slots;
+  }
+  return 0;
+}
+
+/**
+ * Share a dense circuit's state with a new clone copy-on-write
+ * @param circuit Dense circuit
+ * @return State of the clone, or NULL on failure
+ */
+static struct t_q_state *qc_clone_dense(t_q_circuit *circuit) {
+  struct t_q_state *state = circuit->state;
+
+  /* an unchanged state still read through its snapshot can be shared again
+     without copying anything */
+  if (circuit->share_fd < 0 ||
+      circuit->share_version != circuit->state_version ||
+      state->vector != state->file_vector) {
+    int fd = q_state_share(state);
+
+    if (fd < 0)
+      return q_state_copy(state);
+    if (circuit->share_fd >= 0)
+      close(circuit->share_fd);
+    circuit->share_fd = fd;
+    circuit->share_version = circuit->state_version;
+  }
+  return q_state_map_shared(circuit->share_fd, state->qubits_num);
+}
+
+/**
+ * Create an independent copy of a circuit. A dense state is shared
+ * copy-on-write: the first clone moves the amplitudes into a snapshot that
+ * both circuits map privately, and further clones of an unchanged state only
+ * map it again. Gates on a shared state run in place and store only the
+ * amplitudes they change, so each circuit copies just the pages it alters
+ * and a clone that is only read costs no state memory at all. Taking the
+ * first snapshot writes the state once into the shared file.
+ * MPS and sparse states are copied. The clone has the
+ * same gate history, parameter slots and random stream as the original
+ * (reseed it with qc_set_seed to sample independently).
+ * Out-of-core and compressed circuits cannot be cloned.
+ * @param circuit Quantum circuit
+ * @return Pointer to created circuit or NULL on failure
+ */
+t_q_circuit *qc_clone(t_q_circuit *circuit) {
+  t_q_circuit *clone;
+
+  if (circuit == NULL)
+    return NULL;
+  if (circuit->backend == QC_BACKEND_DISK) {
+    fprintf(stderr, "Error: qc_clone is not supported on the out-of-core or "
+                    "compressed backend.\n");
+    return NULL;
+  }
+
+  clone = qc_alloc(circuit->num_qubits);
+  if (!clone)
+    return NULL;
+  clone->backend = circuit->backend;
+  clone->dense_fill_ratio = circuit->dense_fill_ratio;
+  clone->rng = circuit->rng;
+  if (circuit->initial_fd >= 0) {
+    clone->initial_fd = dup(circuit->initial_fd);
+    if (clone->initial_fd < 0) {
+      qc_destroy(clone);
+      return NULL;
+    }
+  }
+
+  if (circuit->backend == QC_BACKEND_MPS) {
+    clone->mps = q_mps_clone(circuit->mps);
+  } else if (circuit->backend == QC_BACKEND_SPARSE) {
+    clone->sparse = q_sparse_clone(circuit->sparse);
+  } else {
+    clone->state = qc_clone_dense(circuit);
+    /* the clone reads the same snapshot, so its own clones can too */
+    if (clone->state && clone->state->file_vector)
+      clone->share_fd = dup(circuit->share_fd);
+  }
+
+  if ((!clone->mps && !clone->sparse && !clone->state) ||
+      qc_copy_history(clone, circuit) != 0) {
+    qc_destroy(clone);
+    return NULL;
+  }
+  return clone;
+}
+
 /**
  * Apply controlled phase gate
  * @param circuit Quantum circuit
@@ -429,10 +1829,9 @@ int qc_get_num_gates(t_q_circuit *circuit) { return circuit->num_gates; }
  * @param angle Phase angle in radians
  */
 void qc_cphase(t_q_circuit *circuit, int control, int target, double angle) {
-  struct t_q_matrix *CP = q_gate_CP(angle);
+  struct t_q_gate CP;
 
-  q_apply_2q_gate(circuit->state, CP, control, target);
-  q_matrix_free(CP);
+  qc_apply_2q(circuit, q_gate_set_P(&CP, angle), control, target);
   qc_add_gate(circuit, "CPHASE", target, control, angle);
 }
 
@@ -459,22 +1858,46 @@ void qc_quantum_fourier_transform(t_q_circuit *circuit) {
 /**
  * Find the quantum state with the highest probability amplitude
  * @param circuit Quantum circuit
- * @return Index of the most likely state
+ * @return Index of the most likely state, or -1 on failure
  */
-int qc_find_most_likely_state(t_q_circuit *circuit) {
-  long max_idx = 0;
+t_q_index qc_find_most_likely_state(t_q_circuit *circuit) {
+  t_q_index max_idx = 0;
   double max_prob = 0.0;
-  long num_states = circuit->state->size;
-  long i;
 
-  for (i = 0; i < num_states; i++) {
-    double prob = qc_get_probability(circuit, i);
-    if (prob > max_prob) {
-      max_prob = prob;
-      max_idx = i;
-    }
-  }
-  return (int)max_idx;
+  if (qc_top_k_states(circuit, 1, &max_idx, &max_prob) <= 0)
+    return -1;
+  return max_idx;
+}
+
+/**
+ * The k most likely basis states
+ * @param circuit Quantum circuit
+ * @param k Number of states wanted
+ * @param indices Output basis indices, most likely first (k entries)
+ * @param probs Output probabilities (k entries)
+ * @return Number of states written (fewer than k when fewer states have
+ *         nonzero probability), or -1 on invalid arguments or failure,
+ *         including MPS states too spread out to search
+ */
+long qc_top_k_states(t_q_circuit *circuit, long k, t_q_index *indices,
+                     double *probs) {
+  long size;
+
+  if (circuit == NULL || indices == NULL || probs == NULL || k < 0)
+    return -1;
+
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return q_sparse_top_k(circuit->sparse, k, indices, probs);
+  if (circuit->backend == QC_BACKEND_DISK)
+    return q_disk_top_k(circuit->disk, k, indices, probs);
+  if (circuit->backend != QC_BACKEND_MPS)
+    return q_state_top_k(circuit->state, k, indices, probs);
+
+  size = q_mps_top_k(circuit->mps, k, indices, probs);
+  if (size < 0)
+    fprintf(stderr, "Error: The MPS state is wider than a basis index or "
+                    "too spread out for a top-k search.\n");
+  return size;
 }
 
 /**
@@ -483,9 +1906,7 @@ int qc_find_most_likely_state(t_q_circuit *circuit) {
  * @param qubit Target qubit index
  */
 void qc_y(t_q_circuit *circuit, int qubit) {
-  struct t_q_matrix *Y = q_gate_Y();
-  q_apply_1q_gate(circuit->state, Y, qubit);
-  q_matrix_free(Y);
+  qc_apply_1q(circuit, &q_gate_table_Y, qubit);
   qc_add_gate(circuit, "Y", qubit, -1, 0.0);
 }
 
@@ -495,9 +1916,7 @@ void qc_y(t_q_circuit *circuit, int qubit) {
  * @param qubit Target qubit index
  */
 void qc_z(t_q_circuit *circuit, int qubit) {
-  struct t_q_matrix *Z = q_gate_Z();
-  q_apply_1q_gate(circuit->state, Z, qubit);
-  q_matrix_free(Z);
+  qc_apply_1q(circuit, &q_gate_table_Z, qubit);
   qc_add_gate(circuit, "Z", qubit, -1, 0.0);
 }
 
@@ -508,9 +1927,9 @@ void qc_z(t_q_circuit *circuit, int qubit) {
  * @param angle Phase angle in radians
  */
 void qc_phase(t_q_circuit *circuit, int qubit, double angle) {
-  struct t_q_matrix *P = q_gate_P(angle);
-  q_apply_1q_gate(circuit->state, P, qubit);
-  q_matrix_free(P);
+  struct t_q_gate P;
+
+  qc_apply_1q(circuit, q_gate_set_P(&P, angle), qubit);
   qc_add_gate(circuit, "P", qubit, -1, angle);
 }
 
@@ -548,9 +1967,12 @@ void qc_barrier(t_q_circuit *circuit) {
  * @param qubit Qubit to reset
  */
 void qc_reset(t_q_circuit *circuit, int qubit) {
-  if (qc_measure(circuit, qubit) == 1) {
-    qc_x(circuit, qubit);
-  }
+  if (circuit == NULL || qubit < 0 || qubit >= circuit->num_qubits)
+    return;
+
+  /* the flip depends on the outcome, so only RESET is recorded */
+  if (qc_measure_qubit(circuit, qubit) == 1)
+    qc_apply_1q(circuit, &q_gate_table_X, qubit);
   qc_add_gate(circuit, "RESET", qubit, -1, 0.0);
 }
 
@@ -559,59 +1981,454 @@ void qc_reset(t_q_circuit *circuit, int qubit) {
  * @param circuit Quantum circuit
  */
 void qc_run(t_q_circuit *circuit) {
-  int *results = malloc(circuit->num_qubits * sizeof(int));
-  if (results) {
-    qc_measure_all(circuit, results);
-    free(results);
+  if (circuit != NULL)
+    qc_collapse_all(circuit, NULL);
+}
+
+/**
+ * Seed the circuit's random number generator. Measurements and shots that
+ * follow are reproducible for a given seed, independent of the thread count.
+ * @param circuit Quantum circuit
+ * @param seed Seed value
+ */
+void qc_set_seed(t_q_circuit *circuit, unsigned long seed) {
+  if (circuit == NULL)
+    return;
+  q_rng_seed(&circuit->rng, seed);
+}
+
+/**
+ * Measurement sampler for the current state, reused across calls until the
+ * state changes
+ * @param circuit Quantum circuit (dense or sparse)
+ * @return Sampler, or NULL on allocation failure
+ */
+static struct t_q_sampler *qc_get_sampler(t_q_circuit *circuit) {
+  if (circuit->sampler != NULL &&
+      circuit->sampler_version == circuit->state_version)
+    return circuit->sampler;
+
+  q_sampler_free(circuit->sampler);
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    circuit->sampler = q_sparse_sampler(circuit->sparse);
+  else
+    circuit->sampler =
+        q_sampler_init(circuit->state->vector, NULL, circuit->state->size);
+  circuit->sampler_version = circuit->state_version;
+  return circuit->sampler;
+}
+
+/**
+ * Draw one shot from a measurement sampler
+ * @param context Sampler
+ * @param rng Generator
+ * @return Sampled basis state
+ */
+static long qc_draw_sampler(void *context, struct t_q_rng *rng) {
+  return q_sampler_sample((const struct t_q_sampler *)context,
+                          q_rng_uniform(rng));
+}
+
+/**
+ * Draw one shot from an MPS prepared for sampling
+ * @param context Matrix product state
+ * @param rng Generator
+ * @return Sampled basis state
+ */
+static long qc_draw_mps(void *context, struct t_q_rng *rng) {
+  return q_mps_sample((const struct t_q_mps *)context, rng, NULL);
+}
+
+/**
+ * Sample shots from the circuit's current state without collapsing it
+ * @param circuit Quantum circuit
+ * @param shots Number of shots to run
+ * @param sink Dense histogram or counts table for the outcomes
+ * @return 0 on success, -1 on failure
+ */
+static int qc_sample_current(t_q_circuit *circuit, long shots,
+                             struct t_q_shot_sink *sink) {
+  struct t_q_sampler *sampler;
+  long size = sink->dense != NULL ? qc_num_states(circuit) : 0;
+
+  if (circuit->backend == QC_BACKEND_MPS) {
+    q_mps_prepare_sampling(circuit->mps);
+    return q_sample_shots(shots, size, qc_draw_mps, circuit->mps,
+                          &circuit->rng, sink);
   }
+
+  /* without a cached sampler, massive shot counts and large states stream
+     the sorted shots past the amplitudes instead of building an N-entry
+     cumulative table */
+  if (circuit->backend == QC_BACKEND_DENSE &&
+      (circuit->sampler == NULL ||
+       circuit->sampler_version != circuit->state_version) &&
+      (shots >= circuit->state->size ||
+       circuit->num_qubits >= QCS_STREAM_SAMPLING_QUBITS)) {
+    if (q_state_sample_counts(circuit->state, shots, &circuit->rng, sink) !=
+        0) {
+      fprintf(stderr, "Error: Shot sampling failed.\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  sampler = qc_get_sampler(circuit);
+  if (sampler == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed for shot sampling.\n");
+    return -1;
+  }
+
+  /* O(1) alias draws pay off once shots reach the number of outcomes;
+     without the table each shot is a binary search */
+  if (shots >= sampler->size)
+    q_sampler_build_alias(sampler);
+
+  return q_sample_shots(shots, size, qc_draw_sampler, sampler, &circuit->rng,
+                        sink);
+}
+
+/**
+ * Empty circuit on the same backend and settings as another circuit
+ * @param circuit Circuit to copy the configuration of
+ * @return New circuit in the other circuit's starting state, or NULL on
+ *         failure
+ */
+static t_q_circuit *qc_create_like(const t_q_circuit *circuit) {
+  t_q_circuit *like;
+
+  if (circuit->backend == QC_BACKEND_MPS)
+    return qc_create_mps(circuit->num_qubits, circuit->mps->max_bond_dim,
+                         circuit->mps->truncation_threshold);
+  if (circuit->backend == QC_BACKEND_SPARSE)
+    return qc_create_sparse(circuit->num_qubits, circuit->dense_fill_ratio);
+
+  like = qc_create(circuit->num_qubits);
+  if (like == NULL || like->state == NULL || circuit->initial_fd < 0)
+    return like;
+  like->initial_fd = dup(circuit->initial_fd);
+  if (like->initial_fd < 0 || qc_reset_state(like) != 0) {
+    qc_destroy(like);
+    return NULL;
+  }
+  return like;
+}
+
+/**
+ * Re-apply a recorded history to another circuit without recording it
+ * @param dst Circuit in the initial state
+ * @param src Circuit whose history is replayed
+ * @param collapse Nonzero to perform measurements and resets, zero to skip
+ *        measurements (only valid for terminal ones)
+ * @return 0 on success, -1 if an entry cannot be replayed
+ */
+static int qc_replay_history(t_q_circuit *dst, const t_q_circuit *src,
+                             int collapse) {
+  int g, q;
+
+  for (g = 0; g < src->history_size; g++) {
+    const char *name = src->gate_history[g];
+    int target = src->target_qubits[g];
+    int control = src->control_qubits[g];
+    struct t_q_gate inline_gate;
+    const struct t_q_matrix *matrix;
+
+    if (strcmp(name, "BARRIER") == 0)
+      continue;
+
+    if (strcmp(name, "MEASURE") == 0) {
+      if (!collapse)
+        continue;
+      for (q = 0; q < dst->num_qubits; q++)
+        if (target < 0 || q == target)
+          qc_measure_qubit(dst, q);
+      continue;
+    }
+
+    if (strcmp(name, "RESET") == 0) {
+      if (qc_measure_qubit(dst, target) == 1)
+        qc_apply_1q(dst, &q_gate_table_X, target);
+      continue;
+    }
+
+    if (strcmp(name, "ORACLE") == 0 || strcmp(name, "DIFFUSION") == 0) {
+      if (dst->backend == QC_BACKEND_SPARSE && qc_sparse_to_dense(dst) != 0)
+        return -1;
+      if (dst->backend != QC_BACKEND_DENSE)
+        return -1;
+      dst->state_version++;
+      if (name[0] == 'O')
+        q_apply_phase_flip(dst->state, (t_q_index)src->parameters[g]);
+      else
+        q_apply_diffusion(dst->state);
+      continue;
+    }
+
+    matrix = qc_history_matrix(name, src->parameters[g], &inline_gate);
+    if (matrix == NULL) {
+      fprintf(stderr, "Error: Gate %s cannot be replayed for shots.\n", name);
+      return -1;
+    }
+    if (control >= 0)
+      qc_apply_2q(dst, matrix, control, target);
+    else
+      qc_apply_1q(dst, matrix, target);
+  }
+  return 0;
 }
 
 /**
- * Run multiple shots of the quantum circuit
+ * Run shots into a histogram or counts table. Each shot is a run of the
+ * recorded history from the circuit's starting state (|0...0>, or the state
+ * loaded by qc_load_state) followed by a measurement of every qubit.
+ * Without mid-circuit measurements or resets the unitary part is simulated
+ * once and all shots are sampled from it; otherwise each shot replays the
+ * history as its own trajectory. The circuit's own state is not changed.
  * @param circuit Quantum circuit
  * @param shots Number of shots to run
- * @param results Array to store shot results
+ * @param sink Dense histogram or counts table for the outcomes
+ * @return 0 on success, -1 on failure
+ */
+static int qc_shots(t_q_circuit *circuit, long shots,
+                    struct t_q_shot_sink *sink) {
+  t_q_circuit *replay;
+  int shape, status = 0;
+  long s;
+  int q;
+
+  if (circuit->backend == QC_BACKEND_DISK) {
+    fprintf(stderr, "Error: Shot sampling is not supported on the "
+                    "out-of-core or compressed backend.\n");
+    return -1;
+  }
+  if (circuit->num_qubits > QCS_INDEX_MAX_QUBITS ||
+      (sink->dense != NULL && qc_num_states(circuit) < 0)) {
+    fprintf(stderr, "Error: Shot outcomes hold at most %d qubits (%d for a "
+                    "dense histogram); use qc_measure_all on wider "
+                    "circuits.\n",
+            QCS_INDEX_MAX_QUBITS, QCS_INDEX_MAX_QUBITS - 1);
+    return -1;
+  }
+
+  /* the current state is the pre-measurement state */
+  shape = qc_history_shape(circuit);
+  if (shape == QC_SHOTS_UNITARY)
+    return qc_sample_current(circuit, shots, sink);
+
+  replay = qc_create_like(circuit);
+  if (replay == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed for shot replay.\n");
+    return -1;
+  }
+  replay->rng = circuit->rng;
+
+  if (sink->dense != NULL)
+    memset(sink->dense, 0, qc_num_states(circuit) * sizeof(int));
+  if (shape == QC_SHOTS_TERMINAL) {
+    status = qc_replay_history(replay, circuit, 0);
+    if (status == 0)
+      status = qc_sample_current(replay, shots, sink);
+  } else {
+    for (s = 0; s < shots && status == 0; s++) {
+      long index = 0;
+
+      if ((s > 0 && qc_reset_state(replay) != 0) ||
+          qc_replay_history(replay, circuit, 1) != 0) {
+        status = -1;
+        break;
+      }
+      if (replay->backend == QC_BACKEND_DENSE) {
+        replay->state_version++;
+        index = q_state_measure_all(replay->state,
+                                    q_rng_uniform(&replay->rng));
+      } else {
+        for (q = 0; q < replay->num_qubits; q++)
+          index |= (long)qc_measure_qubit(replay, q) << q;
+      }
+      if (sink->dense != NULL)
+        sink->dense[index]++;
+      else
+        status = q_counts_add(sink->counts, (unsigned long)index, 1);
+    }
+  }
+
+  circuit->rng = replay->rng;
+  qc_destroy(replay);
+  return status;
+}
+
+/**
+ * Run multiple shots of the quantum circuit (see qc_run_shots_counts for a
+ * result whose size does not grow with 2^n)
+ * @param circuit Quantum circuit
+ * @param shots Number of shots to run
+ * @param results Array of 2^n entries to store shot results
  */
 void qc_run_shots(t_q_circuit *circuit, int shots, int *results) {
-  long i;
-  int s;
-  long num_states;
-  double *probabilities;
+  struct t_q_shot_sink sink;
 
   if (!circuit || shots <= 0 || !results)
     return;
 
-  num_states = circuit->state->size;
-  probabilities = malloc(num_states * sizeof(double));
-  if (!probabilities)
-    return;
+  sink.dense = results;
+  sink.counts = NULL;
+  qc_shots(circuit, shots, &sink);
+}
 
-  for (i = 0; i < num_states; i++) {
-    probabilities[i] = qc_get_probability(circuit, i);
+/**
+ * Run multiple shots of the quantum circuit into a counts table whose
+ * memory grows with the number of distinct outcomes (circuits of at most
+ * 63 qubits)
+ * @param circuit Quantum circuit
+ * @param shots Number of shots to run
+ * @return Counts table (free with qc_counts_free), or NULL on failure
+ */
+t_q_counts *qc_run_shots_counts(t_q_circuit *circuit, long shots) {
+  struct t_q_shot_sink sink;
+
+  if (!circuit || shots < 0)
+    return NULL;
+
+  sink.dense = NULL;
+  sink.counts = q_counts_init(0);
+  if (sink.counts == NULL)
+    return NULL;
+  if (shots > 0 && qc_shots(circuit, shots, &sink) != 0) {
+    q_counts_free(sink.counts);
+    return NULL;
   }
+  return sink.counts;
+}
+
+/**
+ * Number of distinct outcomes in a counts table
+ * @param counts Counts table
+ * @return Number of outcomes with a nonzero count
+ */
+long qc_counts_num_outcomes(const t_q_counts *counts) {
+  return counts ? counts->size : 0;
+}
 
-  memset(results, 0, num_states * sizeof(int));
+/**
+ * Total number of shots in a counts table
+ * @param counts Counts table
+ * @return Sum of all counts
+ */
+long qc_counts_total(const t_q_counts *counts) {
+  return counts ? counts->total : 0;
+}
 
-  for (s = 0; s < shots; s++) {
-    double rand_val = rand() / (double)RAND_MAX;
-    double cumulative_prob = 0.0;
-    for (i = 0; i < num_states; i++) {
-      cumulative_prob += probabilities[i];
-      if (rand_val < cumulative_prob) {
-        results[i]++;
-        break;
-      }
+/**
+ * Count of one outcome
+ * @param counts Counts table
+ * @param bitstring Basis index (bit q is qubit q)
+ * @return Number of shots that produced the outcome
+ */
+long qc_counts_get(const t_q_counts *counts, t_q_index bitstring) {
+  if (!counts)
+    return 0;
+  return q_counts_get(counts, (unsigned long)bitstring);
+}
+
+/**
+ * Iterate over the outcomes of a counts table, in no particular order
+ * @param counts Counts table
+ * @param cursor Iteration state; set to 0 before the first call
+ * @param bitstring Output basis index
+ * @param count Output count
+ * @return 1 if an outcome was returned, 0 when the iteration is over
+ */
+int qc_counts_next(const t_q_counts *counts, long *cursor,
+                   t_q_index *bitstring, long *count) {
+  if (!counts || !cursor)
+    return 0;
+
+  while (*cursor < counts->capacity) {
+    long slot = (*cursor)++;
+
+    if (counts->values[slot] != 0) {
+      *bitstring = (t_q_index)counts->keys[slot];
+      *count = counts->values[slot];
+      return 1;
     }
   }
-  free(probabilities);
+  return 0;
+}
+
+/**
+ * The k most frequent outcomes, most frequent first (ties: smaller index
+ * first)
+ * @param counts Counts table
+ * @param k Number of outcomes wanted
+ * @param bitstrings Output basis indices (k entries)
+ * @param values Output counts (k entries)
+ * @return Number of outcomes written, or -1 on failure
+ */
+long qc_counts_top_k(const t_q_counts *counts, long k, t_q_index *bitstrings,
+                     long *values) {
+  if (!counts || !bitstrings || !values)
+    return -1;
+  return q_counts_top_k(counts, k, (unsigned long *)bitstrings, values);
 }
 
+/**
+ * Counts of a subset of qubits
+ * @param counts Counts table
+ * @param qubits Qubits to keep; bit j of the result is qubits[j]
+ * @param num_qubits Number of qubits to keep
+ * @return New counts table (free with qc_counts_free), or NULL on failure
+ */
+t_q_counts *qc_counts_marginal(const t_q_counts *counts, const int *qubits,
+                               int num_qubits) {
+  int j;
+
+  if (!counts || !qubits || num_qubits < 0 || num_qubits > 63)
+    return NULL;
+  for (j = 0; j < num_qubits; j++) {
+    if (qubits[j] < 0 || qubits[j] > 63)
+      return NULL;
+  }
+  return q_counts_marginal(counts, qubits, num_qubits);
+}
+
+/**
+ * Export a counts table as a dense histogram
+ * @param counts Counts table
+ * @param results Output array of size entries
+ * @param size Number of entries (2^n for the full register)
+ * @return 0 on success, -1 if some outcome does not fit in size entries
+ */
+int qc_counts_to_dense(const t_q_counts *counts, int *results, long size) {
+  long i;
+  int status = 0;
+
+  if (!counts || !results)
+    return -1;
+
+  memset(results, 0, size * sizeof(int));
+  for (i = 0; i < counts->capacity; i++) {
+    if (counts->values[i] == 0)
+      continue;
+    if (counts->keys[i] < (unsigned long)size)
+      results[counts->keys[i]] += (int)counts->values[i];
+    else
+      status = -1;
+  }
+  return status;
+}
+
+/**
+ * Free a counts table
+ * @param counts Counts table to free
+ */
+void qc_counts_free(t_q_counts *counts) { q_counts_free(counts); }
+
 /**
  * Implement Bernstein-Vazirani algorithm
  * @param circuit Quantum circuit
  * @param hidden_string Hidden string to find
  */
-void qc_bernstein_vazirani(t_q_circuit *circuit, int hidden_string) {
+void qc_bernstein_vazirani(t_q_circuit *circuit, t_q_index hidden_string) {
   int n = circuit->num_qubits - 1;
   int i;
 
@@ -649,10 +2466,10 @@ void qc_bernstein_vazirani(t_q_circuit *circuit, int hidden_string) {
  */
 void qc_optimize(t_q_circuit *circuit) {
   int i;
-  char *gate1_name;
+  const char *gate1_name;
   int target1;
   int control1;
-  char *gate2_name;
+  const char *gate2_name;
   int target2;
   int control2;
   int single_qubit_cancel;
@@ -679,16 +2496,17 @@ void qc_optimize(t_q_circuit *circuit) {
                   (target1 == target2) && (control1 == control2);
 
     if (single_qubit_cancel || cnot_cancel) {
-      free(circuit->gate_history[i]);
-      free(circuit->gate_history[i + 1]);
       for (j = i; j < circuit->history_size - 2; j++) {
         circuit->gate_history[j] = circuit->gate_history[j + 2];
         circuit->target_qubits[j] = circuit->target_qubits[j + 2];
         circuit->control_qubits[j] = circuit->control_qubits[j + 2];
         circuit->parameters[j] = circuit->parameters[j + 2];
+        circuit->param_slots[j] = circuit->param_slots[j + 2];
       }
       circuit->history_size -= 2;
       circuit->num_gates -= 2;
+      q_program_free(circuit->program);
+      circuit->program = NULL;
 
       i = 0;
     } else {
@@ -4,8 +4,25 @@
 
 #include "internal.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef QCS_MULTI_THREAD
+extern thread_pool_t *pool;
+#endif
+
 static void *worker_thread_function(void *pool_ptr);
 
+#ifdef QCS_MULTI_THREAD
+struct t_range_task {
+  void (*body)(void *context, long start, long end);
+  void *context;
+  long start;
+  long end;
+};
+#endif
+
 /**
  * Calculate work range for a thread in parallel processing
  * @param total_size Total number of elements to process
@@ -21,6 +38,79 @@ void get_thread_work_range(long total_size, int num_threads, int thread_id,
   *end = (thread_id == num_threads - 1) ? total_size : (*start) + chunk_size;
 }
 
+#ifdef QCS_MULTI_THREAD
+/**
+ * Worker function running one contiguous range of a parallel loop
+ * @param arg Range task describing the body and its bounds
+ */
+static void range_task_worker(void *arg) {
+  struct t_range_task *task = (struct t_range_task *)arg;
+  task->body(task->context, task->start, task->end);
+}
+#endif
+
+/**
+ * Split [0, count) into contiguous ranges and run them across the workers
+ * @param count Number of loop iterations
+ * @param grain Minimum number of iterations worth giving to one worker
+ * @param body Range function, called as body(context, start, end)
+ * @param context Opaque pointer forwarded to body
+ */
+void q_parallel_for(long count, long grain,
+                    void (*body)(void *context, long start, long end),
+                    void *context) {
+  long chunks = 1;
+  long k;
+
+  if (count <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  /* nested calls from inside a worker run inline on that worker */
+#if defined(QCS_MULTI_THREAD)
+  if (pool != NULL && !thread_pool_is_worker(pool))
+    chunks = pool->num_threads < QCS_POOL_MAX_THREADS ? pool->num_threads
+                                                      : QCS_POOL_MAX_THREADS;
+#elif defined(QCS_CPU_OPENMP) && defined(_OPENMP)
+  if (!omp_in_parallel())
+    chunks = omp_get_max_threads();
+#endif
+
+  if (chunks > count / grain)
+    chunks = count / grain;
+
+  if (chunks <= 1) {
+    body(context, 0, count);
+    return;
+  }
+
+#if defined(QCS_MULTI_THREAD)
+  {
+    /* the caller waits for every task, so the slots can live on its stack */
+    struct t_range_task tasks[QCS_POOL_MAX_THREADS];
+
+    for (k = 0; k < chunks; k++) {
+      tasks[k].body = body;
+      tasks[k].context = context;
+      get_thread_work_range(count, (int)chunks, (int)k, &tasks[k].start,
+                            &tasks[k].end);
+      thread_pool_add_task(pool, range_task_worker, &tasks[k]);
+    }
+    thread_pool_wait(pool);
+  }
+#else
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (k = 0; k < chunks; k++) {
+    long start, end;
+    get_thread_work_range(count, (int)chunks, (int)k, &start, &end);
+    body(context, start, end);
+  }
+#endif
+}
+
 /**
  * Create a thread pool for parallel processing
  * @param num_threads Number of worker threads
@@ -61,6 +151,7 @@ thread_pool_t *thread_pool_create(int num_threads, int queue_size) {
   pthread_mutex_init(&(pool->lock), NULL);
   pthread_cond_init(&(pool->notify), NULL);
   pthread_cond_init(&(pool->all_tasks_done), NULL);
+  pthread_cond_init(&(pool->queue_not_full), NULL);
 
   for (i = 0; i < num_threads; i++) {
     pthread_create(&(pool->threads[i]), NULL, worker_thread_function, pool);
@@ -73,9 +164,14 @@ int thread_pool_add_task(thread_pool_t *pool, void (*function)(void *),
                          void *arg) {
   pthread_mutex_lock(&(pool->lock));
 
-  if (pool->task_count == pool->queue_size) {
+  /* several circuits may share the pool: wait for room instead of failing */
+  while (pool->task_count == pool->queue_size && !pool->shutdown) {
+    pthread_cond_wait(&(pool->queue_not_full), &(pool->lock));
+  }
+
+  if (pool->shutdown) {
     pthread_mutex_unlock(&(pool->lock));
-    fprintf(stderr, "Error: Thread pool task queue is full.\n");
+    fprintf(stderr, "Error: Thread pool is shutting down.\n");
     return -1;
   }
 
@@ -118,6 +214,7 @@ int thread_pool_destroy(thread_pool_t *pool) {
   pool->shutdown = 1;
 
   pthread_cond_broadcast(&(pool->notify));
+  pthread_cond_broadcast(&(pool->queue_not_full));
   pthread_mutex_unlock(&(pool->lock));
 
   for (i = 0; i < pool->num_threads; i++) {
@@ -130,12 +227,29 @@ int thread_pool_destroy(thread_pool_t *pool) {
   pthread_mutex_destroy(&(pool->lock));
   pthread_cond_destroy(&(pool->notify));
   pthread_cond_destroy(&(pool->all_tasks_done));
+  pthread_cond_destroy(&(pool->queue_not_full));
 
   free(pool);
 
   return 0;
 }
 
+/**
+ * Check whether the calling thread is one of the pool's workers
+ * @param pool Thread pool
+ * @return 1 if called from a worker thread, 0 otherwise
+ */
+int thread_pool_is_worker(const thread_pool_t *pool) {
+  pthread_t self = pthread_self();
+  int i;
+
+  for (i = 0; i < pool->num_threads; i++) {
+    if (pthread_equal(self, pool->threads[i]))
+      return 1;
+  }
+  return 0;
+}
+
 /**
  * Worker thread function that processes tasks from the queue
  * @param pool_ptr Pointer to thread pool
@@ -162,6 +276,7 @@ static void *worker_thread_function(void *pool_ptr) {
 
     pool->head = (pool->head + 1) % pool->queue_size;
     pool->task_count--;
+    pthread_cond_signal(&(pool->queue_not_full));
 
     pthread_mutex_unlock(&(pool->lock));
 
@@ -172,7 +287,7 @@ static void *worker_thread_function(void *pool_ptr) {
     pool->active_tasks--;
 
     if (pool->active_tasks == 0 && pool->task_count == 0) {
-      pthread_cond_signal(&(pool->all_tasks_done));
+      pthread_cond_broadcast(&(pool->all_tasks_done));
     }
 
     pthread_mutex_unlock(&(pool->lock));
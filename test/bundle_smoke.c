@@ -0,0 +1,30 @@
+#define QCS_IMPLEMENTATION
+#include "qcs.h"
+#include <assert.h>
+
+/* Built from the generated single-header bundle only (see make bundle) */
+int main(void) {
+  t_q_circuit *c;
+
+  printf("Testing: single-header bundle...\n");
+
+  c = qc_create(3);
+  qc_h(c, 0);
+  qc_cnot(c, 0, 2);
+  assert(fabs(qc_get_probability(c, 5) - 0.5) < 1e-12);
+  qc_destroy(c);
+
+  c = qc_create_mps(3, 4, 0.0);
+  qc_h(c, 0);
+  qc_cnot(c, 0, 2);
+  assert(fabs(qc_get_probability(c, 5) - 0.5) < 1e-12);
+  qc_destroy(c);
+
+  c = qc_create_sparse(3, 0.0);
+  qc_x(c, 1);
+  assert(qc_find_most_likely_state(c) == 2);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+  return 0;
+}
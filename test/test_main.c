@@ -22,6 +22,26 @@ void test_qc_grover_search();
 void test_qc_qft();
 void test_qc_bv();
 void test_qc_optimize();
+void test_qc_mps();
+void test_qc_sparse();
+void test_qc_expectation_pauli();
+void test_qc_expectation_hamiltonian();
+void test_qc_gradient_adjoint();
+void test_qc_bind();
+void test_qc_parameter_batch();
+void test_qc_shot_sampler();
+void test_qc_streaming_shots();
+void test_qc_seed();
+void test_qc_shot_replay();
+void test_qc_shot_counts();
+void test_qc_marginal();
+void test_qc_top_k();
+void test_qc_wide_index();
+void test_qc_alloc_policy();
+void test_qc_out_of_core();
+void test_qc_checkpoint();
+void test_qc_compressed();
+void test_qc_clone();
 
 int main() {
   printf("======================================\n");
@@ -50,6 +70,26 @@ int main() {
   test_qc_qft();
   test_qc_bv();
   test_qc_optimize();
+  test_qc_mps();
+  test_qc_sparse();
+  test_qc_expectation_pauli();
+  test_qc_expectation_hamiltonian();
+  test_qc_gradient_adjoint();
+  test_qc_bind();
+  test_qc_parameter_batch();
+  test_qc_shot_sampler();
+  test_qc_streaming_shots();
+  test_qc_seed();
+  test_qc_shot_replay();
+  test_qc_shot_counts();
+  test_qc_marginal();
+  test_qc_top_k();
+  test_qc_wide_index();
+  test_qc_alloc_policy();
+  test_qc_out_of_core();
+  test_qc_checkpoint();
+  test_qc_compressed();
+  test_qc_clone();
 
   printf("\n--------------------------------------\n");
   printf("  ALL TESTS PASSED SUCCESSFULLY! \n");
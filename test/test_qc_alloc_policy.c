@@ -0,0 +1,45 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define ALL_FLAGS (QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH | QC_ALLOC_INTERLEAVE)
+
+/* A fresh state is |0>, and gates work on it whatever memory it got */
+static void check_state(int num_qubits, int policy) {
+  t_q_circuit *c = qc_create(num_qubits);
+  int used = qc_get_alloc_policy(c);
+
+  assert(used >= 0 && (used & ~policy) == 0);
+  assert(fabs(qc_get_probability(c, 0) - 1.0) < 1e-12);
+  assert(qc_get_probability(c, 1) == 0.0);
+  qc_h(c, num_qubits - 1);
+  qc_cnot(c, num_qubits - 1, 0);
+  assert(fabs(qc_get_probability(c, 0) - 0.5) < 1e-12);
+  assert(fabs(qc_get_probability(c, ((t_q_index)1 << (num_qubits - 1)) | 1) -
+              0.5) < 1e-12);
+  qc_destroy(c);
+}
+
+void test_qc_alloc_policy() {
+  printf("Testing: qc_set_alloc_policy / qc_get_alloc_policy...\n");
+  t_q_circuit *c;
+
+  /* 18 qubits is a mapped vector, 4 qubits a heap one */
+  check_state(18, QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH);
+  check_state(4, QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH);
+
+  qc_set_alloc_policy(0);
+  check_state(18, 0);
+
+  qc_set_alloc_policy(ALL_FLAGS);
+  check_state(18, ALL_FLAGS);
+  check_state(4, ALL_FLAGS);
+
+  c = qc_create_mps(4, 8, 0.0);
+  assert(qc_get_alloc_policy(c) == -1);
+  qc_destroy(c);
+
+  qc_set_alloc_policy(QC_ALLOC_HUGE_PAGES | QC_ALLOC_FIRST_TOUCH);
+  printf("  [PASSED]\n");
+}
@@ -0,0 +1,100 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define assert_float_equal(a, b) assert(fabs((a) - (b)) < 1e-9)
+
+static t_q_circuit *build_literal(const double *theta) {
+  t_q_circuit *c = qc_create(3);
+  qc_h(c, 0);
+  qc_rx(c, 0, theta[0]);
+  qc_rz(c, 0, 0.25);
+  qc_ry(c, 1, theta[1]);
+  qc_cnot(c, 0, 1);
+  qc_phase(c, 1, theta[2]);
+  qc_h(c, 2);
+  qc_rz(c, 2, theta[0]);
+  qc_cnot(c, 1, 2);
+  qc_ry(c, 2, theta[1]);
+  return c;
+}
+
+static void snapshot(t_q_circuit *c, double *out) {
+  int i;
+  for (i = 0; i < 8; i++)
+    out[i] = qc_get_probability(c, i);
+  out[8] = qc_expectation_pauli(c, "XYZ");
+  out[9] = qc_expectation_pauli(c, "YIX");
+  out[10] = qc_expectation_pauli(c, "IZY");
+}
+
+static void assert_snapshot(t_q_circuit *c, const double *expected) {
+  double actual[11];
+  int i;
+  snapshot(c, actual);
+  for (i = 0; i < 11; i++)
+    assert_float_equal(actual[i], expected[i]);
+}
+
+void test_qc_bind() {
+  printf("Testing: qc_bind...\n");
+  double first[3] = {0.4, -1.1, 2.3};
+  double second[3] = {0.4, 0.9, -0.6};
+  double ref_first[11], ref_second[11];
+  t_q_circuit *c;
+  double gradients[6];
+  const char *terms[] = {"ZZZ"};
+  const double coeffs[] = {1.0};
+
+  c = build_literal(first);
+  snapshot(c, ref_first);
+  qc_destroy(c);
+  c = build_literal(second);
+  snapshot(c, ref_second);
+  qc_destroy(c);
+
+  /* Same template, shared slot 0 on two gates */
+  c = qc_create(3);
+  qc_h(c, 0);
+  qc_rx_param(c, 0, 0);
+  qc_rz(c, 0, 0.25);
+  qc_ry_param(c, 1, 1);
+  qc_cnot(c, 0, 1);
+  qc_phase_param(c, 1, 2);
+  qc_h(c, 2);
+  qc_rz_param(c, 2, 0);
+  qc_cnot(c, 1, 2);
+  qc_ry_param(c, 2, 1);
+
+  assert(qc_bind(c, first) == 0);
+  assert_snapshot(c, ref_first);
+
+  /* Rebinding only part of the slots keeps the other fused matrices */
+  assert(qc_bind(c, second) == 0);
+  assert_snapshot(c, ref_second);
+  assert(qc_bind(c, first) == 0);
+  assert_snapshot(c, ref_first);
+
+  /* Bound values are visible to the gradient walk */
+  assert(qc_gradient_adjoint(c, terms, coeffs, 1, gradients) == 6);
+
+  /* Terminal measurements are left out of the rebind */
+  qc_measure(c, 2);
+  qc_measure(c, 0);
+  assert(qc_bind(c, second) == 0);
+  assert_snapshot(c, ref_second);
+  assert(qc_bind(c, first) == 0);
+  assert_snapshot(c, ref_first);
+
+  /* Gates added after a bind are compiled into the next one */
+  qc_x(c, 1);
+  assert(qc_bind(c, second) == 0);
+  assert(qc_get_num_gates(c) == 13);
+
+  /* A gate on a measured qubit makes the measurement mid-circuit */
+  qc_x(c, 0);
+  assert(qc_bind(c, second) == -1);
+  qc_destroy(c);
+  printf("  [PASSED]\n");
+}
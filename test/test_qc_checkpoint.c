@@ -0,0 +1,150 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_QUBITS 12
+#define STATE_PATH "/tmp/qcs_test_state.bin"
+#define CHECKPOINT_PATH "/tmp/qcs_test_checkpoint.bin"
+#define ALL_ONES (((t_q_index)1 << NUM_QUBITS) - 1)
+
+/* The first gates of a preparation circuit */
+static void prepare(t_q_circuit *c, int gates) {
+  int q;
+
+  for (q = 0; q < gates; q++) {
+    if (q % 3 == 2)
+      qc_cnot(c, q % NUM_QUBITS, (q + 5) % NUM_QUBITS);
+    else
+      qc_ry(c, q % NUM_QUBITS, 0.3 + 0.1 * q);
+  }
+}
+
+static void check_same(t_q_circuit *a, t_q_circuit *b) {
+  t_q_index i;
+
+  assert(qc_get_num_qubits(a) == qc_get_num_qubits(b));
+  for (i = 0; i < ((t_q_index)1 << NUM_QUBITS); i++)
+    assert(fabs(qc_get_probability(a, i) - qc_get_probability(b, i)) < 1e-12);
+}
+
+void test_qc_checkpoint() {
+  printf("Testing: qc_save_state / qc_load_state / qc_set_checkpoint...\n");
+  t_q_circuit *c = qc_create(NUM_QUBITS);
+  t_q_circuit *loaded, *again, *other;
+  const char *terms[] = {"ZIIIIIIIIIII"};
+  const double coeffs[] = {1.0};
+  double values[1], batch_values[2], expectations[2];
+  FILE *f;
+  int *shots;
+  int q;
+
+  /* a loaded state matches, and gates on it leave the file alone */
+  prepare(c, 20);
+  assert(qc_save_state(c, STATE_PATH) == 0);
+  loaded = qc_load_state(STATE_PATH);
+  assert(loaded != NULL && qc_get_num_gates(loaded) == 0);
+  check_same(c, loaded);
+  qc_h(c, 3);
+  qc_h(loaded, 3);
+  qc_cnot(c, 11, 0);
+  qc_cnot(loaded, 11, 0);
+  check_same(c, loaded);
+  qc_destroy(loaded);
+
+  again = qc_load_state(STATE_PATH);
+  qc_destroy(c);
+  c = qc_create(NUM_QUBITS);
+  prepare(c, 20);
+  check_same(c, again);
+  qc_destroy(again);
+  qc_destroy(c);
+
+  /* sparse and out-of-core states load as dense ones */
+  c = qc_create(NUM_QUBITS);
+  other = qc_create_sparse(NUM_QUBITS, 0.0);
+  qc_h(c, 2);
+  qc_h(other, 2);
+  qc_cnot(c, 2, 10);
+  qc_cnot(other, 2, 10);
+  assert(qc_save_state(other, STATE_PATH) == 0);
+  loaded = qc_load_state(STATE_PATH);
+  check_same(c, loaded);
+  qc_destroy(loaded);
+  qc_destroy(other);
+
+  other = qc_create_out_of_core(NUM_QUBITS, "/tmp", 4);
+  qc_h(other, 2);
+  qc_cnot(other, 2, 10);
+  assert(qc_save_state(other, STATE_PATH) == 0);
+  loaded = qc_load_state(STATE_PATH);
+  check_same(c, loaded);
+  qc_destroy(loaded);
+  qc_destroy(other);
+  qc_destroy(c);
+
+  /* a checkpoint every 4 gates holds the state after gate 8 of 10 */
+  c = qc_create(NUM_QUBITS);
+  assert(qc_set_checkpoint(c, CHECKPOINT_PATH, 4) == 0);
+  prepare(c, 10);
+  assert(qc_set_checkpoint(c, NULL, 0) == 0);
+  loaded = qc_load_state(CHECKPOINT_PATH);
+  qc_destroy(c);
+  c = qc_create(NUM_QUBITS);
+  prepare(c, 8);
+  check_same(c, loaded);
+  qc_destroy(loaded);
+  qc_destroy(c);
+
+  /* the loaded state is where binds and parameter batches start */
+  c = qc_create(NUM_QUBITS);
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_x(c, q);
+  assert(qc_save_state(c, STATE_PATH) == 0);
+  qc_destroy(c);
+  loaded = qc_load_state(STATE_PATH);
+  qc_rz_param(loaded, 0, 0);
+  values[0] = 0.7;
+  assert(qc_bind(loaded, values) == 0);
+  assert(fabs(qc_get_probability(loaded, ALL_ONES) - 1.0) < 1e-12);
+  values[0] = -0.2;
+  assert(qc_bind(loaded, values) == 0);
+  assert(fabs(qc_get_probability(loaded, ALL_ONES) - 1.0) < 1e-12);
+  batch_values[0] = 0.1;
+  batch_values[1] = 1.3;
+  assert(qc_run_parameter_batch(loaded, batch_values, 2, terms, coeffs, 1,
+                                expectations) == 0);
+  assert(fabs(expectations[0] + 1.0) < 1e-12);
+  assert(fabs(expectations[1] + 1.0) < 1e-12);
+  qc_destroy(loaded);
+
+  /* shots after a measurement replay the history from the loaded state */
+  loaded = qc_load_state(STATE_PATH);
+  shots = (int *)malloc(((size_t)1 << NUM_QUBITS) * sizeof(int));
+  assert(qc_measure(loaded, 0) == 1);
+  qc_run_shots(loaded, 100, shots);
+  assert(shots[ALL_ONES] == 100);
+  qc_x(loaded, 0);
+  qc_run_shots(loaded, 100, shots);
+  assert(shots[ALL_ONES - 1] == 100);
+  free(shots);
+  qc_destroy(loaded);
+
+  /* anything else is rejected */
+  f = fopen(STATE_PATH, "w");
+  fputs("not a state", f);
+  fclose(f);
+  assert(qc_load_state(STATE_PATH) == NULL);
+  assert(qc_load_state("/nonexistent-qcs-state") == NULL);
+  c = qc_create_mps(NUM_QUBITS, 8, 0.0);
+  assert(qc_save_state(c, STATE_PATH) == -1);
+  qc_destroy(c);
+  c = qc_create_sparse(62, 0.0);
+  assert(qc_save_state(c, STATE_PATH) == -1);
+  qc_destroy(c);
+
+  remove(STATE_PATH);
+  remove(CHECKPOINT_PATH);
+  printf("  [PASSED]\n");
+}
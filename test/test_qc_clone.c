@@ -0,0 +1,188 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 12
+#define WIDE_QUBITS 20
+#define WIDE_KIB 16384 /* one 20-qubit vector */
+
+/* A short entangling preparation */
+static void prepare(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_ry(c, q, 0.2 + 0.15 * q);
+  for (q = 0; q + 1 < NUM_QUBITS; q++)
+    qc_cnot(c, q, q + 1);
+}
+
+static double max_diff(t_q_circuit *a, t_q_circuit *b) {
+  double diff = 0.0;
+  t_q_index i;
+
+  for (i = 0; i < ((t_q_index)1 << NUM_QUBITS); i++) {
+    double d = fabs(qc_get_probability(a, i) - qc_get_probability(b, i));
+    if (d > diff)
+      diff = d;
+  }
+  return diff;
+}
+
+#ifdef __linux__
+/* Anonymous (private) memory resident in the process, in KiB */
+static long rss_anon_kib(void) {
+  char line[128];
+  long kib = -1;
+  FILE *f = fopen("/proc/self/status", "r");
+
+  if (f == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "RssAnon: %ld", &kib) == 1)
+      break;
+  fclose(f);
+  return kib;
+}
+
+static void prepare_wide(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < WIDE_QUBITS; q++)
+    qc_ry(c, q, 0.3 + 0.1 * q);
+}
+
+/* Clones hold no private memory until a gate changes their amplitudes, and
+   then only the pages it changes */
+static void check_clone_memory(void) {
+  t_q_circuit *c = qc_create(WIDE_QUBITS);
+  t_q_circuit *ref = qc_create(WIDE_QUBITS);
+  t_q_circuit *a, *b;
+  long before, grown;
+  double diff = 0.0;
+  t_q_index i;
+
+  prepare_wide(c);
+  prepare_wide(ref);
+  before = rss_anon_kib();
+  a = qc_clone(c);
+  b = qc_clone(c);
+  assert(a != NULL && b != NULL);
+  assert(rss_anon_kib() <= before);
+
+  /* the phase only touches amplitudes with qubit 19 set: half the pages */
+  before = rss_anon_kib();
+  qc_cphase(a, WIDE_QUBITS - 1, 0, 0.5);
+  grown = rss_anon_kib() - before;
+  assert(grown >= WIDE_KIB / 4 && grown <= WIDE_KIB * 3 / 4);
+
+  qc_cphase(ref, WIDE_QUBITS - 1, 0, 0.5);
+  qc_cnot(a, 2, WIDE_QUBITS - 2);
+  qc_cnot(ref, 2, WIDE_QUBITS - 2);
+  for (i = 0; i < ((t_q_index)1 << WIDE_QUBITS); i++) {
+    double d = fabs(qc_get_probability(a, i) - qc_get_probability(ref, i));
+    double e = fabs(qc_get_probability(b, i) - qc_get_probability(c, i));
+    if (d > diff)
+      diff = d;
+    if (e > diff)
+      diff = e;
+  }
+  assert(diff < 1e-12);
+
+  qc_destroy(a);
+  qc_destroy(b);
+  qc_destroy(c);
+  qc_destroy(ref);
+}
+#endif
+
+void test_qc_clone() {
+  printf("Testing: qc_clone...\n");
+  t_q_circuit *c = qc_create(NUM_QUBITS);
+  t_q_circuit *a, *b, *d, *ref;
+  double values[1];
+
+  /* a clone matches, and gates on either side leave the other alone */
+  prepare(c);
+  a = qc_clone(c);
+  assert(a != NULL && qc_get_num_gates(a) == qc_get_num_gates(c));
+  assert(max_diff(c, a) < 1e-12);
+  qc_h(a, 0);
+  ref = qc_create(NUM_QUBITS);
+  prepare(ref);
+  assert(max_diff(c, ref) < 1e-12);
+  assert(max_diff(c, a) > 1e-3);
+  qc_h(c, 0);
+  assert(max_diff(c, a) < 1e-12);
+
+  /* clones of an unchanged state, and clones of clones, share one snapshot */
+  b = qc_clone(c);
+  d = qc_clone(b);
+  qc_x(c, 5);
+  assert(max_diff(b, d) < 1e-12);
+  assert(max_diff(b, a) < 1e-12);
+  qc_x(d, 5);
+  assert(max_diff(c, d) < 1e-12);
+
+  /* destroying the original first leaves the clones intact */
+  qc_destroy(c);
+  assert(max_diff(b, a) < 1e-12);
+  qc_destroy(a);
+  qc_destroy(b);
+  qc_destroy(d);
+  qc_destroy(ref);
+
+  /* parameter slots are copied and rebind on the clone only */
+  c = qc_create(NUM_QUBITS);
+  qc_h(c, 0);
+  qc_ry_param(c, 1, 0);
+  qc_cnot(c, 1, 2);
+  a = qc_clone(c);
+  values[0] = 1.1;
+  assert(qc_bind(a, values) == 0);
+  assert(qc_get_num_gates(a) == 3);
+  assert(fabs(qc_get_probability(c, 0) - 0.5) < 1e-12);
+  values[0] = 0.0;
+  assert(qc_bind(c, values) == 0);
+  assert(fabs(qc_get_probability(c, 0) - 0.5) < 1e-12);
+  assert(max_diff(c, a) > 1e-3);
+  values[0] = 1.1;
+  assert(qc_bind(c, values) == 0);
+  assert(max_diff(c, a) < 1e-12);
+  qc_destroy(a);
+  qc_destroy(c);
+
+  /* MPS and sparse states are copied */
+  ref = qc_create(NUM_QUBITS);
+  prepare(ref);
+  c = qc_create_mps(NUM_QUBITS, 64, 0.0);
+  prepare(c);
+  a = qc_clone(c);
+  qc_h(c, 3);
+  assert(max_diff(ref, a) < 1e-10);
+  qc_destroy(c);
+  assert(max_diff(ref, a) < 1e-10);
+  qc_destroy(a);
+
+  c = qc_create_sparse(NUM_QUBITS, 0.0);
+  prepare(c);
+  a = qc_clone(c);
+  qc_h(c, 3);
+  assert(max_diff(ref, a) < 1e-12);
+  qc_h(a, 3);
+  assert(max_diff(c, a) < 1e-12);
+  qc_destroy(c);
+  qc_destroy(a);
+  qc_destroy(ref);
+
+#ifdef __linux__
+  check_clone_memory();
+#endif
+
+  /* out-of-core states cannot be cloned */
+  c = qc_create_out_of_core(NUM_QUBITS, "/tmp", 4);
+  assert(qc_clone(c) == NULL);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+}
@@ -0,0 +1,89 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 12
+#define BLOCK_QUBITS 5
+
+/* Gates on low qubits, high qubits and across the block boundary */
+static void build(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_ry(c, q, 0.2 + 0.15 * q);
+  qc_cnot(c, 10, 2);
+  qc_cnot(c, 1, 11);
+  qc_cphase(c, 6, 9, 0.7);
+  qc_rx(c, 8, 1.3);
+  qc_cnot(c, 4, 5);
+  qc_rz(c, 11, -0.4);
+}
+
+static double max_difference(t_q_circuit *a, t_q_circuit *b) {
+  double worst = 0.0;
+  t_q_index i;
+
+  for (i = 0; i < ((t_q_index)1 << NUM_QUBITS); i++) {
+    double d = fabs(qc_get_probability(a, i) - qc_get_probability(b, i));
+    if (d > worst)
+      worst = d;
+  }
+  return worst;
+}
+
+void test_qc_compressed() {
+  printf("Testing: qc_create_compressed...\n");
+  t_q_circuit *dense = qc_create(NUM_QUBITS);
+  t_q_circuit *exact = qc_create_compressed(NUM_QUBITS, BLOCK_QUBITS, 0.0);
+  t_q_circuit *lossy = qc_create_compressed(NUM_QUBITS, BLOCK_QUBITS, 1e-9);
+  long dense_bytes = qc_get_state_bytes(dense);
+  int qubits[2] = {11, 0};
+  double expected[4], actual[4];
+  int q;
+
+  /* |0...0> is one nonzero block */
+  assert(exact != NULL && lossy != NULL);
+  assert(qc_get_state_bytes(exact) < dense_bytes / 16);
+
+  build(dense);
+  build(exact);
+  build(lossy);
+  assert(max_difference(dense, exact) < 1e-15);
+  assert(qc_get_truncation_error(exact) == 0.0);
+  assert(qc_get_truncation_error(lossy) > 0.0);
+  assert(qc_get_truncation_error(lossy) < 1e-6);
+  assert(max_difference(dense, lossy) < 1e-6);
+
+  assert(qc_marginal_probabilities(dense, qubits, 2, expected) == 0);
+  assert(qc_marginal_probabilities(lossy, qubits, 2, actual) == 0);
+  for (q = 0; q < 4; q++)
+    assert(fabs(expected[q] - actual[q]) < 1e-6);
+
+  /* the same random stream collapses to the same outcome */
+  qc_set_seed(dense, 3);
+  qc_set_seed(exact, 3);
+  assert(qc_measure(dense, 11) == qc_measure(exact, 11));
+  qc_h(dense, 7);
+  qc_h(exact, 7);
+  assert(max_difference(dense, exact) < 1e-12);
+  qc_destroy(dense);
+  qc_destroy(exact);
+  qc_destroy(lossy);
+
+  /* a uniform superposition repeats one amplitude and compresses well */
+  exact = qc_create_compressed(NUM_QUBITS, BLOCK_QUBITS, 0.0);
+  lossy = qc_create_compressed(NUM_QUBITS, BLOCK_QUBITS, 1e-9);
+  for (q = 0; q < NUM_QUBITS; q++) {
+    qc_h(exact, q);
+    qc_h(lossy, q);
+  }
+  assert(fabs(qc_get_probability(exact, 77) - 1.0 / (1 << NUM_QUBITS)) <
+         1e-15);
+  assert(qc_get_state_bytes(exact) < dense_bytes / 8);
+  assert(qc_get_state_bytes(lossy) < dense_bytes / 4);
+  qc_destroy(exact);
+  qc_destroy(lossy);
+
+  printf("  [PASSED]\n");
+}
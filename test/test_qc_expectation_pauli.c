@@ -0,0 +1,72 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define assert_float_equal(a, b) assert(fabs((a) - (b)) < 1e-9)
+
+/* an MPS wider than a Pauli mask, with a factor past the last mask bit */
+#define WIDE_QUBITS 70
+#define WIDE_TARGET 65
+
+void test_qc_expectation_pauli() {
+  printf("Testing: qc_expectation_pauli...\n");
+  t_q_circuit *c = qc_create(2);
+  t_q_circuit *mps, *sparse, *dense;
+  const char *strings[] = {"XZI", "YYI", "ZIZ", "IXY", "YXZ", "ZZZ"};
+  char wide[WIDE_QUBITS + 1];
+  int i;
+
+  /* Bell state: <XX> = <ZZ> = 1, <YY> = -1, <ZI> = 0 */
+  qc_h(c, 0);
+  qc_cnot(c, 0, 1);
+  assert_float_equal(qc_expectation_pauli(c, "XX"), 1.0);
+  assert_float_equal(qc_expectation_pauli(c, "ZZ"), 1.0);
+  assert_float_equal(qc_expectation_pauli(c, "YY"), -1.0);
+  assert_float_equal(qc_expectation_pauli(c, "Z"), 0.0);
+  assert_float_equal(qc_get_probability(c, 0), 0.5);
+  qc_destroy(c);
+
+  /* All backends agree on a generic state */
+  dense = qc_create(3);
+  mps = qc_create_mps(3, 8, 0.0);
+  sparse = qc_create_sparse(3, 0.0);
+  for (i = 0; i < 3; i++) {
+    t_q_circuit *b = i == 0 ? dense : (i == 1 ? mps : sparse);
+    qc_ry(b, 0, 0.3);
+    qc_rx(b, 1, 1.2);
+    qc_cnot(b, 0, 2);
+    qc_h(b, 2);
+    qc_rz(b, 2, 0.7);
+    qc_cnot(b, 1, 0);
+  }
+  for (i = 0; i < 6; i++) {
+    double expected = qc_expectation_pauli(dense, strings[i]);
+    assert(fabs(expected) <= 1.0 + 1e-12);
+    assert_float_equal(qc_expectation_pauli(mps, strings[i]), expected);
+    assert_float_equal(qc_expectation_pauli(sparse, strings[i]), expected);
+  }
+  qc_destroy(dense);
+  qc_destroy(mps);
+  qc_destroy(sparse);
+
+  /* Factors past the index width are read, not dropped (MPS reads the
+   * string, not the masks); factors past the register are rejected */
+  for (i = 0; i < WIDE_QUBITS; i++)
+    wide[i] = 'I';
+  wide[WIDE_QUBITS] = '\0';
+  wide[WIDE_TARGET] = 'Z';
+  mps = qc_create_mps(WIDE_QUBITS, 2, 0.0);
+  qc_x(mps, WIDE_TARGET);
+  assert_float_equal(qc_expectation_pauli(mps, wide), -1.0);
+  wide[WIDE_TARGET] = 'Y';
+  assert_float_equal(qc_expectation_pauli(mps, wide), 0.0);
+  qc_destroy(mps);
+  dense = qc_create(3);
+  qc_x(dense, 0);
+  assert_float_equal(qc_expectation_pauli(dense, "ZII"), -1.0);
+  assert_float_equal(qc_expectation_pauli(dense, "ZIIZ"), 0.0);
+  assert_float_equal(qc_expectation_pauli(dense, "ZIII"), 0.0);
+  qc_destroy(dense);
+  printf("  [PASSED]\n");
+}
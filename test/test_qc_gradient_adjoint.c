@@ -0,0 +1,69 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_PARAMS 7
+
+static const char *terms[] = {"ZZI", "XIX", "IYY", "ZIZ", "XYZ"};
+static const double coeffs[] = {0.7, -0.4, 0.9, 0.25, -1.1};
+
+static t_q_circuit *build(const double *theta) {
+  t_q_circuit *c = qc_create(3);
+  qc_h(c, 0);
+  qc_rx(c, 1, theta[0]);
+  qc_ry(c, 2, theta[1]);
+  qc_cnot(c, 0, 1);
+  qc_rz(c, 1, theta[2]);
+  qc_barrier(c);
+  qc_phase(c, 2, theta[3]);
+  qc_quantum_fourier_transform(c);
+  qc_ry(c, 0, theta[4]);
+  qc_cnot(c, 2, 0);
+  qc_rx(c, 2, theta[5]);
+  qc_y(c, 1);
+  qc_rz(c, 0, theta[6]);
+  return c;
+}
+
+static double energy(const double *theta) {
+  t_q_circuit *c = build(theta);
+  double e = qc_expectation_hamiltonian(c, terms, coeffs, 5);
+  qc_destroy(c);
+  return e;
+}
+
+void test_qc_gradient_adjoint() {
+  printf("Testing: qc_gradient_adjoint...\n");
+  double theta[NUM_PARAMS] = {0.3, -1.2, 0.8, 0.45, 2.1, -0.7, 1.4};
+  double gradients[NUM_PARAMS];
+  t_q_circuit *c;
+  int i;
+
+  c = build(theta);
+  assert(qc_get_num_parameters(c) == NUM_PARAMS);
+  assert(qc_gradient_adjoint(c, terms, coeffs, 5, gradients) == NUM_PARAMS);
+  qc_destroy(c);
+
+  /* Compare against central finite differences */
+  for (i = 0; i < NUM_PARAMS; i++) {
+    double h = 1e-5;
+    double saved = theta[i];
+    double plus, minus;
+
+    theta[i] = saved + h;
+    plus = energy(theta);
+    theta[i] = saved - h;
+    minus = energy(theta);
+    theta[i] = saved;
+    assert(fabs(gradients[i] - (plus - minus) / (2.0 * h)) < 1e-6);
+  }
+
+  /* Non-unitary history is rejected */
+  c = qc_create(3);
+  qc_rx(c, 0, 0.5);
+  qc_reset(c, 0);
+  assert(qc_gradient_adjoint(c, terms, coeffs, 1, gradients) == -1);
+  qc_destroy(c);
+  printf("  [PASSED]\n");
+}
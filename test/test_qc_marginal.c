@@ -0,0 +1,71 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 9
+
+/* Marginal by summing qc_get_probability over every basis state */
+static void brute_marginal(t_q_circuit *c, const int *qubits, int k,
+                           double *out) {
+  int i, j;
+
+  for (i = 0; i < (1 << k); i++)
+    out[i] = 0.0;
+  for (i = 0; i < (1 << NUM_QUBITS); i++) {
+    int key = 0;
+    for (j = 0; j < k; j++)
+      key |= ((i >> qubits[j]) & 1) << j;
+    out[key] += qc_get_probability(c, i);
+  }
+}
+
+static void check_subsets(t_q_circuit *c) {
+  static const int subsets[4][3] = {{3, 0, 7}, {8, 2, 0}, {5, 0, 0}, {1, 2, 4}};
+  static const int sizes[4] = {3, 2, 1, 3};
+  double got[8], want[8];
+  int s, i;
+
+  for (s = 0; s < 4; s++) {
+    assert(qc_marginal_probabilities(c, subsets[s], sizes[s], got) == 0);
+    brute_marginal(c, subsets[s], sizes[s], want);
+    for (i = 0; i < (1 << sizes[s]); i++)
+      assert(fabs(got[i] - want[i]) < 1e-12);
+  }
+
+  /* no qubits: the total probability */
+  assert(qc_marginal_probabilities(c, subsets[0], 0, got) == 0);
+  assert(fabs(got[0] - 1.0) < 1e-12);
+}
+
+static void prepare(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_ry(c, q, 0.25 + 0.3 * q);
+  qc_cnot(c, 0, 4);
+  qc_cnot(c, 7, 2);
+  qc_rx(c, 5, 0.9);
+}
+
+void test_qc_marginal() {
+  printf("Testing: qc_marginal_probabilities...\n");
+  t_q_circuit *c;
+  double out[4];
+  int dup[2] = {1, 1};
+  int bad[1] = {NUM_QUBITS};
+
+  c = qc_create(NUM_QUBITS);
+  prepare(c);
+  check_subsets(c);
+  assert(qc_marginal_probabilities(c, dup, 2, out) == -1);
+  assert(qc_marginal_probabilities(c, bad, 1, out) == -1);
+  qc_destroy(c);
+
+  c = qc_create_sparse(NUM_QUBITS, 0.0);
+  prepare(c);
+  check_subsets(c);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+}
@@ -1,5 +1,6 @@
 #include "../include/qcs.h"
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 
 void test_qc_measure() {
@@ -15,5 +16,57 @@ void test_qc_measure() {
   assert(results[0] == 0 && results[1] == 1);
 
   qc_destroy(c);
+
+  /* GHZ over 8 qubits: measuring one qubit collapses and renormalizes all */
+  {
+    int trial, ones = 0;
+    for (trial = 0; trial < 200; trial++) {
+      int r;
+      c = qc_create(8);
+      qc_ghz_state(c);
+      r = qc_measure(c, 5);
+      ones += r;
+      assert(fabs(qc_get_probability(c, r ? 255 : 0) - 1.0) < 1e-12);
+      assert(qc_measure(c, 0) == r && qc_measure(c, 7) == r);
+      qc_destroy(c);
+    }
+    assert(ones > 60 && ones < 140);
+  }
+
+  /* P(1) = 0.2 on qubit 3; the other outcome keeps its relative amplitudes */
+  c = qc_create(6);
+  qc_ry(c, 3, 2.0 * asin(sqrt(0.2)));
+  qc_h(c, 0);
+  assert(qc_measure(c, 3) == qc_measure(c, 3));
+  assert(fabs(qc_get_probability(c, 0) + qc_get_probability(c, 1) +
+              qc_get_probability(c, 8) + qc_get_probability(c, 9) - 1.0) <
+         1e-12);
+  assert(fabs(qc_get_probability(c, 0) - qc_get_probability(c, 1)) < 1e-12);
+  qc_destroy(c);
+
+  /* measure_all samples the joint distribution and leaves a basis state */
+  {
+    int bits[10], again[10];
+    int trial, q, hits_q2 = 0;
+    for (trial = 0; trial < 400; trial++) {
+      int index = 0;
+      c = qc_create(10);
+      qc_ry(c, 2, 2.0 * asin(sqrt(0.25)));
+      qc_h(c, 8);
+      qc_cnot(c, 8, 9);
+      qc_measure_all(c, bits);
+      for (q = 0; q < 10; q++)
+        index |= bits[q] << q;
+      assert(bits[8] == bits[9]);
+      assert(bits[0] == 0 && bits[5] == 0);
+      assert(fabs(qc_get_probability(c, index) - 1.0) < 1e-12);
+      qc_measure_all(c, again);
+      for (q = 0; q < 10; q++)
+        assert(again[q] == bits[q]);
+      hits_q2 += bits[2];
+      qc_destroy(c);
+    }
+    assert(hits_q2 > 60 && hits_q2 < 140);
+  }
   printf("  [PASSED]\n");
 }
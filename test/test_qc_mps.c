@@ -0,0 +1,136 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define assert_float_equal(a, b) assert(fabs((a) - (b)) < 1e-9)
+
+static void build_circuit(t_q_circuit *c) {
+  qc_h(c, 0);
+  qc_cnot(c, 0, 3);
+  qc_rx(c, 2, 0.7);
+  qc_cnot(c, 4, 1);
+  qc_ry(c, 1, 1.1);
+  qc_h(c, 4);
+  qc_cnot(c, 2, 0);
+  qc_rz(c, 3, 0.3);
+  qc_phase(c, 1, 0.9);
+  qc_cnot(c, 1, 4);
+}
+
+/* Deterministic random circuit with 2-qubit gates between distant qubits */
+static void build_random_circuit(t_q_circuit *c, int n, unsigned long seed) {
+  int g;
+
+  for (g = 0; g < 40; g++) {
+    int a, b;
+    double angle;
+
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    a = (int)((seed >> 33) % n);
+    b = (a + 1 + (int)((seed >> 41) % (n - 1))) % n;
+    angle = (double)((seed >> 20) % 1000) / 100.0;
+    switch ((seed >> 50) % 5) {
+    case 0:
+      qc_h(c, a);
+      break;
+    case 1:
+      qc_ry(c, a, angle);
+      break;
+    case 2:
+      qc_rz(c, a, angle);
+      break;
+    case 3:
+      qc_cnot(c, a, b);
+      break;
+    default:
+      qc_cphase(c, a, b, angle);
+      break;
+    }
+  }
+}
+
+void test_qc_mps() {
+  printf("Testing: qc_create_mps...\n");
+  t_q_circuit *dense = qc_create(5);
+  t_q_circuit *mps = qc_create_mps(5, 32, 0.0);
+  int i, first, shots = 1000, results[4] = {0}, wide[70];
+
+  /* Matches the state-vector backend on a small entangling circuit */
+  build_circuit(dense);
+  build_circuit(mps);
+  for (i = 0; i < 32; i++) {
+    assert_float_equal(qc_get_probability(mps, i),
+                       qc_get_probability(dense, i));
+  }
+  assert(qc_get_truncation_error(mps) < 1e-12);
+  qc_destroy(dense);
+  qc_destroy(mps);
+
+  /* Without truncation, rounding noise never costs norm or fidelity */
+  for (first = 0; first < 12; first++) {
+    int n = 6 + first % 3;
+    double norm = 0.0;
+
+    dense = qc_create(n);
+    mps = qc_create_mps(n, 64, 0.0);
+    build_random_circuit(dense, n, 17UL + first);
+    build_random_circuit(mps, n, 17UL + first);
+    for (i = 0; i < (1 << n); i++) {
+      norm += qc_get_probability(mps, i);
+      assert_float_equal(qc_get_probability(mps, i),
+                         qc_get_probability(dense, i));
+    }
+    assert_float_equal(norm, 1.0);
+    assert(qc_get_truncation_error(mps) < 1e-12);
+    qc_destroy(dense);
+    qc_destroy(mps);
+  }
+
+  /* Wide GHZ state far beyond what the dense backend can allocate */
+  mps = qc_create_mps(60, 4, 1e-12);
+  qc_ghz_state(mps);
+  assert_float_equal(qc_get_probability(mps, 0), 0.5);
+  first = qc_measure(mps, 0);
+  for (i = 1; i < 60; i++) {
+    assert(qc_measure(mps, i) == first);
+  }
+  qc_destroy(mps);
+
+  /* Qubits beyond a basis index are measured per qubit, never dropped */
+  mps = qc_create_mps(70, 4, 0.0);
+  qc_x(mps, 65);
+  qc_x(mps, 1);
+  assert_float_equal(qc_get_probability(mps, 2), 0.0);
+  assert(qc_run_shots_counts(mps, 10) == NULL);
+  qc_measure_all(mps, wide);
+  for (i = 0; i < 70; i++) {
+    assert(wide[i] == (i == 1 || i == 65));
+  }
+  qc_destroy(mps);
+
+  /* The top qubit of a full-width index is addressable */
+  mps = qc_create_mps(63, 4, 0.0);
+  qc_x(mps, 62);
+  assert_float_equal(qc_get_probability(mps, (t_q_index)1 << 62), 1.0);
+  assert_float_equal(qc_get_probability(mps, 0), 0.0);
+  qc_destroy(mps);
+
+  /* Bond cap of 1 forces a product state and reports the lost weight */
+  mps = qc_create_mps(2, 1, 0.0);
+  qc_h(mps, 0);
+  qc_cnot(mps, 0, 1);
+  assert(fabs(qc_get_truncation_error(mps) - 0.5) < 1e-9);
+  qc_destroy(mps);
+
+  /* Sampling does not collapse the state */
+  mps = qc_create_mps(2, 4, 0.0);
+  qc_h(mps, 0);
+  qc_cnot(mps, 0, 1);
+  qc_run_shots(mps, shots, results);
+  assert(results[0] + results[3] == shots);
+  assert(results[0] > 400 && results[0] < 600);
+  assert_float_equal(qc_get_probability(mps, 3), 0.5);
+  qc_destroy(mps);
+  printf("  [PASSED]\n");
+}
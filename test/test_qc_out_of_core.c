@@ -0,0 +1,101 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 10
+#define CHUNK_QUBITS 4
+
+/* Gates on low qubits, high qubits and across the chunk boundary */
+static void build(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_h(c, q);
+  qc_rx(c, 7, 0.3);
+  qc_cnot(c, 8, 2);
+  qc_cnot(c, 1, 9);
+  qc_cphase(c, 6, 9, 0.7);
+  qc_ry(c, 5, 1.1);
+  qc_cnot(c, 4, 5);
+  qc_rz(c, 8, -0.4);
+  qc_cnot(c, 9, 7);
+  qc_y(c, 0);
+  qc_phase(c, 6, 0.2);
+}
+
+static void check_same(t_q_circuit *dense, t_q_circuit *disk) {
+  int qubits[3] = {9, 0, 5};
+  double expected[8], actual[8];
+  t_q_index dense_top[4], disk_top[4];
+  double dense_probs[4], disk_probs[4];
+  long found;
+  t_q_index i;
+
+  for (i = 0; i < ((t_q_index)1 << NUM_QUBITS); i++)
+    assert(fabs(qc_get_probability(dense, i) - qc_get_probability(disk, i)) <
+           1e-12);
+
+  assert(qc_marginal_probabilities(dense, qubits, 3, expected) == 0);
+  assert(qc_marginal_probabilities(disk, qubits, 3, actual) == 0);
+  for (i = 0; i < 8; i++)
+    assert(fabs(expected[i] - actual[i]) < 1e-12);
+
+  found = qc_top_k_states(dense, 4, dense_top, dense_probs);
+  assert(found > 0 && qc_top_k_states(disk, 4, disk_top, disk_probs) == found);
+  for (i = 0; i < found; i++)
+    assert(fabs(dense_probs[i] - disk_probs[i]) < 1e-12);
+}
+
+void test_qc_out_of_core() {
+  printf("Testing: qc_create_out_of_core...\n");
+  t_q_circuit *dense = qc_create(NUM_QUBITS);
+  t_q_circuit *disk = qc_create_out_of_core(NUM_QUBITS, "/tmp", CHUNK_QUBITS);
+  double params[1] = {0.9};
+  int results[NUM_QUBITS];
+  t_q_index index = 0;
+  int q;
+
+  assert(disk != NULL);
+  assert(fabs(qc_get_probability(disk, 0) - 1.0) < 1e-12);
+
+  build(dense);
+  build(disk);
+  check_same(dense, disk);
+
+  /* a measured qubit collapses identically for the same random stream */
+  qc_set_seed(dense, 7);
+  qc_set_seed(disk, 7);
+  assert(qc_measure(dense, 8) == qc_measure(disk, 8));
+  assert(qc_measure(dense, 3) == qc_measure(disk, 3));
+  qc_h(dense, 8);
+  qc_h(disk, 8);
+  check_same(dense, disk);
+
+  /* a full measurement leaves exactly the measured basis state */
+  qc_measure_all(disk, results);
+  for (q = 0; q < NUM_QUBITS; q++)
+    index |= (t_q_index)results[q] << q;
+  assert(fabs(qc_get_probability(disk, index) - 1.0) < 1e-12);
+  qc_destroy(dense);
+  qc_destroy(disk);
+
+  /* rebinding restarts from |0...0> */
+  dense = qc_create(NUM_QUBITS);
+  disk = qc_create_out_of_core(NUM_QUBITS, NULL, CHUNK_QUBITS);
+  qc_h(dense, 9);
+  qc_h(disk, 9);
+  qc_ry_param(dense, 9, 0);
+  qc_ry_param(disk, 9, 0);
+  qc_cnot(dense, 9, 0);
+  qc_cnot(disk, 9, 0);
+  assert(qc_bind(dense, params) == 0);
+  assert(qc_bind(disk, params) == 0);
+  check_same(dense, disk);
+  qc_destroy(dense);
+  qc_destroy(disk);
+
+  assert(qc_create_out_of_core(NUM_QUBITS, "/nonexistent-qcs-dir", 4) == NULL);
+
+  printf("  [PASSED]\n");
+}
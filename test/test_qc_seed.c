@@ -0,0 +1,59 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Fill results with shots of a fixed 6-qubit state and a run of measurements
+   of a fresh copy, all under the given seed */
+static void seeded_run(unsigned long seed, int shots, int *results,
+                       int *bits) {
+  t_q_circuit *c = qc_create(6);
+  int q;
+
+  for (q = 0; q < 6; q++)
+    qc_ry(c, q, 0.4 + 0.3 * q);
+  qc_set_seed(c, seed);
+  qc_run_shots(c, shots, results);
+  for (q = 0; q < 6; q++)
+    bits[q] = qc_measure(c, q);
+  qc_destroy(c);
+}
+
+void test_qc_seed() {
+  printf("Testing: qc_set_seed...\n");
+  int a[64], b[64];
+  int bits_a[6], bits_b[6];
+  int mps_a[16], mps_b[16];
+  t_q_circuit *c;
+  int run;
+
+  /* streamed (shots >= outcomes) and binary-search (shots < outcomes) paths */
+  seeded_run(12345, 5000, a, bits_a);
+  seeded_run(12345, 5000, b, bits_b);
+  assert(memcmp(a, b, sizeof(a)) == 0);
+  assert(memcmp(bits_a, bits_b, sizeof(bits_a)) == 0);
+
+  seeded_run(12345, 40, a, bits_a);
+  seeded_run(12345, 40, b, bits_b);
+  assert(memcmp(a, b, sizeof(a)) == 0);
+
+  seeded_run(12345, 5000, a, bits_a);
+  seeded_run(54321, 5000, b, bits_b);
+  assert(memcmp(a, b, sizeof(a)) != 0);
+
+  /* MPS sampling draws from the same generator */
+  for (run = 0; run < 2; run++) {
+    c = qc_create_mps(4, 8, 1e-12);
+    qc_h(c, 0);
+    qc_cnot(c, 0, 1);
+    qc_ry(c, 2, 1.1);
+    qc_set_seed(c, 7);
+    qc_run_shots(c, 1000, run == 0 ? mps_a : mps_b);
+    qc_destroy(c);
+  }
+  assert(memcmp(mps_a, mps_b, sizeof(mps_a)) == 0);
+
+  printf("  [PASSED]\n");
+}
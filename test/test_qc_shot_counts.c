@@ -0,0 +1,95 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Dense histogram and counts table of the same seeded run must agree */
+static void check_matches_dense(int num_qubits, long shots) {
+  int size = 1 << num_qubits;
+  int *dense = (int *)malloc(size * sizeof(int));
+  int *exported = (int *)malloc(size * sizeof(int));
+  t_q_counts *counts;
+  t_q_circuit *c;
+  int q;
+
+  c = qc_create(num_qubits);
+  for (q = 0; q < num_qubits; q++)
+    qc_ry(c, q, 0.3 + 0.2 * q);
+  qc_set_seed(c, 2024);
+  qc_run_shots(c, (int)shots, dense);
+  qc_destroy(c);
+
+  c = qc_create(num_qubits);
+  for (q = 0; q < num_qubits; q++)
+    qc_ry(c, q, 0.3 + 0.2 * q);
+  qc_set_seed(c, 2024);
+  counts = qc_run_shots_counts(c, shots);
+  qc_destroy(c);
+
+  assert(counts != NULL);
+  assert(qc_counts_total(counts) == shots);
+  assert(qc_counts_to_dense(counts, exported, size) == 0);
+  assert(memcmp(dense, exported, size * sizeof(int)) == 0);
+
+  qc_counts_free(counts);
+  free(dense);
+  free(exported);
+}
+
+void test_qc_shot_counts() {
+  printf("Testing: qc_run_shots_counts...\n");
+  t_q_circuit *c;
+  t_q_counts *counts, *marginal;
+  t_q_index keys[4];
+  long values[4];
+  t_q_index bitstring;
+  long cursor = 0, count, seen = 0;
+  int qubits[2] = {0, 39};
+  int dense[4];
+
+  /* streamed (shots >= 2^n) and cached-sampler (shots < 2^n) paths */
+  check_matches_dense(8, 20000);
+  check_matches_dense(8, 100);
+
+  /* 40-qubit GHZ on the MPS backend: two outcomes, no 2^40 buffer */
+  c = qc_create_mps(40, 4, 0.0);
+  qc_h(c, 0);
+  {
+    int q;
+    for (q = 1; q < 40; q++)
+      qc_cnot(c, q - 1, q);
+  }
+  counts = qc_run_shots_counts(c, 3000);
+  qc_destroy(c);
+  assert(counts != NULL);
+  assert(qc_counts_num_outcomes(counts) == 2);
+  assert(qc_counts_total(counts) == 3000);
+  assert(qc_counts_get(counts, 0) + qc_counts_get(counts, (1L << 40) - 1) ==
+         3000);
+  assert(qc_counts_get(counts, 1) == 0);
+
+  while (qc_counts_next(counts, &cursor, &bitstring, &count)) {
+    assert(bitstring == 0 || bitstring == (1L << 40) - 1);
+    seen += count;
+  }
+  assert(seen == 3000);
+
+  /* top-k is sorted by count and clipped to the number of outcomes */
+  assert(qc_counts_top_k(counts, 4, keys, values) == 2);
+  assert(values[0] >= values[1] && values[0] + values[1] == 3000);
+  assert(values[0] == qc_counts_get(counts, keys[0]));
+
+  /* marginal on the two end qubits: only 00 and 11 */
+  marginal = qc_counts_marginal(counts, qubits, 2);
+  assert(marginal != NULL);
+  assert(qc_counts_to_dense(marginal, dense, 4) == 0);
+  assert(dense[1] == 0 && dense[2] == 0 && dense[0] + dense[3] == 3000);
+  assert(dense[0] > 1300 && dense[0] < 1700);
+  assert(qc_counts_to_dense(counts, dense, 4) == -1);
+  qc_counts_free(marginal);
+  qc_counts_free(counts);
+
+  printf("  [PASSED]\n");
+}
@@ -0,0 +1,79 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void test_qc_shot_replay() {
+  printf("Testing: qc_run_shots history replay...\n");
+  int results[8];
+  int bits[3];
+  t_q_circuit *c;
+
+  /* terminal measurements: shots come from the pre-measurement state,
+     not from the collapsed one */
+  c = qc_create(3);
+  qc_h(c, 0);
+  qc_cnot(c, 0, 1);
+  qc_measure_all(c, bits);
+  qc_run_shots(c, 4000, results);
+  assert(results[0] + results[3] == 4000);
+  assert(results[0] > 1800 && results[0] < 2200);
+  /* the circuit keeps its collapsed state */
+  assert(fabs(qc_get_probability(c, bits[0] ? 3 : 0) - 1.0) < 1e-12);
+  qc_destroy(c);
+
+  /* a single terminal measurement commutes past gates on other qubits */
+  c = qc_create(3);
+  qc_h(c, 0);
+  qc_measure(c, 0);
+  qc_x(c, 2);
+  qc_run_shots(c, 4000, results);
+  assert(results[4] + results[5] == 4000);
+  assert(results[4] > 1800 && results[4] < 2200);
+  qc_destroy(c);
+
+  /* mid-circuit reset: qubit 0 is randomised, copied to qubit 1, then
+     reset and flipped, so every shot reads 1 on qubit 0 */
+  c = qc_create(3);
+  qc_h(c, 0);
+  qc_cnot(c, 0, 1);
+  qc_reset(c, 0);
+  qc_x(c, 0);
+  qc_run_shots(c, 2000, results);
+  assert(results[1] + results[3] == 2000);
+  assert(results[1] > 850 && results[1] < 1150);
+  qc_destroy(c);
+
+  /* mid-circuit measurement: H, measure, H gives a uniform qubit, where
+     the unitary part alone (H H = I) would always read 0 */
+  c = qc_create(1);
+  qc_h(c, 0);
+  qc_measure(c, 0);
+  qc_h(c, 0);
+  qc_run_shots(c, 2000, results);
+  assert(results[0] + results[1] == 2000);
+  assert(results[0] > 850 && results[0] < 1150);
+  qc_destroy(c);
+
+  /* the same trajectories on the sparse and MPS backends */
+  c = qc_create_sparse(3, 0.0);
+  qc_h(c, 0);
+  qc_measure(c, 0);
+  qc_h(c, 0);
+  qc_run_shots(c, 2000, results);
+  assert(results[0] + results[1] == 2000);
+  assert(results[0] > 850 && results[0] < 1150);
+  qc_destroy(c);
+
+  c = qc_create_mps(3, 4, 0.0);
+  qc_h(c, 0);
+  qc_cnot(c, 0, 1);
+  qc_reset(c, 0);
+  qc_run_shots(c, 2000, results);
+  assert(results[0] + results[2] == 2000);
+  assert(results[0] > 850 && results[0] < 1150);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+}
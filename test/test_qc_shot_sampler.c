@@ -0,0 +1,61 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_STATES 1024
+
+/* Frequency of qubit 0 reading 1; asserts qubit 9 (left in |0>) never does */
+static double marginal_q0(const int *results, int shots) {
+  long ones = 0, total = 0;
+  int i;
+  for (i = 0; i < NUM_STATES; i++) {
+    if (i & (1 << 9))
+      assert(results[i] == 0);
+    if (i & 1)
+      ones += results[i];
+    total += results[i];
+  }
+  assert(total == shots);
+  return (double)ones / shots;
+}
+
+void test_qc_shot_sampler() {
+  printf("Testing: qc_run_shots sampler...\n");
+  int *results = (int *)malloc(NUM_STATES * sizeof(int));
+  t_q_circuit *c;
+  int q;
+
+  /* P(q0 = 1) = sin^2(theta / 2) = 0.3; qubits 1-8 uniform; qubit 9 in |0> */
+  c = qc_create(10);
+  qc_ry(c, 0, 2.0 * asin(sqrt(0.3)));
+  for (q = 1; q < 9; q++) {
+    qc_h(c, q);
+  }
+
+  /* fewer shots than outcomes: binary search over the prefix sums */
+  qc_run_shots(c, 2000, results);
+  assert(fabs(marginal_q0(results, 2000) - 0.3) < 0.05);
+
+  /* many shots: alias table on the same cached sampler */
+  qc_run_shots(c, 50000, results);
+  assert(fabs(marginal_q0(results, 50000) - 0.3) < 0.02);
+
+  /* a gate invalidates the cached sampler */
+  qc_x(c, 0);
+  qc_run_shots(c, 50000, results);
+  assert(fabs(marginal_q0(results, 50000) - 0.7) < 0.02);
+  qc_destroy(c);
+
+  /* sparse: only the two GHZ outcomes appear */
+  c = qc_create_sparse(10, 0.0);
+  qc_ghz_state(c);
+  qc_run_shots(c, 4000, results);
+  assert(results[0] + results[NUM_STATES - 1] == 4000);
+  assert(results[0] > 1700 && results[0] < 2300);
+  qc_destroy(c);
+
+  free(results);
+  printf("  [PASSED]\n");
+}
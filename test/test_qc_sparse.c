@@ -0,0 +1,61 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define assert_float_equal(a, b) assert(fabs((a) - (b)) < 1e-9)
+
+void test_qc_sparse() {
+  printf("Testing: qc_create_sparse...\n");
+  t_q_circuit *dense = qc_create(6);
+  t_q_circuit *sparse = qc_create_sparse(6, 0.0);
+  int i;
+
+  /* Matches the state-vector backend amplitude for amplitude */
+  for (i = 0; i < 2; i++) {
+    t_q_circuit *c = i == 0 ? dense : sparse;
+    qc_x(c, 1);
+    qc_h(c, 0);
+    qc_cnot(c, 0, 4);
+    qc_ry(c, 2, 0.4);
+    qc_cnot(c, 2, 5);
+    qc_rz(c, 5, 1.3);
+    qc_h(c, 0);
+  }
+  for (i = 0; i < 64; i++) {
+    assert_float_equal(qc_get_probability(sparse, i),
+                       qc_get_probability(dense, i));
+  }
+  qc_destroy(dense);
+  qc_destroy(sparse);
+
+  /* 50 qubits with only a handful of live amplitudes */
+  sparse = qc_create_sparse(50, 0.0);
+  qc_x(sparse, 3);
+  qc_h(sparse, 49);
+  qc_cnot(sparse, 49, 40);
+  qc_h(sparse, 0);
+  qc_cnot(sparse, 0, 1);
+  assert_float_equal(qc_get_probability(sparse, 8), 0.25);
+  assert_float_equal(qc_get_probability(sparse, 11), 0.25);
+  assert(qc_measure(sparse, 40) == qc_measure(sparse, 49));
+  assert(qc_measure(sparse, 0) == qc_measure(sparse, 1));
+  qc_destroy(sparse);
+
+  /* Converts itself to dense once more than half the states are live */
+  sparse = qc_create_sparse(4, 0.5);
+  for (i = 0; i < 4; i++) {
+    qc_h(sparse, i);
+  }
+  for (i = 0; i < 16; i++) {
+    assert_float_equal(qc_get_probability(sparse, i), 1.0 / 16.0);
+  }
+  qc_destroy(sparse);
+
+  /* Dense-only algorithms convert the circuit first */
+  sparse = qc_create_sparse(6, 0.0);
+  qc_grover_search(sparse, 42);
+  assert(qc_get_probability(sparse, 42) > 0.9);
+  qc_destroy(sparse);
+  printf("  [PASSED]\n");
+}
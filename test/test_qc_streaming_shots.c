@@ -0,0 +1,46 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void test_qc_streaming_shots() {
+  printf("Testing: qc_run_shots streaming sampler...\n");
+  int *results = (int *)malloc(256 * sizeof(int));
+  double expected[8];
+  long total;
+  t_q_circuit *c;
+  int i;
+
+  /* product of RY rotations: P(i) = prod_q (bit ? p_q : 1 - p_q) */
+  c = qc_create(3);
+  qc_ry(c, 0, 2.0 * asin(sqrt(0.1)));
+  qc_ry(c, 1, 2.0 * asin(sqrt(0.6)));
+  qc_ry(c, 2, 2.0 * asin(sqrt(0.35)));
+  for (i = 0; i < 8; i++) {
+    expected[i] = ((i & 1) ? 0.1 : 0.9) * ((i & 2) ? 0.6 : 0.4) *
+                  ((i & 4) ? 0.35 : 0.65);
+  }
+
+  /* no cached sampler and shots >= outcomes: streamed */
+  qc_run_shots(c, 400000, results);
+  total = 0;
+  for (i = 0; i < 8; i++) {
+    assert(fabs(results[i] / 400000.0 - expected[i]) < 0.005);
+    total += results[i];
+  }
+  assert(total == 400000);
+  qc_destroy(c);
+
+  /* 64 blocks of 4 outcomes, most of them empty: the multinomial split
+     must put every shot in the two GHZ blocks */
+  c = qc_create(8);
+  qc_ghz_state(c);
+  qc_run_shots(c, 100000, results);
+  assert(results[0] + results[255] == 100000);
+  assert(results[0] > 48500 && results[0] < 51500);
+  qc_destroy(c);
+
+  free(results);
+  printf("  [PASSED]\n");
+}
@@ -0,0 +1,101 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 10
+#define K 20
+
+/* Every outcome ranked by brute force must lose to the reported k-th one */
+static void check_top_k(t_q_circuit *c) {
+  t_q_index indices[K];
+  double probs[K];
+  long n, i, j;
+
+  n = qc_top_k_states(c, K, indices, probs);
+  assert(n == K);
+  for (i = 0; i < n; i++) {
+    assert(fabs(probs[i] - qc_get_probability(c, (int)indices[i])) < 1e-15);
+    if (i > 0)
+      assert(probs[i] < probs[i - 1] ||
+             (probs[i] == probs[i - 1] && indices[i] > indices[i - 1]));
+  }
+  for (j = 0; j < (1L << NUM_QUBITS); j++) {
+    double p = qc_get_probability(c, (int)j);
+    int listed = 0;
+
+    for (i = 0; i < n; i++)
+      if (indices[i] == j)
+        listed = 1;
+    if (!listed)
+      assert(p < probs[n - 1] || (p == probs[n - 1] && j > indices[n - 1]));
+  }
+  assert(qc_find_most_likely_state(c) == (int)indices[0]);
+}
+
+static void prepare(t_q_circuit *c) {
+  int q;
+
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_ry(c, q, 0.3 + 0.17 * q);
+  qc_cnot(c, 2, 6);
+  qc_rx(c, 9, 1.1);
+}
+
+void test_qc_top_k() {
+  printf("Testing: qc_top_k_states...\n");
+  t_q_circuit *c;
+  t_q_index indices[K];
+  double probs[K];
+  int q;
+
+  c = qc_create(NUM_QUBITS);
+  prepare(c);
+  check_top_k(c);
+  qc_destroy(c);
+
+  c = qc_create_sparse(NUM_QUBITS, 0.0);
+  prepare(c);
+  check_top_k(c);
+  qc_destroy(c);
+
+  c = qc_create_mps(NUM_QUBITS, 16, 0.0);
+  prepare(c);
+  check_top_k(c);
+  qc_destroy(c);
+
+  /* a wide MPS is searched, not enumerated */
+  c = qc_create_mps(50, 4, 0.0);
+  qc_ghz_state(c);
+  assert(qc_top_k_states(c, K, indices, probs) == 2);
+  assert(indices[0] == 0 && indices[1] == ((t_q_index)1 << 50) - 1);
+  assert(fabs(probs[1] - 0.5) < 1e-12);
+  assert(qc_find_most_likely_state(c) == 0);
+  qc_destroy(c);
+
+  /* unless it is too spread out to search */
+  c = qc_create_mps(50, 4, 0.0);
+  for (q = 0; q < 50; q++)
+    qc_h(c, q);
+  assert(qc_top_k_states(c, 1, indices, probs) == -1);
+  assert(qc_find_most_likely_state(c) == -1);
+  qc_destroy(c);
+
+  /* uniform superposition: ties go to the smaller index */
+  c = qc_create(NUM_QUBITS);
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_h(c, q);
+  assert(qc_top_k_states(c, 3, indices, probs) == 3);
+  assert(indices[0] == 0 && indices[1] == 1 && indices[2] == 2);
+  qc_destroy(c);
+
+  /* fewer nonzero states than requested */
+  c = qc_create(NUM_QUBITS);
+  qc_h(c, 4);
+  assert(qc_top_k_states(c, K, indices, probs) == 2);
+  assert(indices[0] == 0 && indices[1] == 16);
+  assert(qc_top_k_states(c, -1, indices, probs) == -1);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+}
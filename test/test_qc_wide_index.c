@@ -0,0 +1,31 @@
+#include "../include/qcs.h"
+#include <assert.h>
+#include <stdio.h>
+
+#define NUM_QUBITS 40
+
+void test_qc_wide_index() {
+  printf("Testing: 64-bit state indices...\n");
+  t_q_circuit *c;
+  t_q_index all_ones = ((t_q_index)1 << NUM_QUBITS) - 1;
+  t_q_index marked = (t_q_index)1 << 35;
+  t_q_index indices[2];
+  double probs[2];
+  int q;
+
+  /* a sparse state addresses indices past 2^31 */
+  c = qc_create_sparse(NUM_QUBITS, 0.0);
+  for (q = 0; q < NUM_QUBITS; q++)
+    qc_x(c, q);
+  qc_h(c, 35);
+  assert(qc_get_probability(c, all_ones) > 0.49);
+  assert(qc_get_probability(c, all_ones - marked) > 0.49);
+  assert(qc_get_probability(c, marked) == 0.0);
+  assert(qc_get_probability(c, all_ones + 1) == 0.0);
+  assert(qc_find_most_likely_state(c) == all_ones - marked);
+  assert(qc_top_k_states(c, 2, indices, probs) == 2);
+  assert(indices[0] == all_ones - marked && indices[1] == all_ones);
+  qc_destroy(c);
+
+  printf("  [PASSED]\n");
+}